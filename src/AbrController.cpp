@@ -0,0 +1,105 @@
+#include "AbrController.h"
+
+using namespace streaming;
+
+namespace {
+constexpr juce::int64 kLongAgoMs = -(juce::int64 (1) << 40);
+constexpr int kMinStepKbps = 50;
+constexpr int kRisingSamplesForCongestion = 3;
+} // namespace
+
+AbrController::Settings AbrController::settingsFromConfig(const StreamingConfig& cfg) {
+    Settings s;
+    s.ceilingKbps = juce::jmax(100, cfg.videoBitrateKbps);
+    s.floorKbps = juce::jlimit(100, s.ceilingKbps, cfg.abrMinVideoKbps);
+    s.startKbps = juce::jmax(s.floorKbps, (int) std::lround(s.ceilingKbps * 0.6));
+    s.overheadKbps = cfg.audioBitrateKbps + s.ceilingKbps / 20;
+    // Act well before the endpoints start shedding GOPs
+    s.congestedDelayMs = juce::jmax(s.clearDelayMs * 2, juce::jmin(s.congestedDelayMs, cfg.endpointMaxBacklogMs / 2));
+    return s;
+}
+
+void AbrController::reset(const Settings& s) {
+    settings = s;
+    settings.ceilingKbps = juce::jmax(1, settings.ceilingKbps);
+    settings.floorKbps = juce::jlimit(1, settings.ceilingKbps, settings.floorKbps);
+    targetKbps = juce::jlimit(settings.floorKbps, settings.ceilingKbps, settings.startKbps);
+    haveLast = false;
+    last = {};
+    measuredKbps = -1.0;
+    baseRttMs = -1;
+    risingSamples = 0;
+    lastDecreaseMs = lastIncreaseMs = kLongAgoMs;
+    clearSinceMs = -1;
+}
+
+void AbrController::trackRtt(int rttMs) noexcept {
+    if (rttMs <= 0) return;
+    // Minimum filter that creeps up slowly, so a route change eventually becomes the new baseline
+    if (baseRttMs < 0 || rttMs < baseRttMs) baseRttMs = rttMs;
+    else baseRttMs += (rttMs - baseRttMs + 63) / 64;
+}
+
+bool AbrController::rttInflated(int rttMs) const noexcept {
+    return rttMs > 0 && baseRttMs > 0 && rttMs > (int) (baseRttMs * settings.rttInflation) + 20;
+}
+
+AbrController::Decision AbrController::update(const TransportSample& sample) {
+    Decision d;
+    d.targetKbps = targetKbps;
+    if (!haveLast || sample.sourceId != last.sourceId || sample.bytesSent < last.bytesSent) {
+        // First sample, or a different/reconnected connection: counters restart
+        haveLast = true;
+        last = sample;
+        risingSamples = 0;
+        clearSinceMs = -1;
+        trackRtt(sample.rttMs);
+        return d;
+    }
+    const juce::int64 now = sample.timeMs;
+    const juce::int64 dt = now - last.timeMs;
+    if (dt <= 0) return d;
+
+    const double kbps = (double) (sample.bytesSent - last.bytesSent) * 8.0 / (double) dt;
+    measuredKbps = measuredKbps < 0.0 ? kbps : measuredKbps + 0.3 * (kbps - measuredKbps);
+    trackRtt(sample.rttMs);
+
+    const bool growing = sample.queueDelayMs > settings.clearDelayMs && sample.queueDelayMs > last.queueDelayMs;
+    const bool draining = sample.queueDelayMs < last.queueDelayMs;
+    // With data queued across the whole interval, the send rate is what the link actually carries
+    const bool linkLimited = sample.queuedBytes > 0 && last.queuedBytes > 0;
+    risingSamples = growing ? risingSamples + 1 : 0;
+    const bool inflated = rttInflated(sample.rttMs);
+    // A long queue that is already shrinking means the last cut took hold: don't cut again
+    const bool congested = (sample.queueDelayMs >= settings.congestedDelayMs && !draining)
+                        || risingSamples >= kRisingSamplesForCongestion
+                        || (inflated && growing);
+    const bool clear = !inflated && sample.queueDelayMs <= settings.clearDelayMs;
+    last = sample;
+
+    if (congested) {
+        clearSinceMs = -1;
+        if (now - lastDecreaseMs < settings.decreaseIntervalMs) return d;
+        double next = targetKbps * settings.decreaseFactor;
+        if (linkLimited) next = juce::jmin(next, kbps * 0.9 - settings.overheadKbps);
+        const int kbpsNext = juce::jlimit(settings.floorKbps, settings.ceilingKbps, (int) next);
+        lastDecreaseMs = now;
+        if (kbpsNext < targetKbps) {
+            targetKbps = kbpsNext;
+            d = { Action::decrease, targetKbps };
+        }
+        return d;
+    }
+
+    // Between the two thresholds: hold, and the clear period starts over
+    if (!clear) { clearSinceMs = -1; return d; }
+    if (clearSinceMs < 0) clearSinceMs = now;
+    const juce::int64 hold = settings.increaseHoldMs;
+    if (targetKbps < settings.ceilingKbps && now - clearSinceMs >= hold && now - lastIncreaseMs >= hold && now - lastDecreaseMs >= hold) {
+        const int step = juce::jmax(kMinStepKbps, (int) (targetKbps * settings.increaseStep));
+        targetKbps = juce::jmin(settings.ceilingKbps, targetKbps + step);
+        lastIncreaseMs = now;
+        d = { Action::increase, targetKbps };
+    }
+    return d;
+}
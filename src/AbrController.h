@@ -0,0 +1,72 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include "StreamingConfig.h"
+
+namespace streaming {
+
+// One observation of the egress path, taken periodically by whoever owns the transport
+struct TransportSample {
+    juce::int64 timeMs { 0 };       // monotonic
+    juce::uint64 bytesSent { 0 };   // cumulative bytes the socket accepted
+    size_t queuedBytes { 0 };       // bytes still waiting in our own queues
+    int queueDelayMs { 0 };         // media time waiting to be sent (newest queued pts - last sent pts)
+    int rttMs { -1 };               // smoothed TCP RTT, -1 when unknown
+    int sourceId { 0 };             // which connection the counters belong to; a change restarts rate tracking
+};
+
+// Closed-loop video bitrate control. Pure logic with no threads or clocks of its own: feed it
+// TransportSamples and apply the target it returns through an EncoderControl.
+//
+// Congestion (queue delay past a threshold, or a growing queue with inflated RTT) cuts the target
+// multiplicatively, never above what the link was measured to carry. A clear link (short queue, RTT
+// near its baseline) must stay clear for a hold period before each additive step up, and the two
+// thresholds are far apart, so the target does not oscillate around the link rate.
+class AbrController {
+public:
+    struct Settings {
+        int floorKbps { 800 };
+        int ceilingKbps { 6000 };
+        int startKbps { 3600 };
+        int overheadKbps { 160 };        // audio and container bytes that share the link with video
+        int congestedDelayMs { 700 };    // queue delay that always counts as congestion
+        int clearDelayMs { 150 };        // queue delay below which the link may count as clear
+        int decreaseIntervalMs { 1000 }; // minimum spacing between two decreases
+        int increaseHoldMs { 4000 };     // the link must stay clear this long before each increase
+        double decreaseFactor { 0.75 };
+        double increaseStep { 0.08 };    // fraction of the current target added per increase
+        double rttInflation { 1.5 };     // RTT above baseline * this (plus 20 ms) counts as inflated
+    };
+
+    enum class Action { hold, decrease, increase };
+    struct Decision {
+        Action action { Action::hold };
+        int targetKbps { 0 };
+    };
+
+    // Ceiling is the configured video bitrate, start 60% of it (the old fixed ramp's first step)
+    static Settings settingsFromConfig(const StreamingConfig& cfg);
+
+    void reset(const Settings& s);
+    Decision update(const TransportSample& sample);
+
+    int getTargetKbps() const noexcept { return targetKbps; }
+    double getMeasuredKbps() const noexcept { return measuredKbps; } // send rate, smoothed
+    int getBaseRttMs() const noexcept { return baseRttMs; }
+
+private:
+    Settings settings;
+    int targetKbps { 0 };
+    bool haveLast { false };
+    TransportSample last;
+    double measuredKbps { -1.0 };
+    int baseRttMs { -1 };
+    int risingSamples { 0 };
+    juce::int64 lastDecreaseMs { 0 };
+    juce::int64 lastIncreaseMs { 0 };
+    juce::int64 clearSinceMs { -1 };
+
+    bool rttInflated(int rttMs) const noexcept;
+    void trackRtt(int rttMs) noexcept;
+};
+
+} // namespace streaming
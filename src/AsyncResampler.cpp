@@ -0,0 +1,142 @@
+#include "AsyncResampler.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+ #include <emmintrin.h>
+ #define ASYNCRESAMPLER_SSE 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+ #include <arm_neon.h>
+ #define ASYNCRESAMPLER_NEON 1
+#endif
+
+using namespace streaming;
+
+namespace {
+constexpr int kHalf = AsyncResampler::kTaps / 2;
+constexpr double kKaiserBeta = 8.0;
+// Passband edge as a fraction of the lower of the two Nyquist frequencies
+constexpr double kPassband = 0.9;
+
+double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// coef = a + t * (b - a), kTaps wide
+inline void lerpRow(const float* a, const float* b, float t, float* coef) noexcept {
+#if ASYNCRESAMPLER_SSE
+    const __m128 vt = _mm_set1_ps(t);
+    for (int j = 0; j < AsyncResampler::kTaps; j += 4) {
+        const __m128 va = _mm_loadu_ps(a + j);
+        _mm_store_ps(coef + j, _mm_add_ps(va, _mm_mul_ps(vt, _mm_sub_ps(_mm_loadu_ps(b + j), va))));
+    }
+#elif ASYNCRESAMPLER_NEON
+    const float32x4_t vt = vdupq_n_f32(t);
+    for (int j = 0; j < AsyncResampler::kTaps; j += 4) {
+        const float32x4_t va = vld1q_f32(a + j);
+        vst1q_f32(coef + j, vmlaq_f32(va, vt, vsubq_f32(vld1q_f32(b + j), va)));
+    }
+#else
+    for (int j = 0; j < AsyncResampler::kTaps; ++j) coef[j] = a[j] + t * (b[j] - a[j]);
+#endif
+}
+
+inline float dot(const float* x, const float* coef) noexcept {
+#if ASYNCRESAMPLER_SSE
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    for (int j = 0; j < AsyncResampler::kTaps; j += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + j), _mm_load_ps(coef + j)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + j + 4), _mm_load_ps(coef + j + 4)));
+    }
+    __m128 s = _mm_add_ps(acc0, acc1);
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+#elif ASYNCRESAMPLER_NEON
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+    for (int j = 0; j < AsyncResampler::kTaps; j += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(x + j), vld1q_f32(coef + j));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(x + j + 4), vld1q_f32(coef + j + 4));
+    }
+    return vaddvq_f32(vaddq_f32(acc0, acc1));
+#else
+    float acc = 0.0f;
+    for (int j = 0; j < AsyncResampler::kTaps; ++j) acc += x[j] * coef[j];
+    return acc;
+#endif
+}
+} // namespace
+
+void AsyncResampler::prepare(int numChannels, double nominalRatio, int maxInputBlock) {
+    channels = juce::jlimit(1, kMaxChannels, numChannels);
+    capacity = juce::jmax(1, maxInputBlock) + 4 * kTaps;
+    for (int c = 0; c < channels; ++c) history[c].allocate((size_t) capacity, true);
+
+    // Row r is the kernel for an output sitting r/kPhases of a frame past history[floor(pos)];
+    // tap j reads input frame floor(pos) - (kHalf - 1) + j
+    const double cutoff = kPassband * juce::jmin(1.0, nominalRatio);
+    table.allocate((size_t) (kPhases + 1) * kTaps, true);
+    const double i0Beta = besselI0(kKaiserBeta);
+    for (int r = 0; r <= kPhases; ++r) {
+        float* row = table + (size_t) r * kTaps;
+        double sum = 0.0;
+        for (int j = 0; j < kTaps; ++j) {
+            const double d = (double) (j - (kHalf - 1)) - (double) r / kPhases;
+            const double u = d / kHalf;
+            const double window = std::abs(u) < 1.0 ? besselI0(kKaiserBeta * std::sqrt(1.0 - u * u)) / i0Beta : 0.0;
+            const double x = juce::MathConstants<double>::pi * cutoff * d;
+            const double h = window * (std::abs(x) < 1.0e-9 ? 1.0 : std::sin(x) / x);
+            row[j] = (float) h;
+            sum += h;
+        }
+        for (int j = 0; j < kTaps; ++j) row[j] = (float) (row[j] / sum); // unity gain at DC
+    }
+    setRatio(nominalRatio);
+    reset();
+}
+
+void AsyncResampler::reset() noexcept {
+    // Output 0 is centred on input frame 0, with silence before it
+    for (int c = 0; c < channels; ++c) std::memset(history[c].get(), 0, sizeof(float) * (size_t) capacity);
+    filled = kHalf - 1;
+    bufferStart = -(kHalf - 1);
+    position = kHalf - 1;
+}
+
+int AsyncResampler::process(const float* const* in, int numIn, float* const* out, int maxOut) noexcept {
+    int produced = 0, consumed = 0;
+    alignas(16) float coef[kTaps];
+    while (consumed < numIn) {
+        const int n = juce::jmin(numIn - consumed, capacity - filled);
+        if (n <= 0) break; // only if maxOut was too small to drain the history
+        for (int c = 0; c < channels; ++c) std::memcpy(history[c] + filled, in[c] + consumed, sizeof(float) * (size_t) n);
+        filled += n;
+        consumed += n;
+
+        for (; produced < maxOut; ++produced) {
+            const double whole = std::floor(position);
+            const int base = (int) whole - (kHalf - 1);
+            if (base + kTaps > filled) break;
+            const double phase = (position - whole) * kPhases;
+            const int row = (int) phase;
+            lerpRow(table + (size_t) row * kTaps, table + (size_t) (row + 1) * kTaps, (float) (phase - row), coef);
+            for (int c = 0; c < channels; ++c) out[c][produced] = dot(history[c] + base, coef);
+            position += step;
+        }
+
+        // Drop what no future output can reach
+        const int discard = juce::jlimit(0, filled, (int) std::floor(position) - (kHalf - 1));
+        if (discard > 0) {
+            for (int c = 0; c < channels; ++c) std::memmove(history[c].get(), history[c] + discard, sizeof(float) * (size_t) (filled - discard));
+            filled -= discard;
+            bufferStart += discard;
+            position -= discard;
+        }
+    }
+    return produced;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <juce_core/juce_core.h>
+
+namespace streaming {
+
+// Variable-ratio polyphase windowed-sinc resampler for planar float audio (1 or 2 channels). The
+// ratio may change on every process() call, so it can absorb both a fixed rate mismatch (44.1 kHz
+// host, 48 kHz stream) and slow clock drift. 32 taps, Kaiser window, coefficients interpolated
+// between 256 phases; the dot products use SSE2 / NEON. process() is allocation-free.
+class AsyncResampler {
+public:
+    static constexpr int kTaps = 32;
+    static constexpr int kMaxChannels = 2;
+
+    // Allocates. nominalRatio (output/input rate) sets the anti-aliasing cutoff; maxInputBlock is
+    // the largest numIn process() will see.
+    void prepare(int numChannels, double nominalRatio, int maxInputBlock);
+    void reset() noexcept;
+
+    // Output frames per input frame from the next process() call on
+    void setRatio(double outputPerInput) noexcept { step = 1.0 / juce::jmax(1.0e-3, outputPerInput); }
+
+    // Consumes all numIn input frames; writes at most maxOut output frames and returns the count.
+    // maxOut of getMaxOutput(numIn) never leaves input behind.
+    int process(const float* const* in, int numIn, float* const* out, int maxOut) noexcept;
+    int getMaxOutput(int numIn) const noexcept { return (int) std::ceil((numIn + kTaps) / step) + 1; }
+
+    // Absolute input frame (since reset) that the next output sample is centred on
+    double getInputPosition() const noexcept { return (double) bufferStart + position; }
+
+private:
+    static constexpr int kPhases = 256;
+    int channels { 0 };
+    int capacity { 0 };
+    juce::HeapBlock<float> table;      // (kPhases + 1) rows of kTaps
+    juce::HeapBlock<float> history[kMaxChannels];
+    int filled { 0 };                  // valid frames in history
+    juce::int64 bufferStart { 0 };     // absolute input frame of history[.][0]
+    double position { 0.0 };           // next output's centre, relative to history[.][0]
+    double step { 1.0 };               // input frames per output frame
+};
+
+} // namespace streaming
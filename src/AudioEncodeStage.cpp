@@ -0,0 +1,407 @@
+#include "AudioEncodeStage.h"
+#include "AsyncResampler.h"
+#include "DriftEstimator.h"
+#include "MediaClock.h"
+#include "PacingScheduler.h"
+#include "Telemetry.h"
+#include "Logging.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#if JUCE_MAC
+ #include <AudioToolbox/AudioToolbox.h>
+#endif
+
+#if HAVE_FFMPEG
+extern "C" {
+ #include <libavcodec/avcodec.h>
+ #include <libavutil/channel_layout.h>
+ #include <libswresample/swresample.h>
+}
+#endif
+
+using namespace streaming;
+
+namespace {
+// Host rates the resampler accepts
+constexpr double kMinInputRate = 8000.0;
+constexpr double kMaxInputRate = 384000.0;
+// Input frames the encoder thread resamples per step
+constexpr int kChunkFrames = 1024;
+// Encoder thread also wakes on this period, so a missed notify costs at most one frame of latency
+constexpr int kWakeTimeoutMs = 20;
+
+// Samples in, packets out; one kFrameSize-frame planar float frame per encode() call, on the
+// encoder thread only
+struct AacCodec {
+    using Sink = std::function<void(MediaBuffer::Ptr packet, juce::int64 ptsSamples)>;
+    virtual ~AacCodec() = default;
+    virtual bool open(int sampleRate, int numChannels, int bitrateKbps, juce::MemoryBlock& asc) = 0;
+    virtual void encode(const float* const* planes, juce::int64 firstSample, const Sink& sink) = 0;
+    virtual juce::String getName() const = 0;
+};
+
+#if JUCE_MAC
+// AAC-LC AudioSpecificConfig: object type, sampling frequency index, channel configuration
+void buildAudioSpecificConfig(int sampleRate, int numChannels, juce::MemoryBlock& asc) {
+    const int srTable[] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+    int sfi = 4;
+    for (int i = 0; i < (int) (sizeof(srTable) / sizeof(srTable[0])); ++i) if (srTable[i] == sampleRate) { sfi = i; break; }
+    const uint8_t bytes[2] = { (uint8_t) ((2 << 3) | ((sfi & 0x0F) >> 1)), (uint8_t) (((sfi & 0x01) << 7) | ((numChannels & 0x0F) << 3)) };
+    asc.replaceAll(bytes, sizeof(bytes));
+}
+
+class AudioToolboxAac final : public AacCodec {
+public:
+    ~AudioToolboxAac() override { if (conv != nullptr) AudioConverterDispose(conv); }
+
+    bool open(int sampleRate, int numChannels, int bitrateKbps, juce::MemoryBlock& asc) override {
+        channels = numChannels;
+        AudioStreamBasicDescription in {};
+        in.mSampleRate = sampleRate;
+        in.mFormatID = kAudioFormatLinearPCM;
+        in.mFormatFlags = kAudioFormatFlagIsFloat | kAudioFormatFlagIsPacked | kAudioFormatFlagIsNonInterleaved;
+        in.mBytesPerPacket = in.mBytesPerFrame = sizeof(float);
+        in.mFramesPerPacket = 1;
+        in.mChannelsPerFrame = (UInt32) numChannels;
+        in.mBitsPerChannel = 32;
+        AudioStreamBasicDescription out {};
+        out.mSampleRate = sampleRate;
+        out.mFormatID = kAudioFormatMPEG4AAC;
+        out.mFramesPerPacket = AudioEncodeStage::kFrameSize;
+        out.mChannelsPerFrame = (UInt32) numChannels;
+        if (AudioConverterNew(&in, &out, &conv) != noErr || conv == nullptr) { LogMessage("AAC: AudioConverterNew failed"); return false; }
+        UInt32 bps = (UInt32) bitrateKbps * 1000;
+        AudioConverterSetProperty(conv, kAudioConverterEncodeBitRate, sizeof(bps), &bps);
+        UInt32 size = sizeof(maxPacketBytes);
+        if (AudioConverterGetProperty(conv, kAudioConverterPropertyMaximumOutputPacketSize, &size, &maxPacketBytes) != noErr || maxPacketBytes == 0)
+            maxPacketBytes = 1536 * (UInt32) numChannels;
+        // The converter's magic cookie is an esds descriptor, not the bare ASC that FLV carries
+        buildAudioSpecificConfig(sampleRate, numChannels, asc);
+        return true;
+    }
+
+    void encode(const float* const* planes, juce::int64 firstSample, const Sink& sink) override {
+        juce::ignoreUnused(firstSample);
+        pending = planes;
+        // One output packet per call; the converter's priming shifts content, not the packet count
+        auto* block = static_cast<uint8_t*>(std::malloc(maxPacketBytes));
+        if (block == nullptr) return;
+        AudioBufferList outList {};
+        outList.mNumberBuffers = 1;
+        outList.mBuffers[0].mNumberChannels = (UInt32) channels;
+        outList.mBuffers[0].mDataByteSize = maxPacketBytes;
+        outList.mBuffers[0].mData = block;
+        UInt32 packets = 1;
+        AudioStreamPacketDescription desc {};
+        const OSStatus st = AudioConverterFillComplexBuffer(conv, supplyInput, this, &packets, &outList, &desc);
+        if ((st != noErr && st != kNoMoreInput) || packets == 0) { std::free(block); return; }
+        const size_t bytes = desc.mDataByteSize > 0 ? (size_t) desc.mDataByteSize : (size_t) outList.mBuffers[0].mDataByteSize;
+        sink(MediaBuffer::wrap(block, bytes, [](void* p) { std::free(p); }, block), packetsOut * AudioEncodeStage::kFrameSize);
+        ++packetsOut;
+    }
+
+    juce::String getName() const override { return "AudioToolbox"; }
+
+private:
+    static constexpr OSStatus kNoMoreInput = 'nmin';
+
+    // Hands the converter the one pending frame, then reports "no more for now"
+    static OSStatus supplyInput(AudioConverterRef, UInt32* ioPackets, AudioBufferList* io, AudioStreamPacketDescription**, void* user) {
+        auto* self = static_cast<AudioToolboxAac*>(user);
+        if (self->pending == nullptr) { *ioPackets = 0; return kNoMoreInput; }
+        io->mNumberBuffers = (UInt32) self->channels;
+        for (int c = 0; c < self->channels; ++c) {
+            io->mBuffers[c].mNumberChannels = 1;
+            io->mBuffers[c].mDataByteSize = (UInt32) (sizeof(float) * AudioEncodeStage::kFrameSize);
+            io->mBuffers[c].mData = const_cast<float*>(self->pending[c]);
+        }
+        *ioPackets = AudioEncodeStage::kFrameSize;
+        self->pending = nullptr;
+        return noErr;
+    }
+
+    AudioConverterRef conv { nullptr };
+    UInt32 maxPacketBytes { 0 };
+    int channels { 0 };
+    const float* const* pending { nullptr };
+    juce::int64 packetsOut { 0 };
+};
+#endif
+
+#if HAVE_FFMPEG
+class LibavAac final : public AacCodec {
+public:
+    ~LibavAac() override {
+        if (swr != nullptr) swr_free(&swr);
+        if (frame != nullptr) av_frame_free(&frame);
+        if (pkt != nullptr) av_packet_free(&pkt);
+        if (enc != nullptr) avcodec_free_context(&enc);
+    }
+
+    bool open(int sampleRate, int numChannels, int bitrateKbps, juce::MemoryBlock& asc) override {
+        const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+        if (codec == nullptr) { LogMessage("AAC: no AAC encoder in this FFmpeg build"); return false; }
+        enc = avcodec_alloc_context3(codec);
+        if (enc == nullptr) return false;
+        enc->sample_rate = sampleRate;
+        enc->bit_rate = (int64_t) bitrateKbps * 1000;
+        av_channel_layout_default(&enc->ch_layout, numChannels);
+        enc->sample_fmt = codec->sample_fmts != nullptr ? codec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+        enc->time_base = AVRational{ 1, sampleRate };
+        enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        const int ret = avcodec_open2(enc, codec, nullptr);
+        if (ret < 0) { LogMessage("AAC: avcodec_open2 failed (" + juce::String(ret) + ")"); return false; }
+        if (enc->frame_size > 0 && enc->frame_size != AudioEncodeStage::kFrameSize) { LogMessage("AAC: unexpected frame size " + juce::String(enc->frame_size)); return false; }
+        // Input is planar float at the stream rate; only the sample format may need converting
+        if (enc->sample_fmt != AV_SAMPLE_FMT_FLTP
+            && (swr_alloc_set_opts2(&swr, &enc->ch_layout, enc->sample_fmt, sampleRate, &enc->ch_layout, AV_SAMPLE_FMT_FLTP, sampleRate, 0, nullptr) < 0
+                || swr_init(swr) < 0)) {
+            LogMessage("AAC: swresample init failed");
+            return false;
+        }
+        frame = av_frame_alloc();
+        pkt = av_packet_alloc();
+        if (frame == nullptr || pkt == nullptr) return false;
+        frame->nb_samples = AudioEncodeStage::kFrameSize;
+        frame->format = enc->sample_fmt;
+        frame->sample_rate = sampleRate;
+        av_channel_layout_copy(&frame->ch_layout, &enc->ch_layout);
+        if (av_frame_get_buffer(frame, 0) < 0) return false;
+        if (enc->extradata == nullptr || enc->extradata_size < 2) { LogMessage("AAC: encoder produced no AudioSpecificConfig"); return false; }
+        asc.replaceAll(enc->extradata, (size_t) enc->extradata_size);
+        return true;
+    }
+
+    void encode(const float* const* planes, juce::int64 firstSample, const Sink& sink) override {
+        if (av_frame_make_writable(frame) < 0) return;
+        if (swr != nullptr) {
+            if (swr_convert(swr, frame->data, AudioEncodeStage::kFrameSize, reinterpret_cast<const uint8_t* const*>(planes), AudioEncodeStage::kFrameSize) < 0) return;
+        } else {
+            for (int c = 0; c < enc->ch_layout.nb_channels; ++c)
+                memcpy(frame->data[c], planes[c], sizeof(float) * AudioEncodeStage::kFrameSize);
+        }
+        frame->pts = firstSample;
+        if (avcodec_send_frame(enc, frame) < 0) return;
+        while (avcodec_receive_packet(enc, pkt) == 0) {
+            // The encoder's priming delay shows up as negative PTS; the stream timeline starts at 0.
+            // The packet's bytes are shared (one extra AVBufferRef), not copied.
+            AVBufferRef* ref = pkt->buf != nullptr ? av_buffer_ref(pkt->buf) : nullptr;
+            auto packet = ref != nullptr ? MediaBuffer::wrap(pkt->data, (size_t) pkt->size, [](void* o) { auto* r = static_cast<AVBufferRef*>(o); av_buffer_unref(&r); }, ref)
+                                         : MediaBuffer::copyOf(pkt->data, (size_t) pkt->size);
+            if (packet != nullptr) sink(std::move(packet), pkt->pts + enc->initial_padding);
+            av_packet_unref(pkt);
+        }
+    }
+
+    juce::String getName() const override { return enc != nullptr && enc->codec != nullptr ? "libavcodec/" + juce::String(enc->codec->name) : "libavcodec"; }
+
+private:
+    AVCodecContext* enc { nullptr };
+    SwrContext* swr { nullptr };
+    AVFrame* frame { nullptr };
+    AVPacket* pkt { nullptr };
+};
+#endif
+
+// Platform encoder first; libavcodec where there is none (or it fails to open)
+std::unique_ptr<AacCodec> openCodec(int sampleRate, int numChannels, int bitrateKbps, juce::MemoryBlock& asc) {
+    std::unique_ptr<AacCodec> codec;
+   #if JUCE_MAC
+    codec = std::make_unique<AudioToolboxAac>();
+    if (codec->open(sampleRate, numChannels, bitrateKbps, asc)) return codec;
+   #endif
+   #if HAVE_FFMPEG
+    codec = std::make_unique<LibavAac>();
+    if (codec->open(sampleRate, numChannels, bitrateKbps, asc)) return codec;
+   #endif
+    juce::ignoreUnused(sampleRate, numChannels, bitrateKbps, asc);
+    return nullptr;
+}
+} // namespace
+
+struct AudioEncodeStage::Impl {
+    std::unique_ptr<AacCodec> codec;
+    PacketCallback onPacket;
+    int sampleRate { 0 };
+    int channels { 0 };
+
+    // Input: this stage's cursor on the shared tap
+    AudioTap::Reader reader;
+
+    // Encoder thread: tap -> chunk -> resampler -> pending -> whole AAC frames. The estimator is
+    // fed with each block's arrival time as the block is read.
+    DriftEstimator drift;
+    AsyncResampler resampler;
+    double inputRate { 0.0 };
+    juce::HeapBlock<float> chunkData;   // kChunkFrames per channel
+    juce::HeapBlock<float> pendingData; // pendingCapacity per channel
+    int pendingCapacity { 0 };
+    int pendingCount { 0 };
+    juce::int64 outputFrames { 0 };     // resampled frames so far, at sampleRate
+    juce::int64 segmentOutput { 0 };    // outputFrames when the input rate last changed
+    double segmentOriginUs { -1.0 };
+    juce::int64 offsetUs { 0 };         // clock time of output frame 0 under the current anchor
+    juce::int64 firstOffsetUs { -1 };
+    juce::int64 lastPtsMs { 0 };
+    const MediaClock* timeline { nullptr };
+
+    std::atomic<bool> running { false };
+    std::thread thread;
+    juce::int64 samplesEncoded { 0 };
+    std::atomic<juce::uint64> framesEncoded { 0 };
+    std::atomic<double> driftPpm { 0.0 };
+    Telemetry::GaugeShare tapBacklogMetric { Telemetry::getInstance().gauge("aac.tapBacklogFrames") };
+    Telemetry::GaugeShare droppedMetric { Telemetry::getInstance().gauge("aac.droppedSamples") };
+    Telemetry::Histogram& latencyMetric = Telemetry::getInstance().histogram("latency.audioEncodeUs");
+
+    void run() {
+        while (running.load()) {
+            reader.wait(kWakeTimeoutMs);
+            tapBacklogMetric.set(reader.getUnreadFrames());
+            while (running.load() && resampleChunk()) {}
+            droppedMetric.set((juce::int64) reader.getSkippedFrames());
+        }
+    }
+
+    // A host rate change starts a fresh estimator and resampler, continuing from the current output frame
+    void followRate(double rate) {
+        rate = juce::jlimit(kMinInputRate, kMaxInputRate, rate > 0.0 ? rate : (double) sampleRate);
+        if (rate == inputRate) return;
+        drift.reset(rate);
+        resampler.prepare(channels, sampleRate / rate, kChunkFrames);
+        inputRate = rate;
+        segmentOutput = outputFrames;
+        LogMessage("AAC: input " + juce::String(rate, 0) + " Hz -> " + juce::String(sampleRate) + " Hz");
+    }
+
+    // The device clock's anchor moves on the first block, after a stall (the gap shows up as a PTS
+    // jump rather than being resampled away) and after a rate change
+    void followAnchor(const DriftEstimator::Snapshot& s) {
+        if (!s.valid || s.originUs == segmentOriginUs) return;
+        segmentOriginUs = s.originUs;
+        offsetUs = (juce::int64) s.originUs - segmentOutput * 1000000 / sampleRate;
+        if (firstOffsetUs < 0) firstOffsetUs = offsetUs;
+    }
+
+    bool resampleChunk() {
+        float* chunk[kMaxChannels] = {};
+        for (int c = 0; c < channels; ++c) chunk[c] = chunkData.get() + c * kChunkFrames;
+        const int srcChannels = juce::jlimit(1, channels, reader.getSourceChannels());
+        AudioTap::BlockInfo info;
+        const int n = reader.read(chunk, srcChannels, kChunkFrames, info);
+        if (n == 0) return false;
+        // Nothing before the shared timeline's first video frame
+        if (timeline != nullptr && !timeline->isStarted()) return true;
+        // Mono input feeds both channels of a stereo stream
+        for (int c = srcChannels; c < channels; ++c) memcpy(chunk[c], chunk[0], sizeof(float) * (size_t) n);
+
+        followRate(info.sampleRate);
+        if (info.isBlockStart) drift.onBlock(info.numFrames, info.timeUs);
+        const auto snap = drift.read();
+        followAnchor(snap);
+
+        // Measured device rate plus a slow pull of the sample-counted timeline onto the clock
+        resampler.setRatio(DriftEstimator::ratioFor(snap, resampler.getInputPosition(), outputFrames - segmentOutput, sampleRate, inputRate));
+        driftPpm.store(DriftEstimator::ppm(snap, inputRate), std::memory_order_relaxed);
+        const float* in[kMaxChannels] = { chunk[0], chunk[1] };
+        float* out[kMaxChannels] = {};
+        for (int c = 0; c < channels; ++c) out[c] = pendingData.get() + (size_t) c * (size_t) pendingCapacity + pendingCount;
+        const int produced = resampler.process(in, n, out, pendingCapacity - pendingCount);
+        pendingCount += produced;
+        outputFrames += produced;
+
+        int used = 0;
+        for (; pendingCount - used >= kFrameSize; used += kFrameSize) encodeFrame(used);
+        if (used > 0) {
+            pendingCount -= used;
+            for (int c = 0; c < channels; ++c) {
+                float* lane = pendingData.get() + (size_t) c * (size_t) pendingCapacity;
+                memmove(lane, lane + used, sizeof(float) * (size_t) pendingCount);
+            }
+        }
+        return true;
+    }
+
+    void encodeFrame(int start) {
+        const float* planes[kMaxChannels] = {};
+        for (int c = 0; c < channels; ++c) planes[c] = pendingData.get() + (size_t) c * (size_t) pendingCapacity + start;
+        codec->encode(planes, samplesEncoded, [this](MediaBuffer::Ptr packet, juce::int64 ptsSamples) {
+            const juce::int64 ptsMs = toPtsMs(ptsSamples);
+            // Capture to encoded: where the frame sits on the timeline against the clock now
+            if (timeline != nullptr && timeline->isStarted())
+                latencyMetric.record(PrecisionClock::nowMicros() - timeline->getOriginMicros() - ptsMs * 1000);
+            onPacket(std::move(packet), ptsMs);
+        });
+        samplesEncoded += kFrameSize;
+        framesEncoded.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Output frame -> ms on the shared timeline (or since this stage's first audio without one)
+    juce::int64 toPtsMs(juce::int64 ptsSamples) {
+        const juce::int64 originUs = timeline != nullptr && timeline->isStarted() ? timeline->getOriginMicros() : firstOffsetUs;
+        const juce::int64 ms = (offsetUs - originUs) / 1000 + MediaClock::toMs(juce::jmax<juce::int64>(0, ptsSamples), sampleRate);
+        lastPtsMs = juce::jmax(lastPtsMs, ms);
+        return lastPtsMs;
+    }
+};
+
+AudioEncodeStage::AudioEncodeStage() : impl(std::make_unique<Impl>()) {}
+AudioEncodeStage::~AudioEncodeStage() { stop(); }
+
+bool AudioEncodeStage::start(AudioTap& source, int sampleRate, int numChannels, int bitrateKbps, ConfigCallback onConfig, PacketCallback onPacket,
+                             const MediaClock* timeline) {
+    stop();
+    auto& d = *impl;
+    d.sampleRate = juce::jmax(8000, sampleRate);
+    d.channels = juce::jlimit(1, kMaxChannels, numChannels);
+    juce::MemoryBlock asc;
+    d.codec = openCodec(d.sampleRate, d.channels, bitrateKbps, asc);
+    if (d.codec == nullptr) { LogMessage("AAC: no encoder available"); return false; }
+
+    d.chunkData.allocate((size_t) d.channels * kChunkFrames, true);
+    // Room for one partial AAC frame plus a chunk upsampled from the lowest input rate
+    d.pendingCapacity = kFrameSize + (int) std::ceil((kChunkFrames + AsyncResampler::kTaps) * d.sampleRate / kMinInputRate * 1.01) + 2;
+    d.pendingData.allocate((size_t) d.channels * (size_t) d.pendingCapacity, true);
+    d.pendingCount = 0;
+    d.inputRate = 0.0;
+    d.outputFrames = d.segmentOutput = 0;
+    d.segmentOriginUs = -1.0;
+    d.offsetUs = 0;
+    d.firstOffsetUs = -1;
+    d.lastPtsMs = 0;
+    d.timeline = timeline;
+    d.samplesEncoded = 0;
+    d.framesEncoded.store(0);
+    d.onPacket = std::move(onPacket);
+    if (onConfig) onConfig(asc.getData(), asc.getSize());
+    LogMessage("AAC: " + d.codec->getName() + " " + juce::String(d.sampleRate) + " Hz x" + juce::String(d.channels) + " " + juce::String(bitrateKbps) + " kbps");
+
+    // Wake per AAC frame's worth of input rather than per host block
+    d.reader.setWakeThreshold(kFrameSize);
+    if (!d.reader.attach(source)) { LogMessage("AAC: audio tap has no free reader slot"); d.codec.reset(); return false; }
+    d.running.store(true);
+    d.thread = std::thread([this] { impl->run(); });
+    return true;
+}
+
+void AudioEncodeStage::stop() {
+    auto& d = *impl;
+    d.running.store(false);
+    d.reader.wake();
+    if (d.thread.joinable()) d.thread.join();
+    d.reader.detach();
+    if (d.codec != nullptr && d.reader.getSkippedFrames() > 0) LogMessage("AAC: skipped " + juce::String((juce::int64) d.reader.getSkippedFrames()) + " samples (fell behind the audio tap)");
+    d.codec.reset();
+    d.onPacket = nullptr;
+}
+
+bool AudioEncodeStage::isRunning() const { return impl->running.load(); }
+
+juce::String AudioEncodeStage::getCodecName() const { return impl->codec != nullptr ? impl->codec->getName() : juce::String(); }
+juce::uint64 AudioEncodeStage::getDroppedSamples() const { return impl->reader.getSkippedFrames(); }
+juce::uint64 AudioEncodeStage::getEncodedFrames() const { return impl->framesEncoded.load(); }
+double AudioEncodeStage::getDriftPpm() const { return impl->driftPpm.load(); }
@@ -0,0 +1,49 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <functional>
+#include "AudioTap.h"
+#include "MediaBuffer.h"
+
+namespace streaming {
+
+class MediaClock;
+
+// AAC encoding off the audio callback: the stage reads the shared AudioTap on its own thread, so the
+// audio thread's only cost is the tap's single copy. That thread feeds each block's arrival time to
+// a DriftEstimator, resamples the host rate to the stream rate with an AsyncResampler whose ratio
+// also absorbs the device clock's drift against PrecisionClock, then encodes exact 1024-frame AAC
+// frames with AudioToolbox on macOS or libavcodec elsewhere. Packet timestamps are output sample
+// counts anchored to the clock time of the first captured frame.
+class AudioEncodeStage {
+public:
+    static constexpr int kFrameSize = 1024;
+    static constexpr int kMaxChannels = 2;
+
+    using ConfigCallback = std::function<void(const void* audioSpecificConfig, size_t size)>;
+    using PacketCallback = std::function<void(MediaBuffer::Ptr packet, juce::int64 ptsMs)>;
+
+    AudioEncodeStage();
+    ~AudioEncodeStage();
+
+    // Opens the codec, reports its AudioSpecificConfig through onConfig (on the calling thread),
+    // attaches to `source` and starts the encoder thread. onPacket runs on the encoder thread. With a
+    // timeline, audio before it starts is discarded and packet PTS are relative to its origin;
+    // otherwise to the first captured frame. Mono input feeds both channels of a stereo stream.
+    bool start(AudioTap& source, int sampleRate, int numChannels, int bitrateKbps, ConfigCallback onConfig, PacketCallback onPacket,
+               const MediaClock* timeline = nullptr);
+    void stop();
+    bool isRunning() const;
+
+    juce::String getCodecName() const;
+    // Input lost by falling a whole tap ring behind
+    juce::uint64 getDroppedSamples() const;
+    juce::uint64 getEncodedFrames() const;
+    // Host device clock against PrecisionClock, as last measured
+    double getDriftPpm() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace streaming
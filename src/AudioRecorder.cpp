@@ -1,98 +1,292 @@
 #include "AudioRecorder.h"
+#include "SampleConvert.h"
+#include "Logging.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#if JUCE_MAC || JUCE_LINUX
+ #include <fcntl.h>
+ #include <sys/stat.h>
+ #include <unistd.h>
+#endif
 
-AudioRecorder::AudioRecorder() {
-    writerThread.startThread();
+namespace {
+// Samples per write to the format writer; also the backlog that wakes the drain thread
+constexpr int kDrainBlockSamples = 4096;
+// Upper bound on how long a partial block waits before it is written
+constexpr int kDrainTimeoutMs = 250;
+// Stream buffer large enough that each block reaches the file in one or two write() calls
+constexpr size_t kFileBufferBytes = 64 * 1024;
+constexpr int kBitsPerSample = 24;
+// Edges of a realtime take ramp from and to silence over this long, so cutting mid-signal never
+// clicks; offline takes are written bit-exact
+constexpr double kFadeMs = 2.0;
+constexpr int kMaxFadeFrames = 512;
+// stop() checks this often whether the host is still delivering audio, and gives up waiting for
+// stopFrame once no audio has arrived for kStallMs (longer than any host buffer)
+constexpr int kStopPollMs = 50;
+constexpr juce::uint32 kStallMs = 500;
+constexpr double kMaxPreRollSeconds = 600.0;
+// Beyond the window the history has room for live audio to queue while a take flushes it: an eighth
+// of the window plus a second covers a file written 10x slower than the audio arrives
+constexpr double kPreRollHeadroom = 0.125;
+constexpr double kPreRollHeadroomSeconds = 1.0;
+// WAV headers and FLAC STREAMINFO are rewritten this often, so a crash leaves every file playable up to the last refresh
+constexpr double kHeaderRefreshSeconds = 2.0;
+// Reserved beyond a segment's sample data for the WAV/RF64 header or FLAC frame headers
+constexpr juce::int64 kHeaderReserveBytes = 4096;
+
+// Disk space reserved for a file without changing its size, so writing it never waits on the
+// filesystem's allocator or finds the disk full halfway. Held while the file is written; release()
+// hands back whatever went unused.
+class DiskReservation {
+public:
+    ~DiskReservation() { release(); }
+
+    void reserve(const juce::File& file, juce::int64 bytes) {
+       #if JUCE_MAC || JUCE_LINUX
+        fd = ::open(file.getFullPathName().toRawUTF8(), O_WRONLY);
+        if (fd < 0) return;
+        #if JUCE_MAC
+        fstore_t store { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t) bytes, 0 };
+        if (::fcntl(fd, F_PREALLOCATE, &store) == -1) {
+            store.fst_flags = F_ALLOCATEALL;
+            ::fcntl(fd, F_PREALLOCATE, &store);
+        }
+        #else
+        ::fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) bytes);
+        #endif
+       #else
+        juce::ignoreUnused(file, bytes);
+       #endif
+    }
+
+    void release() {
+       #if JUCE_MAC || JUCE_LINUX
+        if (fd < 0) return;
+        // Truncating to the current size frees the blocks reserved past the end
+        struct stat st {};
+        if (::fstat(fd, &st) == 0 && ::ftruncate(fd, st.st_size) != 0) {}
+        ::close(fd);
+        fd = -1;
+       #endif
+    }
+
+private:
+   #if JUCE_MAC || JUCE_LINUX
+    int fd = -1;
+   #endif
+};
+
+// One file of a take
+struct SegmentFile {
+    ~SegmentFile() {
+        writer.reset(); // flushes the file and patches the WAV header or STREAMINFO
+        space.release();
+    }
+    juce::File file;
+    std::unique_ptr<juce::AudioFormatWriter> writer;
+    DiskReservation space;
+};
+
+// Creates the file, FLAC if given the pool and otherwise WAV, and reserves reserveBytes for it (0: nothing)
+std::unique_ptr<SegmentFile> openSegment(const juce::File& file, int numChannels, double sampleRate, juce::int64 reserveBytes,
+                                         streaming::FlacEncodePool* flacPool) {
+    auto parentDir = file.getParentDirectory();
+    if (! parentDir.exists())
+        parentDir.createDirectory();
+
+    file.deleteFile();
+    auto fileStream = file.createOutputStream(kFileBufferBytes);
+    if (fileStream == nullptr)
+        return nullptr;
+
+    auto segment = std::make_unique<SegmentFile>();
+    if (flacPool != nullptr) {
+        segment->writer = std::make_unique<streaming::FlacWriter>(fileStream.get(), sampleRate, numChannels, kBitsPerSample, *flacPool);
+    } else {
+        juce::WavAudioFormat wavFormat;
+        segment->writer.reset(wavFormat.createWriterFor(fileStream.get(), sampleRate, (unsigned int) numChannels, kBitsPerSample, {}, 0));
+    }
+    if (segment->writer == nullptr)
+        return nullptr;
+
+    fileStream.release(); // writer now owns the stream
+    segment->file = file;
+    if (reserveBytes > 0)
+        segment->space.reserve(file, reserveBytes);
+    return segment;
+}
 }
 
+struct AudioRecorder::Session {
+    ~Session() {
+        // The file opened ahead of a switch that never came
+        if (next != nullptr) {
+            const auto unused = next->file;
+            next.reset();
+            unused.deleteFile();
+        }
+    }
+
+    // current is being written; with segmentation, next is already open for the switch
+    std::unique_ptr<SegmentFile> current, next;
+    juce::File firstFile;
+    streaming::FlacEncodePool* flacPool = nullptr; // null: WAV
+    double sampleRate = 0.0;
+    juce::int64 segmentFrames = std::numeric_limits<juce::int64>::max(), reserveBytes = 0, headerFrames = 0;
+    int segmentIndex = 1;
+    juce::int64 segmentWritten = 0, sinceHeader = 0; // drain thread
+    int numChannels = 0;
+    int fadeFrames = 0;
+    juce::int64 startHostSample = -1;
+    juce::int64 pressedAt = 0; // tap write position when the take was started
+    // Drain thread: the take's tap frames, -1 until a host-aligned start is reached
+    juce::int64 startFrame = -1, endFrame = -1;
+    juce::int64 written = 0;
+    std::atomic<juce::int64> stopFrame { std::numeric_limits<juce::int64>::max() };
+    std::atomic<bool> flushTail { false }; // the audio stopped short of stopFrame
+};
+
+AudioRecorder::AudioRecorder() {}
+
 AudioRecorder::~AudioRecorder() {
     stop();
-    writerThread.stopThread(2000);
+    stopDrainThread();
+    reader.detach();
 }
 
 void AudioRecorder::prepare(double sampleRate) {
+    stop();
+    stopDrainThread();
+    reader.detach();
     currentSampleRate = sampleRate;
+    const int capacity = kDrainBlockSamples + kMaxFadeFrames;
+    blockBuffer.setSize(kMaxChannels, capacity);
+    readPtrs.allocate((size_t) kMaxChannels, true);
+    fixedBuffer.allocate((size_t) kMaxChannels * (size_t) capacity, true);
+    fixedPtrs.allocate((size_t) kMaxChannels + 1, true);
+    scratch.setSize(kMaxChannels, kDrainBlockSamples);
+
+    // The reader is attached here and detached only with the drain thread stopped, so the drain never
+    // sees it change; between takes the drain keeps the pre-roll current (or, unarmed, keeps up)
+    flushFrom = -1;
+    preRollWindow = (int) std::ceil(preRollSeconds * sampleRate);
+    const int headroom = preRollWindow > 0 ? (int) std::ceil((preRollSeconds * kPreRollHeadroom + kPreRollHeadroomSeconds) * sampleRate) : 0;
+    if (! preRoll.prepare(kMaxChannels, preRollWindow + headroom)) {
+        LogMessage("Recorder: no memory for " + juce::String(preRollSeconds) + " s of pre-roll");
+        preRollWindow = 0;
+    }
+    if (source != nullptr) {
+        reader.setWakeThreshold(kDrainBlockSamples);
+        reader.attach(*source);
+    }
+    startDrainThread();
 }
 
-bool AudioRecorder::startRecording(const juce::File& file, int numChannels, double sampleRate) {
-    stop();
+void AudioRecorder::setAudioSource(streaming::AudioTap* tap) {
+    source = tap;
+    if (drainThread != nullptr)
+        prepare(currentSampleRate);
+}
 
-    auto parentDir = file.getParentDirectory();
-    if (! parentDir.exists())
-        parentDir.createDirectory();
+void AudioRecorder::setPreRoll(double seconds) {
+    preRollSeconds = juce::jlimit(0.0, kMaxPreRollSeconds, seconds);
+    if (drainThread != nullptr)
+        prepare(currentSampleRate);
+}
 
-    file.deleteFile();
-    fileStream = file.createOutputStream();
-    if (fileStream == nullptr)
-        return false;
+bool AudioRecorder::startRecording(const juce::File& file, int channels, double sampleRate, juce::int64 startFrame) {
+    return beginTake(file, channels, sampleRate, startFrame, -1);
+}
 
-    juce::WavAudioFormat wavFormat;
-    std::unique_ptr<juce::AudioFormatWriter> writer(
-        wavFormat.createWriterFor(fileStream.get(), sampleRate, (unsigned int) numChannels, 24, {}, 0));
+bool AudioRecorder::startRecordingAtHostSample(const juce::File& file, int channels, double sampleRate, juce::int64 hostSample) {
+    return beginTake(file, channels, sampleRate, -1, juce::jmax<juce::int64>(0, hostSample));
+}
 
-    if (writer.get() == nullptr)
+bool AudioRecorder::beginTake(const juce::File& file, int channels, double sampleRate, juce::int64 startFrame, juce::int64 startHostSample) {
+    stop();
+    if (source == nullptr || drainThread == nullptr || ! reader.isAttached() || channels < 1 || channels > kMaxChannels)
         return false;
 
-    fileStream.release(); // writer now owns the stream
+    // Each segment gets exactly segmentFrames, whichever limit is tighter
+    auto take = std::make_unique<Session>();
+    const juce::int64 bytesPerFrame = channels * kBitsPerSample / 8;
+    if (segmentSeconds > 0.0)
+        take->segmentFrames = juce::jmax<juce::int64>(1, std::llround(segmentSeconds * sampleRate));
+    if (segmentBytes > 0)
+        take->segmentFrames = juce::jmin(take->segmentFrames, juce::jmax<juce::int64>(1, segmentBytes / bytesPerFrame));
+    const bool segmented = take->segmentFrames < std::numeric_limits<juce::int64>::max();
+    take->reserveBytes = segmented ? take->segmentFrames * bytesPerFrame + kHeaderReserveBytes : 0;
+    take->headerFrames = juce::jmax<juce::int64>(1, std::llround(kHeaderRefreshSeconds * sampleRate));
+    take->firstFile = file;
+    take->sampleRate = sampleRate;
+    take->flacPool = format == Format::flac ? flacPool.get() : nullptr;
 
-    const juce::ScopedLock sl(writerLock);
-    threadedWriter.reset(new juce::AudioFormatWriter::ThreadedWriter(writer.release(), writerThread, 32768));
+    take->current = openSegment(file, channels, sampleRate, take->reserveBytes, take->flacPool);
+    if (take->current == nullptr)
+        return false;
+    if (segmented && (take->next = openSegment(getSegmentFile(file, 2), channels, sampleRate, take->reserveBytes, take->flacPool)) == nullptr)
+        return false;
+    take->numChannels = channels;
+    if (! source->isNonRealtime())
+        take->fadeFrames = juce::jlimit(1, kMaxFadeFrames, juce::roundToInt(sampleRate * kFadeMs / 1000.0));
+    take->startHostSample = startHostSample;
 
-    // Allocate FIFO with 2 seconds of audio as headroom (minimum 32768 samples)
-    fifoNumChannels = juce::jmax(1, numChannels);
-    const int targetSamples = juce::jmax(32768, (int) (2.0 * sampleRate));
-    fifoCapacity = targetSamples;
-    fifo.reset(new juce::AbstractFifo(fifoCapacity));
-    fifoBuffer.setSize(fifoNumChannels, fifoCapacity);
-    fifoBuffer.clear();
-    droppedSamples.store(0);
+    skippedBase = reader.getSkippedFrames();
+    flushLost.store(0);
+    // The drain thread clamps this to the oldest frame still in reach once it adopts the take
+    take->pressedAt = source->getWritePosition();
+    if (startHostSample < 0)
+        take->startFrame = startFrame >= 0 ? startFrame : take->pressedAt - preRollWindow;
 
-    startDrainThread();
+    retired.reset();
+    session = std::move(take);
+    pending.store(session.get(), std::memory_order_release);
     isRecordingAtomic.store(true);
+    reader.wake();
     return true;
 }
 
-void AudioRecorder::stop() {
-    stopDrainThread();
-    const juce::ScopedLock sl(writerLock);
-    threadedWriter.reset();
-    fileStream.reset();
-    fifoBuffer.setSize(0, 0);
-    fifoCapacity = 0;
-    fifoNumChannels = 0;
-    fifo.reset();
+void AudioRecorder::stop(juce::int64 stopFrame) {
     isRecordingAtomic.store(false);
-}
+    if (session == nullptr) return;
 
-void AudioRecorder::pushBuffer(const juce::AudioBuffer<float>& buffer, int numSamples) {
-    auto* w = threadedWriter.get();
-    if (w == nullptr || ! isRecordingAtomic.load() || numSamples <= 0 || fifo == nullptr)
-        return;
-
-    // Lock-free write into ring buffer; drop if full
-    int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
-    fifo->prepareToWrite(numSamples, start1, size1, start2, size2);
-
-    if (size1 + size2 < numSamples) {
-        droppedSamples.fetch_add(numSamples);
-        return;
+    auto lastPosition = source->getWritePosition();
+    session->stopFrame.store(stopFrame >= 0 ? stopFrame : lastPosition, std::memory_order_release);
+    reader.wake();
+    // The drain finishes the take once the tap reaches stopFrame; if the host stops calling back
+    // first, it finishes with what the tap has
+    auto lastProgressMs = juce::Time::getMillisecondCounter();
+    while (! retired.wait(kStopPollMs)) {
+        const auto position = source->getWritePosition();
+        const auto nowMs = juce::Time::getMillisecondCounter();
+        if (position != lastPosition) lastProgressMs = nowMs;
+        else if (nowMs - lastProgressMs >= kStallMs) session->flushTail.store(true);
+        lastPosition = position;
+        reader.wake();
     }
+    session.reset(); // flushes the file and patches the WAV header or STREAMINFO
+    if (const auto lost = getDroppedSamples(); lost > 0)
+        LogMessage("Recorder: take lost " + juce::String(lost) + " samples to a full tap");
+}
 
-    const int channelsToCopy = juce::jmin(buffer.getNumChannels(), fifoNumChannels);
+void AudioRecorder::setSegmentLimits(double maxSeconds, juce::int64 maxBytes) {
+    segmentSeconds = juce::jmax(0.0, maxSeconds);
+    segmentBytes = juce::jmax<juce::int64>(0, maxBytes);
+}
 
-    if (size1 > 0) {
-        for (int ch = 0; ch < channelsToCopy; ++ch)
-            fifoBuffer.copyFrom(ch, start1, buffer.getReadPointer(ch), size1);
-        for (int ch = channelsToCopy; ch < fifoNumChannels; ++ch)
-            fifoBuffer.clear(ch, start1, size1);
-    }
-    if (size2 > 0) {
-        for (int ch = 0; ch < channelsToCopy; ++ch)
-            fifoBuffer.copyFrom(ch, start2, buffer.getReadPointer(ch) + size1, size2);
-        for (int ch = channelsToCopy; ch < fifoNumChannels; ++ch)
-            fifoBuffer.clear(ch, start2, size2);
+void AudioRecorder::setFormat(Format f, int flacWorkers) {
+    format = f;
+    if (f == Format::flac && (flacPool == nullptr || (flacWorkers >= 0 && flacWorkers != flacPool->getNumWorkers()))) {
+        stop(); // a take's writers use the pool
+        flacPool = std::make_unique<streaming::FlacEncodePool>(flacWorkers);
     }
+}
 
-    fifo->finishedWrite(size1 + size2);
+juce::File AudioRecorder::getSegmentFile(const juce::File& first, int index) {
+    if (index <= 1) return first;
+    return first.getSiblingFile(first.getFileNameWithoutExtension() + "_" + juce::String(index).paddedLeft('0', 3) + first.getFileExtension());
 }
 
 void AudioRecorder::startDrainThread() {
@@ -107,6 +301,8 @@ void AudioRecorder::startDrainThread() {
 
 void AudioRecorder::stopDrainThread() {
     if (drainThread) {
+        drainThread->signalThreadShouldExit();
+        reader.wake();
         drainThread->stopThread(2000);
         drainThread.reset();
     }
@@ -114,39 +310,162 @@ void AudioRecorder::stopDrainThread() {
 
 void AudioRecorder::DrainThread::run() {
     while (! threadShouldExit()) {
+        owner.reader.wait(kDrainTimeoutMs);
+        owner.tapBacklogMetric.set(owner.reader.getUnreadFrames());
         owner.drainOnce();
-        wait(2);
+        owner.droppedMetric.set(owner.getDroppedSamples());
     }
-    owner.drainOnce();
 }
 
 void AudioRecorder::drainOnce() {
-    auto* w = threadedWriter.get();
-    if (w == nullptr || fifo == nullptr) return;
+    if (active == nullptr) {
+        active = pending.exchange(nullptr, std::memory_order_acquire);
+        if (active == nullptr) { feedPreRoll(); return; }
+        held = 0;
+        // Nothing older than the pre-roll (without one, the reader's position) is in reach; a start inside it
+        // flushes the history from there before any live audio
+        auto& take = *active;
+        if (take.startHostSample < 0) {
+            const bool hasHistory = preRoll.getEnd() > preRoll.getStart();
+            take.startFrame = take.endFrame = juce::jmax(take.startFrame, hasHistory ? preRoll.getStart() : reader.getPosition());
+            if (hasHistory && take.startFrame < preRoll.getEnd())
+                flushFrom = take.startFrame;
+        }
+    }
+    auto& take = *active;
+    const int capacity = kDrainBlockSamples + take.fadeFrames;
 
-    int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
-    fifo->prepareToRead(fifoCapacity, start1, size1, start2, size2);
+    // Pre-roll first, then everything buffered in the tap, trimmed to [startFrame, stopFrame) and
+    // gathered across host blocks into writes of kDrainBlockSamples
+    streaming::AudioTap::BlockInfo info;
+    for (;;) {
+        const juce::int64 stopAt = take.stopFrame.load(std::memory_order_acquire);
+        for (int ch = 0; ch < take.numChannels; ++ch)
+            readPtrs[ch] = blockBuffer.getWritePointer(ch, held);
+        int n = 0;
+        if (flushFrom >= 0) {
+            // Live audio keeps queueing behind the history in the pre-roll while it is written out;
+            // whatever the live side overwrites before it is flushed is lost (reader skips aside)
+            const auto skippedBefore = reader.getSkippedFrames();
+            feedPreRoll();
+            if (const auto overrun = preRoll.getStart() - flushFrom; overrun > 0) {
+                const auto skippedNow = (juce::int64) (reader.getSkippedFrames() - skippedBefore);
+                flushLost.fetch_add((juce::uint64) (overrun - juce::jmin(overrun, skippedNow)));
+                flushFrom = preRoll.getStart();
+            }
+            n = preRoll.read(flushFrom, readPtrs.getData(), take.numChannels, capacity - held);
+            if (n == 0) { flushFrom = -1; continue; } // caught up with the tap
+            info.firstFrame = flushFrom;
+            info.hostSample = -1;
+            flushFrom += n;
+        } else {
+            n = reader.read(readPtrs.getData(), take.numChannels, capacity - held, info);
+            if (n == 0) {
+                if (reader.getPosition() >= stopAt || take.flushTail.load()) finishTake();
+                return;
+            }
+        }
+        if (consume(info, n)) return;
+    }
+}
 
-    if (size1 + size2 == 0) {
-        fifo->finishedRead(0);
-        return;
+void AudioRecorder::feedPreRoll() {
+    // Unarmed, nothing is kept but the reader keeps up with the tap. It leaves the newest half block
+    // unread, so a take started while this runs still finds its first frame; the start trims the rest.
+    const juce::int64 keepUnread = isArmed() ? 0 : kDrainBlockSamples / 2;
+    streaming::AudioTap::BlockInfo info;
+    while (reader.getUnreadFrames() > keepUnread) {
+        const int n = reader.read(scratch.getArrayOfWritePointers(), kMaxChannels, scratch.getNumSamples(), info);
+        if (n == 0) break;
+        if (isArmed()) preRoll.append(scratch.getArrayOfReadPointers(), kMaxChannels, n, info.firstFrame);
     }
+}
 
-    if (size1 > 0) {
-        std::vector<const float*> channelPtrs;
-        channelPtrs.reserve((size_t) fifoNumChannels);
-        for (int ch = 0; ch < fifoNumChannels; ++ch)
-            channelPtrs.push_back(fifoBuffer.getReadPointer(ch, start1));
-        w->write(channelPtrs.data(), size1);
+bool AudioRecorder::consume(const streaming::AudioTap::BlockInfo& info, int n) {
+    auto& take = *active;
+    const int capacity = kDrainBlockSamples + take.fadeFrames;
+    const juce::int64 stopAt = take.stopFrame.load(std::memory_order_acquire);
+    const juce::int64 end = info.firstFrame + n;
+    // A host-aligned take waits for the playhead to reach its start
+    if (take.startFrame < 0 && info.hostSample >= 0 && info.hostSample + n > take.startHostSample)
+        take.startFrame = take.endFrame = info.firstFrame + juce::jmax<juce::int64>(0, take.startHostSample - info.hostSample);
+    const juce::int64 from = take.startFrame < 0 ? end : juce::jmax(info.firstFrame, take.startFrame);
+    const int keep = (int) juce::jlimit<juce::int64>(0, n, juce::jmin(end, stopAt) - from);
+    if (keep > 0) {
+        const int skip = (int) (from - info.firstFrame);
+        const int fadeIn = (int) juce::jlimit<juce::int64>(0, keep, take.fadeFrames - take.written);
+        for (int ch = 0; ch < take.numChannels; ++ch) {
+            float* dst = blockBuffer.getWritePointer(ch, held);
+            if (skip > 0) std::memmove(dst, dst + skip, sizeof(float) * (size_t) keep);
+            for (int i = 0; i < fadeIn; ++i) dst[i] *= (float) (take.written + i) / (float) take.fadeFrames;
+        }
+        held += keep;
+        take.written += keep;
+        take.endFrame = from + keep;
+        // The last fadeFrames stay behind, so a stop can still fade them out
+        if (held == capacity) {
+            writeBlock(kDrainBlockSamples);
+            for (int ch = 0; ch < take.numChannels; ++ch)
+                std::memmove(blockBuffer.getWritePointer(ch), blockBuffer.getReadPointer(ch, kDrainBlockSamples), sizeof(float) * (size_t) take.fadeFrames);
+            held = take.fadeFrames;
+        }
     }
+    if (end >= stopAt) { finishTake(); return true; }
+    return false;
+}
+
+void AudioRecorder::finishTake() {
+    auto& take = *active;
+    const int fadeOut = juce::jmin(held, take.fadeFrames);
+    for (int ch = 0; ch < take.numChannels; ++ch) {
+        float* tail = blockBuffer.getWritePointer(ch, held - fadeOut);
+        for (int i = 0; i < fadeOut; ++i) tail[i] *= (float) (fadeOut - 1 - i) / (float) take.fadeFrames;
+    }
+    writeBlock(held);
+    held = 0;
+    flushFrom = -1;
+    const auto fromPreRoll = take.startFrame < 0 ? 0 : juce::jlimit<juce::int64>(0, take.endFrame - take.startFrame, take.pressedAt - take.startFrame);
+    lastTake = { take.startFrame, take.endFrame, fromPreRoll, take.segmentIndex };
+    active = nullptr;
+    retired.signal();
+}
 
-    if (size2 > 0) {
-        std::vector<const float*> channelPtrs;
-        channelPtrs.reserve((size_t) fifoNumChannels);
-        for (int ch = 0; ch < fifoNumChannels; ++ch)
-            channelPtrs.push_back(fifoBuffer.getReadPointer(ch, start2));
-        w->write(channelPtrs.data(), size2);
+void AudioRecorder::writeBlock(int numSamples) {
+    auto& take = *active;
+    // Rounded and clipped at 24 bits, left-justified in int32
+    const int stride = blockBuffer.getNumSamples();
+    for (int ch = 0; ch < take.numChannels; ++ch)
+        SampleConvert::toFixedPoint(blockBuffer.getReadPointer(ch), numSamples, fixedBuffer + (size_t) ch * (size_t) stride, kBitsPerSample);
+
+    // Split at segment boundaries; a file only rolls over once there is audio for the next one
+    for (int done = 0; done < numSamples;) {
+        if (take.segmentWritten == take.segmentFrames) nextSegment();
+        const int n = (int) juce::jmin<juce::int64>(numSamples - done, take.segmentFrames - take.segmentWritten);
+        for (int ch = 0; ch <= kMaxChannels; ++ch)
+            fixedPtrs[ch] = ch < take.numChannels ? fixedBuffer + (size_t) ch * (size_t) stride + (size_t) done : nullptr;
+        take.current->writer->write(fixedPtrs.getData(), n);
+        done += n;
+        take.segmentWritten += n;
+        if ((take.sinceHeader += n) >= take.headerFrames) {
+            take.current->writer->flush();
+            take.sinceHeader = 0;
+        }
     }
+}
 
-    fifo->finishedRead(size1 + size2);
+void AudioRecorder::nextSegment() {
+    auto& take = *active;
+    // Normally opened one segment ahead; if that failed, try again now and otherwise keep growing
+    // the current file rather than lose audio
+    if (take.next == nullptr)
+        take.next = openSegment(getSegmentFile(take.firstFile, take.segmentIndex + 1), take.numChannels, take.sampleRate, take.reserveBytes, take.flacPool);
+    if (take.next == nullptr) {
+        LogMessage("Recorder: cannot open segment " + juce::String(take.segmentIndex + 1) + ", continuing in " + take.current->file.getFileName());
+        take.segmentFrames = std::numeric_limits<juce::int64>::max();
+        return;
+    }
+    take.current = std::move(take.next); // closes the finished file
+    ++take.segmentIndex;
+    take.segmentWritten = take.sinceHeader = 0;
+    take.next = openSegment(getSegmentFile(take.firstFile, take.segmentIndex + 1), take.numChannels, take.sampleRate, take.reserveBytes, take.flacPool);
 }
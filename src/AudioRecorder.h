@@ -2,47 +2,128 @@
 #include <juce_audio_formats/juce_audio_formats.h>
 #include <juce_audio_basics/juce_audio_basics.h>
 #include <juce_core/juce_core.h>
+#include "AudioTap.h"
+#include "FlacWriter.h"
+#include "PreRollBuffer.h"
+#include "Telemetry.h"
 
 class AudioRecorder {
 public:
+    static constexpr int kMaxChannels = 2;
+
     AudioRecorder();
     ~AudioRecorder();
 
+    // Allocates the drain buffers, attaches to the audio source and starts the drain thread, so starting
+    // a take allocates nothing but the file. Call from prepareToPlay; a take in progress is stopped first.
     void prepare(double sampleRate);
-    bool startRecording(const juce::File& file, int numChannels, double sampleRate);
-    void stop();
+    // Where recordings read their audio from. Set after prepare(), it prepares again (stopping a take
+    // in progress), since the recorder stays attached to its source from prepare() on.
+    void setAudioSource(streaming::AudioTap* tap);
+    // Keeps the last `seconds` of audio at all times (0: off), so a take can start before Record was
+    // pressed. Memory is fixed at prepare(); long windows are memory-mapped. Takes effect immediately
+    // if already prepared, stopping a take in progress.
+    void setPreRoll(double seconds);
+    double getPreRollSeconds() const { return preRollSeconds; }
+    bool isPreRollMapped() const { return preRoll.isMapped(); }
+    enum class Format { wav, flac };
+    // File format of takes started afterwards (24-bit either way). FLAC frames are compressed on an
+    // encoder pool and written in order by the drain thread; flacWorkers sets its size (-1: one per
+    // core beyond the first, 0: encode on the drain thread). Rebuilding the pool stops a take in progress.
+    void setFormat(Format f, int flacWorkers = -1);
+    Format getFormat() const { return format; }
+    static const char* getFileExtension(Format f) { return f == Format::flac ? "flac" : "wav"; }
+    // The FLAC encoder pool, once FLAC has been selected
+    const streaming::FlacEncodePool* getFlacPool() const { return flacPool.get(); }
+    // Rolls takes started afterwards over into a new file every maxSeconds of audio or maxBytes of
+    // uncompressed sample data, whichever comes first (0: no limit). The next file is opened and its space
+    // reserved ahead of time and the switch falls on an exact frame, so the files join without a gap.
+    // Unsegmented takes become RF64 past 4 GB.
+    void setSegmentLimits(double maxSeconds, juce::int64 maxBytes);
+    // File the index-th segment (from 1) of a take started on `first` goes to: first itself, then
+    // name_002.wav, name_003.wav, ...
+    static juce::File getSegmentFile(const juce::File& first, int index);
+
+    // Opens the file here and hands the take to the drain thread. It starts at tap frame startFrame
+    // (default: the next frame the host delivers, less the pre-roll; anything older than the pre-roll
+    // holds starts at its oldest frame). The drain thread writes the pre-roll ahead of the live audio.
+    // Takes on a non-realtime tap (offline bounce) are lossless and bit-exact: no edge fades.
+    bool startRecording(const juce::File& file, int numChannels, double sampleRate, juce::int64 startFrame = -1);
+    // As above, but the take starts at the first frame the host plays at timeline position hostSample
+    // from now on; the pre-roll is not searched
+    bool startRecordingAtHostSample(const juce::File& file, int numChannels, double sampleRate, juce::int64 hostSample);
+    // Ends the take at tap frame stopFrame (default: the next frame the host delivers) and returns once
+    // the file is complete. If the host stops calling back first, the take ends where the audio did.
+    void stop(juce::int64 stopFrame = -1);
     bool isRecording() const { return isRecordingAtomic.load(); }
 
-    void pushBuffer(const juce::AudioBuffer<float>& buffer, int numSamples);
+    // Frames the current or last take lost: the drain thread fell a whole tap ring behind, or live
+    // audio overran the pre-roll before it was flushed
+    int getDroppedSamples() const { return (int) (reader.getSkippedFrames() - skippedBase + flushLost.load()); }
+
+    // Tap frames the last finished take covered, [startFrame, endFrame), of which the first
+    // preRollFrames were played before it was started, split over `segments` files; -1 if it never started
+    struct Take { juce::int64 startFrame { -1 }, endFrame { -1 }, preRollFrames { 0 }; int segments { 0 }; };
+    Take getLastTake() const { return lastTake; }
 
 private:
-    // Writer to disk (JUCE-provided background writer)
-    juce::TimeSliceThread writerThread { "Audio Recorder Writer Thread" };
-    juce::CriticalSection writerLock;
-    std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> threadedWriter;
-    std::unique_ptr<juce::FileOutputStream> fileStream;
-
-    // Lock-free ring buffer between audio thread and drain thread
-    std::unique_ptr<juce::AbstractFifo> fifo;
-    juce::AudioBuffer<float> fifoBuffer;
-    int fifoCapacity = 0;
-    int fifoNumChannels = 0;
-
-    // Drain thread moves from ring buffer -> ThreadedWriter (non-audio thread)
+    // One take: built on the message thread, handed to the drain thread through `pending`, and
+    // destroyed (closing the file) back on the message thread once the drain thread signals `retired`
+    struct Session;
+    std::unique_ptr<Session> session;
+    std::atomic<Session*> pending { nullptr };
+    juce::WaitableEvent retired;
+
+    streaming::AudioTap* source = nullptr;
+    streaming::AudioTap::Reader reader;
+    juce::uint64 skippedBase = 0;
+    std::atomic<juce::uint64> flushLost { 0 };
+    double preRollSeconds = 0.0;
+    int preRollWindow = 0; // frames a default start reaches back
+    double segmentSeconds = 0.0;
+    juce::int64 segmentBytes = 0;
+    Format format = Format::wav;
+    std::unique_ptr<streaming::FlacEncodePool> flacPool;
+
+    // Drain thread only: the adopted take and one drain block of float samples read out of the tap,
+    // plus a held-back tail so a stop can fade it, then the same block as 24-bit samples
+    Session* active = nullptr;
+    int held = 0;
+    juce::AudioBuffer<float> blockBuffer;
+    juce::HeapBlock<float*> readPtrs;
+    juce::HeapBlock<int> fixedBuffer;
+    juce::HeapBlock<const int*> fixedPtrs; // zero-terminated, as AudioFormatWriter::write() expects
+    Take lastTake;
+    // Drain thread only while prepared: recent audio (the window plus headroom for live audio queueing
+    // during a flush), fed through `scratch` whenever no take reads the tap directly. flushFrom is the next pre-roll frame a take still has to write, -1 once caught up.
+    streaming::PreRollBuffer preRoll;
+    juce::AudioBuffer<float> scratch;
+    juce::int64 flushFrom = -1;
+
+    // Drain thread sleeps until a whole block is buffered (or a timeout flushes the tail)
     struct DrainThread : public juce::Thread {
         AudioRecorder& owner;
         explicit DrainThread(AudioRecorder& o) : juce::Thread("Audio Recorder FIFO Drain"), owner(o) {}
         void run() override;
     };
     std::unique_ptr<DrainThread> drainThread;
+    // Sampled by the drain thread each time it wakes; this recorder's share of the process-wide gauges
+    streaming::Telemetry::GaugeShare tapBacklogMetric { streaming::Telemetry::getInstance().gauge("recorder.tapBacklogFrames") };
+    streaming::Telemetry::GaugeShare droppedMetric { streaming::Telemetry::getInstance().gauge("recorder.droppedSamples") };
 
     std::atomic<bool> isRecordingAtomic { false };
-    std::atomic<int> droppedSamples { 0 };
     double currentSampleRate { 44100.0 };
 
+    bool beginTake(const juce::File& file, int numChannels, double sampleRate, juce::int64 startFrame, juce::int64 startHostSample);
     void startDrainThread();
     void stopDrainThread();
+    bool isArmed() const { return preRoll.getCapacity() > 0; }
     void drainOnce();
+    void feedPreRoll();
+    bool consume(const streaming::AudioTap::BlockInfo& info, int numFrames);
+    void finishTake();
+    void writeBlock(int numSamples);
+    void nextSegment();
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioRecorder)
 };
@@ -0,0 +1,185 @@
+#include "AudioTap.h"
+#include "PacingScheduler.h"
+#include <cstring>
+#include <thread>
+
+using namespace streaming;
+
+void AudioTap::prepare(int numChannels, int capacityFrames) {
+    jassert(! hasReaders());
+    channels = juce::jmax(1, numChannels);
+    capacity = (int) juce::nextPowerOfTwo(juce::jmax(1024, capacityFrames));
+    data.allocate((size_t) channels * (size_t) capacity, true);
+    blocks = std::make_unique<Block[]>(kBlockSlots);
+    claimed.store(0);
+    published.store(0);
+    blocksClaimed.store(0);
+    blocksPublished.store(0);
+}
+
+void AudioTap::write(const float* const* channelData, int numChannels, int numFrames, double sampleRate, juce::int64 hostSample) noexcept {
+    if (! hasReaders() || channelData == nullptr || numFrames <= 0 || channels == 0) return;
+    writeEpoch.fetch_add(1); // odd: readers[] may be in use
+    const juce::int64 nowUs = PrecisionClock::nowMicros();
+    const int skip = juce::jmax(0, numFrames - capacity);
+    numFrames -= skip;
+    if (hostSample >= 0) hostSample += skip;
+
+    // Claim first, so a reader that copies from the region being overwritten sees it afterwards
+    const juce::int64 first = published.load(std::memory_order_relaxed);
+    const juce::int64 blockIndex = blocksPublished.load(std::memory_order_relaxed);
+    if (nonRealtime.load(std::memory_order_relaxed)) waitForSpace(first + numFrames, blockIndex);
+    claimed.store(first + numFrames, std::memory_order_relaxed);
+    blocksClaimed.store(blockIndex + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const int pos = (int) (first & (capacity - 1));
+    const int n1 = juce::jmin(numFrames, capacity - pos);
+    for (int c = 0; c < channels; ++c) {
+        float* lane = data + (size_t) c * (size_t) capacity;
+        if (c < numChannels && channelData[c] != nullptr) {
+            const float* src = channelData[c] + skip;
+            std::memcpy(lane + pos, src, sizeof(float) * (size_t) n1);
+            std::memcpy(lane, src + n1, sizeof(float) * (size_t) (numFrames - n1));
+        } else {
+            std::memset(lane + pos, 0, sizeof(float) * (size_t) n1);
+            std::memset(lane, 0, sizeof(float) * (size_t) (numFrames - n1));
+        }
+    }
+
+    auto& rec = blocks[blockIndex & (kBlockSlots - 1)];
+    rec.firstFrame.store(first, std::memory_order_relaxed);
+    rec.timeUs.store(nowUs, std::memory_order_relaxed);
+    rec.sampleRate.store(sampleRate, std::memory_order_relaxed);
+    rec.numFrames.store(numFrames, std::memory_order_relaxed);
+    rec.hostSample.store(hostSample, std::memory_order_relaxed);
+    published.store(first + numFrames, std::memory_order_release);
+    blocksPublished.store(blockIndex + 1, std::memory_order_release);
+
+    const juce::int64 end = first + numFrames;
+    for (auto& slot : readers)
+        if (auto* r = slot.load())
+            if (end - r->position.load(std::memory_order_relaxed) >= r->wakeThreshold.load(std::memory_order_relaxed))
+                r->signal.notify();
+    writeEpoch.fetch_add(1);
+}
+
+void AudioTap::waitForSpace(juce::int64 end, juce::int64 blockIndex) noexcept {
+    const juce::int64 startUs = PrecisionClock::nowMicros();
+    juce::int64 nowUs = startUs;
+    for (;;) {
+        // Wake every reader this block would lap, in frames or (small blocks) in block records; one
+        // that detaches meanwhile stops counting
+        bool full = false;
+        for (auto& slot : readers)
+            if (auto* r = slot.load())
+                if (end - r->position.load(std::memory_order_acquire) > capacity
+                    || blockIndex + 1 - r->blockPosition.load(std::memory_order_acquire) >= kBlockSlots) { full = true; r->signal.notify(); }
+        if (! full || nowUs - startUs >= (juce::int64) kMaxBackpressureMs * 1000) break;
+        spaceFreed.waitMicros(1000);
+        nowUs = PrecisionClock::nowMicros();
+    }
+    if (nowUs > startUs) backpressureUs.fetch_add((juce::uint64) (nowUs - startUs), std::memory_order_relaxed);
+}
+
+bool AudioTap::Reader::attach(AudioTap& t) {
+    detach();
+    for (int i = 0; i < kMaxReaders; ++i) {
+        Reader* expected = nullptr;
+        if (t.readers[i].load() != nullptr) continue;
+        tap = &t;
+        slot = i;
+        block = t.blocksPublished.load(std::memory_order_acquire);
+        blockPosition.store(block);
+        offset = 0;
+        position.store(t.published.load(std::memory_order_acquire));
+        skipped.store(0);
+        if (t.readers[i].compare_exchange_strong(expected, this)) {
+            t.numReaders.fetch_add(1);
+            return true;
+        }
+    }
+    tap = nullptr;
+    slot = -1;
+    return false;
+}
+
+void AudioTap::Reader::detach() {
+    if (tap == nullptr) return;
+    tap->readers[slot].store(nullptr);
+    tap->numReaders.fetch_sub(1);
+    tap->spaceFreed.notify();
+    // A write() that loaded this reader before the store above is still running; let it finish
+    const auto epoch = tap->writeEpoch.load();
+    if ((epoch & 1) != 0)
+        while (tap->writeEpoch.load() == epoch) std::this_thread::yield();
+    tap = nullptr;
+    slot = -1;
+}
+
+int AudioTap::Reader::getSourceChannels() const noexcept { return tap != nullptr ? tap->channels : 0; }
+
+void AudioTap::Reader::skipToNewest() noexcept {
+    auto& t = *tap;
+    const juce::int64 newest = t.blocksPublished.load(std::memory_order_acquire) - 1;
+    if (newest < block) return;
+    const juce::int64 newestFirst = t.blocks[newest & (kBlockSlots - 1)].firstFrame.load(std::memory_order_relaxed);
+    const juce::int64 lost = newestFirst - position.load(std::memory_order_relaxed);
+    if (lost > 0) skipped.fetch_add((juce::uint64) lost, std::memory_order_relaxed);
+    block = newest;
+    blockPosition.store(block, std::memory_order_relaxed);
+    offset = 0;
+    position.store(newestFirst, std::memory_order_relaxed);
+}
+
+int AudioTap::Reader::read(float* const* dst, int numChannels, int maxFrames, BlockInfo& info) noexcept {
+    if (tap == nullptr || maxFrames <= 0) return 0;
+    auto& t = *tap;
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        const juce::int64 available = t.blocksPublished.load(std::memory_order_acquire);
+        if (block >= available) return 0;
+        if (available - block >= kBlockSlots) { skipToNewest(); continue; }
+
+        const auto& rec = t.blocks[block & (kBlockSlots - 1)];
+        const juce::int64 first = rec.firstFrame.load(std::memory_order_relaxed);
+        const int frames = rec.numFrames.load(std::memory_order_relaxed);
+        info.timeUs = rec.timeUs.load(std::memory_order_relaxed);
+        info.sampleRate = rec.sampleRate.load(std::memory_order_relaxed);
+        info.numFrames = frames;
+        info.isBlockStart = offset == 0;
+        const juce::int64 host = rec.hostSample.load(std::memory_order_relaxed);
+        info.hostSample = host >= 0 ? host + offset : -1;
+
+        const juce::int64 start = first + offset;
+        info.firstFrame = start;
+        const int n = juce::jlimit(0, juce::jmax(0, frames - offset), maxFrames);
+        const int pos = (int) (start & (t.capacity - 1));
+        const int n1 = juce::jmin(n, t.capacity - pos);
+        for (int c = 0; c < numChannels; ++c) {
+            if (c < t.channels) {
+                const float* lane = t.data + (size_t) c * (size_t) t.capacity;
+                std::memcpy(dst[c], lane + pos, sizeof(float) * (size_t) n1);
+                std::memcpy(dst[c] + n1, lane, sizeof(float) * (size_t) (n - n1));
+            } else {
+                std::memset(dst[c], 0, sizeof(float) * (size_t) n);
+            }
+        }
+
+        // Lapped while copying: the copy (or the block record) may be torn, so drop it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (t.claimed.load(std::memory_order_relaxed) - start > t.capacity
+            || t.blocksClaimed.load(std::memory_order_relaxed) - block > kBlockSlots) {
+            skipToNewest();
+            continue;
+        }
+
+        offset += n;
+        if (offset >= frames) { ++block; offset = 0; }
+        // Release: the writer may only reuse these frames (and the block record) after the copy above
+        blockPosition.store(block, std::memory_order_release);
+        position.store(start + n, std::memory_order_release);
+        if (t.nonRealtime.load(std::memory_order_relaxed)) t.spaceFreed.notify();
+        return n;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <memory>
+#include "RealtimeSignal.h"
+
+namespace streaming {
+
+// One broadcast ring between processBlock and every audio consumer (WAV recorder, A+V writer, live
+// encoder). The audio thread copies each host block in once; each consumer attaches a Reader with
+// its own cursor and converts on its own thread. In real time the writer never waits for anyone:
+// the ring is overwritten in place, and a reader that falls a whole ring behind notices after its
+// copy, discards it and skips ahead to the newest block (counted in getSkippedFrames()). For offline
+// renders setNonRealtime(true) makes write() wait for slow readers instead, up to a bound.
+class AudioTap {
+public:
+    static constexpr int kMaxReaders = 4;
+
+    // Per-block facts a consumer may need: when it arrived, at what host rate and where it sits
+    struct BlockInfo {
+        juce::int64 timeUs { 0 };      // PrecisionClock time the block reached write()
+        double sampleRate { 0.0 };
+        int numFrames { 0 };           // whole block, not just the part returned by one read()
+        bool isBlockStart { false };
+        juce::int64 firstFrame { 0 };  // tap frame of the first frame returned
+        juce::int64 hostSample { -1 }; // host timeline position of that frame; -1 with the transport stopped
+    };
+
+    class Reader {
+    public:
+        Reader() = default;
+        ~Reader() { detach(); }
+
+        // Starts at the next block written. Not realtime-safe; one tap at a time.
+        bool attach(AudioTap& tap);
+        // Returns once the audio thread can no longer touch this reader
+        void detach();
+        bool isAttached() const noexcept { return tap != nullptr; }
+
+        // Consumer thread. Copies up to maxFrames of the oldest unread block into numChannels planes
+        // (channels the tap lacks are zero). Never spans two blocks; 0 when nothing is ready.
+        int read(float* const* dst, int numChannels, int maxFrames, BlockInfo& info) noexcept;
+        int getSourceChannels() const noexcept;
+        // Tap frame the next read() returns
+        juce::int64 getPosition() const noexcept { return position.load(std::memory_order_relaxed); }
+
+        // The writer wakes this reader once wakeThreshold frames are unread (default: every block)
+        void setWakeThreshold(int frames) noexcept { wakeThreshold.store(juce::jmax(1, frames)); }
+        bool wait(int timeoutMs) noexcept { return signal.wait(timeoutMs); }
+        void wake() noexcept { signal.notify(); }
+
+        juce::uint64 getSkippedFrames() const noexcept { return skipped.load(); }
+        // Consumer thread: frames written that this reader has yet to read
+        juce::int64 getUnreadFrames() const noexcept { return tap != nullptr ? juce::jmax<juce::int64>(0, tap->getWritePosition() - getPosition()) : 0; }
+
+    private:
+        friend class AudioTap;
+        AudioTap* tap { nullptr };
+        int slot { -1 };
+        juce::int64 block { 0 };           // next block to read
+        int offset { 0 };                  // frames of `block` already returned
+        std::atomic<juce::int64> position { 0 }; // absolute frame of the next read, for the writer
+        std::atomic<juce::int64> blockPosition { 0 }; // `block`, for the writer
+        std::atomic<int> wakeThreshold { 1 };
+        std::atomic<juce::uint64> skipped { 0 };
+        RealtimeSignal signal;
+
+        void skipToNewest() noexcept;
+        JUCE_DECLARE_NON_COPYABLE(Reader)
+    };
+
+    AudioTap() = default;
+
+    // Allocates numChannels lanes of capacityFrames (rounded up to a power of two). Call before any
+    // reader attaches; the size does not depend on the host rate, so once is enough.
+    void prepare(int numChannels, int capacityFrames);
+    int getNumChannels() const noexcept { return channels; }
+    int getCapacity() const noexcept { return capacity; }
+    bool hasReaders() const noexcept { return numReaders.load(std::memory_order_relaxed) > 0; }
+    // Tap frame the next write() starts at. Frames are only counted while a reader is attached.
+    juce::int64 getWritePosition() const noexcept { return published.load(std::memory_order_acquire); }
+
+    // While the host renders offline, write() blocks until every reader has room for the block, in
+    // frames and in block records (at
+    // most kMaxBackpressureMs per block, after which a stalled reader skips as in real time)
+    static constexpr int kMaxBackpressureMs = 2000;
+    void setNonRealtime(bool shouldWait) noexcept { nonRealtime.store(shouldWait); }
+    bool isNonRealtime() const noexcept { return nonRealtime.load(std::memory_order_relaxed); }
+    // Total time write() has spent waiting for readers
+    juce::uint64 getBackpressureMicros() const noexcept { return backpressureUs.load(); }
+
+    // Audio thread: one copy per block, then wakes the readers that asked. Wait-free unless
+    // non-realtime; a no-op while nobody is attached. Blocks larger than the ring keep only their newest frames. hostSample is
+    // the playhead position of the block's first frame while the transport runs, otherwise -1.
+    void write(const float* const* channelData, int numChannels, int numFrames, double sampleRate, juce::int64 hostSample = -1) noexcept;
+
+private:
+    struct Block {
+        std::atomic<juce::int64> firstFrame { 0 };
+        std::atomic<juce::int64> timeUs { 0 };
+        std::atomic<double> sampleRate { 0.0 };
+        std::atomic<int> numFrames { 0 };
+        std::atomic<juce::int64> hostSample { -1 };
+    };
+    static constexpr int kBlockSlots = 1024;
+
+    int channels { 0 };
+    int capacity { 0 };
+    juce::HeapBlock<float> data;          // channels lanes of capacity
+    std::unique_ptr<Block[]> blocks;      // kBlockSlots records
+
+    // Frames below `claimed` (blocks below `blocksClaimed`) may be being overwritten; below the
+    // published counters they are complete. Readers compare against the claims after copying.
+    alignas(64) std::atomic<juce::int64> claimed { 0 };
+    std::atomic<juce::int64> published { 0 };
+    std::atomic<juce::int64> blocksClaimed { 0 };
+    std::atomic<juce::int64> blocksPublished { 0 };
+    // Odd while write() runs, so detach() can wait it out
+    std::atomic<juce::uint32> writeEpoch { 0 };
+
+    alignas(64) std::atomic<Reader*> readers[kMaxReaders] {};
+    std::atomic<int> numReaders { 0 };
+
+    // Offline backpressure: readers signal after every read so a blocked write() can re-check
+    std::atomic<bool> nonRealtime { false };
+    RealtimeSignal spaceFreed;
+    std::atomic<juce::uint64> backpressureUs { 0 };
+    void waitForSpace(juce::int64 end, juce::int64 blockIndex) noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE(AudioTap)
+};
+
+} // namespace streaming
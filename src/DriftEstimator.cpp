@@ -0,0 +1,98 @@
+#include "DriftEstimator.h"
+#include <cmath>
+
+using namespace streaming;
+
+namespace {
+// The loop bandwidth narrows from kStartBandwidthHz to kBandwidthHz over the first tens of seconds:
+// lock quickly, then average callback jitter over a long window
+constexpr double kStartBandwidthHz = 0.5;
+constexpr double kBandwidthHz = 0.01;
+constexpr double kNarrowingSec = 8.0;
+// A callback this far off the prediction means the host stopped calling (transport, device
+// reconfiguration): re-anchor instead of slewing, so the gap is not "made up" by resampling
+constexpr double kStallUs = 250000.0;
+// The timeline correction removes an offset over about kSteerSeconds, never faster than kMaxSteer
+constexpr double kSteerSeconds = 20.0;
+constexpr double kMaxSteer = 0.002;
+// Real device clocks sit within a few hundred ppm; beyond this the host is not running in real time
+// (offline bounce, a stalled then bursting driver) and the nominal rate is the better guess
+constexpr double kMaxPlausiblePpm = 1000.0;
+}
+
+void DriftEstimator::reset(double nominalRate) noexcept {
+    nominal.store(nominalRate > 0.0 ? nominalRate : 48000.0, std::memory_order_relaxed);
+    frames = 0;
+    timeUs = originUs = 0.0;
+    usPerFrame = 1.0e6 / nominal.load(std::memory_order_relaxed);
+    publish();
+}
+
+void DriftEstimator::onBlock(int numFrames, juce::int64 nowUs) noexcept {
+    if (numFrames <= 0) return;
+    const double now = (double) nowUs;
+    if (frames == 0) {
+        usPerFrame = 1.0e6 / nominal.load(std::memory_order_relaxed);
+        originUs = now - numFrames * usPerFrame;
+        timeUs = now;
+        frames = numFrames;
+        publish();
+        return;
+    }
+    const double predicted = timeUs + numFrames * usPerFrame;
+    const double err = now - predicted;
+    frames += numFrames;
+    if (std::abs(err) > kStallUs) {
+        originUs += err;
+        timeUs = now;
+        publish();
+        return;
+    }
+    // Second-order DLL (F. Adriaensen, "Using a DLL to filter time"), per frame so block sizes may vary
+    const double elapsedSec = (timeUs - originUs) * 1.0e-6;
+    const double bandwidth = kBandwidthHz + (kStartBandwidthHz - kBandwidthHz) * std::exp(-elapsedSec / kNarrowingSec);
+    const double omega = 2.0 * juce::MathConstants<double>::pi * bandwidth * numFrames * usPerFrame * 1.0e-6;
+    timeUs = predicted + juce::MathConstants<double>::sqrt2 * omega * err;
+    usPerFrame += omega * omega * err / numFrames;
+    publish();
+}
+
+void DriftEstimator::publish() noexcept {
+    const auto s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    framesA.store(frames, std::memory_order_relaxed);
+    timeA.store(timeUs, std::memory_order_relaxed);
+    periodA.store(usPerFrame, std::memory_order_relaxed);
+    originA.store(originUs, std::memory_order_relaxed);
+    seq.store(s + 2, std::memory_order_release);
+}
+
+DriftEstimator::Snapshot DriftEstimator::read() const noexcept {
+    Snapshot out;
+    for (;;) {
+        const auto s0 = seq.load(std::memory_order_acquire);
+        if ((s0 & 1) != 0) continue;
+        out.frames = framesA.load(std::memory_order_relaxed);
+        out.timeUs = timeA.load(std::memory_order_relaxed);
+        out.usPerFrame = periodA.load(std::memory_order_relaxed);
+        out.originUs = originA.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) == s0) break;
+    }
+    out.valid = out.frames > 0 && out.usPerFrame > 0.0;
+    return out;
+}
+
+double DriftEstimator::ppm(const Snapshot& s, double nominalRate) noexcept {
+    if (!s.valid || nominalRate <= 0.0) return 0.0;
+    return (1.0e6 / s.usPerFrame / nominalRate - 1.0) * 1.0e6;
+}
+
+double DriftEstimator::ratioFor(const Snapshot& s, double inputPosition, juce::int64 outputFrames, double outputRate, double nominalInputRate) noexcept {
+    if (!s.valid || std::abs(ppm(s, nominalInputRate)) > kMaxPlausiblePpm) return outputRate / nominalInputRate;
+    const double inputSec = (s.timeUs + (inputPosition - (double) s.frames) * s.usPerFrame - s.originUs) * 1.0e-6;
+    const double outputSec = (double) outputFrames / outputRate;
+    const double steer = juce::jlimit(-kMaxSteer, kMaxSteer, (inputSec - outputSec) / kSteerSeconds);
+    return outputRate * s.usPerFrame * 1.0e-6 * (1.0 + steer);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+namespace streaming {
+
+// Measures the audio device's real sample rate against PrecisionClock. A second-order delay-locked
+// loop, fed with (frames, arrival time) for every audio callback, filters out callback jitter and
+// tracks the device clock's offset from nominal (typically tens to hundreds of ppm). ratioFor()
+// turns the estimate into a resampling ratio that also steers the accumulated audio timeline back
+// onto the wall clock, so the A/V offset stays bounded however long the stream runs.
+class DriftEstimator {
+public:
+    struct Snapshot {
+        bool valid { false };
+        juce::int64 frames { 0 };   // input frames observed so far
+        double timeUs { 0.0 };      // filtered clock time at which frame `frames` was reached
+        double usPerFrame { 0.0 };  // filtered device frame period
+        double originUs { 0.0 };    // clock time of input frame 0
+    };
+
+    // Not concurrently with onBlock()
+    void reset(double nominalRate) noexcept;
+
+    // Audio thread: a callback delivering numFrames arrived at nowUs. No locks, no allocation.
+    void onBlock(int numFrames, juce::int64 nowUs) noexcept;
+
+    // Any thread: a consistent copy of the latest filter state
+    Snapshot read() const noexcept;
+    double getNominalRate() const noexcept { return nominal.load(std::memory_order_relaxed); }
+
+    // Measured device rate relative to nominal, in ppm (0 until locked)
+    static double ppm(const Snapshot& s, double nominalRate) noexcept;
+
+    // Output frames per input frame for a resampler producing outputRate whose next output is
+    // centred on `inputPosition` after emitting `outputFrames`: the measured device rate, plus a
+    // slow correction that pulls outputFrames / outputRate back onto the input's wall-clock time.
+    // Falls back to the nominal ratio until locked, or when the measurement is implausible.
+    static double ratioFor(const Snapshot& s, double inputPosition, juce::int64 outputFrames, double outputRate, double nominalInputRate) noexcept;
+
+private:
+    // Written by the audio thread under a sequence counter, read by anyone
+    std::atomic<juce::uint32> seq { 0 };
+    std::atomic<juce::int64> framesA { 0 };
+    std::atomic<double> timeA { 0.0 }, periodA { 0.0 }, originA { 0.0 };
+    std::atomic<double> nominal { 48000.0 };
+
+    // Audio thread only
+    juce::int64 frames { 0 };
+    double timeUs { 0.0 }, usPerFrame { 0.0 }, originUs { 0.0 };
+
+    void publish() noexcept;
+};
+
+} // namespace streaming
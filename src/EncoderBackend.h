@@ -0,0 +1,49 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <functional>
+#include <memory>
+#include "EncoderControl.h"
+#include "MediaBuffer.h"
+#include "StreamingConfig.h"
+
+namespace streaming {
+
+// Uncompressed picture handed to a software encoder. Planes are borrowed for the duration of the
+// encodeVideo() call only.
+struct RawVideoFrame {
+    enum class PixelFormat { bgra, nv12, yuv420p };
+    const uint8_t* planes[3] { nullptr, nullptr, nullptr };
+    int strides[3] { 0, 0, 0 };
+    PixelFormat format { PixelFormat::bgra };
+    int width { 0 };
+    int height { 0 };
+    juce::int64 ptsMs { 0 };
+};
+
+// Pluggable H.264 encoder. LiveStreamer drives it with raw pictures and receives AVCC access units
+// (FLV payloads) through the callbacks, which run on the encoding thread. Audio is encoded by
+// LiveStreamer's own AudioEncodeStage whichever video encoder runs; the VideoToolbox path on macOS
+// stays built into LiveStreamer.
+class EncoderBackend : public EncoderControl {
+public:
+    struct Callbacks {
+        std::function<void(const void* data, size_t size)> videoConfig; // avcC, once from start()
+        // One per encoded picture, with the ptsMs of the RawVideoFrame it came from
+        std::function<void(MediaBuffer::Ptr frame, juce::int64 ptsMs, bool keyframe)> video;
+    };
+
+    ~EncoderBackend() override = default;
+
+    virtual bool start(const StreamingConfig& cfg, Callbacks callbacks) = 0;
+    virtual void stop() = 0;
+
+    // Not realtime-safe: scales and encodes on the caller's thread
+    virtual bool encodeVideo(const RawVideoFrame& frame) = 0;
+
+    virtual juce::String getName() const = 0;
+
+    // libavcodec (libx264 when present); nullptr when built without FFmpeg
+    static std::unique_ptr<EncoderBackend> createSoftware();
+};
+
+} // namespace streaming
@@ -0,0 +1,20 @@
+#pragma once
+#include <juce_core/juce_core.h>
+
+namespace streaming {
+
+// Runtime controls of a live video encoder, implemented once per encoder backend. Called from
+// control threads (ABR, egress); implementations must not block on the encoder's output path.
+class EncoderControl {
+public:
+    virtual ~EncoderControl() = default;
+
+    // Average video bitrate the encoder should aim for from now on; false if it was rejected
+    virtual bool setTargetBitrate(int kbps) = 0;
+    virtual int getTargetBitrate() const = 0;
+
+    // Ask for the next encoded frame to be an IDR
+    virtual void requestKeyframe() = 0;
+};
+
+} // namespace streaming
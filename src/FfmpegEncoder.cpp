@@ -0,0 +1,304 @@
+#include "FfmpegEncoder.h"
+#include "Logging.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#if HAVE_FFMPEG
+extern "C" {
+ #include <libavcodec/avcodec.h>
+ #include <libavutil/opt.h>
+ #include <libswscale/swscale.h>
+}
+#endif
+
+using namespace streaming;
+
+#if HAVE_FFMPEG
+namespace {
+juce::String ffErr(int err) {
+    char buf[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+    av_strerror(err, buf, sizeof(buf));
+    return juce::String(buf);
+}
+
+struct Nal { const uint8_t* data; size_t size; int startCodeLen; };
+
+// Splits an Annex B stream into NAL units; empty if there is no start code (already length-prefixed)
+void splitAnnexB(const uint8_t* p, size_t n, std::vector<Nal>& out) {
+    out.clear();
+    for (size_t k = 0; k + 3 <= n; ++k) {
+        if (p[k] != 0 || p[k + 1] != 0 || p[k + 2] != 1) continue;
+        const size_t codeBegin = (k > 0 && p[k - 1] == 0) ? k - 1 : k;
+        if (!out.empty()) out.back().size = (size_t) (p + codeBegin - out.back().data);
+        out.push_back({ p + k + 3, 0, (int) (k + 3 - codeBegin) });
+        k += 2;
+    }
+    if (!out.empty()) out.back().size = (size_t) (p + n - out.back().data);
+}
+
+// avcC from the encoder's global header (Annex B SPS/PPS, or already avcC)
+bool buildAvcC(const uint8_t* p, size_t n, juce::MemoryOutputStream& avcc) {
+    if (p == nullptr || n == 0) return false;
+    if (p[0] == 1) { avcc.write(p, n); return true; }
+    std::vector<Nal> nals;
+    splitAnnexB(p, n, nals);
+    const Nal* sps = nullptr; const Nal* pps = nullptr;
+    for (const auto& nal : nals) {
+        if (nal.size == 0) continue;
+        const int type = nal.data[0] & 0x1F;
+        if (type == 7 && sps == nullptr) sps = &nal;
+        else if (type == 8 && pps == nullptr) pps = &nal;
+    }
+    if (sps == nullptr || pps == nullptr || sps->size < 4) return false;
+    avcc.writeByte(1);
+    avcc.writeByte((char) sps->data[1]);
+    avcc.writeByte((char) sps->data[2]);
+    avcc.writeByte((char) sps->data[3]);
+    avcc.writeByte((char) (0xFC | 3));
+    avcc.writeByte((char) (0xE0 | 1));
+    avcc.writeShortBigEndian((short) sps->size);
+    avcc.write(sps->data, sps->size);
+    avcc.writeByte(1);
+    avcc.writeShortBigEndian((short) pps->size);
+    avcc.write(pps->data, pps->size);
+    return true;
+}
+
+// Shares the packet's bytes (one extra AVBufferRef) instead of copying them
+MediaBuffer::Ptr wrapPacket(AVPacket* pkt) {
+    AVBufferRef* ref = pkt->buf != nullptr ? av_buffer_ref(pkt->buf) : nullptr;
+    if (ref == nullptr) return MediaBuffer::copyOf(pkt->data, (size_t) pkt->size);
+    return MediaBuffer::wrap(pkt->data, (size_t) pkt->size, [](void* o) { auto* r = static_cast<AVBufferRef*>(o); av_buffer_unref(&r); }, ref);
+}
+
+AVPixelFormat pickPixelFormat(const AVCodec* codec) {
+    if (codec->pix_fmts == nullptr) return AV_PIX_FMT_YUV420P;
+    for (const AVPixelFormat* f = codec->pix_fmts; *f != AV_PIX_FMT_NONE; ++f)
+        if (*f == AV_PIX_FMT_YUV420P) return *f;
+    return codec->pix_fmts[0];
+}
+
+AVPixelFormat toAVPixelFormat(RawVideoFrame::PixelFormat f) {
+    switch (f) {
+        case RawVideoFrame::PixelFormat::nv12:    return AV_PIX_FMT_NV12;
+        case RawVideoFrame::PixelFormat::yuv420p: return AV_PIX_FMT_YUV420P;
+        case RawVideoFrame::PixelFormat::bgra:    break;
+    }
+    return AV_PIX_FMT_BGRA;
+}
+} // namespace
+#endif
+
+struct FfmpegEncoder::Impl {
+    StreamingConfig cfg;
+    Callbacks cb;
+    std::atomic<bool> running { false };
+    std::atomic<int> targetKbps { 0 };
+    std::atomic<bool> forceKeyframe { false };
+
+#if HAVE_FFMPEG
+    // Video: encoded on the caller's thread; videoMutex only guards against stop()
+    std::mutex videoMutex;
+    AVCodecContext* venc { nullptr };
+    SwsContext* sws { nullptr };
+    AVFrame* vframe { nullptr };
+    AVPacket* vpkt { nullptr };
+    juce::int64 frameIndex { 0 };
+    int appliedKbps { 0 };
+    bool isX264 { false };
+    std::vector<Nal> nals;
+
+    // Caller's ptsMs by frame index, looked up again when the packet comes out
+    static constexpr int kPtsSlots = 64;
+    juce::int64 ptsByIndex[kPtsSlots] {};
+
+    // CBR keeps a one-second VBV (as the VT data-rate window); VBR may peak at 1.5x
+    void setRateControl(int kbps) {
+        venc->bit_rate = (int64_t) kbps * 1000;
+        venc->rc_max_rate = cfg.constantBitrate ? venc->bit_rate : venc->bit_rate * 3 / 2;
+        venc->rc_buffer_size = (int) (cfg.constantBitrate ? venc->bit_rate : venc->bit_rate * 2);
+        appliedKbps = kbps;
+    }
+
+    bool openVideo() {
+        const AVCodec* codec = avcodec_find_encoder_by_name("libx264");
+        if (codec == nullptr) codec = avcodec_find_encoder_by_name("libopenh264");
+        if (codec == nullptr) codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+        if (codec == nullptr) { LogMessage("FFENC: no H.264 encoder in this FFmpeg build"); return false; }
+        isX264 = std::strcmp(codec->name, "libx264") == 0;
+        venc = avcodec_alloc_context3(codec);
+        if (venc == nullptr) return false;
+        const int fps = juce::jmax(1, cfg.fps);
+        venc->width = cfg.videoWidth;
+        venc->height = cfg.videoHeight;
+        venc->time_base = AVRational{ 1, fps };
+        venc->framerate = AVRational{ fps, 1 };
+        venc->gop_size = juce::jmax(1, cfg.keyframeIntervalSec) * fps;
+        venc->max_b_frames = 0;
+        venc->pix_fmt = pickPixelFormat(codec);
+        venc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        venc->thread_count = 0;
+        setRateControl(targetKbps.load() > 0 ? targetKbps.load() : cfg.videoBitrateKbps);
+        targetKbps.store(appliedKbps);
+
+        AVDictionary* opts = nullptr;
+        if (isX264) {
+            av_dict_set(&opts, "preset", "veryfast", 0);
+            av_dict_set(&opts, "tune", "zerolatency", 0);
+            av_dict_set(&opts, "profile", "high", 0);
+            av_dict_set(&opts, "forced-idr", "1", 0);
+            if (cfg.constantBitrate) av_dict_set(&opts, "nal-hrd", "cbr", 0);
+        }
+        const int ret = avcodec_open2(venc, codec, &opts);
+        av_dict_free(&opts);
+        if (ret < 0) { LogMessage("FFENC: open " + juce::String(codec->name) + " failed -> " + ffErr(ret)); return false; }
+
+        vframe = av_frame_alloc();
+        vpkt = av_packet_alloc();
+        if (vframe == nullptr || vpkt == nullptr) return false;
+        vframe->format = venc->pix_fmt;
+        vframe->width = venc->width;
+        vframe->height = venc->height;
+        if (av_frame_get_buffer(vframe, 0) < 0) return false;
+        frameIndex = 0;
+
+        juce::MemoryOutputStream avcc(256);
+        if (!buildAvcC(venc->extradata, (size_t) juce::jmax(0, venc->extradata_size), avcc)) { LogMessage("FFENC: encoder produced no SPS/PPS"); return false; }
+        cb.videoConfig(avcc.getData(), avcc.getDataSize());
+        LogMessage("FFENC: video " + juce::String(codec->name) + " " + juce::String(venc->width) + "x" + juce::String(venc->height) + "@" + juce::String(fps)
+                   + " " + juce::String(appliedKbps) + " kbps" + (cfg.constantBitrate ? " CBR" : "") + " gop=" + juce::String(venc->gop_size));
+        return true;
+    }
+
+    void close() {
+        if (sws != nullptr) { sws_freeContext(sws); sws = nullptr; }
+        if (vframe != nullptr) av_frame_free(&vframe);
+        if (vpkt != nullptr) av_packet_free(&vpkt);
+        if (venc != nullptr) avcodec_free_context(&venc);
+    }
+
+    // FLV wants length-prefixed NAL units. Rewritten in place when every start code is 4 bytes;
+    // x264 separates the slices of one picture with 3-byte codes, which needs one counted copy.
+    MediaBuffer::Ptr toAvcc(AVPacket* pkt) {
+        if (av_packet_make_writable(pkt) < 0) return nullptr;
+        splitAnnexB(pkt->data, (size_t) pkt->size, nals);
+        if (nals.empty()) return wrapPacket(pkt);
+        bool inPlace = nals.front().data == pkt->data + 4;
+        size_t total = 0;
+        for (const auto& nal : nals) { inPlace = inPlace && nal.startCodeLen == 4; total += 4 + nal.size; }
+        if (inPlace) {
+            for (const auto& nal : nals) juce::ByteOrder::writeBigEndianInt(const_cast<uint8_t*>(nal.data) - 4, (juce::uint32) nal.size);
+            return wrapPacket(pkt);
+        }
+        auto* block = static_cast<uint8_t*>(std::malloc(total));
+        if (block == nullptr) return nullptr;
+        uint8_t* w = block;
+        for (const auto& nal : nals) {
+            juce::ByteOrder::writeBigEndianInt(w, (juce::uint32) nal.size);
+            memcpy(w + 4, nal.data, nal.size);
+            w += 4 + nal.size;
+        }
+        MediaBuffer::noteCopied(total);
+        return MediaBuffer::wrap(block, total, [](void* p) { std::free(p); }, block);
+    }
+
+    bool encodeVideo(const RawVideoFrame& f) {
+        if (venc == nullptr || f.planes[0] == nullptr || f.width <= 0 || f.height <= 0) return false;
+        // libx264 reconfigures the running encoder when the rate fields change between frames
+        const int kbps = targetKbps.load();
+        if (kbps > 0 && kbps != appliedKbps) setRateControl(kbps);
+
+        sws = sws_getCachedContext(sws, f.width, f.height, toAVPixelFormat(f.format), venc->width, venc->height, venc->pix_fmt,
+                                   SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+        if (sws == nullptr) { LogMessage("FFENC: no scaler for " + juce::String(f.width) + "x" + juce::String(f.height)); return false; }
+        if (av_frame_make_writable(vframe) < 0) return false;
+        const uint8_t* src[4] = { f.planes[0], f.planes[1], f.planes[2], nullptr };
+        const int srcStride[4] = { f.strides[0], f.strides[1], f.strides[2], 0 };
+        sws_scale(sws, src, srcStride, 0, f.height, vframe->data, vframe->linesize);
+
+        const bool forceKey = frameIndex == 0 || forceKeyframe.exchange(false);
+        vframe->pict_type = forceKey ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        ptsByIndex[frameIndex % kPtsSlots] = f.ptsMs;
+        vframe->pts = frameIndex++;
+        int ret = avcodec_send_frame(venc, vframe);
+        if (ret < 0) { LogMessage("FFENC: send video frame failed -> " + ffErr(ret)); return false; }
+        while ((ret = avcodec_receive_packet(venc, vpkt)) == 0) {
+            const bool keyframe = (vpkt->flags & AV_PKT_FLAG_KEY) != 0;
+            const juce::int64 ptsMs = ptsByIndex[(vpkt->pts >= 0 ? vpkt->pts : 0) % kPtsSlots];
+            if (auto frame = toAvcc(vpkt)) cb.video(std::move(frame), ptsMs, keyframe);
+            av_packet_unref(vpkt);
+        }
+        return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+    }
+#endif
+};
+
+FfmpegEncoder::FfmpegEncoder() : impl(std::make_unique<Impl>()) {}
+FfmpegEncoder::~FfmpegEncoder() { stop(); }
+
+bool FfmpegEncoder::start(const StreamingConfig& cfg, Callbacks callbacks) {
+#if HAVE_FFMPEG
+    stop();
+    impl->cfg = cfg;
+    impl->cb = std::move(callbacks);
+    impl->forceKeyframe.store(false);
+    if (!impl->openVideo()) { impl->close(); return false; }
+    impl->running.store(true);
+    return true;
+#else
+    juce::ignoreUnused(cfg, callbacks);
+    LogMessage("FFENC: not available (HAVE_FFMPEG off)");
+    return false;
+#endif
+}
+
+void FfmpegEncoder::stop() {
+#if HAVE_FFMPEG
+    impl->running.store(false);
+    std::lock_guard<std::mutex> lk(impl->videoMutex);
+    impl->close();
+#endif
+}
+
+bool FfmpegEncoder::encodeVideo(const RawVideoFrame& frame) {
+#if HAVE_FFMPEG
+    if (!impl->running.load()) return false;
+    std::lock_guard<std::mutex> lk(impl->videoMutex);
+    return impl->encodeVideo(frame);
+#else
+    juce::ignoreUnused(frame);
+    return false;
+#endif
+}
+
+juce::String FfmpegEncoder::getName() const {
+#if HAVE_FFMPEG
+    if (impl->venc != nullptr && impl->venc->codec != nullptr) return "libavcodec/" + juce::String(impl->venc->codec->name);
+#endif
+    return "libavcodec";
+}
+
+bool FfmpegEncoder::setTargetBitrate(int kbps) {
+    if (kbps <= 0) return false;
+    impl->targetKbps.store(kbps);
+#if HAVE_FFMPEG
+    // Other H.264 encoders only read the rate at open
+    return !impl->running.load() || impl->isX264;
+#else
+    return false;
+#endif
+}
+
+int FfmpegEncoder::getTargetBitrate() const { return impl->targetKbps.load(); }
+void FfmpegEncoder::requestKeyframe() { impl->forceKeyframe.store(true); }
+
+std::unique_ptr<EncoderBackend> EncoderBackend::createSoftware() {
+#if HAVE_FFMPEG
+    return std::make_unique<FfmpegEncoder>();
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include "EncoderBackend.h"
+
+namespace streaming {
+
+// Software encoder on libavcodec: libx264 (veryfast/zerolatency, no B-frames) or whatever H.264
+// encoder the FFmpeg build offers. Pictures go through swscale.
+class FfmpegEncoder final : public EncoderBackend {
+public:
+    FfmpegEncoder();
+    ~FfmpegEncoder() override;
+
+    bool start(const StreamingConfig& cfg, Callbacks callbacks) override;
+    void stop() override;
+    bool encodeVideo(const RawVideoFrame& frame) override;
+    juce::String getName() const override;
+
+    bool setTargetBitrate(int kbps) override;
+    int getTargetBitrate() const override;
+    void requestKeyframe() override;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+} // namespace streaming
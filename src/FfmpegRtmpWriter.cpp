@@ -1,12 +1,19 @@
 #include "FfmpegRtmpWriter.h"
 #include "Logging.h"
+#include "PacketRing.h"
+#include "RealtimeSignal.h"
+#include "PacingScheduler.h"
+#include "GopDropper.h"
+#include "Trace.h"
+#include "Telemetry.h"
 #include <mutex>
 #include <cstdarg>
 #include <atomic>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <chrono>
-#include <deque>
+#include <ctime>
 #include <vector>
 #include <condition_variable>
 #include <thread>
@@ -27,7 +34,7 @@ extern "C" {
 }
 
 // Forward declaration so member methods can call it
-static inline void ff_try_write_header_internal(AVFormatContext* fmt, bool haveVideoConfig, bool haveAudioConfig, bool& headerWritten, AVDictionary** muxerOpts);
+static inline void ff_try_write_header_internal(AVFormatContext* fmt, bool haveVideoConfig, bool haveAudioConfig, std::atomic<bool>& headerWritten, AVDictionary** muxerOpts);
 
 static inline juce::String ff_err2str(int err) {
     char buf[AV_ERROR_MAX_STRING_SIZE] = {0};
@@ -35,18 +42,78 @@ static inline juce::String ff_err2str(int err) {
     return juce::String(buf);
 }
 
+// libav* lines go through the trace gate; the context a line comes from picks the subsystem
+static streaming::Trace::Subsystem ff_subsystem(void* ptr) {
+    using streaming::Trace;
+    const AVClass* avc = ptr != nullptr ? *(const AVClass**) ptr : nullptr;
+    if (avc == nullptr) return Trace::ffmpeg;
+    // Protocols and muxers name themselves through item_name ("rtmps", "tls", "tcp", "flv")
+    const char* name = avc->item_name != nullptr ? avc->item_name(ptr) : avc->class_name;
+    if (name == nullptr) return Trace::ffmpeg;
+    if (std::strncmp(name, "rtmp", 4) == 0 || std::strcmp(name, "tcp") == 0) return Trace::rtmp;
+    if (std::strcmp(name, "tls") == 0) return Trace::tls;
+    if (std::strncmp(name, "flv", 3) == 0) return Trace::flv;
+    return Trace::ffmpeg;
+}
+
+static streaming::Trace::Level ff_trace_level(int avLevel) {
+    using streaming::Trace;
+    if (avLevel <= AV_LOG_ERROR) return Trace::error;
+    if (avLevel <= AV_LOG_WARNING) return Trace::warning;
+    if (avLevel <= AV_LOG_INFO) return Trace::info;
+    if (avLevel <= AV_LOG_VERBOSE) return Trace::verbose;
+    if (avLevel <= AV_LOG_DEBUG) return Trace::debug;
+    return Trace::trace;
+}
+
 static void ff_log_cb(void* ptr, int level, const char* fmt, va_list vl) {
-    juce::ignoreUnused(ptr);
-    if (level > AV_LOG_TRACE) return; // capture TRACE and below
+    const auto subsystem = ff_subsystem(ptr);
+    const auto traceLevel = ff_trace_level(level);
+    if (!streaming::Trace::enabled(subsystem, traceLevel)) return; // before any formatting
     char msg[1024];
     vsnprintf(msg, sizeof(msg), fmt, vl);
-    juce::String s(msg);
-    s = s.trim();
-    if (s.isNotEmpty()) LogMessage("FFMPEG-LOG: " + s);
+    const auto s = juce::String(msg).trim();
+    if (s.isNotEmpty()) streaming::Trace::write(subsystem, traceLevel, fmt, s);
+}
+
+// libav*'s own gate sits ahead of the callback: keep it at the most verbose subsystem's level, so
+// lines nobody asked for are never even handed over
+static void ff_sync_log_level() {
+    static const int avLevels[] = { AV_LOG_QUIET, AV_LOG_ERROR, AV_LOG_WARNING, AV_LOG_INFO, AV_LOG_VERBOSE, AV_LOG_DEBUG, AV_LOG_TRACE };
+    av_log_set_level(avLevels[streaming::Trace::getMaxLevel()]);
+}
+
+// Thread CPU time, for the egress thread's cost report
+static juce::int64 thread_cpu_micros() {
+#if JUCE_MAC || defined(__APPLE__) || defined(__unix__)
+    timespec ts {};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) return (juce::int64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+    return 0;
+}
+
+// Video this far behind its due time starts shedding up to the next keyframe
+static constexpr int kMaxVideoLateMs = 1000;
+
+// Process-wide FFmpeg setup runs once; all write state is per writer so streams never serialize each other
+static std::once_flag g_ffmpegInitOnce;
+static void ff_global_init() {
+    std::call_once(g_ffmpegInitOnce, [] {
+        avformat_network_init();
+        streaming::Trace::configureFromEnvironment();
+        av_log_set_callback(ff_log_cb);
+    });
 }
 #endif
 
-static std::mutex g_ffmpegWriteMutex;
+static inline bool is_network_broken(int err) {
+#if HAVE_FFMPEG
+    return err == AVERROR(EPIPE) || err == AVERROR_EOF || err == AVERROR(ECONNRESET) || err == AVERROR(ETIMEDOUT) || err == AVERROR(EIO);
+#else
+    juce::ignoreUnused(err);
+    return false;
+#endif
+}
 
 static juce::String derive_tcurl(const juce::String& rtmpUrl) {
     auto idx = rtmpUrl.indexOfIgnoreCase("/rtmp/");
@@ -65,9 +132,11 @@ struct FfmpegRtmpWriter::Impl {
     AVStream* vstream = nullptr;
     AVStream* astream = nullptr;
     juce::String url;
-    bool headerWritten { false };
+    std::atomic<bool> headerWritten { false };
     bool haveVideoConfig { false };
     bool haveAudioConfig { false };
+    // Guards fmt/streams/extradata for this writer only; never held across a connect
+    std::mutex ioMutex;
     // Cached extradata for reconnects
     juce::MemoryBlock vExtra;
     juce::MemoryBlock aExtra;
@@ -84,13 +153,47 @@ struct FfmpegRtmpWriter::Impl {
     AVDictionary* muxerOpts { nullptr }; // flvflags, etc.
 
     std::atomic<bool> isOpen { false };
-    struct QueuedPacket { bool isVideo { true }; bool keyframe { false }; std::vector<uint8_t> bytes; int64_t ptsMs { 0 }; int durationMs { 0 }; };
-    std::deque<QueuedPacket> egressQueue; std::mutex egressMutex; std::condition_variable egressCv; std::thread egressThread; std::atomic<bool> egressRunning { false }; std::chrono::steady_clock::time_point wallStart; bool egressBaseAligned { false }; std::atomic<int64_t> lastVideoSentRelMs { 0 }; double tokensBytes { 0.0 }; double bucketCapacityBytes { 0.0 }; double fillRateBytesPerSec { 0.0 }; std::chrono::steady_clock::time_point lastTokenUpdate;
+    // close() quiesces producers before the rings are reset. isOpen alone can't: a producer may pass its check
+    // and still be inside push() when the reset runs, and reconnects flip isOpen without closing.
+    std::atomic<bool> admitting { false }; std::atomic<int> producersInside { 0 };
+    struct ProducerScope {
+        explicit ProducerScope(Impl& o) : owner(o) { owner.producersInside.fetch_add(1); admitted = owner.admitting.load(); }
+        ~ProducerScope() { owner.producersInside.fetch_sub(1); }
+        Impl& owner; bool admitted { false };
+    };
+    // One SPSC ring per producer (video and audio are written from different threads); egress merges by PTS
+    streaming::PacketRing videoRing, audioRing; streaming::RealtimeSignal egressSignal; std::atomic<juce::uint64> ringDrops { 0 }; std::thread egressThread; std::atomic<bool> egressRunning { false }; juce::int64 egressOriginUs { 0 }; bool egressBaseAligned { false }; std::atomic<int64_t> lastVideoSentRelMs { 0 }; streaming::TokenBucket egressBucket;
+    // Egress counters behind getStats(): queued = bytesQueued - bytesReleased
+    std::atomic<juce::uint64> bytesSent { 0 }, bytesQueued { 0 }, bytesReleased { 0 }; std::atomic<int64_t> lastQueuedVideoPtsMs { 0 };
 
     // Reconnect/backoff state
     std::atomic<int> reconnectAttempts { 0 };
     std::chrono::steady_clock::time_point lastReconnectAt { std::chrono::steady_clock::now() - std::chrono::seconds(60) };
     std::chrono::steady_clock::time_point openedAt { std::chrono::steady_clock::now() };
+    // Reconnects run on their own thread so a slow connect never stalls the egress path
+    std::thread reconnectThread; std::mutex reconnectMutex; std::condition_variable reconnectCv;
+    std::atomic<bool> reconnectRequested { false };
+    std::atomic<bool> closing { false }; // also aborts blocking FFmpeg I/O via the interrupt callback
+    std::atomic<bool> needKeyframe { false }; // after a reconnect, hold video until the next IDR
+    streaming::GopDropper gop; // egress thread only
+
+    // Telemetry, shared by every writer in the process
+    streaming::Telemetry::Histogram& sendLatencyMetric = streaming::Telemetry::getInstance().histogram("latency.sendUs"); // queued -> written
+    streaming::Telemetry::GaugeShare queuedBytesMetric { streaming::Telemetry::getInstance().gauge("egress.queuedBytes") };
+    streaming::Telemetry::GaugeShare queuedPacketsMetric { streaming::Telemetry::getInstance().gauge("egress.queuedPackets") };
+    streaming::Telemetry::Counter& bytesSentMetric = streaming::Telemetry::getInstance().counter("egress.bytesSent");
+    streaming::Telemetry::Counter& ringDropsMetric = streaming::Telemetry::getInstance().counter("egress.droppedPackets");
+    streaming::Telemetry::Counter& shedFramesMetric = streaming::Telemetry::getInstance().counter("egress.shedVideoFrames");
+    streaming::Telemetry::Counter& reconnectsMetric = streaming::Telemetry::getInstance().counter("egress.reconnects");
+
+    static int interrupt_cb(void* opaque) { return static_cast<Impl*>(opaque)->closing.load() ? 1 : 0; }
+
+    static void free_context(AVFormatContext* ctx, bool writeTrailer) {
+        if (!ctx) return;
+        if (writeTrailer) av_write_trailer(ctx);
+        if (ctx->pb) avio_closep(&ctx->pb);
+        avformat_free_context(ctx);
+    }
 
     void build_io_options() {
         if (ioOpts) { av_dict_free(&ioOpts); ioOpts = nullptr; }
@@ -185,11 +288,10 @@ struct FfmpegRtmpWriter::Impl {
 
     void note_reconnect_attempt(bool success) {
         lastReconnectAt = std::chrono::steady_clock::now();
-        if (success) reconnectAttempts.store(0); else reconnectAttempts.fetch_add(1);
+        if (success) { reconnectAttempts.store(0); reconnectsMetric.add(); } else reconnectAttempts.fetch_add(1);
     }
 
     bool reopen() {
-        std::lock_guard<std::mutex> lk(g_ffmpegWriteMutex);
         // Preview guard: if repeated failures occur shortly after opening, avoid
         // hammering the server while user hasn't clicked "Go Live" yet.
         using namespace std::chrono;
@@ -202,167 +304,264 @@ struct FfmpegRtmpWriter::Impl {
             LogMessage("FFMPEG: backoff active, skipping reconnect");
             return false;
         }
-        if (fmt) {
-            if (headerWritten) av_write_trailer(fmt);
-            if (fmt->pb) avio_closep(&fmt->pb);
-            avformat_free_context(fmt);
-            fmt = nullptr; vstream = nullptr; astream = nullptr; headerWritten = false;
+        // Detach the dead context under the lock; tear it down and connect the new one without it
+        AVFormatContext* oldfmt = nullptr;
+        juce::MemoryBlock vCfg, aCfg;
+        {
+            std::lock_guard<std::mutex> lk(ioMutex);
+            oldfmt = fmt;
+            fmt = nullptr; vstream = nullptr; astream = nullptr; headerWritten.store(false);
+            isOpen.store(false);
+            vCfg = vExtra; aCfg = aExtra;
         }
+        free_context(oldfmt, false); // connection is gone: no trailer
         AVFormatContext* newfmt = nullptr;
         juce::String trimmed = url.trim();
         // Keep original hostname to preserve RTMP vhost/TLS SNI; do not rewrite to IPv4.
         if (avformat_alloc_output_context2(&newfmt, nullptr, "flv", trimmed.toRawUTF8()) < 0 || newfmt == nullptr) {
             LogMessage("FFMPEG: reconnect alloc failed");
-            isOpen.store(false);
             note_reconnect_attempt(false);
             return false;
         }
+        newfmt->interrupt_callback = { &Impl::interrupt_cb, this };
         // Tighten interleave queue threshold to 0ms (no backlog bursts)
         av_opt_set_int(newfmt, "max_interleave_delta", 0, 0);
 
         AVStream* v = avformat_new_stream(newfmt, nullptr);
-        if (!v) { avformat_free_context(newfmt); LogMessage("FFMPEG: reconnect new video stream failed"); isOpen.store(false); return false; }
+        if (!v) { avformat_free_context(newfmt); LogMessage("FFMPEG: reconnect new video stream failed"); return false; }
         v->id = 0; v->time_base = AVRational{1, 1000}; v->codecpar->codec_type = AVMEDIA_TYPE_VIDEO; v->codecpar->codec_id = AV_CODEC_ID_H264; v->codecpar->width = videoWidth; v->codecpar->height = videoHeight;
-        if (vExtra.getSize() > 0) {
-            v->codecpar->extradata = (uint8_t*) av_malloc((int)vExtra.getSize() + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (vCfg.getSize() > 0) {
+            v->codecpar->extradata = (uint8_t*) av_malloc((int)vCfg.getSize() + AV_INPUT_BUFFER_PADDING_SIZE);
             if (v->codecpar->extradata) {
-                memcpy(v->codecpar->extradata, vExtra.getData(), vExtra.getSize());
-                memset(v->codecpar->extradata + vExtra.getSize(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
-                v->codecpar->extradata_size = (int) vExtra.getSize();
+                memcpy(v->codecpar->extradata, vCfg.getData(), vCfg.getSize());
+                memset(v->codecpar->extradata + vCfg.getSize(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
+                v->codecpar->extradata_size = (int) vCfg.getSize();
             }
-            haveVideoConfig = true;
         }
         AVStream* a = avformat_new_stream(newfmt, nullptr);
-        if (!a) { avformat_free_context(newfmt); LogMessage("FFMPEG: reconnect new audio stream failed"); isOpen.store(false); return false; }
+        if (!a) { avformat_free_context(newfmt); LogMessage("FFMPEG: reconnect new audio stream failed"); return false; }
         a->id = 1; a->time_base = AVRational{1, 1000}; a->codecpar->codec_type = AVMEDIA_TYPE_AUDIO; a->codecpar->codec_id = AV_CODEC_ID_AAC; a->codecpar->sample_rate = audioSampleRate;
-        if (aExtra.getSize() > 0) {
-            a->codecpar->extradata = (uint8_t*) av_malloc((int)aExtra.getSize() + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (aCfg.getSize() > 0) {
+            a->codecpar->extradata = (uint8_t*) av_malloc((int)aCfg.getSize() + AV_INPUT_BUFFER_PADDING_SIZE);
             if (a->codecpar->extradata) {
-                memcpy(a->codecpar->extradata, aExtra.getData(), aExtra.getSize());
-                memset(a->codecpar->extradata + aExtra.getSize(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
-                a->codecpar->extradata_size = (int) aExtra.getSize();
+                memcpy(a->codecpar->extradata, aCfg.getData(), aCfg.getSize());
+                memset(a->codecpar->extradata + aCfg.getSize(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
+                a->codecpar->extradata_size = (int) aCfg.getSize();
             }
-            haveAudioConfig = true;
         }
         build_io_options();
         build_muxer_options();
         int ret = 0;
         if (!(newfmt->oformat->flags & AVFMT_NOFILE)) {
-            ret = avio_open2(&newfmt->pb, trimmed.toRawUTF8(), AVIO_FLAG_WRITE, nullptr, &ioOpts);
+            ret = avio_open2(&newfmt->pb, trimmed.toRawUTF8(), AVIO_FLAG_WRITE, &newfmt->interrupt_callback, &ioOpts);
             if (ret < 0) {
                 LogMessage("FFMPEG: reconnect avio_open2 failed -> " + ff_err2str(ret));
                 AVDictionary* tls = nullptr; av_dict_set(&tls, "tls_verify", "0", 0);
-                ret = avio_open2(&newfmt->pb, trimmed.toRawUTF8(), AVIO_FLAG_WRITE, nullptr, &tls);
+                ret = avio_open2(&newfmt->pb, trimmed.toRawUTF8(), AVIO_FLAG_WRITE, &newfmt->interrupt_callback, &tls);
                 av_dict_free(&tls);
-                if (ret < 0) { avformat_free_context(newfmt); isOpen.store(false); note_reconnect_attempt(false); return false; }
+                if (ret < 0) { avformat_free_context(newfmt); note_reconnect_attempt(false); return false; }
             }
         }
-        if (haveVideoConfig) {
+        bool newHeader = false;
+        if (vCfg.getSize() > 0) {
             if (avformat_write_header(newfmt, &muxerOpts) < 0) {
                 LogMessage("FFMPEG: reconnect write_header failed");
-                if (newfmt->pb) avio_closep(&newfmt->pb);
-                avformat_free_context(newfmt);
-                isOpen.store(false);
+                free_context(newfmt, false);
                 note_reconnect_attempt(false);
                 return false;
             }
-            headerWritten = true;
-        } else {
-            headerWritten = false;
+            newHeader = true;
+        }
+        {
+            std::lock_guard<std::mutex> lk(ioMutex);
+            fmt = newfmt; vstream = v; astream = a;
+            haveVideoConfig = vCfg.getSize() > 0; haveAudioConfig = aCfg.getSize() > 0;
+            headerWritten.store(newHeader);
+            needKeyframe.store(true);
+            isOpen.store(true);
         }
-        fmt = newfmt; vstream = v; astream = a;
-        isOpen.store(true);
         LogMessage("FFMPEG: reconnected");
         note_reconnect_attempt(true);
         return true;
     }
 
+    void requestReconnect() {
+        {
+            std::lock_guard<std::mutex> lk(reconnectMutex);
+            reconnectRequested.store(true);
+        }
+        reconnectCv.notify_all();
+    }
+
+    void startReconnectThread() {
+        if (reconnectThread.joinable()) return;
+        reconnectThread = std::thread([this]{ reconnectLoop(); });
+    }
+
+    void stopReconnectThread() {
+        {
+            std::lock_guard<std::mutex> lk(reconnectMutex);
+            closing.store(true);
+        }
+        reconnectCv.notify_all();
+        if (reconnectThread.joinable()) reconnectThread.join();
+        reconnectRequested.store(false);
+    }
+
+    void reconnectLoop() {
+        std::unique_lock<std::mutex> lk(reconnectMutex);
+        while (!closing.load()) {
+            reconnectCv.wait(lk, [&]{ return reconnectRequested.load() || closing.load(); });
+            if (closing.load()) break;
+            lk.unlock();
+            const bool ok = reopen();
+            lk.lock();
+            if (ok) { reconnectRequested.store(false); continue; }
+            // Still broken: retry once the backoff allows (reopen() enforces the actual schedule)
+            reconnectCv.wait_for(lk, std::chrono::seconds(1), [&]{ return closing.load(); });
+        }
+    }
+
     void startEgressIfNeeded() {
-        if (egressRunning.load()) return;
-        egressRunning.store(true);
-        wallStart = std::chrono::steady_clock::now();
+        // Video, audio and config threads may race here; exactly one wins the exchange and starts the thread
+        bool expected = false;
+        if (!egressRunning.compare_exchange_strong(expected, true)) return;
         egressBaseAligned = false;
-        tokensBytes = 0.0;
-        bucketCapacityBytes = std::max(1024.0, (double)(videoBitrateKbps + audioBitrateKbps) * 1000.0 / 8.0);
-        fillRateBytesPerSec = (double)(videoBitrateKbps + audioBitrateKbps) * 1000.0 / 8.0;
-        lastTokenUpdate = std::chrono::steady_clock::now();
+        gop.reset();
+        // One second of the nominal rate as burst; refill at the nominal rate
+        const double bytesPerSec = (double)(videoBitrateKbps + audioBitrateKbps) * 1000.0 / 8.0;
+        egressBucket.configure(bytesPerSec, std::max(1024.0, bytesPerSec), streaming::PrecisionClock::nowMicros());
         egressThread = std::thread([this]{ egressLoop(); });
     }
 
+    void allocateRings() {
+        // ~4 s of video at the configured bitrate (at least 8 MB) so a keyframe burst never fails to fit
+        const size_t videoSlab = std::max<size_t>(8u << 20, (size_t) videoBitrateKbps * 1000 / 8 * 4);
+        videoRing.allocate(512, videoSlab);
+        audioRing.allocate(512, 1u << 20);
+        ringDrops.store(0);
+    }
+
     void stopEgress() {
         if (!egressRunning.load()) return;
         egressRunning.store(false);
-        egressCv.notify_all();
+        egressSignal.notify();
         if (egressThread.joinable()) egressThread.join();
-        std::lock_guard<std::mutex> lk(egressMutex);
-        egressQueue.clear();
+        videoRing.reset();
+        audioRing.reset();
+        bytesQueued.store(0); bytesReleased.store(0);
         egressBaseAligned = false;
     }
 
+    // `buffer` set: queued by reference, otherwise `data` is copied into the ring's slab
+    bool enqueue(streaming::PacketRing& ring, const streaming::MediaBuffer::Ptr& buffer, const void* data, size_t size, int64_t ptsMs, int durationMs, bool isVideo, bool keyframe) {
+        const bool pushed = buffer != nullptr ? ring.push(buffer, ptsMs, durationMs, isVideo, keyframe)
+                                              : ring.push(data, size, ptsMs, durationMs, isVideo, keyframe);
+        if (!pushed) {
+            ringDropsMetric.add();
+            if (ringDrops.fetch_add(1) == 0) LogEvent("FFMPEG: egress ring full, dropping packets");
+            return false;
+        }
+        bytesQueued.fetch_add(size);
+        if (isVideo) lastQueuedVideoPtsMs.store(ptsMs);
+        egressSignal.notify();
+        return true;
+    }
+
+    bool writeVideo(const streaming::MediaBuffer::Ptr& buffer, const void* data, size_t size, int64_t ptsMs, bool keyframe) {
+        const ProducerScope scope(*this);
+        if (!scope.admitted || !isOpen.load()) return false;
+        // Avoid pre-header backlog: drop frames until header is written
+        if (!headerWritten.load()) return true;
+        startEgressIfNeeded();
+        const int frameDurMs = (fps > 0) ? (int) std::lround(1000.0 / (double) fps) : 33;
+        return enqueue(videoRing, buffer, data, size, ptsMs, frameDurMs, true, keyframe);
+    }
+
+    bool writeAudio(const streaming::MediaBuffer::Ptr& buffer, const void* data, size_t size, int64_t ptsMs) {
+        const ProducerScope scope(*this);
+        if (!scope.admitted || !isOpen.load()) return false;
+        // Avoid pre-header backlog and ensure audio after first video
+        if (!headerWritten.load()) return true;
+        startEgressIfNeeded();
+        const int aacFrameDurMs = (int) std::lround(1024.0 * 1000.0 / (double) audioSampleRate);
+        return enqueue(audioRing, buffer, data, size, ptsMs, aacFrameDurMs, false, false);
+    }
+
+    void release(streaming::PacketRing& ring, size_t size) { bytesReleased.fetch_add(size); ring.pop(); }
+
     void egressLoop() {
+        const juce::int64 cpuStartUs = thread_cpu_micros(), wallStartUs = streaming::PrecisionClock::nowMicros();
         while (egressRunning.load()) {
-            QueuedPacket pkt;
-            bool hasPkt = false;
+            // Next packet in PTS order across both rings
+            const streaming::PacketRing::Packet* v = videoRing.front();
+            const streaming::PacketRing::Packet* a = audioRing.front();
+            if (v == nullptr && a == nullptr) { egressSignal.wait(100); continue; }
+            const bool takeVideo = v != nullptr && (a == nullptr || v->ptsMs <= a->ptsMs);
+            streaming::PacketRing& ring = takeVideo ? videoRing : audioRing;
+            const streaming::PacketRing::Packet& pkt = *(takeVideo ? v : a);
+            queuedPacketsMetric.set(videoRing.getNumReady() + audioRing.getNumReady());
+            queuedBytesMetric.set((juce::int64) (bytesQueued.load() - bytesReleased.load()));
+            if (!egressBaseAligned) {
+                egressOriginUs = streaming::PrecisionClock::nowMicros() - pkt.ptsMs * 1000;
+                egressBaseAligned = true;
+            }
+            // Wait until due (microsecond deadline); a new packet, possibly earlier on the other stream, wakes us early
+            const juce::int64 dueUs = egressOriginUs + pkt.ptsMs * 1000;
+            const juce::int64 nowUs = streaming::PrecisionClock::nowMicros();
+            if (dueUs > nowUs) { streaming::PrecisionClock::waitUntilMicros(dueUs, egressSignal); continue; }
+
+            // Video running more than kMaxVideoLateMs behind opens a gap up to the next keyframe; audio is never shed here
+            if (pkt.isVideo) {
+                if (needKeyframe.exchange(false)) gop.requireKeyframe();
+                if (!gop.admit(pkt.keyframe, nowUs - dueUs > (juce::int64) kMaxVideoLateMs * 1000)) { shedFramesMetric.add(); release(ring, pkt.size); continue; }
+            }
+
+            // Token bucket pacing; an oversized keyframe goes out once the bucket is full and leaves it in debt
+            const juce::int64 tokenWaitUs = egressBucket.microsUntil((double) pkt.size, nowUs);
+            if (tokenWaitUs > 0) streaming::PrecisionClock::sleepUntilMicros(nowUs + tokenWaitUs);
+            egressBucket.consume((double) pkt.size);
+
+            // Send via FFmpeg. While a reconnect is in flight packets are dropped, not queued.
+            if (!isOpen.load()) { release(ring, pkt.size); continue; }
+            int ret = 0;
             {
-                std::unique_lock<std::mutex> lk(egressMutex);
-                egressCv.wait_for(lk, std::chrono::milliseconds(5), [&]{ return !egressQueue.empty() || !egressRunning.load(); });
-                if (!egressRunning.load()) break;
-                if (egressQueue.empty()) continue;
-                if (!egressBaseAligned) {
-                    wallStart = std::chrono::steady_clock::now() - std::chrono::milliseconds(egressQueue.front().ptsMs);
-                    egressBaseAligned = true;
-                }
-                // Drop late non-keyframes if backlog too large
-                if (egressQueue.front().isVideo && !egressQueue.front().keyframe) {
-                    int64_t headPts = egressQueue.front().ptsMs;
-                    int64_t lag = headPts - lastVideoSentRelMs.load();
-                    if (lag > 1000) { egressQueue.pop_front(); continue; }
-                }
-                // Wait until due
-                auto now = std::chrono::steady_clock::now();
-                int64_t elapsedMs = (int64_t) std::chrono::duration_cast<std::chrono::milliseconds>(now - wallStart).count();
-                if (egressQueue.front().ptsMs > elapsedMs) {
-                    int64_t waitMs = std::min<int64_t>(egressQueue.front().ptsMs - elapsedMs, 5);
-                    lk.unlock();
-                    std::this_thread::sleep_for(std::chrono::milliseconds((int)waitMs));
-                    continue;
-                }
-                pkt = std::move(egressQueue.front());
-                egressQueue.pop_front();
-                hasPkt = true;
+                std::lock_guard<std::mutex> lk(ioMutex);
+                if (isOpen.load() && fmt != nullptr)
+                    ff_try_write_header_internal(fmt, haveVideoConfig, haveAudioConfig, headerWritten, &muxerOpts);
+                if (!isOpen.load() || fmt == nullptr || !headerWritten.load()) { release(ring, pkt.size); continue; }
+                // MediaBuffer packets go out refcounted, so libavformat keeps a reference instead of copying.
+                // Slab packets are not: libavformat copies them, so the slot is released right after.
+                AVPacket avpkt{}; av_init_packet(&avpkt);
+                avpkt.data = const_cast<uint8_t*>(pkt.data); avpkt.size = (int) pkt.size;
+                if (pkt.buffer != nullptr) avpkt.buf = pkt.buffer->toAVBuffer();
+                avpkt.stream_index = pkt.isVideo ? vstream->index : astream->index;
+                avpkt.pts = avpkt.dts = pkt.ptsMs;
+                if (pkt.isVideo && pkt.keyframe) avpkt.flags |= AV_PKT_FLAG_KEY;
+                avpkt.duration = pkt.durationMs;
+                ret = av_interleaved_write_frame(fmt, &avpkt);
+            }
+            const bool wasVideo = pkt.isVideo;
+            const int64_t sentPts = pkt.ptsMs;
+            const size_t sentSize = pkt.size;
+            const juce::int64 queuedUs = pkt.queuedUs;
+            release(ring, sentSize);
+            if (ret >= 0) {
+                bytesSent.fetch_add(sentSize);
+                if (wasVideo) lastVideoSentRelMs.store(sentPts);
+                bytesSentMetric.add(sentSize);
+                sendLatencyMetric.record(streaming::PrecisionClock::nowMicros() - queuedUs);
             }
-            if (!hasPkt) continue;
-
-            // Token bucket pacing
-            auto now2 = std::chrono::steady_clock::now();
-            double dt = std::chrono::duration<double>(now2 - lastTokenUpdate).count();
-            lastTokenUpdate = now2;
-            tokensBytes = std::min(bucketCapacityBytes, tokensBytes + dt * fillRateBytesPerSec);
-            size_t pktSize = pkt.bytes.size();
-            if ((double)pktSize > tokensBytes) {
-                double need = ((double)pktSize - tokensBytes) / fillRateBytesPerSec;
-                if (need > 0.0) std::this_thread::sleep_for(std::chrono::milliseconds((int) std::ceil(need * 1000.0)));
-                now2 = std::chrono::steady_clock::now();
-                dt = std::chrono::duration<double>(now2 - lastTokenUpdate).count();
-                lastTokenUpdate = now2;
-                tokensBytes = std::min(bucketCapacityBytes, tokensBytes + dt * fillRateBytesPerSec);
+            else if (is_network_broken(ret) && !closing.load()) {
+                LogEvent("FFMPEG: write failed -> {}, reconnecting", ff_err2str(ret));
+                isOpen.store(false);
+                requestReconnect();
             }
-            if ((double)pktSize <= tokensBytes) tokensBytes -= (double)pktSize;
-
-            // Send via FFmpeg
-            std::lock_guard<std::mutex> lk(g_ffmpegWriteMutex);
-            if (!isOpen.load()) continue;
-            ff_try_write_header_internal(fmt, haveVideoConfig, haveAudioConfig, headerWritten, &muxerOpts);
-            if (!headerWritten) continue;
-            AVPacket avpkt{}; av_init_packet(&avpkt);
-            avpkt.data = pkt.bytes.data(); avpkt.size = (int) pkt.bytes.size();
-            avpkt.stream_index = pkt.isVideo ? vstream->index : astream->index;
-            avpkt.pts = avpkt.dts = pkt.ptsMs;
-            if (pkt.isVideo && pkt.keyframe) avpkt.flags |= AV_PKT_FLAG_KEY;
-            avpkt.duration = pkt.durationMs;
-            int ret = av_interleaved_write_frame(fmt, &avpkt);
-            if (ret >= 0 && pkt.isVideo) lastVideoSentRelMs.store(pkt.ptsMs);
         }
+        const double cpuMs = (double) (thread_cpu_micros() - cpuStartUs) / 1000.0;
+        const double wallMs = (double) juce::jmax<juce::int64>(1, streaming::PrecisionClock::nowMicros() - wallStartUs) / 1000.0;
+        LogMessage("FFMPEG: egress thread CPU " + juce::String(cpuMs, 1) + " ms over " + juce::String(wallMs / 1000.0, 1)
+                   + " s (" + juce::String(100.0 * cpuMs / wallMs, 2) + "% of a core), " + juce::String((juce::int64) bytesSent.load()) + " bytes sent");
     }
 #endif
 };
@@ -371,37 +570,37 @@ FfmpegRtmpWriter::FfmpegRtmpWriter() : impl(std::make_unique<Impl>()) {}
 FfmpegRtmpWriter::~FfmpegRtmpWriter() { close(); }
 
 #if HAVE_FFMPEG
-static inline void ff_try_write_header_internal(AVFormatContext* fmt, bool haveVideoConfig, bool haveAudioConfig, bool& headerWritten, AVDictionary** muxerOpts) {
-    if (!fmt || headerWritten) return;
+static inline void ff_try_write_header_internal(AVFormatContext* fmt, bool haveVideoConfig, bool haveAudioConfig, std::atomic<bool>& headerWritten, AVDictionary** muxerOpts) {
+    if (!fmt || headerWritten.load()) return;
     if (!haveVideoConfig && !haveAudioConfig) return;
     if (avformat_write_header(fmt, muxerOpts) < 0) {
         LogMessage("FFMPEG: write_header failed");
         return;
     }
-    headerWritten = true;
+    headerWritten.store(true);
     LogMessage("FFMPEG: write_header OK");
 }
 #endif
 
 bool FfmpegRtmpWriter::open(const juce::String& url, const StreamingConfig& cfg) {
 #if HAVE_FFMPEG
-    // Enable deep TLS logging (GnuTLS)
-    setenv("GNUTLS_DEBUG_LEVEL", "6", 1);
-
     juce::String inputUrl = url.isNotEmpty() ? url.trim() : cfg.rtmpUrl.trim();
     if (inputUrl.isEmpty()) { LogMessage("FFMPEG: open failed (empty URL)"); return false; }
     // Force IPv4 if possible to avoid AAAA-only issues
     juce::String finalUrl = inputUrl;
     LogMessage("FFMPEG: open -> " + finalUrl);
-    avformat_network_init();
-    av_log_set_level(AV_LOG_TRACE);
-    av_log_set_callback(ff_log_cb);
+    ff_global_init();
+    ff_sync_log_level(); // levels may have changed since the last stream
+    impl->closing.store(false);
+    impl->reconnectRequested.store(false);
+    impl->needKeyframe.store(false);
 
     AVFormatContext* fmt = nullptr;
     if (avformat_alloc_output_context2(&fmt, nullptr, "flv", finalUrl.toRawUTF8()) < 0 || fmt == nullptr) {
         LogMessage("FFMPEG: avformat_alloc_output_context2 failed");
         return false;
     }
+    fmt->interrupt_callback = { &Impl::interrupt_cb, impl.get() };
 
     // Tighten interleave queue threshold to 0ms (no backlog bursts)
     av_opt_set_int(fmt, "max_interleave_delta", 0, 0);
@@ -433,28 +632,34 @@ bool FfmpegRtmpWriter::open(const juce::String& url, const StreamingConfig& cfg)
     impl->audioBitrateKbps = cfg.audioBitrateKbps;
     impl->openedAt = std::chrono::steady_clock::now();
     impl->reconnectAttempts.store(0);
+    impl->allocateRings();
     impl->build_io_options();
     impl->build_muxer_options();
 
     int ret = 0;
     if (!(fmt->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open2(&fmt->pb, finalUrl.toRawUTF8(), AVIO_FLAG_WRITE, nullptr, &impl->ioOpts);
+        ret = avio_open2(&fmt->pb, finalUrl.toRawUTF8(), AVIO_FLAG_WRITE, &fmt->interrupt_callback, &impl->ioOpts);
         if (ret < 0) {
             LogMessage("FFMPEG: avio_open2 failed -> " + ff_err2str(ret));
             AVDictionary* tls = nullptr; av_dict_set(&tls, "tls_verify", "0", 0);
-            ret = avio_open2(&fmt->pb, finalUrl.toRawUTF8(), AVIO_FLAG_WRITE, nullptr, &tls);
+            ret = avio_open2(&fmt->pb, finalUrl.toRawUTF8(), AVIO_FLAG_WRITE, &fmt->interrupt_callback, &tls);
             av_dict_free(&tls);
             if (ret < 0) { avformat_free_context(fmt); return false; }
         }
     }
 
-    impl->fmt = fmt;
-    impl->vstream = v;
-    impl->astream = a;
-    impl->headerWritten = false;
-    impl->haveVideoConfig = false;
-    impl->haveAudioConfig = false;
-    impl->isOpen.store(true);
+    {
+        std::lock_guard<std::mutex> lk(impl->ioMutex);
+        impl->fmt = fmt;
+        impl->vstream = v;
+        impl->astream = a;
+        impl->headerWritten.store(false);
+        impl->haveVideoConfig = false;
+        impl->haveAudioConfig = false;
+        impl->isOpen.store(true);
+    }
+    impl->admitting.store(true);
+    impl->startReconnectThread();
     return true;
 #else
     juce::ignoreUnused(url, cfg);
@@ -465,7 +670,9 @@ bool FfmpegRtmpWriter::open(const juce::String& url, const StreamingConfig& cfg)
 
 bool FfmpegRtmpWriter::setVideoConfig(const void* data, size_t size) {
 #if HAVE_FFMPEG
-    if (!impl->fmt || !impl->vstream) return false;
+    const Impl::ProducerScope scope(*impl);
+    std::lock_guard<std::mutex> lk(impl->ioMutex);
+    if (!scope.admitted || !impl->fmt || !impl->vstream) return false;
     impl->startEgressIfNeeded();
     auto* par = impl->vstream->codecpar;
     par->extradata = (uint8_t*)av_malloc((int)size + AV_INPUT_BUFFER_PADDING_SIZE);
@@ -487,7 +694,9 @@ bool FfmpegRtmpWriter::setVideoConfig(const void* data, size_t size) {
 
 bool FfmpegRtmpWriter::setAudioConfig(const void* data, size_t size) {
 #if HAVE_FFMPEG
-    if (!impl->fmt || !impl->astream) return false;
+    const Impl::ProducerScope scope(*impl);
+    std::lock_guard<std::mutex> lk(impl->ioMutex);
+    if (!scope.admitted || !impl->fmt || !impl->astream) return false;
     impl->startEgressIfNeeded();
     auto* par = impl->astream->codecpar;
     par->extradata = (uint8_t*)av_malloc((int)size + AV_INPUT_BUFFER_PADDING_SIZE);
@@ -507,72 +716,83 @@ bool FfmpegRtmpWriter::setAudioConfig(const void* data, size_t size) {
 #endif
 }
 
-static inline bool is_network_broken(int err) {
+bool FfmpegRtmpWriter::writeVideoFrame(const void* data, size_t size, int64_t ptsMs, bool keyframe) {
 #if HAVE_FFMPEG
-    return err == AVERROR(EPIPE) || err == AVERROR_EOF || err == AVERROR(ECONNRESET) || err == AVERROR(ETIMEDOUT) || err == AVERROR(EIO);
+    return impl->writeVideo(nullptr, data, size, ptsMs, keyframe);
 #else
+    juce::ignoreUnused(data, size, ptsMs, keyframe);
     return false;
 #endif
 }
 
-bool FfmpegRtmpWriter::writeVideoFrame(const void* data, size_t size, int64_t ptsMs, bool keyframe) {
+bool FfmpegRtmpWriter::writeVideoFrame(const streaming::MediaBuffer::Ptr& frame, int64_t ptsMs, bool keyframe) {
 #if HAVE_FFMPEG
-    if (!impl->isOpen.load() || !impl->fmt || !impl->vstream) return false;
-    // Avoid pre-header backlog: drop frames until header is written
-    if (!impl->headerWritten) return true;
-    impl->startEgressIfNeeded();
-    int frameDurMs = (impl->fps > 0) ? (int) std::lround(1000.0 / (double) impl->fps) : 33;
-    Impl::QueuedPacket qp;
-    qp.isVideo = true; qp.keyframe = keyframe; qp.ptsMs = ptsMs; qp.durationMs = frameDurMs; qp.bytes.assign((const uint8_t*)data, (const uint8_t*)data + size);
-    {
-        std::lock_guard<std::mutex> lk(impl->egressMutex);
-        impl->egressQueue.emplace_back(std::move(qp));
-    }
-    impl->egressCv.notify_one();
-    return true;
+    return frame != nullptr && impl->writeVideo(frame, nullptr, frame->size(), ptsMs, keyframe);
 #else
-    juce::ignoreUnused(data, size, ptsMs, keyframe);
+    juce::ignoreUnused(frame, ptsMs, keyframe);
     return false;
 #endif
 }
 
 bool FfmpegRtmpWriter::writeAudioFrame(const void* data, size_t size, int64_t ptsMs) {
 #if HAVE_FFMPEG
-    if (!impl->isOpen.load() || !impl->fmt || !impl->astream) return false;
-    // Avoid pre-header backlog and ensure audio after first video
-    if (!impl->headerWritten) return true;
-    impl->startEgressIfNeeded();
-    int aacFrameDurMs = (int) std::lround(1024.0 * 1000.0 / (double) impl->audioSampleRate);
-    Impl::QueuedPacket qp;
-    qp.isVideo = false; qp.keyframe = false; qp.ptsMs = ptsMs; qp.durationMs = aacFrameDurMs; qp.bytes.assign((const uint8_t*)data, (const uint8_t*)data + size);
-    {
-        std::lock_guard<std::mutex> lk(impl->egressMutex);
-        impl->egressQueue.emplace_back(std::move(qp));
-    }
-    impl->egressCv.notify_one();
-    return true;
+    return impl->writeAudio(nullptr, data, size, ptsMs);
 #else
     juce::ignoreUnused(data, size, ptsMs);
     return false;
 #endif
 }
 
+bool FfmpegRtmpWriter::writeAudioFrame(const streaming::MediaBuffer::Ptr& frame, int64_t ptsMs) {
+#if HAVE_FFMPEG
+    return frame != nullptr && impl->writeAudio(frame, nullptr, frame->size(), ptsMs);
+#else
+    juce::ignoreUnused(frame, ptsMs);
+    return false;
+#endif
+}
+
+void FfmpegRtmpWriter::setEncoderControl(streaming::EncoderControl* encoder) {
+#if HAVE_FFMPEG
+    impl->gop.setEncoderControl(encoder);
+#else
+    juce::ignoreUnused(encoder);
+#endif
+}
+
+FfmpegRtmpWriter::Stats FfmpegRtmpWriter::getStats() const {
+    Stats s;
+#if HAVE_FFMPEG
+    s.connected = impl->isOpen.load();
+    s.bytesSent = impl->bytesSent.load();
+    const juce::uint64 released = impl->bytesReleased.load(), queued = impl->bytesQueued.load();
+    s.queuedBytes = queued > released ? (size_t) (queued - released) : 0;
+    if (s.queuedBytes > 0) s.queueDelayMs = (int) juce::jmax<int64_t>(0, impl->lastQueuedVideoPtsMs.load() - impl->lastVideoSentRelMs.load());
+    s.droppedPackets = impl->ringDrops.load();
+    s.droppedVideoFrames = impl->gop.getDroppedFrames();
+#endif
+    return s;
+}
+
 void FfmpegRtmpWriter::close() {
 #if HAVE_FFMPEG
+    // No producer may still be inside push() when stopEgress() resets the rings
+    impl->admitting.store(false);
+    impl->isOpen.store(false);
+    while (impl->producersInside.load() > 0) std::this_thread::yield();
+    impl->stopReconnectThread();
     impl->stopEgress();
-    std::lock_guard<std::mutex> lk(g_ffmpegWriteMutex);
+    std::lock_guard<std::mutex> lk(impl->ioMutex);
     if (!impl->fmt) { impl->isOpen.store(false); return; }
     LogMessage("FFMPEG: close -> " + impl->url);
     impl->isOpen.store(false);
-    if (impl->headerWritten)
-        av_write_trailer(impl->fmt);
-    if (impl->fmt->pb) avio_closep(&impl->fmt->pb);
-    avformat_free_context(impl->fmt);
+    // closing is set, so a trailer write to a stuck peer is interrupted rather than waiting out rw_timeout
+    Impl::free_context(impl->fmt, impl->headerWritten.load());
     impl->fmt = nullptr;
     impl->vstream = nullptr;
     impl->astream = nullptr;
     impl->url = {};
-    impl->headerWritten = false;
+    impl->headerWritten.store(false);
     impl->haveVideoConfig = false;
     impl->haveAudioConfig = false;
     if (impl->ioOpts) { av_dict_free(&impl->ioOpts); impl->ioOpts = nullptr; }
@@ -3,6 +3,8 @@
 #include <juce_core/juce_core.h>
 #include "StreamingConfig.h"
 #include "Logging.h"
+#include "EncoderControl.h"
+#include "MediaBuffer.h"
 
 // Define HAVE_FFMPEG at build time if libavformat/libavutil/libavcodec are available
 
@@ -21,6 +23,23 @@ public:
     // Push encoded frames (timestamps in ms). Data: Annex B H.264 for video, raw AAC without ADTS for audio
     bool writeVideoFrame(const void* data, size_t size, int64_t ptsMs, bool keyframe);
     bool writeAudioFrame(const void* data, size_t size, int64_t ptsMs);
+    // Same, queued and handed to libavformat by reference (no copy of the payload)
+    bool writeVideoFrame(const streaming::MediaBuffer::Ptr& frame, int64_t ptsMs, bool keyframe);
+    bool writeAudioFrame(const streaming::MediaBuffer::Ptr& frame, int64_t ptsMs);
+
+    // Egress state for rate control; safe to call from any thread
+    struct Stats {
+        bool connected { false };
+        juce::uint64 bytesSent { 0 };    // payload bytes handed to libavformat
+        size_t queuedBytes { 0 };        // waiting in the egress rings
+        int queueDelayMs { 0 };          // newest queued video pts - last sent video pts
+        juce::uint64 droppedPackets { 0 };     // egress ring full
+        juce::uint64 droppedVideoFrames { 0 }; // shed as whole GOP tails under backlog
+    };
+    Stats getStats() const;
+
+    // Encoder to ask for an IDR when a backlog gap opens (optional; without it the gap runs to the next GOP)
+    void setEncoderControl(streaming::EncoderControl* encoder);
 
     void close();
 
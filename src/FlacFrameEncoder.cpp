@@ -0,0 +1,299 @@
+#include "FlacFrameEncoder.h"
+#include <cstdlib>
+
+namespace streaming {
+
+namespace {
+constexpr int kMaxFixedOrder = 4;
+constexpr int kMaxPartitionOrder = 8;
+constexpr int kMaxRiceParam = 14;  // 4-bit parameters
+constexpr int kMaxRice2Param = 30; // 5-bit parameters; 31 would be the escape code
+
+struct CrcTables {
+    uint8_t crc8[256];
+    uint16_t crc16[256];
+    CrcTables() {
+        for (int i = 0; i < 256; ++i) {
+            unsigned c8 = (unsigned) i, c16 = (unsigned) i << 8;
+            for (int b = 0; b < 8; ++b) {
+                c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1;
+                c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1;
+            }
+            crc8[i] = (uint8_t) c8;
+            crc16[i] = (uint16_t) c16;
+        }
+    }
+};
+const CrcTables crcTables;
+
+uint8_t crc8(const uint8_t* data, size_t n) noexcept {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < n; ++i) crc = crcTables.crc8[crc ^ data[i]];
+    return crc;
+}
+
+uint16_t crc16(const uint8_t* data, size_t n) noexcept {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < n; ++i) crc = (uint16_t) ((crc << 8) ^ crcTables.crc16[(crc >> 8) ^ data[i]]);
+    return crc;
+}
+
+// MSB-first bit packer. Writing past `limit` sets `overflow` instead, so an attempt that turns out
+// larger than the fallback can be rolled back with reset().
+struct BitWriter {
+    uint8_t* out;
+    size_t limit, pos = 0;
+    uint64_t acc = 0;
+    int pending = 0; // bits in acc not yet stored, always < 8 between calls
+    bool overflow = false;
+
+    struct Mark { size_t pos; uint64_t acc; int pending; };
+    Mark mark() const noexcept { return { pos, acc, pending }; }
+    void reset(const Mark& m) noexcept { pos = m.pos; acc = m.acc; pending = m.pending; overflow = false; }
+    size_t bits() const noexcept { return pos * 8 + (size_t) pending; }
+
+    void put(uint32_t value, int n) noexcept { // n <= 32
+        acc = (acc << n) | (n == 32 ? value : value & ((1u << n) - 1));
+        pending += n;
+        while (pending >= 8) {
+            pending -= 8;
+            if (pos < limit) out[pos++] = (uint8_t) (acc >> pending);
+            else overflow = true;
+        }
+    }
+    void putZeros(uint32_t n) noexcept {
+        for (; n >= 32 && ! overflow; n -= 32) put(0, 32);
+        if (n > 0 && n < 32) put(0, (int) n);
+    }
+    void putRice(uint32_t u, int k) noexcept {
+        putZeros(u >> k);
+        put(1, 1);
+        if (k > 0) put(u, k);
+    }
+    void align() noexcept { if (pending > 0) put(0, 8 - pending); }
+};
+
+inline uint32_t zigzag(int32_t r) noexcept { return ((uint32_t) r << 1) ^ (uint32_t) (r >> 31); }
+
+// Fixed predictor whose residual has the smallest absolute sum, and that sum
+int bestFixedOrder(const int32_t* x, int n, juce::uint64& bestSum) noexcept {
+    juce::uint64 sum[kMaxFixedOrder + 1] {};
+    juce::int64 last0 = x[3], last1 = (juce::int64) x[3] - x[2];
+    juce::int64 last2 = last1 - ((juce::int64) x[2] - x[1]);
+    juce::int64 last3 = last2 - ((juce::int64) x[2] - x[1] - ((juce::int64) x[1] - x[0]));
+    for (int i = kMaxFixedOrder; i < n; ++i) {
+        const juce::int64 e0 = x[i], e1 = e0 - last0, e2 = e1 - last1, e3 = e2 - last2, e4 = e3 - last3;
+        sum[0] += (juce::uint64) std::llabs(e0);
+        sum[1] += (juce::uint64) std::llabs(e1);
+        sum[2] += (juce::uint64) std::llabs(e2);
+        sum[3] += (juce::uint64) std::llabs(e3);
+        sum[4] += (juce::uint64) std::llabs(e4);
+        last0 = e0; last1 = e1; last2 = e2; last3 = e3;
+    }
+    int order = 0;
+    for (int o = 1; o <= kMaxFixedOrder; ++o)
+        if (sum[o] < sum[order]) order = o;
+    bestSum = sum[order];
+    return order;
+}
+
+void fixedResidual(const int32_t* x, int n, int order, int32_t* r) noexcept {
+    switch (order) {
+        case 0: for (int i = 0; i < n; ++i) r[i] = x[i]; break;
+        case 1: for (int i = 1; i < n; ++i) r[i] = x[i] - x[i - 1]; break;
+        case 2: for (int i = 2; i < n; ++i) r[i] = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+        case 3: for (int i = 3; i < n; ++i) r[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]; break;
+        default: for (int i = 4; i < n; ++i) r[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4]; break;
+    }
+}
+
+// Rice parameter for `count` zigzagged residuals summing to `sum`, and the bits they then take
+int riceParam(juce::uint64 sum, juce::uint64 count, int maxParam, juce::uint64& bits) noexcept {
+    int k = 0;
+    while (k < maxParam && (count << (k + 1)) < sum) ++k;
+    bits = count * (juce::uint64) (k + 1) + (sum >> k);
+    return k;
+}
+
+struct Partitioning {
+    int order = 0;
+    bool rice2 = false;
+    int params[1 << kMaxPartitionOrder] {};
+    juce::uint64 bits = 0;
+};
+
+// Picks the partition order and per-partition parameters with the fewest estimated bits
+void choosePartitions(const int32_t* r, int n, int predictorOrder, Partitioning& best) noexcept {
+    int maxOrder = 0;
+    while (maxOrder < kMaxPartitionOrder && (n % (2 << maxOrder)) == 0 && (n >> (maxOrder + 1)) > predictorOrder) ++maxOrder;
+
+    juce::uint64 sums[1 << kMaxPartitionOrder];
+    const int size = n >> maxOrder;
+    for (int p = 0; p < (1 << maxOrder); ++p) {
+        juce::uint64 s = 0;
+        for (int i = p == 0 ? predictorOrder : p * size; i < (p + 1) * size; ++i) s += zigzag(r[i]);
+        sums[p] = s;
+    }
+    // Coarser orders reuse the finer sums; parameters above 14 need the 5-bit variant, which is
+    // only kept where it pays for its extra bits
+    best.bits = ~(juce::uint64) 0;
+    for (int order = maxOrder; order >= 0; --order) {
+        const int parts = 1 << order, partSize = n >> order;
+        for (const bool rice2 : { false, true }) {
+            Partitioning candidate;
+            candidate.order = order;
+            candidate.rice2 = rice2;
+            for (int p = 0; p < parts; ++p) {
+                juce::uint64 bits = 0;
+                const auto count = (juce::uint64) (partSize - (p == 0 ? predictorOrder : 0));
+                candidate.params[p] = riceParam(sums[p], count, rice2 ? kMaxRice2Param : kMaxRiceParam, bits);
+                candidate.bits += bits + (rice2 ? 5 : 4);
+            }
+            if (candidate.bits < best.bits) best = candidate;
+        }
+        for (int p = 0; p < parts / 2; ++p) sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+}
+
+void putSubframeHeader(BitWriter& bw, uint32_t type) noexcept {
+    bw.put(0, 1);
+    bw.put(type, 6);
+    bw.put(0, 1); // no wasted bits
+}
+
+void encodeSubframe(BitWriter& bw, const int32_t* x, int n, int bps, int32_t* residual) noexcept {
+    bool constant = true;
+    for (int i = 1; i < n && constant; ++i) constant = x[i] == x[0];
+    if (constant) {
+        putSubframeHeader(bw, 0);
+        bw.put((uint32_t) x[0], bps);
+        return;
+    }
+
+    const juce::uint64 verbatimBits = 8 + (juce::uint64) n * (juce::uint64) bps;
+    if (n > kMaxFixedOrder) {
+        juce::uint64 absSum = 0;
+        const int order = bestFixedOrder(x, n, absSum);
+        fixedResidual(x, n, order, residual);
+        Partitioning parts;
+        choosePartitions(residual, n, order, parts);
+        if (8 + (juce::uint64) (order * bps) + 6 + parts.bits < verbatimBits) {
+            const auto start = bw.mark();
+            putSubframeHeader(bw, 8 + (uint32_t) order);
+            for (int i = 0; i < order; ++i) bw.put((uint32_t) x[i], bps);
+            bw.put(parts.rice2 ? 1 : 0, 2);
+            bw.put((uint32_t) parts.order, 4);
+            const int partSize = n >> parts.order;
+            for (int p = 0; p < (1 << parts.order) && ! bw.overflow; ++p) {
+                const int k = parts.params[p];
+                bw.put((uint32_t) k, parts.rice2 ? 5 : 4);
+                for (int i = p == 0 ? order : p * partSize; i < (p + 1) * partSize; ++i) bw.putRice(zigzag(residual[i]), k);
+            }
+            // The estimate can be off; never emit more than verbatim would
+            if (! bw.overflow && bw.bits() - (start.pos * 8 + (size_t) start.pending) < verbatimBits) return;
+            bw.reset(start);
+        }
+    }
+    putSubframeHeader(bw, 1);
+    for (int i = 0; i < n; ++i) bw.put((uint32_t) x[i], bps);
+}
+
+void putUtf8(BitWriter& bw, juce::uint64 v) noexcept {
+    if (v < 0x80) { bw.put((uint32_t) v, 8); return; }
+    int bytes = 2;
+    while (bytes < 7 && v >= (juce::uint64) 1 << (5 * bytes + 1)) ++bytes;
+    const int lead = 7 - bytes; // bits of v in the first byte, after `bytes` ones and a zero
+    bw.put(((1u << bytes) - 1) << 1, bytes + 1);
+    bw.put((uint32_t) (v >> (6 * (bytes - 1))), lead);
+    for (int b = bytes - 2; b >= 0; --b) bw.put(0x80 | (uint32_t) ((v >> (6 * b)) & 0x3F), 8);
+}
+
+uint32_t sampleSizeCode(int bps) noexcept {
+    switch (bps) {
+        case 8: return 1;
+        case 12: return 2;
+        case 16: return 4;
+        case 20: return 5;
+        case 24: return 6;
+        default: return 0; // from STREAMINFO
+    }
+}
+} // namespace
+
+void FlacFrameEncoder::writeStreamHeader(const StreamInfo& info, uint8_t* out) noexcept {
+    out[0] = 'f'; out[1] = 'L'; out[2] = 'a'; out[3] = 'C';
+    out[4] = 0x80; // last metadata block, STREAMINFO
+    out[5] = 0; out[6] = 0; out[7] = 34;
+    BitWriter bw { out + 8, 34 };
+    bw.put(kBlockSize, 16);
+    bw.put(kBlockSize, 16);
+    bw.put((uint32_t) info.minFrameBytes, 24);
+    bw.put((uint32_t) info.maxFrameBytes, 24);
+    bw.put((uint32_t) info.sampleRate, 20);
+    bw.put((uint32_t) (info.numChannels - 1), 3);
+    bw.put((uint32_t) (info.bitsPerSample - 1), 5);
+    bw.put((uint32_t) ((juce::uint64) info.totalSamples >> 32), 4);
+    bw.put((uint32_t) info.totalSamples, 32);
+    for (int i = 0; i < 4; ++i) bw.put(0, 32); // no MD5
+}
+
+size_t FlacFrameEncoder::getMaxFrameBytes(int numChannels, int numFrames, int bitsPerSample) noexcept {
+    // Header, then each channel verbatim at one extra bit (side), then padding and CRC
+    return 16 + (size_t) numChannels * (2 + ((size_t) numFrames * (size_t) (bitsPerSample + 1) + 7) / 8) + 3;
+}
+
+FlacFrameEncoder::FlacFrameEncoder() {
+    mid.allocate(kBlockSize, false);
+    side.allocate(kBlockSize, false);
+    residual.allocate(kBlockSize, false);
+}
+
+size_t FlacFrameEncoder::encodeFrame(const int32_t* const* samples, int numChannels, int numFrames, int bps, juce::int64 frameNumber,
+                                     uint8_t* out) noexcept {
+    BitWriter bw { out, getMaxFrameBytes(numChannels, numFrames, bps) };
+    const int32_t* planes[kMaxChannels];
+    int planeBits[kMaxChannels];
+    uint32_t assignment = (uint32_t) numChannels - 1;
+    for (int ch = 0; ch < numChannels; ++ch) { planes[ch] = samples[ch]; planeBits[ch] = bps; }
+
+    // Stereo: whichever pair of left, right, mid and side predicts best
+    if (numChannels == 2 && numFrames > kMaxFixedOrder) {
+        const int32_t* left = samples[0];
+        const int32_t* right = samples[1];
+        for (int i = 0; i < numFrames; ++i) {
+            mid[i] = (left[i] + right[i]) >> 1;
+            side[i] = left[i] - right[i];
+        }
+        juce::uint64 l = 0, r = 0, m = 0, s = 0;
+        bestFixedOrder(left, numFrames, l);
+        bestFixedOrder(right, numFrames, r);
+        bestFixedOrder(mid, numFrames, m);
+        bestFixedOrder(side, numFrames, s);
+        const juce::uint64 costs[] = { l + r, l + s, s + r, m + s };
+        int best = 0;
+        for (int c = 1; c < 4; ++c)
+            if (costs[c] < costs[best]) best = c;
+        if (best == 1) { assignment = 8; planes[1] = side; planeBits[1] = bps + 1; }
+        if (best == 2) { assignment = 9; planes[0] = side; planeBits[0] = bps + 1; }
+        if (best == 3) { assignment = 10; planes[0] = mid; planes[1] = side; planeBits[1] = bps + 1; }
+    }
+
+    bw.put(0xFFF8, 16); // sync, fixed block size
+    const bool standardSize = numFrames == kBlockSize;
+    bw.put(standardSize ? 12 : 7, 4); // 4096, or 16 bits at the end of the header
+    bw.put(0, 4);                     // sample rate from STREAMINFO
+    bw.put(assignment, 4);
+    bw.put(sampleSizeCode(bps), 3);
+    bw.put(0, 1);
+    putUtf8(bw, (juce::uint64) frameNumber);
+    if (! standardSize) bw.put((uint32_t) (numFrames - 1), 16);
+    bw.put(crc8(out, bw.pos), 8);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        encodeSubframe(bw, planes[ch], numFrames, planeBits[ch], residual);
+    bw.align();
+    bw.put(crc16(out, bw.pos), 16);
+    return bw.pos;
+}
+
+} // namespace streaming
@@ -0,0 +1,43 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <cstdint>
+
+namespace streaming {
+
+// Encodes FLAC frames one at a time. Every frame depends only on its own samples and its number in
+// the stream, so frames can be encoded on any thread in any order and concatenated afterwards.
+// Subframes are CONSTANT, FIXED (orders 0-4, partitioned Rice) or VERBATIM, whichever is smallest;
+// stereo also tries left/side, right/side and mid/side. Not thread-safe: one instance per thread.
+class FlacFrameEncoder {
+public:
+    static constexpr int kBlockSize = 4096;
+    static constexpr int kMaxChannels = 8;
+    // "fLaC" plus the STREAMINFO block
+    static constexpr int kStreamHeaderBytes = 42;
+
+    struct StreamInfo {
+        int sampleRate { 0 };
+        int numChannels { 0 };
+        int bitsPerSample { 0 };
+        juce::int64 totalSamples { 0 }; // 0: unknown
+        int minFrameBytes { 0 }, maxFrameBytes { 0 }; // 0: unknown
+    };
+    static void writeStreamHeader(const StreamInfo& info, uint8_t* out) noexcept;
+
+    // Upper bound on one encoded frame of numFrames
+    static size_t getMaxFrameBytes(int numChannels, int numFrames, int bitsPerSample) noexcept;
+
+    // Allocates the residual scratch for frames of up to kBlockSize
+    FlacFrameEncoder();
+
+    // samples: numChannels planes of right-justified integers within bitsPerSample (at most 24).
+    // All frames but a stream's last must hold kBlockSize frames. Writes at most getMaxFrameBytes()
+    // to out and returns the bytes written.
+    size_t encodeFrame(const int32_t* const* samples, int numChannels, int numFrames, int bitsPerSample, juce::int64 frameNumber,
+                       uint8_t* out) noexcept;
+
+private:
+    juce::HeapBlock<int32_t> mid, side, residual;
+};
+
+} // namespace streaming
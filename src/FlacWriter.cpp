@@ -0,0 +1,150 @@
+#include "FlacWriter.h"
+#include <chrono>
+
+namespace streaming {
+
+namespace {
+// A writer that needs a slot back polls this often in case a wakeup raced its wait
+constexpr int kEncodeWaitMs = 1;
+}
+
+FlacEncodePool::FlacEncodePool(int numWorkers) {
+    if (numWorkers < 0)
+        numWorkers = juce::jlimit(0, kMaxWorkers, juce::SystemStats::getNumCpus() - 1);
+    for (int i = 0; i < numWorkers; ++i)
+        workers.emplace_back([this] {
+            FlacFrameEncoder encoder;
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                wake.wait(lock, [this] { return exiting || ! queue.empty(); });
+                if (queue.empty()) return;
+                auto* job = queue.front();
+                queue.pop_front();
+                lock.unlock();
+                job->run(encoder);
+                lock.lock();
+            }
+        });
+}
+
+FlacEncodePool::~FlacEncodePool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        exiting = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+bool FlacEncodePool::submit(Job& job) {
+    if (workers.empty()) return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(&job);
+    }
+    wake.notify_one();
+    return true;
+}
+
+FlacWriter::FlacWriter(juce::OutputStream* out, double rate, int channels, int bits, FlacEncodePool& p)
+    : juce::AudioFormatWriter(out, "FLAC file", rate, (unsigned int) channels, (unsigned int) bits), pool(p) {
+    jassert(channels >= 1 && channels <= FlacFrameEncoder::kMaxChannels && bits <= 24);
+    // Enough slots that every worker has a frame to encode while finished ones wait to be written
+    numSlots = 2 * juce::jmax(1, pool.getNumWorkers()) + 2;
+    slots.reset(new Slot[(size_t) numSlots]);
+    for (int s = 0; s < numSlots; ++s) {
+        auto& slot = slots[(size_t) s];
+        slot.owner = this;
+        slot.pcm.allocate((size_t) channels * FlacFrameEncoder::kBlockSize, true);
+        slot.bytes.allocate(FlacFrameEncoder::getMaxFrameBytes(channels, FlacFrameEncoder::kBlockSize, bits), false);
+        for (int ch = 0; ch < channels; ++ch) slot.planes[ch] = slot.pcm + (size_t) ch * FlacFrameEncoder::kBlockSize;
+    }
+    info.sampleRate = juce::roundToInt(rate);
+    info.numChannels = channels;
+    info.bitsPerSample = bits;
+    uint8_t header[FlacFrameEncoder::kStreamHeaderBytes];
+    FlacFrameEncoder::writeStreamHeader(info, header);
+    ok = output->write(header, sizeof(header));
+}
+
+FlacWriter::~FlacWriter() {
+    // Only the stream's last frame may be short
+    if (slotFor(filling).frames > 0) submit();
+    writeEncoded(filling, true);
+    while (inFlight.load(std::memory_order_acquire) > 0) std::this_thread::yield();
+    writeStreamInfo();
+    output->flush();
+}
+
+void FlacWriter::Slot::run(FlacFrameEncoder& encoder) noexcept {
+    const auto t0 = std::chrono::steady_clock::now();
+    size = encoder.encodeFrame(planes, (int) owner->numChannels, frames, (int) owner->bitsPerSample, frameNumber, bytes);
+    owner->pool.addEncodeMicros((juce::uint64) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count());
+    encoded.store(true, std::memory_order_release);
+    owner->encodedSignal.notify();
+    owner->inFlight.fetch_sub(1, std::memory_order_release); // last touch: the writer may go now
+}
+
+bool FlacWriter::write(const int** samples, int numSamples) {
+    const int shift = 32 - (int) bitsPerSample;
+    for (int done = 0; done < numSamples;) {
+        auto& slot = slotFor(filling);
+        const int n = juce::jmin(numSamples - done, FlacFrameEncoder::kBlockSize - slot.frames);
+        for (int ch = 0; ch < (int) numChannels; ++ch) {
+            int32_t* dst = slot.pcm + (size_t) ch * FlacFrameEncoder::kBlockSize + (size_t) slot.frames;
+            if (const int* src = samples[ch])
+                for (int i = 0; i < n; ++i) dst[i] = src[done + i] >> shift;
+            else
+                std::fill(dst, dst + n, 0);
+        }
+        slot.frames += n;
+        done += n;
+        if (slot.frames == FlacFrameEncoder::kBlockSize) {
+            submit();
+            // The slot to fill next must have been written out first
+            writeEncoded(filling - numSlots + 1, true);
+        }
+    }
+    writeEncoded(filling, false);
+    return ok;
+}
+
+bool FlacWriter::flush() {
+    writeEncoded(filling, true);
+    writeStreamInfo();
+    output->flush();
+    return ok;
+}
+
+void FlacWriter::submit() {
+    auto& slot = slotFor(filling);
+    slot.frameNumber = filling++;
+    slot.encoded.store(false, std::memory_order_relaxed);
+    inFlight.fetch_add(1, std::memory_order_relaxed);
+    if (! pool.submit(slot)) slot.run(inlineEncoder);
+}
+
+void FlacWriter::writeEncoded(juce::int64 upTo, bool wait) {
+    for (; written < juce::jmin(upTo, filling); ++written) {
+        auto& slot = slotFor(written);
+        while (! slot.encoded.load(std::memory_order_acquire)) {
+            if (! wait) return;
+            encodedSignal.wait(kEncodeWaitMs);
+        }
+        ok = output->write(slot.bytes, slot.size) && ok;
+        encodedBytes += (juce::int64) slot.size;
+        info.totalSamples += slot.frames;
+        info.minFrameBytes = info.minFrameBytes == 0 ? (int) slot.size : juce::jmin(info.minFrameBytes, (int) slot.size);
+        info.maxFrameBytes = juce::jmax(info.maxFrameBytes, (int) slot.size);
+        slot.frames = 0;
+    }
+}
+
+void FlacWriter::writeStreamInfo() {
+    const auto end = output->getPosition();
+    uint8_t header[FlacFrameEncoder::kStreamHeaderBytes];
+    FlacFrameEncoder::writeStreamHeader(info, header);
+    ok = output->setPosition(0) && output->write(header, sizeof(header)) && output->setPosition(end) && ok;
+}
+
+} // namespace streaming
@@ -0,0 +1,98 @@
+#pragma once
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <juce_core/juce_core.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "FlacFrameEncoder.h"
+#include "RealtimeSignal.h"
+
+namespace streaming {
+
+// Encoder threads shared by every FlacWriter of a recorder. A job is one whole FLAC frame, so
+// compression spreads over the workers while each writer still emits its frames in order.
+class FlacEncodePool {
+public:
+    static constexpr int kMaxWorkers = 4;
+
+    // numWorkers < 0: one per core beyond the first (which the writer thread needs), up to kMaxWorkers.
+    // With no workers, writers encode on their own thread.
+    explicit FlacEncodePool(int numWorkers = -1);
+    ~FlacEncodePool();
+    int getNumWorkers() const { return (int) workers.size(); }
+    // Time spent inside encodeFrame() across all threads
+    juce::uint64 getEncodeMicros() const { return encodeMicros.load(); }
+
+    struct Job {
+        virtual ~Job() = default;
+        virtual void run(FlacFrameEncoder& encoder) noexcept = 0;
+    };
+    // False if there are no workers; the caller then runs the job itself
+    bool submit(Job& job);
+    void addEncodeMicros(juce::uint64 us) noexcept { encodeMicros.fetch_add(us, std::memory_order_relaxed); }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Job*> queue;
+    bool exiting = false;
+    std::atomic<juce::uint64> encodeMicros { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(FlacEncodePool)
+};
+
+// FLAC behind the juce::AudioFormatWriter interface, so AudioRecorder's segments take it in place
+// of the WAV writer. write() gathers samples into whole frames for the pool and writes finished
+// frames in order on the calling thread; it only waits when every frame slot is still encoding.
+// flush() writes everything submitted and refreshes STREAMINFO, as the WAV writer refreshes its
+// header; a file cut short by a crash stays decodable up to the last frame on disk.
+class FlacWriter : public juce::AudioFormatWriter {
+public:
+    // Takes ownership of `out`, which must be seekable. bitsPerSample at most 24.
+    FlacWriter(juce::OutputStream* out, double sampleRate, int numChannels, int bitsPerSample, FlacEncodePool& pool);
+    ~FlacWriter() override;
+
+    // Samples left-justified in int32, as for every juce::AudioFormatWriter
+    bool write(const int** samples, int numSamples) override;
+    bool flush() override;
+
+    juce::int64 getEncodedBytes() const { return encodedBytes; }
+
+private:
+    struct Slot : FlacEncodePool::Job {
+        FlacWriter* owner = nullptr;
+        juce::HeapBlock<int32_t> pcm;    // numChannels planes of kBlockSize
+        juce::HeapBlock<uint8_t> bytes;  // the encoded frame
+        const int32_t* planes[FlacFrameEncoder::kMaxChannels] {};
+        int frames = 0;
+        juce::int64 frameNumber = 0;
+        size_t size = 0;
+        std::atomic<bool> encoded { false };
+        void run(FlacFrameEncoder& encoder) noexcept override;
+    };
+
+    FlacEncodePool& pool;
+    FlacFrameEncoder inlineEncoder; // when the pool has no workers
+    std::unique_ptr<Slot[]> slots;
+    int numSlots = 0;
+    juce::int64 filling = 0, written = 0; // frames [written, filling) are with the pool
+    RealtimeSignal encodedSignal;
+    std::atomic<int> inFlight { 0 }; // jobs a worker may still touch
+    FlacFrameEncoder::StreamInfo info;
+    juce::int64 encodedBytes = 0;
+    bool ok = true;
+
+    Slot& slotFor(juce::int64 frame) noexcept { return slots[(size_t) (frame % numSlots)]; }
+    void submit();
+    void writeEncoded(juce::int64 upTo, bool wait);
+    void writeStreamInfo();
+
+    JUCE_DECLARE_NON_COPYABLE(FlacWriter)
+};
+
+} // namespace streaming
@@ -0,0 +1,312 @@
+#include "FlvMuxer.h"
+#include "Logging.h"
+
+using namespace streaming;
+
+namespace {
+constexpr uint8_t kTagAudio = 8;
+constexpr uint8_t kTagVideo = 9;
+constexpr uint8_t kTagScript = 18;
+
+// Same flag bytes libavformat's flvenc emits for AAC / H.264
+constexpr uint8_t kAacFlags = 0xAF;      // AAC | 44k | 16-bit | stereo (fixed for AAC per spec)
+constexpr uint8_t kAvcKeyFlags = 0x17;   // keyframe | AVC
+constexpr uint8_t kAvcInterFlags = 0x27; // inter frame | AVC
+
+constexpr size_t kInitialScratchBytes = 256 * 1024;
+
+inline void wb16(uint8_t* p, uint32_t v) noexcept { p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t) v; }
+inline void wb24(uint8_t* p, uint32_t v) noexcept { p[0] = (uint8_t)(v >> 16); p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t) v; }
+inline void wb32(uint8_t* p, uint32_t v) noexcept { p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t) v; }
+
+inline uint32_t flvTimestamp(juce::int64 ms) noexcept { return ms > 0 ? (uint32_t) ms : 0u; }
+
+inline void putTagHeader(uint8_t* p, uint8_t type, uint32_t dataSize, uint32_t ts) noexcept {
+    p[0] = type;
+    wb24(p + 1, dataSize);
+    wb24(p + 4, ts & 0xFFFFFF);
+    p[7] = (uint8_t)(ts >> 24); // timestamp extension
+    wb24(p + 8, 0);             // stream id
+}
+
+// Returns the offset of the next 00 00 01 at or after pos, backing up over one leading zero
+// (4-byte start code) the way ff_avc_find_startcode does; returns size if none.
+size_t findStartCode(const uint8_t* d, size_t pos, size_t size) noexcept {
+    for (size_t i = pos; i + 3 <= size; ++i) {
+        if (d[i] == 0 && d[i + 1] == 0 && d[i + 2] == 1)
+            return (i > pos && d[i - 1] == 0) ? i - 1 : i;
+    }
+    return size;
+}
+
+bool looksLikeAnnexB(const uint8_t* d, size_t size) noexcept {
+    if (size >= 4 && d[0] == 0 && d[1] == 0 && d[2] == 0 && d[3] == 1) return true;
+    return size >= 3 && d[0] == 0 && d[1] == 0 && d[2] == 1;
+}
+
+// Minimal RBSP bit reader (emulation prevention bytes skipped) for the SPS fields avcC needs
+struct BitReader {
+    const uint8_t* d; size_t size; size_t byte { 0 }; int bit { 0 }; int zeros { 0 };
+    BitReader(const uint8_t* data, size_t n) : d(data), size(n) {}
+    int readBit() noexcept {
+        if (byte >= size) return 0;
+        if (bit == 0) {
+            if (zeros >= 2 && d[byte] == 3) { ++byte; zeros = 0; if (byte >= size) return 0; }
+            zeros = (d[byte] == 0) ? zeros + 1 : 0;
+        }
+        int v = (d[byte] >> (7 - bit)) & 1;
+        if (++bit == 8) { bit = 0; ++byte; }
+        return v;
+    }
+    uint32_t readBits(int n) noexcept { uint32_t v = 0; while (n-- > 0) v = (v << 1) | (uint32_t) readBit(); return v; }
+    uint32_t readUE() noexcept {
+        int lz = 0;
+        while (readBit() == 0 && lz < 32) ++lz;
+        return lz == 0 ? 0u : ((1u << lz) - 1u + readBits(lz));
+    }
+};
+
+// AMF0 writers for the onMetaData script tag
+struct AmfWriter {
+    uint8_t* p;
+    void key(const char* s) { auto n = (uint32_t) strlen(s); wb16(p, n); memcpy(p + 2, s, n); p += 2 + n; }
+    void str(const char* s) { *p++ = 0x02; key(s); }
+    void num(double v) { *p++ = 0x00; uint64_t bits; memcpy(&bits, &v, 8); for (int i = 7; i >= 0; --i) *p++ = (uint8_t)(bits >> (i * 8)); }
+    void boolean(bool v) { *p++ = 0x01; *p++ = v ? 1 : 0; }
+};
+} // namespace
+
+size_t FlvChunk::totalSize() const noexcept {
+    size_t n = 0;
+    for (int i = 0; i < numSlices; ++i) n += slices[i].size;
+    return n;
+}
+
+void FlvChunk::copyTo(void* dest) const noexcept {
+    auto* out = static_cast<uint8_t*>(dest);
+    for (int i = 0; i < numSlices; ++i) {
+        if (slices[i].size == 0) continue;
+        memcpy(out, slices[i].data, slices[i].size);
+        out += slices[i].size;
+    }
+}
+
+void FlvMuxer::start(const StreamingConfig& config) {
+    cfg = config;
+    started = true;
+    videoIsAnnexB = false;
+    ensureScratch(kInitialScratchBytes);
+}
+
+void FlvMuxer::reset() {
+    started = false;
+    videoIsAnnexB = false;
+}
+
+uint8_t* FlvMuxer::ensureScratch(size_t bytes) {
+    if (bytes > scratchCapacity) {
+        size_t newCap = juce::jmax(bytes, scratchCapacity + scratchCapacity / 2);
+        scratch.allocate(newCap, false);
+        scratchCapacity = newCap;
+        if (started) LogMessage("FLV: scratch grown to " + juce::String((juce::int64) newCap) + " bytes");
+    }
+    return scratch.getData();
+}
+
+bool FlvMuxer::writeFileHeader(FlvChunk& out) {
+    if (!started) return false;
+    uint8_t* p = ensureScratch(13);
+    p[0] = 'F'; p[1] = 'L'; p[2] = 'V'; p[3] = 1;
+    p[4] = 0x05; // audio | video
+    wb32(p + 5, 9);
+    wb32(p + 9, 0); // PreviousTagSize0
+    out.clear();
+    out.slices[0] = { p, 13 };
+    out.numSlices = 1;
+    return true;
+}
+
+bool FlvMuxer::writeMetadata(FlvChunk& out) {
+    if (!started) return false;
+    uint8_t* base = ensureScratch(1024 + cfg.flvEncoderName.getNumBytesAsUTF8());
+    AmfWriter w { base + FlvChunk::tagHeaderSize };
+    w.str("onMetaData");
+    *w.p++ = 0x08; // ECMA array
+    uint8_t* countPos = w.p; w.p += 4;
+    uint32_t count = 0;
+    // Property order follows libavformat's flvenc (duration/filesize omitted as with no_duration_filesize)
+    w.key("width");          w.num((double) cfg.videoWidth); ++count;
+    w.key("height");         w.num((double) cfg.videoHeight); ++count;
+    w.key("videodatarate");  w.num((double) cfg.videoBitrateKbps * 1000.0 / 1024.0); ++count;
+    if (cfg.fps > 0) { w.key("framerate"); w.num((double) cfg.fps); ++count; }
+    w.key("videocodecid");   w.num(7.0); ++count;
+    w.key("audiodatarate");  w.num((double) cfg.audioBitrateKbps * 1000.0 / 1024.0); ++count;
+    w.key("audiosamplerate"); w.num((double) cfg.audioSampleRate); ++count;
+    w.key("audiosamplesize"); w.num(16.0); ++count;
+    w.key("stereo");         w.boolean(cfg.audioChannels == 2); ++count;
+    w.key("audiocodecid");   w.num(10.0); ++count;
+    if (cfg.flvEncoderName.isNotEmpty()) { w.key("encoder"); w.str(cfg.flvEncoderName.toRawUTF8()); ++count; }
+    wb32(countPos, count);
+    w.key(""); *w.p++ = 0x09; // object end
+
+    const auto dataSize = (uint32_t)(w.p - (base + FlvChunk::tagHeaderSize));
+    putTagHeader(base, kTagScript, dataSize, 0);
+    wb32(w.p, dataSize + (uint32_t) FlvChunk::tagHeaderSize);
+    out.clear();
+    out.slices[0] = { base, FlvChunk::tagHeaderSize + dataSize + FlvChunk::trailerSize };
+    out.numSlices = 1;
+    out.tagType = kTagScript;
+    out.keyframe = true;
+    return true;
+}
+
+bool FlvMuxer::buildConfigTag(uint8_t tagType, const uint8_t* codecHeader, size_t codecHeaderSize,
+                              const uint8_t* body, size_t bodySize, FlvChunk& out) {
+    const size_t dataSize = codecHeaderSize + bodySize;
+    uint8_t* p = ensureScratch(FlvChunk::tagHeaderSize + dataSize + FlvChunk::trailerSize);
+    putTagHeader(p, tagType, (uint32_t) dataSize, 0); // sequence headers go out at ts 0, as flvenc does
+    memcpy(p + FlvChunk::tagHeaderSize, codecHeader, codecHeaderSize);
+    if (bodySize > 0) memcpy(p + FlvChunk::tagHeaderSize + codecHeaderSize, body, bodySize);
+    wb32(p + FlvChunk::tagHeaderSize + dataSize, (uint32_t)(dataSize + FlvChunk::tagHeaderSize));
+    out.clear();
+    out.slices[0] = { p, FlvChunk::tagHeaderSize + dataSize + FlvChunk::trailerSize };
+    out.numSlices = 1;
+    out.tagType = tagType;
+    out.keyframe = true;
+    return true;
+}
+
+bool FlvMuxer::buildAvcDecoderConfig(const uint8_t* annexB, size_t size, FlvChunk& out) {
+    // Collect SPS/PPS NAL units (typically one each)
+    const uint8_t* sps[4]; size_t spsLen[4]; int nSps = 0;
+    const uint8_t* pps[4]; size_t ppsLen[4]; int nPps = 0;
+    size_t pos = findStartCode(annexB, 0, size);
+    while (pos < size) {
+        while (pos < size && annexB[pos] == 0) ++pos;
+        if (pos < size) ++pos; // the 0x01
+        size_t end = findStartCode(annexB, pos, size);
+        if (end > pos) {
+            const int nalType = annexB[pos] & 0x1F;
+            if (nalType == 7 && nSps < 4) { sps[nSps] = annexB + pos; spsLen[nSps++] = end - pos; }
+            else if (nalType == 8 && nPps < 4) { pps[nPps] = annexB + pos; ppsLen[nPps++] = end - pos; }
+        }
+        pos = end;
+    }
+    if (nSps == 0 || nPps == 0 || spsLen[0] < 4) { LogMessage("FLV: Annex B config without SPS/PPS"); return false; }
+
+    uint8_t avcc[1024];
+    size_t n = 0;
+    avcc[n++] = 1;
+    avcc[n++] = sps[0][1]; // profile_idc
+    avcc[n++] = sps[0][2]; // constraint flags
+    avcc[n++] = sps[0][3]; // level_idc
+    avcc[n++] = 0xFF;      // 4-byte NAL lengths
+    avcc[n++] = (uint8_t)(0xE0 | nSps);
+    for (int i = 0; i < nSps; ++i) {
+        if (n + 2 + spsLen[i] > sizeof(avcc) - 16) return false;
+        wb16(avcc + n, (uint32_t) spsLen[i]); memcpy(avcc + n + 2, sps[i], spsLen[i]); n += 2 + spsLen[i];
+    }
+    avcc[n++] = (uint8_t) nPps;
+    for (int i = 0; i < nPps; ++i) {
+        if (n + 2 + ppsLen[i] > sizeof(avcc) - 4) return false;
+        wb16(avcc + n, (uint32_t) ppsLen[i]); memcpy(avcc + n + 2, pps[i], ppsLen[i]); n += 2 + ppsLen[i];
+    }
+    // High profiles carry chroma format and bit depth (ISO/IEC 14496-15), as ff_isom_write_avcc writes them
+    const int profile = sps[0][1];
+    if (profile != 66 && profile != 77 && profile != 88) {
+        BitReader br(sps[0] + 4, spsLen[0] - 4);
+        br.readUE(); // seq_parameter_set_id
+        uint32_t chroma = 1, depthLuma = 0, depthChroma = 0;
+        if (profile == 100 || profile == 110 || profile == 122 || profile == 244 || profile == 44 ||
+            profile == 83 || profile == 86 || profile == 118 || profile == 128 || profile == 138 ||
+            profile == 139 || profile == 134 || profile == 135) {
+            chroma = br.readUE();
+            if (chroma == 3) br.readBit(); // separate_colour_plane_flag
+            depthLuma = br.readUE();
+            depthChroma = br.readUE();
+        }
+        avcc[n++] = (uint8_t)(0xFC | (chroma & 3));
+        avcc[n++] = (uint8_t)(0xF8 | (depthLuma & 7));
+        avcc[n++] = (uint8_t)(0xF8 | (depthChroma & 7));
+        avcc[n++] = 0; // no SPS extensions
+    }
+    const uint8_t codecHeader[5] = { kAvcKeyFlags, 0 /* sequence header */, 0, 0, 0 };
+    return buildConfigTag(kTagVideo, codecHeader, sizeof(codecHeader), avcc, n, out);
+}
+
+size_t FlvMuxer::annexBToAvcc(const uint8_t* in, size_t size, uint8_t* out) const noexcept {
+    size_t o = 0;
+    size_t pos = findStartCode(in, 0, size);
+    while (pos < size) {
+        while (pos < size && in[pos] == 0) ++pos;
+        if (pos < size) ++pos;
+        size_t end = findStartCode(in, pos, size);
+        if (end > pos) {
+            wb32(out + o, (uint32_t)(end - pos));
+            memcpy(out + o + 4, in + pos, end - pos);
+            o += 4 + (end - pos);
+        }
+        pos = end;
+    }
+    return o;
+}
+
+bool FlvMuxer::pushAudio(const EncodedAudioFrame& frame, FlvChunk& out) {
+    if (!started || frame.data == nullptr || frame.size == 0) return false;
+    const auto* payload = static_cast<const uint8_t*>(frame.data);
+    if (frame.isConfig) {
+        const uint8_t codecHeader[2] = { kAacFlags, 0 /* AudioSpecificConfig */ };
+        return buildConfigTag(kTagAudio, codecHeader, sizeof(codecHeader), payload, frame.size, out);
+    }
+    const uint32_t ts = flvTimestamp(frame.timestampMs);
+    const auto dataSize = (uint32_t)(2 + frame.size);
+    putTagHeader(head, kTagAudio, dataSize, ts);
+    head[FlvChunk::tagHeaderSize] = kAacFlags;
+    head[FlvChunk::tagHeaderSize + 1] = 1; // raw AAC frame
+    wb32(tail, dataSize + (uint32_t) FlvChunk::tagHeaderSize);
+    out.slices[0] = { head, FlvChunk::tagHeaderSize + 2 };
+    out.slices[1] = { payload, frame.size };
+    out.slices[2] = { tail, FlvChunk::trailerSize };
+    out.numSlices = 3;
+    out.tagType = kTagAudio;
+    out.timestampMs = ts;
+    out.keyframe = false;
+    return true;
+}
+
+bool FlvMuxer::pushVideo(const EncodedVideoFrame& frame, FlvChunk& out) {
+    if (!started || frame.data == nullptr || frame.size == 0) return false;
+    const auto* payload = static_cast<const uint8_t*>(frame.data);
+    if (frame.isConfig) {
+        // avcC record passes through; Annex B SPS/PPS is rewritten and implies Annex B frames
+        videoIsAnnexB = looksLikeAnnexB(payload, frame.size);
+        if (videoIsAnnexB) return buildAvcDecoderConfig(payload, frame.size, out);
+        const uint8_t codecHeader[5] = { kAvcKeyFlags, 0, 0, 0, 0 };
+        return buildConfigTag(kTagVideo, codecHeader, sizeof(codecHeader), payload, frame.size, out);
+    }
+
+    size_t payloadSize = frame.size;
+    if (videoIsAnnexB) {
+        // 3-byte start codes grow by one byte each; bound the rewrite generously
+        uint8_t* conv = ensureScratch(frame.size + frame.size / 4 + 16);
+        payloadSize = annexBToAvcc(payload, frame.size, conv);
+        payload = conv;
+        if (payloadSize == 0) return false;
+    }
+
+    const uint32_t ts = flvTimestamp(frame.timestampMs);
+    const auto dataSize = (uint32_t)(5 + payloadSize);
+    putTagHeader(head, kTagVideo, dataSize, ts);
+    head[FlvChunk::tagHeaderSize] = frame.isKeyframe ? kAvcKeyFlags : kAvcInterFlags;
+    head[FlvChunk::tagHeaderSize + 1] = 1; // NALU
+    wb24(head + FlvChunk::tagHeaderSize + 2, (uint32_t) frame.compositionOffsetMs & 0xFFFFFF);
+    wb32(tail, dataSize + (uint32_t) FlvChunk::tagHeaderSize);
+    out.slices[0] = { head, FlvChunk::tagHeaderSize + 5 };
+    out.slices[1] = { payload, payloadSize };
+    out.slices[2] = { tail, FlvChunk::trailerSize };
+    out.numSlices = 3;
+    out.tagType = kTagVideo;
+    out.timestampMs = ts;
+    out.keyframe = frame.isKeyframe;
+    return true;
+}
@@ -4,16 +4,48 @@
 
 namespace streaming {
 
+// Encoded frames are views: the muxer never takes ownership or copies the payload
 struct EncodedAudioFrame {
-    juce::MemoryBlock data; // AAC raw or ADTS-less payload
+    const void* data { nullptr }; // AAC raw (no ADTS), or AudioSpecificConfig when isConfig
+    size_t size { 0 };
     juce::int64 timestampMs { 0 };
     bool isConfig { false }; // true if this carries AudioSpecificConfig
 };
 
 struct EncodedVideoFrame {
-    juce::MemoryBlock data; // H.264 Annex B (with SPS/PPS for IDR)
+    const void* data { nullptr }; // H.264 AVCC (length-prefixed) or Annex B; avcC or Annex B SPS/PPS when isConfig
+    size_t size { 0 };
     juce::int64 timestampMs { 0 };
+    int compositionOffsetMs { 0 }; // pts - dts (0 without B-frames)
     bool isKeyframe { false };
+    bool isConfig { false }; // true if this carries the decoder configuration (SPS/PPS)
+};
+
+// One contiguous piece of outgoing bytes (same layout as POSIX struct iovec)
+struct IoSlice {
+    const void* data { nullptr };
+    size_t size { 0 };
+};
+
+// Scatter/gather view of one muxed FLV unit: [tag header + codec header] [payload] [PreviousTagSize].
+// Slices point into the muxer's preallocated storage or straight at the caller's payload and stay
+// valid until the next call on the muxer (and, for the payload, for as long as the caller's frame does).
+struct FlvChunk {
+    static constexpr int maxSlices = 3;
+    static constexpr size_t tagHeaderSize = 11;
+    static constexpr size_t trailerSize = 4;
+
+    IoSlice slices[maxSlices];
+    int numSlices { 0 };
+    uint8_t tagType { 0 };       // 8 audio, 9 video, 18 script data; 0 for the FLV file header
+    uint32_t timestampMs { 0 };
+    bool keyframe { false };     // video keyframe or codec config (never droppable)
+
+    size_t totalSize() const noexcept;
+    // Tag body only (what RTMP carries as a message payload)
+    size_t bodySize() const noexcept { return tagType == 0 ? 0 : totalSize() - tagHeaderSize - trailerSize; }
+    void copyTo(void* dest) const noexcept;
+    void clear() noexcept { numSlices = 0; tagType = 0; timestampMs = 0; keyframe = false; }
 };
 
 class FlvMuxer {
@@ -21,14 +53,39 @@ public:
     FlvMuxer() = default;
     ~FlvMuxer() = default;
 
-    // Initialize FLV header and write AAC/H.264 codec configs
+    // Initialize stream parameters and preallocate all working storage
     void start(const StreamingConfig& cfg);
 
-    // Mux frames into internal buffer; returns a chunk ready to send
-    bool pushAudio(const EncodedAudioFrame& aacFrame, juce::MemoryBlock& outChunk);
-    bool pushVideo(const EncodedVideoFrame& h264Frame, juce::MemoryBlock& outChunk);
+    // FLV file signature (files only; RTMP publishers skip it) and the onMetaData script tag
+    bool writeFileHeader(FlvChunk& outChunk);
+    bool writeMetadata(FlvChunk& outChunk);
+
+    // Mux one frame (or codec config) into a tag; outChunk references the frame payload without copying
+    bool pushAudio(const EncodedAudioFrame& aacFrame, FlvChunk& outChunk);
+    bool pushVideo(const EncodedVideoFrame& h264Frame, FlvChunk& outChunk);
 
     void reset();
+
+private:
+    StreamingConfig cfg;
+    bool started { false };
+    bool videoIsAnnexB { false };
+
+    // Fixed storage for media tags: 11-byte tag header + up to 5 codec header bytes, and the trailer
+    uint8_t head[FlvChunk::tagHeaderSize + 5] {};
+    uint8_t tail[FlvChunk::trailerSize] {};
+
+    // Reused storage for config/metadata tags and Annex B -> AVCC rewrites; grows only on a larger frame
+    juce::HeapBlock<uint8_t> scratch;
+    size_t scratchCapacity { 0 };
+
+    uint8_t* ensureScratch(size_t bytes);
+    bool buildConfigTag(uint8_t tagType, const uint8_t* codecHeader, size_t codecHeaderSize,
+                        const uint8_t* body, size_t bodySize, FlvChunk& outChunk);
+    bool buildAvcDecoderConfig(const uint8_t* annexB, size_t size, FlvChunk& outChunk);
+    size_t annexBToAvcc(const uint8_t* in, size_t size, uint8_t* out) const noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE(FlvMuxer)
 };
 
 } // namespace streaming
@@ -0,0 +1,33 @@
+#include "GopDropper.h"
+
+using namespace streaming;
+
+void GopDropper::reset() noexcept {
+    dropping = false;
+    idrRequested = false;
+    droppedFrames.store(0);
+    gaps.store(0);
+}
+
+void GopDropper::beginGap() noexcept {
+    if (!dropping) { dropping = true; gaps.fetch_add(1); }
+    if (idrRequested) return;
+    idrRequested = true;
+    if (auto* e = encoder.load()) e->requestKeyframe();
+}
+
+bool GopDropper::admit(bool keyframe, bool behind) noexcept {
+    if (keyframe) {
+        dropping = false;
+        idrRequested = false;
+        return true;
+    }
+    if (!dropping && !behind) return true;
+    beginGap();
+    droppedFrames.fetch_add(1);
+    return false;
+}
+
+void GopDropper::requireKeyframe() noexcept {
+    beginGap();
+}
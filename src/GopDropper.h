@@ -0,0 +1,38 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include "EncoderControl.h"
+
+namespace streaming {
+
+// Video shedding that respects GOP structure: once one inter frame is dropped, every frame up to the
+// next keyframe goes too, so the decoder never sees a frame whose reference is missing. Optionally
+// asks the encoder for an IDR (once per gap) so the outage ends early rather than at the GOP
+// boundary. Only video goes through it; audio stays continuous.
+// One instance per send path; admit() and requireKeyframe() must come from a single thread.
+class GopDropper {
+public:
+    void reset() noexcept;
+    void setEncoderControl(EncoderControl* e) noexcept { encoder.store(e); }
+
+    // Decide one video frame. `behind` is the caller's backlog verdict for it. Keyframes always pass
+    // and end a gap; returns false for frames that must be dropped.
+    bool admit(bool keyframe, bool behind) noexcept;
+
+    // Start a gap without a backlog, e.g. after a reconnect the stream must restart at an IDR
+    void requireKeyframe() noexcept;
+
+    bool isDropping() const noexcept { return dropping; }
+    juce::uint64 getDroppedFrames() const noexcept { return droppedFrames.load(); }
+    juce::uint64 getGaps() const noexcept { return gaps.load(); }
+
+private:
+    bool dropping { false };
+    bool idrRequested { false };
+    std::atomic<EncoderControl*> encoder { nullptr };
+    std::atomic<juce::uint64> droppedFrames { 0 }, gaps { 0 };
+
+    void beginGap() noexcept;
+};
+
+} // namespace streaming
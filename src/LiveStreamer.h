@@ -4,6 +4,8 @@
 #include "StreamingConfig.h"
 #include "FlvMuxer.h"
 #include "RtmpClient.h"
+#include "EncoderBackend.h"
+#include "AudioTap.h"
 
 namespace streaming {
 
@@ -15,12 +17,22 @@ public:
     bool start(const StreamingConfig& cfg);
     void stop();
 
-    // Audio: push PCM from the audio thread (non-blocking)
-    void pushAudioPCM(const juce::AudioBuffer<float>& buffer, int numSamples, double sampleRate, int numChannels);
+    // Audio is read from this tap (at the host rate, resampled to cfg.audioSampleRate) while
+    // streaming; set before start()
+    void setAudioSource(AudioTap* tap);
 
-    // Video frame bridge: from ScreenRecorder (CVPixelBufferRef + ms pts)
+    // Bytes this stream has waiting to be sent (summed over fan-out endpoints)
+    size_t getQueuedBytes() const;
+
+    // Video frame bridge: from ScreenRecorder (CVPixelBufferRef + ms pts). Frames are restamped on
+    // arrival onto the stream's fps grid (MediaClock), so ptsMs is informational.
     void pushPixelBuffer(void* cvPixelBufferRef, int64_t ptsMs);
 
+    // Portable video input (BGRA / NV12 / I420). With the software encoder this encodes on the
+    // caller's thread; under VideoToolbox BGRA and NV12 are copied into pooled CVPixelBuffers.
+    // Same timestamping as pushPixelBuffer.
+    void pushVideoFrame(const RawVideoFrame& frame);
+
 private:
     struct Impl;
     std::unique_ptr<Impl> impl;
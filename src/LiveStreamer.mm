@@ -1,10 +1,18 @@
 #include "LiveStreamer.h"
 #include "FfmpegRtmpWriter.h"
+#include "PacingScheduler.h"
+#include "AbrController.h"
+#include "EncoderControl.h"
+#include "GopDropper.h"
+#include "MediaBuffer.h"
+#include "EncoderBackend.h"
+#include "AudioEncodeStage.h"
+#include "MediaClock.h"
+#include "Telemetry.h"
 #include "Logging.h"
 
 #if JUCE_MAC
  #import <VideoToolbox/VideoToolbox.h>
- #import <AudioToolbox/AudioToolbox.h>
  #import <AVFoundation/AVFoundation.h>
  #import <CoreMedia/CoreMedia.h>
 #endif
@@ -12,102 +20,352 @@
 using namespace streaming;
 
 namespace {
+constexpr int kAbrIntervalMs = 500;
+
+#if JUCE_MAC
 static void vtRelease(CFTypeRef obj) { if (obj) CFRelease(obj); }
+
+// VideoToolbox session knobs. Bitrate changes apply to the running session; a keyframe request is
+// picked up by the next pushPixelBuffer().
+class VtEncoderControl final : public EncoderControl {
+public:
+    void attach(VTCompressionSessionRef s, int kbps) { session.store(s); currentKbps.store(kbps); forceKeyframe.store(false); }
+    void detach() { session.store(nullptr); }
+
+    bool setTargetBitrate(int kbps) override {
+        VTCompressionSessionRef s = session.load();
+        if (s == nullptr || kbps <= 0) return false;
+        applyBitrate(s, kbps);
+        currentKbps.store(kbps);
+        return true;
+    }
+    int getTargetBitrate() const override { return currentKbps.load(); }
+    void requestKeyframe() override { forceKeyframe.store(true); }
+    bool takeKeyframeRequest() { return forceKeyframe.exchange(false); }
+
+    // Average bitrate plus a one-second data rate window (that property takes BYTES/sec and seconds)
+    static void applyBitrate(VTCompressionSessionRef s, int kbps) {
+        int32_t bps = kbps * 1000;
+        CFNumberRef br = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &bps);
+        VTSessionSetProperty(s, kVTCompressionPropertyKey_AverageBitRate, br); vtRelease(br);
+        NSNumber* bytesPerSec = @(bps / 8);
+        NSNumber* windowSec = @(1);
+        VTSessionSetProperty(s, kVTCompressionPropertyKey_DataRateLimits, (__bridge CFArrayRef)@[bytesPerSec, windowSec]);
+    }
+
+private:
+    std::atomic<VTCompressionSessionRef> session { nullptr };
+    std::atomic<int> currentKbps { 0 };
+    std::atomic<bool> forceKeyframe { false };
+};
+#endif
 }
 
 struct streaming::LiveStreamer::Impl {
     StreamingConfig cfg;
     FfmpegRtmpWriter rtmp;
 
+    // Multistream: encode and mux once, then fan the tags out to every endpoint.
+    // Single-URL / relay streaming stays on FfmpegRtmpWriter.
+    bool fanOut { false };
+    FlvMuxer mux;
+    RtmpMultiPublisher publisher;
+    std::mutex muxMutex; // video and audio are muxed from different pacing threads
+
+    // Adaptive bitrate: samples the egress path every kAbrIntervalMs and retunes `encoder`
+    EncoderControl* encoder { nullptr };
+    AbrController abr;
+    std::thread abrThread;
+    RealtimeSignal abrWake;
+    std::atomic<bool> abrRunning { false };
+    int abrSource { -1 }; // fan-out endpoint the controller follows
+
+    // Software encoder (libavcodec): the only encoder off macOS, opt-in there via useHardwareEncoder=false
+    std::unique_ptr<EncoderBackend> backend;
+    bool useBackend { false };
+
+    std::atomic<bool> active{false};
+    std::atomic<juce::int64> lastVideoSentRelMs { 0 };
+    GopDropper videoGop; // sheds encoder output while the pacer is more than 1 s behind
+
+    // Stream timeline, started by the first video frame; audio is accepted from then on
+    MediaClock clock;
+    // AAC for either video encoder, stamped on `clock`
+    AudioTap* audioSource { nullptr };
+    AudioEncodeStage aac;
+
 #if JUCE_MAC
     VTCompressionSessionRef vt{nullptr};
+    VtEncoderControl vtControl;
     std::atomic<bool> vtReady{false};
-    std::atomic<bool> active{false};
     bool sentFirstVideo { false };
     juce::HeapBlock<uint8_t> spspps;
     size_t spsppsSize{0};
-    std::atomic<juce::int64> lastVideoSentRelMs { 0 };
 
-    // Audio conversion
-    AVAudioConverter* converter { nil };
-    AVAudioFormat* inFmt { nil };
-    AVAudioFormat* outFmt { nil }; // AAC
-    juce::int64 audioPtsMs{0};
-    dispatch_queue_t aacQueue { nullptr };
-
-    // Common PTS base (ms) set on first video frame
-    std::atomic<bool> ptsBaseSet { false };
-    std::atomic<juce::int64> basePtsMs { 0 };
-    // Pacing: send encoded frames at real-time rate
-    struct PendingFrame {
-        juce::HeapBlock<uint8_t> bytes;
-        size_t length { 0 };
+    // pushVideoFrame's copies into VideoToolbox come from a pool, recreated when the size or format changes
+    // (capture thread only)
+    CVPixelBufferPoolRef inputPool{nullptr};
+    int inputPoolWidth{0}, inputPoolHeight{0};
+    OSType inputPoolFormat{0};
+
+    CVPixelBufferRef takeInputBuffer(int width, int height, OSType format) {
+        if (inputPool == nullptr || width != inputPoolWidth || height != inputPoolHeight || format != inputPoolFormat) {
+            releaseInputPool();
+            const int32_t values[] = { width, height, (int32_t) format };
+            CFNumberRef numbers[3];
+            for (int i = 0; i < 3; ++i) numbers[i] = CFNumberCreate(kCFAllocatorDefault, kCFNumberSInt32Type, &values[i]);
+            CFDictionaryRef ioSurface = CFDictionaryCreate(kCFAllocatorDefault, nullptr, nullptr, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+            const void* keys[] = { kCVPixelBufferWidthKey, kCVPixelBufferHeightKey, kCVPixelBufferPixelFormatTypeKey, kCVPixelBufferIOSurfacePropertiesKey };
+            const void* vals[] = { numbers[0], numbers[1], numbers[2], ioSurface };
+            CFDictionaryRef attrs = CFDictionaryCreate(kCFAllocatorDefault, keys, vals, 4, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+            if (CVPixelBufferPoolCreate(kCFAllocatorDefault, nullptr, attrs, &inputPool) != kCVReturnSuccess) inputPool = nullptr;
+            CFRelease(attrs);
+            CFRelease(ioSurface);
+            for (auto* n : numbers) CFRelease(n);
+            if (inputPool == nullptr) { LogMessage("VT: cannot create an input buffer pool"); return nullptr; }
+            inputPoolWidth = width; inputPoolHeight = height; inputPoolFormat = format;
+        }
+        CVPixelBufferRef pixel = nullptr;
+        if (CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, inputPool, &pixel) != kCVReturnSuccess) return nullptr;
+        return pixel;
+    }
+
+    void releaseInputPool() {
+        if (inputPool != nullptr) CVPixelBufferPoolRelease(inputPool);
+        inputPool = nullptr;
+    }
+#endif
+
+    // Pacing: one thread releases audio and video in PTS order at real-time rate (microsecond deadlines)
+    // Payloads stay in the encoder's own memory (retained) all the way to the socket
+    struct PacedPacket {
+        MediaBuffer::Ptr buffer;
         juce::int64 ptsMs { 0 };
+        bool isVideo { false };
         bool keyframe { false };
+        juce::int64 queuedUs { 0 };
     };
-    std::deque<PendingFrame> pendingFrames;
-    std::mutex pendingMutex;
-    std::atomic<bool> pacingStarted { false };
-    std::chrono::steady_clock::time_point wallStart;
-    dispatch_source_t pacerTimer { nullptr };
-
-    // Audio pacing
-    struct PendingAudio {
-        juce::HeapBlock<uint8_t> bytes;
-        size_t length { 0 };
-        juce::int64 ptsMs { 0 };
-    };
-    std::deque<PendingAudio> pendingAudio;
-    std::mutex audioMutex;
-    std::atomic<bool> audioPacingStarted { false };
-    dispatch_source_t audioTimer { nullptr };
-
-    void startAudioPacingIfNeeded() {
-        if (audioPacingStarted.load()) return;
-        audioTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0));
-        if (!audioTimer) return;
-        // Fire every ~21ms for 48kHz AAC (1024 samples ≈ 21.33ms)
-        dispatch_source_set_timer(audioTimer, dispatch_time(DISPATCH_TIME_NOW, 0), (uint64_t)(21 * NSEC_PER_MSEC), (uint64_t)(1 * NSEC_PER_MSEC));
-        dispatch_source_set_event_handler(audioTimer, ^{
-            if (!ptsBaseSet.load()) return;
-            auto now = std::chrono::steady_clock::now();
-            juce::int64 elapsedMs = (juce::int64) std::chrono::duration_cast<std::chrono::milliseconds>(now - wallStart).count();
-            int sentThisTick = 0;
-            while (sentThisTick < 2) { // allow up to 2 AAC packets per tick to catch up slightly
-                PendingAudio pa;
-                {
-                    std::lock_guard<std::mutex> lk(audioMutex);
-                    if (pendingAudio.empty()) break;
-                    if (pendingAudio.front().ptsMs > elapsedMs) break; // not yet due
-                    pa = std::move(pendingAudio.front());
-                    pendingAudio.pop_front();
-                }
-                rtmp.writeAudioFrame(pa.bytes.getData(), pa.length, pa.ptsMs);
-                ++sentThisTick;
+    PacingQueue<PacedPacket> pacer;
+    std::thread pacerThread;
+
+    // Telemetry: capture -> encoded -> released by the pacer; the egress side records the send
+    Telemetry::Histogram& encodeLatencyMetric = Telemetry::getInstance().histogram("latency.videoEncodeUs");
+    Telemetry::Histogram& paceLatencyMetric = Telemetry::getInstance().histogram("latency.paceUs");
+    Telemetry::GaugeShare pacerDepthMetric { Telemetry::getInstance().gauge("pacer.queuedPackets") };
+    Telemetry::Gauge& framesInFlightMetric = Telemetry::getInstance().gauge("encoder.framesInFlight"); // already summed: +1/-1 per frame
+    Telemetry::Counter& pacerDropsMetric = Telemetry::getInstance().counter("pacer.droppedPackets");
+    Telemetry::Counter& shedFramesMetric = Telemetry::getInstance().counter("encoder.shedFrames");
+    Telemetry::Counter& failedFramesMetric = Telemetry::getInstance().counter("encoder.failedFrames");
+    Telemetry::Counter& droppedFramesMetric = Telemetry::getInstance().counter("encoder.droppedFrames"); // by VideoToolbox
+
+    void startPacer() {
+        pacer.prepare(1024);
+        pacer.start();
+        pacerThread = std::thread([this] {
+            PacedPacket p;
+            while (pacer.waitPop(p)) {
+                paceLatencyMetric.record(PrecisionClock::nowMicros() - p.queuedUs);
+                pacerDepthMetric.set((juce::int64) pacer.size());
+                if (!p.isVideo) { sendAudio(p.buffer, p.ptsMs); p.buffer = nullptr; continue; }
+                if (sendVideo(p.buffer, p.ptsMs, p.keyframe))
+                    lastVideoSentRelMs.store(p.ptsMs);
+                p.buffer = nullptr;
             }
         });
-        dispatch_resume(audioTimer);
-        audioPacingStarted.store(true);
     }
-#endif
+
+    void stopPacer() {
+        pacer.stop();
+        if (pacerThread.joinable()) pacerThread.join();
+        pacer.clear();
+    }
+
+    void schedule(PacedPacket&& p) {
+        const juce::int64 ptsUs = p.ptsMs * 1000;
+        p.queuedUs = PrecisionClock::nowMicros();
+        if (!pacer.push(std::move(p), ptsUs)) { pacerDropsMetric.add(); LogEvent("LIVE: pacing queue full, dropping packet"); }
+    }
+
+    // Capture thread: the frame's slot on the fps grid of the stream timeline, false to skip it
+    bool stampVideo(juce::int64& relMs) {
+        relMs = clock.videoPtsMs(PrecisionClock::nowMicros(), cfg.fps);
+        return relMs >= 0;
+    }
+
+    // Encoded video from either encoder: GOP-aware shedding. False means drop the frame.
+    bool admitVideo(bool keyframe, juce::int64 relMs) {
+        // Capture to encoded: the frame's slot on the timeline against the clock now
+        encodeLatencyMetric.record(PrecisionClock::nowMicros() - clock.getOriginMicros() - relMs * 1000);
+        // If the backlog is large, shed the rest of this GOP (and ask for an early IDR) rather than single frames
+        const juce::int64 lastSent = lastVideoSentRelMs.load();
+        const bool wasDropping = videoGop.isDropping();
+        if (!videoGop.admit(keyframe, (relMs - lastSent) > 1000)) {
+            if (!wasDropping) LogEvent("LIVE: backlog, dropping to next keyframe relMs={} lastSent={}", relMs, lastSent);
+            shedFramesMetric.add();
+            return false;
+        }
+        return true;
+    }
+
+    void scheduleVideo(MediaBuffer::Ptr frame, juce::int64 relMs, bool keyframe) {
+        PacedPacket pf;
+        pf.buffer = std::move(frame);
+        pf.ptsMs = relMs;
+        pf.isVideo = true;
+        pf.keyframe = keyframe;
+        schedule(std::move(pf));
+    }
+
+    // VideoToolbox stays the macOS encoder unless software encoding is asked for
+    bool wantsSoftwareEncoder() const {
+       #if JUCE_MAC
+        return !cfg.useHardwareEncoder;
+       #else
+        return true;
+       #endif
+    }
+
+    bool startBackend() {
+        if (backend == nullptr) backend = EncoderBackend::createSoftware();
+        if (backend == nullptr) { LogMessage("LIVE: no software encoder (built without FFmpeg)"); return false; }
+        EncoderBackend::Callbacks cb;
+        cb.videoConfig = [this](const void* data, size_t size) { sendVideo(data, size, 0, true, true); };
+        cb.video = [this](MediaBuffer::Ptr frame, juce::int64 relMs, bool keyframe) {
+            if (admitVideo(keyframe, relMs)) scheduleVideo(std::move(frame), relMs, keyframe);
+        };
+        // Same starting point as VideoToolbox: the ABR start rate, else the configured rate
+        backend->setTargetBitrate(cfg.adaptiveBitrate ? abr.getTargetKbps() : cfg.videoBitrateKbps);
+        if (!backend->start(cfg, std::move(cb))) return false;
+        encoder = backend.get();
+        videoGop.reset();
+        videoGop.setEncoderControl(encoder);
+        if (fanOut) publisher.setEncoderControl(encoder); else rtmp.setEncoderControl(encoder);
+        LogMessage("LIVE: software encoder " + backend->getName());
+        return true;
+    }
 
     bool openRtmp() {
+        fanOut = false;
+        if (!(cfg.useLocalRelay && cfg.relayUrl.isNotEmpty()))
+            for (const auto& ep : cfg.endpoints) if (ep.enabled && ep.url.isNotEmpty()) { fanOut = true; break; }
+        if (fanOut) {
+            mux.start(cfg);
+            if (!publisher.connectAll(cfg)) return false;
+            std::lock_guard<std::mutex> lk(muxMutex);
+            FlvChunk meta;
+            if (mux.writeMetadata(meta)) publisher.sendTag(meta);
+            return true;
+        }
         if (!rtmp.open(cfg.relayUrl.isNotEmpty() && cfg.useLocalRelay ? cfg.relayUrl : cfg.rtmpUrl, cfg)) return false;
         return true;
     }
 
+    void closeRtmp() {
+        if (fanOut) { publisher.closeAll(); mux.reset(); }
+        else rtmp.close();
+    }
+
+    bool sampleTransport(TransportSample& s) {
+        s.timeMs = PrecisionClock::nowMicros() / 1000;
+        if (!fanOut) {
+            const auto st = rtmp.getStats();
+            if (!st.connected) return false;
+            s.bytesSent = st.bytesSent; s.queuedBytes = st.queuedBytes; s.queueDelayMs = st.queueDelayMs;
+            return true;
+        }
+        // One encoder feeds every endpoint: follow the most backlogged one (sticky, so its counters
+        // stay continuous). An endpoint too slow even at the floor keeps shedding GOPs on its own.
+        const auto stats = publisher.getStats();
+        if (abrSource >= stats.size() || (abrSource >= 0 && !stats.getReference(abrSource).connected)) abrSource = -1;
+        for (int i = 0; i < stats.size(); ++i) {
+            const auto& e = stats.getReference(i);
+            if (e.connected && (abrSource < 0 || e.backlogMs > stats.getReference(abrSource).backlogMs + 150)) abrSource = i;
+        }
+        if (abrSource < 0) return false;
+        const auto& e = stats.getReference(abrSource);
+        s.bytesSent = e.bytesSent; s.queuedBytes = e.backlogBytes; s.queueDelayMs = e.backlogMs; s.rttMs = e.rttMs;
+        s.sourceId = (abrSource << 16) | (e.reconnects & 0xffff);
+        return true;
+    }
+
+    void startAbr() {
+        if (!cfg.adaptiveBitrate || encoder == nullptr || abrRunning.load()) return;
+        abrSource = -1;
+        abrRunning.store(true);
+        abrThread = std::thread([this] {
+            while (abrRunning.load()) {
+                abrWake.wait(kAbrIntervalMs);
+                TransportSample sample;
+                if (!abrRunning.load() || !sampleTransport(sample)) continue;
+                const auto d = abr.update(sample);
+                if (d.action == AbrController::Action::hold || !encoder->setTargetBitrate(d.targetKbps)) continue;
+                LogMessage(juce::String("ABR: ") + (d.action == AbrController::Action::decrease ? "down" : "up") + " to " + juce::String(d.targetKbps)
+                           + " kbps (sending " + juce::String((int) abr.getMeasuredKbps()) + " kbps, queue " + juce::String(sample.queueDelayMs)
+                           + " ms, rtt " + juce::String(sample.rttMs) + " ms)");
+            }
+        });
+    }
+
+    void stopAbr() {
+        abrRunning.store(false);
+        abrWake.notify();
+        if (abrThread.joinable()) abrThread.join();
+    }
+
+    bool sendVideo(const void* data, size_t size, juce::int64 ptsMs, bool keyframe, bool isConfig) {
+        if (!fanOut) return isConfig ? rtmp.setVideoConfig(data, size) : rtmp.writeVideoFrame(data, size, ptsMs, keyframe);
+        EncodedVideoFrame f;
+        f.data = data; f.size = size; f.timestampMs = ptsMs; f.isKeyframe = keyframe; f.isConfig = isConfig;
+        std::lock_guard<std::mutex> lk(muxMutex);
+        FlvChunk chunk;
+        return mux.pushVideo(f, chunk) && publisher.sendTag(chunk);
+    }
+
+    bool sendAudio(const void* data, size_t size, juce::int64 ptsMs, bool isConfig) {
+        if (!fanOut) return isConfig ? rtmp.setAudioConfig(data, size) : rtmp.writeAudioFrame(data, size, ptsMs);
+        EncodedAudioFrame f;
+        f.data = data; f.size = size; f.timestampMs = ptsMs; f.isConfig = isConfig;
+        std::lock_guard<std::mutex> lk(muxMutex);
+        FlvChunk chunk;
+        return mux.pushAudio(f, chunk) && publisher.sendTag(chunk);
+    }
+
+    // Media frames by reference: the muxed tag / egress packet shares `frame` instead of copying it
+    bool sendVideo(const MediaBuffer::Ptr& frame, juce::int64 ptsMs, bool keyframe) {
+        if (frame == nullptr) return false;
+        if (!fanOut) return rtmp.writeVideoFrame(frame, ptsMs, keyframe);
+        EncodedVideoFrame f;
+        f.data = frame->data(); f.size = frame->size(); f.timestampMs = ptsMs; f.isKeyframe = keyframe;
+        std::lock_guard<std::mutex> lk(muxMutex);
+        FlvChunk chunk;
+        return mux.pushVideo(f, chunk) && publisher.sendTag(chunk, frame);
+    }
+
+    bool sendAudio(const MediaBuffer::Ptr& frame, juce::int64 ptsMs) {
+        if (frame == nullptr) return false;
+        if (!fanOut) return rtmp.writeAudioFrame(frame, ptsMs);
+        EncodedAudioFrame f;
+        f.data = frame->data(); f.size = frame->size(); f.timestampMs = ptsMs;
+        std::lock_guard<std::mutex> lk(muxMutex);
+        FlvChunk chunk;
+        return mux.pushAudio(f, chunk) && publisher.sendTag(chunk, frame);
+    }
+
 #if JUCE_MAC
     static void vtOutputCallback(void* outputCallbackRefCon, void* sourceFrameRefCon, OSStatus status, VTEncodeInfoFlags infoFlags, CMSampleBufferRef sampleBuffer) {
-        juce::ignoreUnused(sourceFrameRefCon, infoFlags);
+        juce::ignoreUnused(sourceFrameRefCon);
         auto* self = static_cast<Impl*>(outputCallbackRefCon);
-        if (status != noErr || !sampleBuffer) return;
+        self->framesInFlightMetric.add(-1);
+        if ((infoFlags & kVTEncodeInfo_FrameDropped) != 0) self->droppedFramesMetric.add();
+        if (status != noErr || !sampleBuffer) { if (status != noErr) self->failedFramesMetric.add(); return; }
         bool keyframe = false;
         CFArrayRef attachments = CMSampleBufferGetSampleAttachmentsArray(sampleBuffer, false);
         if (attachments && CFArrayGetCount(attachments) > 0) {
             CFDictionaryRef att = (CFDictionaryRef)CFArrayGetValueAtIndex(attachments, 0);
             keyframe = !CFDictionaryContainsKey(att, kCMSampleAttachmentKey_NotSync);
         }
-        // We will generate a CFR timeline; ignore capture PTS
+        // The PTS we stamped on the way in (MediaClock ms)
+        const juce::int64 relMs = CMTimeConvertScale(CMSampleBufferGetPresentationTimeStamp(sampleBuffer), 1000, kCMTimeRoundingMethod_Default).value;
 
         // Extract SPS/PPS once
         if (self->spsppsSize == 0) {
@@ -134,80 +392,27 @@ struct streaming::LiveStreamer::Impl {
                     self->spsppsSize = (size_t)avcc.getDataSize();
                     self->spspps.allocate(self->spsppsSize, true);
                     memcpy(self->spspps.getData(), avcc.getData(), self->spsppsSize);
-                    self->rtmp.setVideoConfig(self->spspps.getData(), self->spsppsSize);
-                    LogMessage("VT: SPS/PPS extracted and set (avcC) size=" + juce::String((int)self->spsppsSize));
+                    self->sendVideo(self->spspps.getData(), self->spsppsSize, 0, true, true);
+                    LogEvent("VT: SPS/PPS extracted and set (avcC) size={}", self->spsppsSize);
                 }
             }
         }
 
-        // Base PTS and CFR counter
-        if (!self->ptsBaseSet.load()) {
-            self->ptsBaseSet.store(true);
-            self->wallStart = std::chrono::steady_clock::now();
-            self->lastVideoSentRelMs.store(0);
-        }
-        const int frameMs = (self->cfg.fps > 0 ? (int) llround(1000.0 / (double) self->cfg.fps) : 33);
-        int64_t relMs = self->lastVideoSentRelMs.load() + frameMs;
+        // Backlog shedding
+        if (!self->admitVideo(keyframe, relMs)) return;
 
-        // Emit frame (enqueue for paced sending)
         CMBlockBufferRef bb = CMSampleBufferGetDataBuffer(sampleBuffer);
-        if (!bb) return;
-        size_t totalLen = 0; char* dataPtr = nullptr;
-        OSStatus st = CMBlockBufferGetDataPointer(bb, 0, nullptr, &totalLen, &dataPtr);
-        if (st != noErr || totalLen == 0 || dataPtr == nullptr) return;
-
-        // If backlog is large, drop non-keyframes to avoid bursts
-        juce::int64 lastSent = self->lastVideoSentRelMs.load();
-        if (!keyframe && (relMs - lastSent) > 1000) {
-            LogMessage("VT: dropping non-keyframe due to backlog relMs=" + juce::String((int)relMs) + " lastSent=" + juce::String((int)lastSent));
-            return;
-        }
-
-        // Copy frame bytes as the CMBlockBuffer will not remain valid after callback
-        PendingFrame pf;
-        pf.bytes.allocate(totalLen, true);
-        memcpy(pf.bytes.getData(), dataPtr, totalLen);
-        pf.length = totalLen;
-        pf.ptsMs = relMs;
-        pf.keyframe = keyframe;
-        {
-            std::lock_guard<std::mutex> lk(self->pendingMutex);
-            self->pendingFrames.emplace_back(std::move(pf));
-        }
+        if (!bb || CMBlockBufferGetDataLength(bb) == 0) return;
 
-        // Start pacing on first video if not started
-        if (!self->pacingStarted.load()) {
-            self->wallStart = std::chrono::steady_clock::now();
-            self->pacerTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0));
-            if (self->pacerTimer) {
-                // Pace according to cfg.fps (one frame period)
-                int32_t frameMs = (self->cfg.fps > 0 ? (int32_t) llround(1000.0 / (double) self->cfg.fps) : 33);
-                dispatch_source_set_timer(self->pacerTimer, dispatch_time(DISPATCH_TIME_NOW, 0), (uint64_t)(frameMs * NSEC_PER_MSEC), (uint64_t)(1 * NSEC_PER_MSEC));
-                dispatch_source_set_event_handler(self->pacerTimer, ^{
-                    auto now = std::chrono::steady_clock::now();
-                    juce::int64 elapsedMs = (juce::int64) std::chrono::duration_cast<std::chrono::milliseconds>(now - self->wallStart).count();
-                    int sentThisTick = 0;
-                    while (sentThisTick < 1) {
-                        PendingFrame next;
-                        {
-                            std::lock_guard<std::mutex> lk(self->pendingMutex);
-                            if (self->pendingFrames.empty()) break;
-                            // Only send when its PTS is due
-                            if (self->pendingFrames.front().ptsMs > elapsedMs) break;
-                            next = std::move(self->pendingFrames.front());
-                            self->pendingFrames.pop_front();
-                        }
-                        // Send
-                        if (self->rtmp.writeVideoFrame(next.bytes.getData(), next.length, next.ptsMs, next.keyframe)) {
-                            self->lastVideoSentRelMs.store(next.ptsMs);
-                        }
-                        ++sentThisTick;
-                    }
-                });
-                dispatch_resume(self->pacerTimer);
-                self->pacingStarted.store(true);
-            }
-        }
+        // Keep the encoder's block buffer alive instead of copying it. VT output is normally contiguous,
+        // in which case this just retains it; otherwise CoreMedia makes the one contiguous copy.
+        const size_t totalLen = CMBlockBufferGetDataLength(bb);
+        if (!CMBlockBufferIsRangeContiguous(bb, 0, 0)) MediaBuffer::noteCopied(totalLen);
+        CMBlockBufferRef contiguous = nullptr;
+        if (CMBlockBufferCreateContiguous(kCFAllocatorDefault, bb, kCFAllocatorDefault, nullptr, 0, 0, 0, &contiguous) != noErr || !contiguous) return;
+        char* dataPtr = nullptr;
+        if (CMBlockBufferGetDataPointer(contiguous, 0, nullptr, nullptr, &dataPtr) != noErr || dataPtr == nullptr) { CFRelease(contiguous); return; }
+        self->scheduleVideo(MediaBuffer::wrap(dataPtr, totalLen, [](void* o) { CFRelease((CFTypeRef) o); }, (void*) contiguous), relMs, keyframe);
     }
 
     bool initVideoEncoder() {
@@ -223,11 +428,10 @@ struct streaming::LiveStreamer::Impl {
         int32_t fps = cfg.fps;
         CFNumberRef fpsNum = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &fps);
         VTSessionSetProperty(vt, kVTCompressionPropertyKey_ExpectedFrameRate, fpsNum); vtRelease(fpsNum);
-        // Bitrate ramp: start lower to stabilize ingest, then raise to target
-        int32_t bpsTarget = cfg.videoBitrateKbps * 1000;
-        int32_t bpsInitial = (int32_t) std::lround((double) bpsTarget * 0.6);
-        CFNumberRef br = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &bpsInitial);
-        VTSessionSetProperty(vt, kVTCompressionPropertyKey_AverageBitRate, br); vtRelease(br);
+        // Start lower to stabilize ingest. With ABR the controller raises it as the link allows;
+        // without, a one-shot ramp to the target follows after 5 s.
+        const int startKbps = cfg.adaptiveBitrate ? abr.getTargetKbps() : (int) std::lround(cfg.videoBitrateKbps * 0.6);
+        VtEncoderControl::applyBitrate(vt, startKbps);
         // Short initial GOP (1s) for faster detection, will switch later
         int32_t keyintInitial = fps;
         CFNumberRef gopInit = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &keyintInitial);
@@ -243,14 +447,15 @@ struct streaming::LiveStreamer::Impl {
             ? kVTProfileLevel_H264_High_4_2
             : kVTProfileLevel_H264_High_4_1;
         VTSessionSetProperty(vt, kVTCompressionPropertyKey_ProfileLevel, level);
-        // Constrain data rate window (per-second). This property expects BYTES/sec and a window in seconds.
-        NSNumber* bytesPerSecInit = @(bpsInitial / 8);
-        NSNumber* windowSec = @(1);
-        VTSessionSetProperty(vt, kVTCompressionPropertyKey_DataRateLimits, (__bridge CFArrayRef)@[bytesPerSecInit, windowSec]);
 
         st = VTCompressionSessionPrepareToEncodeFrames(vt);
         if (st != noErr) { LogMessage("VT: prepare failed"); return false; }
         vtReady.store(true);
+        vtControl.attach(vt, startKbps);
+        encoder = &vtControl;
+        videoGop.reset();
+        videoGop.setEncoderControl(encoder);
+        if (fanOut) publisher.setEncoderControl(encoder); else rtmp.setEncoderControl(encoder);
         LogMessage("VT: ready");
 
         // After 2s, switch to configured GOP (2s by default)
@@ -261,159 +466,165 @@ struct streaming::LiveStreamer::Impl {
             VTSessionSetProperty(vt, kVTCompressionPropertyKey_MaxKeyFrameInterval, gopFinal); vtRelease(gopFinal);
         });
 
-        // After 5s, raise to target bitrate and update data rate window
-        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5 * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
-            if (!vt) return;
-            CFNumberRef brFinal = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &bpsTarget);
-            VTSessionSetProperty(vt, kVTCompressionPropertyKey_AverageBitRate, brFinal); vtRelease(brFinal);
-            NSNumber* bytesPerSecFinal = @(bpsTarget / 8);
-            NSNumber* windowSecFinal = @(1);
-            VTSessionSetProperty(vt, kVTCompressionPropertyKey_DataRateLimits, (__bridge CFArrayRef)@[bytesPerSecFinal, windowSecFinal]);
-        });
-        return true;
-    }
-
-    bool initAudioConverter() {
-        // Input: float32 non-interleaved
-        inFmt = [[AVAudioFormat alloc] initStandardFormatWithSampleRate:cfg.audioSampleRate channels:cfg.audioChannels];
-        // Output: AAC LC
-        NSDictionary* settings = @{ AVFormatIDKey: @(kAudioFormatMPEG4AAC),
-                                     AVSampleRateKey: @(cfg.audioSampleRate),
-                                     AVNumberOfChannelsKey: @(cfg.audioChannels),
-                                     AVEncoderBitRateKey: @(cfg.audioBitrateKbps * 1000) };
-        outFmt = [[AVAudioFormat alloc] initWithSettings:settings];
-        converter = [[AVAudioConverter alloc] initFromFormat:inFmt toFormat:outFmt];
-        if (!converter) { LogMessage("AAC: converter create failed"); return false; }
-        NSData* cookie = [outFmt magicCookie];
-        if (cookie && cookie.length > 0) {
-            rtmp.setAudioConfig(cookie.bytes, (size_t) cookie.length);
-            LogMessage("AAC: sent magic cookie ASC size=" + juce::String((int)cookie.length));
-        } else {
-            auto sr = (int) cfg.audioSampleRate;
-            int sfi = 4; const int srTable[] = {96000,88200,64000,48000,44100,32000,24000,22050,16000,12000,11025,8000,7350};
-            for (int i = 0; i < (int)(sizeof(srTable)/sizeof(srTable[0])); ++i) { if (srTable[i] == sr) { sfi = i; break; } }
-            int ch = juce::jlimit(1, 2, (int) cfg.audioChannels);
-            uint8_t asc[2];
-            asc[0] = (uint8_t)((2 << 3) | ((sfi & 0x0F) >> 1));
-            asc[1] = (uint8_t)(((sfi & 0x01) << 7) | ((ch & 0x0F) << 3));
-            rtmp.setAudioConfig(asc, sizeof(asc));
-            LogMessage("AAC: built minimal ASC (sr=" + juce::String(sr) + ", ch=" + juce::String(ch) + ")");
+        if (!cfg.adaptiveBitrate) {
+            const int targetKbps = cfg.videoBitrateKbps;
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(5 * NSEC_PER_SEC)), dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+                if (!vt) return;
+                vtControl.setTargetBitrate(targetKbps);
+            });
         }
-        LogMessage("AAC: converter ready");
         return true;
     }
+
 #endif
+
+    bool startAudioEncoder() {
+        if (audioSource == nullptr) { LogMessage("LIVE: no audio source"); return false; }
+        return aac.start(*audioSource, cfg.audioSampleRate, cfg.audioChannels, cfg.audioBitrateKbps,
+                         [this](const void* data, size_t size) { sendAudio(data, size, 0, true); },
+                         [this](MediaBuffer::Ptr packet, juce::int64 ptsMs) {
+                             PacedPacket pa;
+                             pa.buffer = std::move(packet);
+                             pa.ptsMs = ptsMs;
+                             schedule(std::move(pa));
+                         },
+                         &clock);
+    }
 };
 
 LiveStreamer::LiveStreamer() : impl(new Impl()) {}
-LiveStreamer::~LiveStreamer() { stop(); }
+LiveStreamer::~LiveStreamer() {
+    stop();
+#if JUCE_MAC
+    impl->releaseInputPool(); // not in stop(): a capture thread may still be inside pushVideoFrame
+#endif
+}
 
 bool LiveStreamer::start(const StreamingConfig& cfg) {
     impl->cfg = cfg;
+    impl->abr.reset(AbrController::settingsFromConfig(cfg));
     if (!impl->openRtmp()) return false;
+    // From here on a failure tears down whatever already started (connection, encoders) the way stop() does
+    auto fail = [this] { stop(); return false; };
+    impl->clock.reset();
+    impl->lastVideoSentRelMs.store(0);
+    impl->useBackend = impl->wantsSoftwareEncoder() && impl->startBackend();
 #if JUCE_MAC
-    if (!impl->initVideoEncoder()) return false;
-    if (!impl->initAudioConverter()) return false;
-    impl->active.store(true);
-    impl->sentFirstVideo = false;
-    impl->aacQueue = dispatch_queue_create("live.aac.queue", DISPATCH_QUEUE_SERIAL);
-    impl->ptsBaseSet.store(false);
-    impl->basePtsMs.store(0);
-    impl->audioPtsMs = 0;
-        impl->startAudioPacingIfNeeded();
+    if (!impl->useBackend) {
+        if (!cfg.useHardwareEncoder) LogMessage("LIVE: software encoder unavailable, using VideoToolbox");
+        if (!impl->initVideoEncoder()) return fail();
+        impl->sentFirstVideo = false;
+    }
+#else
+    if (!impl->useBackend) return fail();
 #endif
+    if (!impl->startAudioEncoder()) return fail();
+    impl->active.store(true);
+    impl->startPacer();
+    impl->startAbr();
     return true;
 }
 
 void LiveStreamer::stop() {
-#if JUCE_MAC
+    impl->stopAbr();
+    impl->publisher.setEncoderControl(nullptr);
+    impl->rtmp.setEncoderControl(nullptr);
+    impl->encoder = nullptr;
     impl->active.store(false);
-    if (impl->pacerTimer) { dispatch_source_cancel(impl->pacerTimer); impl->pacerTimer = nullptr; }
-    if (impl->audioTimer) { dispatch_source_cancel(impl->audioTimer); impl->audioTimer = nullptr; }
-    {
-        std::lock_guard<std::mutex> lk(impl->pendingMutex);
-        impl->pendingFrames.clear();
-    }
-    {
-        std::lock_guard<std::mutex> lk2(impl->audioMutex);
-        impl->pendingAudio.clear();
-    }
+    // The backend object outlives stop(): capture/audio threads may still be inside a push call
+    if (impl->backend != nullptr) impl->backend->stop();
+    impl->aac.stop();
+    impl->stopPacer();
+#if JUCE_MAC
+    impl->vtControl.detach();
     if (impl->vt) { VTCompressionSessionInvalidate(impl->vt); CFRelease(impl->vt); impl->vt = nullptr; }
-    impl->converter = nil; impl->inFmt = nil; impl->outFmt = nil;
-    impl->aacQueue = nullptr;
 #endif
-    impl->rtmp.close();
+    impl->closeRtmp();
+}
+
+void LiveStreamer::setAudioSource(AudioTap* tap) { impl->audioSource = tap; }
+
+size_t LiveStreamer::getQueuedBytes() const {
+    if (!impl->fanOut) return impl->rtmp.getStats().queuedBytes;
+    size_t total = 0;
+    for (const auto& e : impl->publisher.getStats()) total += e.backlogBytes;
+    return total;
 }
 
-void LiveStreamer::pushAudioPCM(const juce::AudioBuffer<float>& buffer, int numSamples, double sampleRate, int numChannels) {
-    juce::ignoreUnused(sampleRate, numChannels);
+void LiveStreamer::pushVideoFrame(const RawVideoFrame& frame) {
+    if (!impl->active.load()) return;
+    if (impl->useBackend) {
+        RawVideoFrame f = frame;
+        if (impl->stampVideo(f.ptsMs)) impl->backend->encodeVideo(f);
+        return;
+    }
 #if JUCE_MAC
-    if (!impl->active.load() || !impl->converter || !impl->inFmt || !impl->outFmt || impl->aacQueue == nullptr) return;
-    if (!impl->ptsBaseSet.load()) return;
-    AVAudioPCMBuffer* inBuf = [[AVAudioPCMBuffer alloc] initWithPCMFormat:impl->inFmt frameCapacity:(AVAudioFrameCount) numSamples];
-    inBuf.frameLength = (AVAudioFrameCount) numSamples;
-    const int ch = juce::jmin(buffer.getNumChannels(), (int) impl->inFmt.channelCount);
-    for (int c = 0; c < ch; ++c) {
-        memcpy(inBuf.floatChannelData[c], buffer.getReadPointer(c), sizeof(float) * (size_t) numSamples);
+    // VideoToolbox path: copy BGRA or NV12 into a pooled CVPixelBuffer
+    const bool nv12 = frame.format == RawVideoFrame::PixelFormat::nv12;
+    if ((!nv12 && frame.format != RawVideoFrame::PixelFormat::bgra) || frame.planes[0] == nullptr || (nv12 && frame.planes[1] == nullptr)) return;
+    CVPixelBufferRef pixel = impl->takeInputBuffer(frame.width, frame.height, nv12 ? kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange : kCVPixelFormatType_32BGRA);
+    if (pixel == nullptr) return;
+    CVPixelBufferLockBaseAddress(pixel, 0);
+    for (size_t p = 0; p < (nv12 ? 2u : 1u); ++p) {
+        auto* dst = (uint8_t*) (nv12 ? CVPixelBufferGetBaseAddressOfPlane(pixel, p) : CVPixelBufferGetBaseAddress(pixel));
+        const size_t dstStride = nv12 ? CVPixelBufferGetBytesPerRowOfPlane(pixel, p) : CVPixelBufferGetBytesPerRow(pixel);
+        const int rows = p == 0 ? frame.height : frame.height / 2;
+        const size_t rowBytes = nv12 ? (size_t) frame.width : (size_t) frame.width * 4;
+        for (int y = 0; y < rows; ++y)
+            memcpy(dst + (size_t) y * dstStride, frame.planes[p] + (size_t) y * (size_t) frame.strides[p], rowBytes);
     }
-    juce::int64 ptsMs = impl->audioPtsMs;
-    impl->audioPtsMs += (int64_t) llround(1000.0 * (double) numSamples / (double) impl->cfg.audioSampleRate);
-    AVAudioFormat* outFmt = impl->outFmt;
-    AVAudioConverter* conv = impl->converter;
-    std::atomic<bool>* activePtr = &impl->active;
-    std::deque<Impl::PendingAudio>* pendingAudio = &impl->pendingAudio;
-    std::mutex* audioMutex = &impl->audioMutex;
-    dispatch_async(impl->aacQueue, ^{
-        if (!conv) return;
-        AVAudioCompressedBuffer* outBuf = [[AVAudioCompressedBuffer alloc] initWithFormat:outFmt packetCapacity:512 maximumPacketSize:2048];
-        NSError* err = nil;
-        AVAudioConverterOutputStatus st = [conv convertToBuffer:outBuf error:&err withInputFromBlock:^AVAudioBuffer * _Nullable(AVAudioPacketCount inNumberOfPackets, AVAudioConverterInputStatus * _Nonnull outStatus) {
-            juce::ignoreUnused(inNumberOfPackets);
-            if (inBuf.frameLength > 0) { *outStatus = AVAudioConverterInputStatus_HaveData; return (AVAudioBuffer*) inBuf; }
-            *outStatus = AVAudioConverterInputStatus_EndOfStream; return (AVAudioBuffer*) nil;
-        }];
-        if (st == AVAudioConverterOutputStatus_Error || err) { LogMessage("AAC: convert failed"); return; }
-        if (!activePtr->load()) return;
-        if (outBuf.byteLength > 0) {
-            AVAudioPacketCount pc = outBuf.packetCount;
-            const AudioStreamPacketDescription* pds = outBuf.packetDescriptions;
-            const int64_t packetDurMs = (int64_t) llround(1024.0 * 1000.0 / (double) impl->cfg.audioSampleRate);
-            uint8_t* base = (uint8_t*) outBuf.data;
-            for (AVAudioPacketCount i = 0; i < pc; ++i) {
-                size_t offs = (size_t) pds[i].mStartOffset;
-                size_t sz   = (size_t) pds[i].mDataByteSize;
-                Impl::PendingAudio pa;
-                pa.bytes.allocate(sz, true);
-                memcpy(pa.bytes.getData(), base + offs, sz);
-                pa.length = sz;
-                pa.ptsMs = ptsMs + (int64_t) i * packetDurMs;
-                std::lock_guard<std::mutex> lk(*audioMutex);
-                pendingAudio->emplace_back(std::move(pa));
-            }
-        }
-    });
+    CVPixelBufferUnlockBaseAddress(pixel, 0);
+    pushPixelBuffer(pixel, frame.ptsMs);
+    CVBufferRelease(pixel);
 #endif
 }
 
 void LiveStreamer::pushPixelBuffer(void* cvPixelBufferRef, int64_t ptsMs) {
 #if JUCE_MAC
+    juce::ignoreUnused(ptsMs); // restamped on arrival
+    if (impl->useBackend) {
+        if (!impl->active.load()) return;
+        // Software encoder reads the pixels in place (NV12 from capture, BGRA otherwise)
+        CVPixelBufferRef pix = (CVPixelBufferRef) cvPixelBufferRef;
+        if (CVPixelBufferLockBaseAddress(pix, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess) return;
+        RawVideoFrame f;
+        f.width = (int) CVPixelBufferGetWidth(pix);
+        f.height = (int) CVPixelBufferGetHeight(pix);
+        if (!impl->stampVideo(f.ptsMs)) { CVPixelBufferUnlockBaseAddress(pix, kCVPixelBufferLock_ReadOnly); return; }
+        const OSType type = CVPixelBufferGetPixelFormatType(pix);
+        if (type == kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange || type == kCVPixelFormatType_420YpCbCr8BiPlanarFullRange) {
+            f.format = RawVideoFrame::PixelFormat::nv12;
+            for (size_t p = 0; p < 2; ++p) {
+                f.planes[p] = (const uint8_t*) CVPixelBufferGetBaseAddressOfPlane(pix, p);
+                f.strides[p] = (int) CVPixelBufferGetBytesPerRowOfPlane(pix, p);
+            }
+        } else {
+            f.planes[0] = (const uint8_t*) CVPixelBufferGetBaseAddress(pix);
+            f.strides[0] = (int) CVPixelBufferGetBytesPerRow(pix);
+        }
+        impl->backend->encodeVideo(f);
+        CVPixelBufferUnlockBaseAddress(pix, kCVPixelBufferLock_ReadOnly);
+        return;
+    }
     if (!impl->vt || !impl->vtReady.load() || !impl->active.load()) return;
     CVImageBufferRef pix = (CVImageBufferRef) cvPixelBufferRef;
-    CMTime pts = CMTimeMake(ptsMs, 1000);
+    juce::int64 relMs = 0;
+    if (!impl->stampVideo(relMs)) return;
+    CMTime pts = CMTimeMake(relMs, 1000);
     VTEncodeInfoFlags flags = 0;
     CFDictionaryRef opts = nullptr;
-    if (!impl->sentFirstVideo) {
+    if (!impl->sentFirstVideo || impl->vtControl.takeKeyframeRequest()) {
         const void* keys[] = { kVTEncodeFrameOptionKey_ForceKeyFrame };
         const void* vals[] = { kCFBooleanTrue };
         opts = CFDictionaryCreate(kCFAllocatorDefault, keys, vals, 1, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
     }
+    impl->framesInFlightMetric.add(1);
     OSStatus st = VTCompressionSessionEncodeFrame(impl->vt, pix, pts, kCMTimeInvalid, opts, nullptr, &flags);
     if (opts) CFRelease(opts);
-    if (st != noErr) { LogMessage("VT: encode frame failed" ); }
+    if (st != noErr) { impl->framesInFlightMetric.add(-1); impl->failedFramesMetric.add(); LogEvent("VT: encode frame failed status={}", (int) st); }
     impl->sentFirstVideo = true;
 #else
     juce::ignoreUnused(cvPixelBufferRef, ptsMs);
 #endif
 }
 
-// (removed static duplicate: audio pacing implemented as Impl::startAudioPacingIfNeeded)
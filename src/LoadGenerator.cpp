@@ -0,0 +1,386 @@
+#include "LoadGenerator.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+ #define LOADGEN_SSE2 1
+ #include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+ #define LOADGEN_NEON 1
+ #include <arm_neon.h>
+#endif
+
+namespace streaming {
+
+namespace {
+constexpr int kNumScenes = 4;
+constexpr double kChirpSec = 10.0;
+
+// Scripts behind the built-in names
+const char* const builtInScripts[][2] = {
+    { "steady", "# one scene panning, a box bouncing, a tone\n" },
+    { "cuts", "loop 20\n0 cut 0\n5 cut 1\n10 cut 2\n15 cut 3\n" },
+    { "spikes", "loop 10\n5 spike 2\n" },
+    { "static", "loop 12\n2 still 8\n" },
+    { "capacity", "loop 60\n0 cut 0\n0 audio tone\n10 cut 1\n15 spike 3\n25 still 5\n30 audio chirp\n35 cut 2\n40 spike 5\n50 cut 3\n55 audio noise\n" },
+};
+
+const char* const signalNames[] = { "tone", "chirp", "noise", "silence" };
+
+// 5x7 glyphs, bit 4 the leftmost column: digits, ':', '.', '#', ' '
+const uint8_t glyphs[][7] = {
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C },
+    { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A }, { 0, 0, 0, 0, 0, 0, 0 },
+};
+
+const uint8_t* glyphFor(char c) {
+    if (c >= '0' && c <= '9') return glyphs[c - '0'];
+    return glyphs[c == ':' ? 10 : c == '.' ? 11 : c == '#' ? 12 : 13];
+}
+
+inline juce::uint32 mix32(juce::uint32 x) noexcept {
+    x ^= x >> 16; x *= 0x7feb352dU; x ^= x >> 15; x *= 0x846ca68bU; x ^= x >> 16;
+    return x;
+}
+
+// Repeats a 4-byte pattern over `bytes` bytes; the pattern's phase follows dst, so any multiple of
+// the pixel size works
+void fillPattern(uint8_t* dst, size_t bytes, juce::uint32 pattern) noexcept {
+#if LOADGEN_SSE2
+    const __m128i v = _mm_set1_epi32((int) pattern);
+    for (; bytes >= 64; dst += 64, bytes -= 64) {
+        _mm_storeu_si128((__m128i*) dst, v);
+        _mm_storeu_si128((__m128i*) (dst + 16), v);
+        _mm_storeu_si128((__m128i*) (dst + 32), v);
+        _mm_storeu_si128((__m128i*) (dst + 48), v);
+    }
+    for (; bytes >= 16; dst += 16, bytes -= 16) _mm_storeu_si128((__m128i*) dst, v);
+#elif LOADGEN_NEON
+    const uint8x16_t v = vreinterpretq_u8_u32(vdupq_n_u32(pattern));
+    for (; bytes >= 16; dst += 16, bytes -= 16) vst1q_u8(dst, v);
+#endif
+    for (size_t i = 0; i < bytes; ++i) dst[i] = (uint8_t) (pattern >> (8 * (i & 3)));
+}
+
+struct Rgb { int r, g, b; };
+
+// BT.601 limited range, as the encoders assume for NV12
+inline int lumaOf(Rgb c) noexcept { return ((66 * c.r + 129 * c.g + 25 * c.b + 128) >> 8) + 16; }
+inline int cbOf(Rgb c) noexcept { return ((-38 * c.r - 74 * c.g + 112 * c.b + 128) >> 8) + 128; }
+inline int crOf(Rgb c) noexcept { return ((112 * c.r - 94 * c.g - 18 * c.b + 128) >> 8) + 128; }
+
+// One picture in the generator's format: BGRA in one plane, or NV12 as Y and interleaved CbCr at half resolution
+struct Image {
+    juce::HeapBlock<uint8_t> planes[2];
+    int numPlanes { 0 }, width { 0 }, height { 0 };
+    int strides[2] {}, bytesPerPixel[2] {}, shift[2] {};
+
+    void allocate(LoadGenerator::Format format, int w, int h) {
+        width = w;
+        height = h;
+        numPlanes = format == LoadGenerator::Format::bgra ? 1 : 2;
+        for (int p = 0; p < numPlanes; ++p) {
+            shift[p] = p;
+            bytesPerPixel[p] = format == LoadGenerator::Format::bgra ? 4 : (p == 0 ? 1 : 2);
+            strides[p] = ((w >> p) * bytesPerPixel[p] + 63) & ~63;
+            planes[p].calloc((size_t) strides[p] * (size_t) (h >> p));
+        }
+    }
+    uint8_t* row(int p, int y) const noexcept { return planes[p].get() + (size_t) y * (size_t) strides[p]; }
+
+    juce::uint32 patternFor(int p, Rgb c) const noexcept {
+        if (bytesPerPixel[p] == 4) return (juce::uint32) c.b | (juce::uint32) c.g << 8 | (juce::uint32) c.r << 16 | 0xff000000u;
+        if (p == 0) return 0x01010101u * (juce::uint32) lumaOf(c);
+        return 0x00010001u * (juce::uint32) (cbOf(c) | crOf(c) << 8);
+    }
+
+    // Clipped to the picture; x, y, w, h in full-resolution pixels
+    void fillRect(int x, int y, int w, int h, Rgb c) noexcept {
+        const int x0 = juce::jmax(0, x), y0 = juce::jmax(0, y), x1 = juce::jmin(width, x + w), y1 = juce::jmin(height, y + h);
+        if (x0 >= x1 || y0 >= y1) return;
+        for (int p = 0; p < numPlanes; ++p) {
+            const auto pattern = patternFor(p, c);
+            const int px0 = x0 >> shift[p], px1 = juce::jmax(px0 + 1, x1 >> shift[p]);
+            const int py0 = y0 >> shift[p], py1 = juce::jmax(py0 + 1, y1 >> shift[p]);
+            for (int yy = py0; yy < py1; ++yy)
+                fillPattern(row(p, yy) + (size_t) px0 * (size_t) bytesPerPixel[p], (size_t) (px1 - px0) * (size_t) bytesPerPixel[p], pattern);
+        }
+    }
+
+    // Copies the window of `src` at (ox, oy), even offsets for NV12, into the whole of this picture
+    void copyWindow(const Image& src, int ox, int oy) noexcept {
+        for (int p = 0; p < numPlanes; ++p) {
+            const size_t bytes = (size_t) (width >> shift[p]) * (size_t) bytesPerPixel[p];
+            const size_t offset = (size_t) (ox >> shift[p]) * (size_t) bytesPerPixel[p];
+            for (int yy = 0; yy < height >> shift[p]; ++yy) std::memcpy(row(p, yy), src.row(p, (oy >> shift[p]) + yy) + offset, bytes);
+        }
+    }
+
+    // From an RGB function of (x, y); chroma is taken at the top-left pixel of each 2x2 block
+    template <typename Fn>
+    void paint(Fn&& colourAt) {
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x) {
+                const Rgb c = colourAt(x, y);
+                if (numPlanes == 1) {
+                    uint8_t* d = row(0, y) + (size_t) x * 4;
+                    d[0] = (uint8_t) c.b; d[1] = (uint8_t) c.g; d[2] = (uint8_t) c.r; d[3] = 0xff;
+                    continue;
+                }
+                row(0, y)[x] = (uint8_t) lumaOf(c);
+                if (((x | y) & 1) == 0) {
+                    uint8_t* d = row(1, y >> 1) + (size_t) x;
+                    d[0] = (uint8_t) cbOf(c); d[1] = (uint8_t) crOf(c);
+                }
+            }
+    }
+};
+
+inline int clampByte(int v) noexcept { return juce::jlimit(0, 255, v); }
+inline double triangle(double u) noexcept { return 1.0 - std::abs(2.0 * (u - std::floor(u)) - 1.0); }
+} // namespace
+
+bool LoadGenerator::Scenario::parse(const juce::String& script, Scenario& out, juce::String& error) {
+    Scenario s;
+    s.name = out.name;
+    int lineNumber = 0;
+    for (auto line : juce::StringArray::fromLines(script)) {
+        ++lineNumber;
+        line = line.upToFirstOccurrenceOf("#", false, false).trim();
+        if (line.isEmpty()) continue;
+        auto tokens = juce::StringArray::fromTokens(line, " \t", "");
+        tokens.removeEmptyStrings();
+        auto isNumber = [](const juce::String& t) { return t.isNotEmpty() && t.containsOnly("0123456789."); };
+        auto fail = [&](const juce::String& why) { error = "line " + juce::String(lineNumber) + ": " + why; return false; };
+        if (tokens[0] == "loop") {
+            if (tokens.size() != 2 || !isNumber(tokens[1])) return fail("expected 'loop <seconds>'");
+            s.loopSec = tokens[1].getDoubleValue();
+            continue;
+        }
+        if (tokens.size() != 3 || !isNumber(tokens[0])) return fail("expected '<seconds> <event> <argument>'");
+        Event e;
+        e.atSec = tokens[0].getDoubleValue();
+        const auto& kind = tokens[1];
+        const auto& arg = tokens[2];
+        if (kind == "audio") {
+            e.type = Event::Type::audio;
+            e.value = -1;
+            for (int k = 0; k < 4; ++k) if (arg == signalNames[k]) e.value = k;
+            if (e.value < 0) return fail("unknown signal '" + arg + "'");
+        } else if (kind == "cut") {
+            e.type = Event::Type::cut;
+            e.value = arg.getIntValue();
+            if (!isNumber(arg) || e.value >= kNumScenes) return fail("scenes are 0-" + juce::String(kNumScenes - 1));
+        } else if (kind == "still" || kind == "spike") {
+            e.type = kind == "still" ? Event::Type::still : Event::Type::spike;
+            if (!isNumber(arg)) return fail("expected a duration in seconds");
+            e.durationSec = arg.getDoubleValue();
+        } else {
+            return fail("unknown event '" + kind + "'");
+        }
+        int at = s.events.size();
+        while (at > 0 && s.events.getReference(at - 1).atSec > e.atSec) --at;
+        s.events.insert(at, e);
+    }
+    out = s;
+    return true;
+}
+
+bool LoadGenerator::Scenario::load(const juce::String& nameOrFile, Scenario& out, juce::String& error) {
+    out.name = nameOrFile;
+    for (const auto& b : builtInScripts)
+        if (nameOrFile == b[0]) return parse(b[1], out, error);
+    const auto file = juce::File::getCurrentWorkingDirectory().getChildFile(nameOrFile);
+    if (!file.existsAsFile()) { error = "no built-in scenario or file called " + nameOrFile; return false; }
+    out.name = file.getFileNameWithoutExtension();
+    return parse(file.loadFileAsString(), out, error);
+}
+
+juce::StringArray LoadGenerator::Scenario::getBuiltInNames() {
+    juce::StringArray names;
+    for (const auto& b : builtInScripts) names.add(b[0]);
+    return names;
+}
+
+struct LoadGenerator::Impl {
+    Options options;
+    Scenario scenario;
+    // Pictures larger than the frame by a margin the pan moves through; one per scene plus noise
+    Image scenes[kNumScenes], noise;
+    std::unique_ptr<Image[]> pool;
+    int poolSize { 0 }, nextBuffer { 0 };
+    RawVideoFrame frame;
+    juce::int64 audioPosition { 0 };
+
+    struct State { int scene { 0 }; bool spike { false }; double stillStartSec { -1.0 }; Signal signal { Signal::tone }; };
+
+    State stateAt(double t, bool ignoreStill) const noexcept {
+        State st;
+        if (scenario.loopSec > 0.0) t = std::fmod(t, scenario.loopSec);
+        for (const auto& e : scenario.events) {
+            if (e.atSec > t) break;
+            const bool active = t < e.atSec + e.durationSec;
+            if (e.type == Scenario::Event::Type::cut) st.scene = e.value;
+            else if (e.type == Scenario::Event::Type::audio) st.signal = (Signal) e.value;
+            else if (e.type == Scenario::Event::Type::spike) st.spike = st.spike || active;
+            else if (active && !ignoreStill) st.stillStartSec = e.atSec;
+        }
+        return st;
+    }
+
+    void paintScene(Image& img, int scene) {
+        const juce::uint32 seed = options.seed * 0x9E3779B9u + (juce::uint32) scene;
+        const int cell = juce::jmax(16, options.width / 20);
+        const Rgb tint[kNumScenes] = { { 40, 90, 160 }, { 170, 60, 40 }, { 60, 150, 70 }, { 130, 120, 30 } };
+        const Rgb t = tint[scene];
+        img.paint([&](int x, int y) {
+            // Gradient, a checkerboard and fine grain, so the encoder has edges and texture to spend bits on
+            const int gx = x * 160 / img.width, gy = y * 160 / img.height;
+            const int check = (((x / cell) ^ (y / cell)) & 1) ? 36 : -36;
+            const int grain = (int) (mix32(seed ^ (juce::uint32) (y * 65599 + x)) & 31) - 16;
+            return Rgb { clampByte(t.r + gx / 2 - gy / 3 + check + grain), clampByte(t.g + gy / 2 + check + grain),
+                         clampByte(t.b + (gx + gy) / 4 - check + grain) };
+        });
+    }
+
+    void draw(Image& img, juce::int64 index, const State& st) noexcept {
+        const double t = (double) index / options.fps;
+        const Image& src = st.spike ? noise : scenes[st.scene];
+        const int marginX = src.width - img.width, marginY = src.height - img.height;
+        int ox, oy;
+        if (st.spike) {
+            // A fresh window every frame: nothing for motion search to find
+            const auto h = mix32(options.seed ^ (juce::uint32) index * 0x85EBCA6Bu);
+            ox = (int) (h % (juce::uint32) (marginX + 1));
+            oy = (int) ((h >> 12) % (juce::uint32) (marginY + 1));
+        } else {
+            ox = (int) (0.5 * marginX * (1.0 + std::sin(2.0 * juce::MathConstants<double>::pi * t / 7.3 + st.scene)));
+            oy = (int) (0.5 * marginY * (1.0 + std::sin(2.0 * juce::MathConstants<double>::pi * t / 5.1 + st.scene)));
+        }
+        img.copyWindow(src, ox & ~1, oy & ~1);
+
+        const int boxW = (img.width / 8) & ~1, boxH = (img.height / 6) & ~1;
+        const int hue = (int) (index % 360);
+        img.fillRect((int) (triangle(t / 3.7) * (img.width - boxW)) & ~1, (int) (triangle(t / 2.9) * (img.height - boxH)) & ~1, boxW, boxH,
+                     { clampByte(255 - hue / 2), clampByte(hue / 2 + 40), clampByte(200 - hue / 3) });
+
+        // Time code and frame number, white on black, top left
+        char text[32];
+        const auto ms = index * 1000 / options.fps;
+        std::snprintf(text, sizeof(text), "%02d:%02d:%02d.%03d #%06lld", (int) (ms / 3600000), (int) (ms / 60000 % 60), (int) (ms / 1000 % 60),
+                      (int) (ms % 1000), (long long) index);
+        const int scale = juce::jmax(2, img.height / 135) & ~1, len = (int) std::strlen(text);
+        img.fillRect(scale, scale, (len * 6 + 2) * scale, 9 * scale, { 0, 0, 0 });
+        for (int i = 0; i < len; ++i) {
+            const uint8_t* g = glyphFor(text[i]);
+            for (int gy = 0; gy < 7; ++gy)
+                for (int gx = 0; gx < 5; ++gx)
+                    if (g[gy] & (0x10 >> gx)) img.fillRect((2 + i * 6 + gx) * scale, (2 + gy) * scale, scale, scale, { 255, 255, 255 });
+        }
+    }
+};
+
+LoadGenerator::LoadGenerator() : impl(std::make_unique<Impl>()) {}
+LoadGenerator::~LoadGenerator() = default;
+
+void LoadGenerator::prepare(const Options& o, const Scenario& s) {
+    auto& d = *impl;
+    d.options = o;
+    d.options.width = juce::jmax(160, o.width) & ~1;
+    d.options.height = juce::jmax(90, o.height) & ~1;
+    d.options.fps = juce::jmax(1, o.fps);
+    d.scenario = s;
+    const int w = d.options.width, h = d.options.height;
+    const int texW = (w + w / 4) & ~1, texH = (h + h / 4) & ~1;
+    for (int scene = 0; scene < kNumScenes; ++scene) {
+        d.scenes[scene].allocate(o.format, texW, texH);
+        d.paintScene(d.scenes[scene], scene);
+    }
+    d.noise.allocate(o.format, texW, texH);
+    d.noise.paint([&](int x, int y) {
+        const auto n = mix32(d.options.seed ^ (juce::uint32) (y * 131071 + x) * 0xC2B2AE35u);
+        return Rgb { (int) (n & 255), (int) ((n >> 8) & 255), (int) ((n >> 16) & 255) };
+    });
+    d.poolSize = juce::jmax(1, o.poolSize);
+    d.pool = std::make_unique<Image[]>((size_t) d.poolSize);
+    for (int i = 0; i < d.poolSize; ++i) d.pool[i].allocate(o.format, w, h);
+    d.nextBuffer = 0;
+    d.audioPosition = 0;
+}
+
+const RawVideoFrame& LoadGenerator::renderVideo(juce::int64 index) {
+    auto& d = *impl;
+    auto& img = d.pool[d.nextBuffer];
+    d.nextBuffer = (d.nextBuffer + 1) % d.poolSize;
+    const double t = (double) index / d.options.fps;
+    auto st = d.stateAt(t, false);
+    if (st.stillStartSec >= 0.0) {
+        // The frame the still began on, drawn again
+        const double loopStart = d.scenario.loopSec > 0.0 ? std::floor(t / d.scenario.loopSec) * d.scenario.loopSec : 0.0;
+        const auto first = (juce::int64) std::ceil((loopStart + st.stillStartSec) * d.options.fps - 1e-9);
+        d.draw(img, first, d.stateAt((double) first / d.options.fps, true));
+    } else {
+        d.draw(img, index, st);
+    }
+    d.frame = RawVideoFrame();
+    d.frame.format = d.options.format == Format::bgra ? RawVideoFrame::PixelFormat::bgra : RawVideoFrame::PixelFormat::nv12;
+    for (int p = 0; p < img.numPlanes; ++p) {
+        d.frame.planes[p] = img.row(p, 0);
+        d.frame.strides[p] = img.strides[p];
+    }
+    d.frame.width = img.width;
+    d.frame.height = img.height;
+    d.frame.ptsMs = index * 1000 / d.options.fps;
+    return d.frame;
+}
+
+void LoadGenerator::renderAudio(float* const* channels, int numChannels, int numFrames) {
+    auto& d = *impl;
+    const int rate = d.options.sampleRate;
+    constexpr float kLevel = 0.1f; // -20 dBFS
+    Signal signal = Signal::tone;
+    for (int i = 0; i < numFrames; ++i) {
+        const juce::int64 n = d.audioPosition + i;
+        // Looked up every 64 samples of the timeline (not of the block), so a change lands on the same sample whatever the block size
+        if (i == 0 || (n & 63) == 0) signal = d.stateAt((double) (n & ~(juce::int64) 63) / rate, true).signal;
+        for (int c = 0; c < numChannels; ++c) {
+            float v = 0.0f;
+            if (signal == Signal::tone) {
+                const int freq = (c & 1) ? 1499 : 997;
+                v = kLevel * (float) std::sin(2.0 * juce::MathConstants<double>::pi * (double) ((n * freq) % rate) / rate);
+            } else if (signal == Signal::chirp) {
+                // Logarithmic sweep 20 Hz - 20 kHz, restarting every kChirpSec
+                const double k = std::log(1000.0), tt = std::fmod((double) n / rate, kChirpSec);
+                v = kLevel * (float) std::sin(2.0 * juce::MathConstants<double>::pi * 20.0 * kChirpSec / k * (std::exp(k * tt / kChirpSec) - 1.0));
+            } else if (signal == Signal::noise) {
+                const auto h = mix32(d.options.seed ^ (juce::uint32) n * 0x9E3779B9u ^ (juce::uint32) (n >> 32) ^ (juce::uint32) c * 0x85EBCA6Bu);
+                v = kLevel * ((float) (h >> 8) / 8388608.0f - 1.0f);
+            }
+            channels[c][i] = v;
+        }
+    }
+    d.audioPosition += numFrames;
+}
+
+void LoadGenerator::resetAudio() noexcept { impl->audioPosition = 0; }
+
+juce::uint64 LoadGenerator::hashFrame(const RawVideoFrame& f) noexcept {
+    juce::uint64 h = 14695981039346656037ull;
+    const bool bgra = f.format == RawVideoFrame::PixelFormat::bgra;
+    for (int p = 0; p < (bgra ? 1 : 2); ++p) {
+        const size_t bytes = bgra ? (size_t) f.width * 4 : (size_t) f.width;
+        for (int y = 0; y < (p == 0 ? f.height : f.height / 2); ++y) {
+            const uint8_t* row = f.planes[p] + (size_t) y * (size_t) f.strides[p];
+            for (size_t i = 0; i < bytes; ++i) h = (h ^ row[i]) * 1099511628211ull;
+        }
+    }
+    return h;
+}
+
+} // namespace streaming
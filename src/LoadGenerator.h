@@ -0,0 +1,74 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <memory>
+#include "EncoderBackend.h"
+
+namespace streaming {
+
+// Deterministic synthetic input for load and capacity tests: video drawn into a small pool of reused
+// BGRA or NV12 buffers, and test audio, both following a scenario script. A frame is a function of
+// the seed, the scenario and its index only, and a sample of its position only, so two runs feed the
+// pipeline identical pictures and audio whatever the speed or block size.
+class LoadGenerator {
+public:
+    enum class Format { bgra, nv12 };
+    enum class Signal { tone, chirp, noise, silence };
+
+    // Timed changes over stream seconds, optionally looping. One event per line, '#' starts a comment:
+    //   loop 60          repeat the script every 60 s
+    //   10 cut 2         scene cut to picture 2 (0-3)
+    //   15 spike 3       full-frame noise for 3 s: the encoder runs into its rate cap
+    //   25 still 5       freeze the whole picture for 5 s (a static screen)
+    //   30 audio chirp   tone | chirp | noise | silence from here on
+    struct Scenario {
+        struct Event {
+            enum class Type { cut, still, spike, audio };
+            double atSec { 0.0 }, durationSec { 0.0 };
+            Type type { Type::cut };
+            int value { 0 }; // cut: scene; audio: Signal
+        };
+        juce::String name;
+        juce::Array<Event> events; // sorted by atSec
+        double loopSec { 0.0 };
+
+        static bool parse(const juce::String& script, Scenario& out, juce::String& error);
+        // A built-in name (see getBuiltInNames) or a script file
+        static bool load(const juce::String& nameOrFile, Scenario& out, juce::String& error);
+        static juce::StringArray getBuiltInNames();
+    };
+
+    struct Options {
+        int width { 1280 }, height { 720 };
+        int fps { 30 };               // frame index -> stream time
+        Format format { Format::bgra };
+        int poolSize { 3 };
+        juce::uint32 seed { 1 };
+        int sampleRate { 48000 };
+    };
+
+    LoadGenerator();
+    ~LoadGenerator();
+
+    // Draws the scene textures and allocates the pool; not realtime-safe
+    void prepare(const Options& options, const Scenario& scenario);
+
+    // Draws frame `index` into the next pool buffer. The view stays valid until poolSize more frames
+    // have been rendered; ptsMs is the frame's stream time.
+    const RawVideoFrame& renderVideo(juce::int64 index);
+
+    // The next numFrames samples per channel (even channels 997 Hz, odd 1499 Hz for the tone); each
+    // call continues where the last one stopped
+    void renderAudio(float* const* channels, int numChannels, int numFrames);
+    void resetAudio() noexcept;
+
+    // FNV-1a over a frame's visible bytes, to check that runs match
+    static juce::uint64 hashFrame(const RawVideoFrame& frame) noexcept;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+
+    JUCE_DECLARE_NON_COPYABLE(LoadGenerator)
+};
+
+} // namespace streaming
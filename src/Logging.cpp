@@ -0,0 +1,329 @@
+#include "Logging.h"
+#include "PacingScheduler.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+namespace streaming {
+
+namespace {
+struct RecordHeader {
+    uint32_t bytes;    // the whole record, padded to 8; 0 marks the skipped end of the ring
+    uint16_t argBytes;
+    uint8_t numArgs;
+    uint8_t reserved;
+    const char* format;
+    juce::int64 timeUs;
+};
+constexpr uint32_t kWrapMarker = 0;
+constexpr int kMaxArgs = 64;
+// The logger thread is woken early once a ring is this full, and formats into a buffer this large
+// per write
+constexpr juce::uint64 kWakeBytes = BinaryLog::kRingBytes / 4;
+constexpr size_t kOutputBufferBytes = 256 * 1024;
+// A waiting append re-checks for room this often
+constexpr int kWaitPollUs = 200;
+
+// One thread's records. The thread appends at head, the logger thread consumes at tail.
+struct LogRing {
+    alignas(64) std::atomic<juce::uint64> head { 0 };
+    alignas(64) std::atomic<juce::uint64> tail { 0 };
+    std::atomic<juce::uint64> dropped { 0 };
+    std::atomic<bool> inUse { false };
+    alignas(8) uint8_t data[BinaryLog::kRingBytes];
+};
+
+// Hands the ring back when its thread ends; records still in it are written as usual
+struct RingBinding {
+    LogRing* ring = nullptr;
+    ~RingBinding() { if (ring != nullptr) ring->inUse.store(false, std::memory_order_release); }
+};
+thread_local RingBinding tBinding;
+
+juce::File defaultLogFile(const char* timeText) {
+    auto logDir = juce::File::getSpecialLocation(juce::File::userDesktopDirectory).getChildFile("CreatorTool_Logs");
+    logDir.createDirectory();
+    return logDir.getChildFile("CreatorTool_" + juce::String(timeText).trim().replaceCharacters(" :", "__") + ".log");
+}
+}
+
+struct BinaryLog::Impl {
+    std::unique_ptr<LogRing[]> rings { new LogRing[kMaxThreads] };
+    std::atomic<juce::uint64> unbound { 0 }; // records from threads that found no free ring
+    RealtimeSignal wake;
+    std::atomic<bool> exiting { false };
+    std::thread thread;
+
+    // Logger thread, or under fileMutex
+    std::mutex fileMutex;
+    juce::File file;
+    std::unique_ptr<juce::FileOutputStream> out;
+    juce::HeapBlock<char> buffer { kOutputBufferBytes };
+    size_t buffered = 0;
+    struct Pending { juce::int64 timeUs; int ring; size_t pos; };
+    std::vector<Pending> pending;
+    juce::uint64 reportedDrops = 0;
+    // Wall clock at one monotonic instant, to date records by
+    juce::int64 baseUs = 0, baseMs = 0;
+    juce::int64 prefixSecond = -1;
+    char prefix[80] {};
+
+    // flush() waits for drains that started after it
+    std::mutex drainMutex;
+    std::condition_variable drained;
+    juce::uint64 drains = 0;
+    bool running = true;
+
+    LogRing* claim() noexcept {
+        for (int i = 0; i < kMaxThreads; ++i) {
+            auto& r = rings[(size_t) i];
+            bool expected = false;
+            if (! r.inUse.load(std::memory_order_relaxed) && r.inUse.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) return &r;
+        }
+        return nullptr;
+    }
+
+    juce::uint64 droppedTotal() const noexcept {
+        juce::uint64 total = unbound.load(std::memory_order_relaxed);
+        for (int i = 0; i < kMaxThreads; ++i) total += rings[(size_t) i].dropped.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    void run(BinaryLog& owner) {
+        while (! exiting.load()) {
+            wake.wait(kFlushIntervalMs);
+            drain(owner);
+        }
+        drain(owner);
+    }
+
+    void stop() {
+        if (! thread.joinable()) return;
+        exiting.store(true);
+        wake.notify();
+        thread.join();
+        std::lock_guard<std::mutex> lock(fileMutex);
+        out.reset();
+        std::lock_guard<std::mutex> drainLock(drainMutex);
+        running = false;
+        drained.notify_all();
+    }
+
+    // Everything appended so far, in time order across threads, then one write
+    void drain(BinaryLog& owner) {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        pending.clear();
+        juce::uint64 ends[kMaxThreads];
+        for (int i = 0; i < kMaxThreads; ++i) {
+            auto& r = rings[(size_t) i];
+            ends[i] = r.head.load(std::memory_order_acquire);
+            for (auto t = r.tail.load(std::memory_order_relaxed); t < ends[i];) {
+                const size_t pos = (size_t) (t % kRingBytes);
+                RecordHeader h;
+                std::memcpy(&h, r.data + pos, sizeof(h));
+                if (h.bytes == kWrapMarker) { t += kRingBytes - pos; continue; }
+                pending.push_back({ h.timeUs, i, pos });
+                t += h.bytes;
+            }
+        }
+        std::stable_sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) { return a.timeUs < b.timeUs; });
+        for (const auto& p : pending) {
+            RecordHeader h;
+            std::memcpy(&h, rings[(size_t) p.ring].data + p.pos, sizeof(h));
+            format(h, rings[(size_t) p.ring].data + p.pos + sizeof(h), owner.isHealthy());
+        }
+        if (const auto lost = droppedTotal(); lost != reportedDrops) {
+            char line[96];
+            const int n = std::snprintf(line, sizeof(line), "Log: %llu records dropped (full or no ring)", (unsigned long long) (lost - reportedDrops));
+            stampLine(PrecisionClock::nowMicros(), owner.isHealthy());
+            put(line, (size_t) n, owner.isHealthy());
+            put("\n", 1, owner.isHealthy());
+            reportedDrops = lost;
+        }
+        writeBuffered(owner.isHealthy());
+        if (out != nullptr) out->flush();
+        for (int i = 0; i < kMaxThreads; ++i) rings[(size_t) i].tail.store(ends[i], std::memory_order_release);
+        owner.written.fetch_add(pending.size(), std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> drainLock(drainMutex);
+        ++drains;
+        drained.notify_all();
+    }
+
+    void format(const RecordHeader& h, const uint8_t* args, bool toFile) {
+        struct Arg { uint8_t tag; uint64_t value; const char* text; size_t length; };
+        Arg parsed[kMaxArgs];
+        int numArgs = 0;
+        for (const uint8_t* p = args; p < args + h.argBytes && numArgs < kMaxArgs;) {
+            Arg& a = parsed[numArgs++];
+            a.tag = *p;
+            if (a.tag == kText) {
+                uint16_t n;
+                std::memcpy(&n, p + 1, 2);
+                a.text = reinterpret_cast<const char*>(p + 3);
+                a.length = n;
+                p += 3 + n;
+            } else {
+                std::memcpy(&a.value, p + 1, 8);
+                p += 9;
+            }
+        }
+
+        stampLine(h.timeUs, toFile);
+        int next = 0;
+        auto putArg = [&](const Arg& a) {
+            char number[32];
+            int n = 0;
+            switch (a.tag) {
+                case kText: put(a.text, a.length, toFile); return;
+                case kInt: n = std::snprintf(number, sizeof(number), "%lld", (long long) (int64_t) a.value); break;
+                case kUInt: n = std::snprintf(number, sizeof(number), "%llu", (unsigned long long) a.value); break;
+                case kBool: n = std::snprintf(number, sizeof(number), "%s", a.value != 0 ? "true" : "false"); break;
+                default: { double d; std::memcpy(&d, &a.value, 8); n = std::snprintf(number, sizeof(number), "%g", d); break; }
+            }
+            put(number, (size_t) juce::jlimit(0, (int) sizeof(number) - 1, n), toFile);
+        };
+        for (const char* f = h.format; *f != 0; ++f) {
+            if (f[0] == '{' && f[1] == '}' && next < numArgs) { putArg(parsed[next++]); ++f; }
+            else put(f, 1, toFile);
+        }
+        for (; next < numArgs; ++next) { put(" ", 1, toFile); putArg(parsed[next]); }
+        put("\n", 1, toFile);
+    }
+
+    // "[2026-10-16 01:55:30.123] "
+    void stampLine(juce::int64 timeUs, bool toFile) {
+        const juce::int64 ms = baseMs + (timeUs - baseUs) / 1000;
+        if (ms / 1000 != prefixSecond) {
+            prefixSecond = ms / 1000;
+            const juce::Time t(prefixSecond * 1000);
+            std::snprintf(prefix, sizeof(prefix), "[%04d-%02d-%02d %02d:%02d:%02d", t.getYear(), t.getMonth() + 1, t.getDayOfMonth(),
+                          t.getHours(), t.getMinutes(), t.getSeconds());
+        }
+        char stamp[96];
+        const int n = std::snprintf(stamp, sizeof(stamp), "%s.%03d] ", prefix, (int) (((ms % 1000) + 1000) % 1000));
+        put(stamp, (size_t) n, toFile);
+    }
+
+    void put(const char* s, size_t n, bool toFile) {
+        while (n > 0) {
+            if (buffered == kOutputBufferBytes) writeBuffered(toFile);
+            const size_t chunk = juce::jmin(n, kOutputBufferBytes - buffered);
+            std::memcpy(buffer + buffered, s, chunk);
+            buffered += chunk;
+            s += chunk;
+            n -= chunk;
+        }
+    }
+
+    void writeBuffered(bool toFile) {
+        if (buffered == 0) return;
+        if (toFile && out != nullptr) out->write(buffer, buffered);
+        else std::cout.write(buffer, (std::streamsize) buffered);
+        buffered = 0;
+    }
+
+    bool open(const juce::File& f, const char* startedAt) {
+        out = std::make_unique<juce::FileOutputStream>(f);
+        if (out->failedToOpen()) {
+            out.reset();
+            std::cout << "[LOGGER ERROR] Failed to open log file: " << f.getFullPathName().toStdString() << std::endl;
+            return false;
+        }
+        file = f;
+        const juce::String banner = "=== Creator Tool Log Started at " + juce::String(startedAt).trim() + " ===\n";
+        out->write(banner.toRawUTF8(), banner.getNumBytesAsUTF8());
+        out->flush();
+        return true;
+    }
+};
+
+BinaryLog& BinaryLog::getInstance() {
+    static BinaryLog* instance = new BinaryLog();
+    // Completes the file at exit; the instance stays, for threads that still log
+    static struct Closer { ~Closer() { instance->impl->stop(); } } closer;
+    return *instance;
+}
+
+BinaryLog::BinaryLog() : impl(std::make_unique<Impl>()) {
+    auto& d = *impl;
+    d.pending.reserve((size_t) kMaxThreads * (size_t) (kRingBytes / sizeof(RecordHeader)));
+    d.baseUs = PrecisionClock::nowMicros();
+    d.baseMs = juce::Time::currentTimeMillis();
+    const time_t now = time(nullptr);
+    const char* startedAt = ctime(&now);
+    healthy.store(d.open(defaultLogFile(startedAt), startedAt));
+    d.thread = std::thread([this] { impl->run(*this); });
+}
+
+BinaryLog::~BinaryLog() { impl->stop(); }
+
+bool BinaryLog::append(const char* format, const uint8_t* args, size_t argBytes, int numArgs, int waitMs) noexcept {
+    auto& d = *impl;
+    LogRing* ring = tBinding.ring;
+    if (ring == nullptr && (ring = tBinding.ring = d.claim()) == nullptr) {
+        d.unbound.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    const auto bytes = (juce::uint64) ((sizeof(RecordHeader) + argBytes + 7) & ~(size_t) 7);
+    const juce::uint64 head = ring->head.load(std::memory_order_relaxed);
+    const size_t pos = (size_t) (head % kRingBytes);
+    // A record never wraps: the end of the ring is skipped instead
+    const juce::uint64 pad = pos + bytes > (juce::uint64) kRingBytes ? kRingBytes - pos : 0;
+    juce::uint64 used = head - ring->tail.load(std::memory_order_acquire);
+    if (used + pad + bytes > (juce::uint64) kRingBytes) {
+        d.wake.notify();
+        const juce::int64 deadline = waitMs > 0 ? PrecisionClock::nowMicros() + (juce::int64) waitMs * 1000 : 0;
+        while (used + pad + bytes > (juce::uint64) kRingBytes && PrecisionClock::nowMicros() < deadline) {
+            std::this_thread::sleep_for(std::chrono::microseconds(kWaitPollUs));
+            used = head - ring->tail.load(std::memory_order_acquire);
+        }
+        if (used + pad + bytes > (juce::uint64) kRingBytes) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    if (pad > 0) std::memcpy(ring->data + pos, &kWrapMarker, sizeof(kWrapMarker));
+    uint8_t* at = ring->data + (pad > 0 ? 0 : pos);
+    const RecordHeader h { (uint32_t) bytes, (uint16_t) argBytes, (uint8_t) numArgs, 0, format, PrecisionClock::nowMicros() };
+    std::memcpy(at, &h, sizeof(h));
+    std::memcpy(at + sizeof(h), args, argBytes);
+    ring->head.store(head + pad + bytes, std::memory_order_release);
+    if (used + pad + bytes >= kWakeBytes) d.wake.notify();
+    return true;
+}
+
+void BinaryLog::setOutputFile(const juce::File& file) {
+    flush();
+    std::lock_guard<std::mutex> lock(impl->fileMutex);
+    impl->out.reset();
+    const time_t now = time(nullptr);
+    healthy.store(impl->open(file, ctime(&now)));
+}
+
+juce::File BinaryLog::getOutputFile() const {
+    std::lock_guard<std::mutex> lock(impl->fileMutex);
+    return impl->file;
+}
+
+bool BinaryLog::flush(int timeoutMs) {
+    auto& d = *impl;
+    std::unique_lock<std::mutex> lock(d.drainMutex);
+    // The drain under way may have looked at the rings before this call; the one after has not
+    const auto target = d.drains + 2;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (d.drains < target && d.running) {
+        d.wake.notify();
+        if (d.drained.wait_until(lock, juce::jmin(deadline, std::chrono::steady_clock::now() + std::chrono::milliseconds(5))) == std::cv_status::timeout
+            && std::chrono::steady_clock::now() >= deadline)
+            return false;
+    }
+    return true;
+}
+
+juce::uint64 BinaryLog::getDroppedRecords() const noexcept { return impl->droppedTotal(); }
+
+} // namespace streaming
@@ -1,181 +1,129 @@
 #pragma once
 #include <juce_core/juce_core.h>
-#include <fstream>
-#include <ctime>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
 #include <memory>
-#include <queue>
-#include <thread>
 #include <mutex>
-#include <condition_variable>
-#include <atomic>
-#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "RealtimeSignal.h"
 
-// Asynchronous logger class
-class AsyncLogger {
-private:
-    std::queue<std::string> logQueue_;
-    std::timed_mutex queueMutex_;
-    std::condition_variable_any cv_;
-    std::atomic<bool> shouldStop_{false};
-    std::thread logThread_;
-    std::unique_ptr<std::ofstream> logFile_;
-    std::string logFilePath_;
-    std::atomic<bool> loggerHealthy_{true};
-    
-    // Private constructor for singleton
-    AsyncLogger() {
-        initializeLogFile();
-        logThread_ = std::thread(&AsyncLogger::logWorker, this);
-    }
-    
-    void initializeLogFile() {
-        try {
-            auto desktopDir = juce::File::getSpecialLocation(juce::File::userDesktopDirectory);
-            auto logDir = desktopDir.getChildFile("CreatorTool_Logs");
-            logDir.createDirectory();
-            
-            time_t now = time(nullptr);
-            char* timeStr = ctime(&now);
-            juce::String timestamp(timeStr);
-            timestamp = timestamp.trim().replaceCharacters(" :", "__");
-            
-            auto logPath = logDir.getChildFile("CreatorTool_" + timestamp + ".log");
-            logFilePath_ = logPath.getFullPathName().toStdString();
-            
-            logFile_ = std::make_unique<std::ofstream>(logFilePath_, std::ios::app);
-            if (logFile_->is_open()) {
-                *logFile_ << "=== Creator Tool Async Log Started at " << timeStr << " ===" << std::endl;
-                logFile_->flush();
-                loggerHealthy_.store(true);
-            } else {
-                loggerHealthy_.store(false);
-                std::cout << "[LOGGER ERROR] Failed to open log file: " << logFilePath_ << std::endl;
-            }
-        } catch (const std::exception& e) {
-            loggerHealthy_.store(false);
-            std::cout << "[LOGGER ERROR] Exception in initializeLogFile: " << e.what() << std::endl;
-        } catch (...) {
-            loggerHealthy_.store(false);
-            std::cout << "[LOGGER ERROR] Unknown exception in initializeLogFile" << std::endl;
-        }
-    }
-    
-    void logWorker() {
-        try {
-            while (!shouldStop_.load()) {
-                std::unique_lock<std::timed_mutex> lock(queueMutex_);
-                cv_.wait(lock, [this] { return !logQueue_.empty() || shouldStop_.load(); });
-                while (!logQueue_.empty()) {
-                    std::string message = logQueue_.front();
-                    logQueue_.pop();
-                    lock.unlock();
-                    if (logFile_ && logFile_->is_open()) {
-                        try {
-                            time_t now = time(nullptr);
-                            char* timeStr = ctime(&now);
-                            std::string timestamp(timeStr);
-                            if (!timestamp.empty() && timestamp.back() == '\n') {
-                                timestamp.pop_back();
-                            }
-                            *logFile_ << "[" << timestamp << "] " << message << std::endl;
-                            static int flushCounter = 0;
-                            if (++flushCounter % 3 == 0) {
-                                logFile_->flush();
-                            }
-                        } catch (const std::exception& e) {
-                            std::cout << "[LOGGER ERROR] File write exception: " << e.what() << std::endl;
-                            loggerHealthy_.store(false);
-                        } catch (...) {
-                            std::cout << "[LOGGER ERROR] Unknown file write exception" << std::endl;
-                            loggerHealthy_.store(false);
-                        }
-                    }
-                    lock.lock();
-                }
-            }
-            if (logFile_ && logFile_->is_open()) {
-                try {
-                    logFile_->flush();
-                    std::cout << "[LOGGER] Background thread shutting down gracefully" << std::endl;
-                } catch (...) {
-                    std::cout << "[LOGGER ERROR] Exception during final flush" << std::endl;
-                }
-            }
-        } catch (const std::exception& e) {
-            std::cout << "[LOGGER FATAL] Background thread exception: " << e.what() << std::endl;
-            loggerHealthy_.store(false);
-        } catch (...) {
-            std::cout << "[LOGGER FATAL] Unknown background thread exception" << std::endl;
-            loggerHealthy_.store(false);
-        }
-    }
-    
+namespace streaming {
+
+// Process-wide log. Each thread appends binary records (the format string's address, a timestamp
+// and the raw arguments) to a lock-free ring of its own; the logger thread merges the rings in time
+// order, formats the records and writes them in batches. A call never locks, allocates or formats;
+// a record that finds its ring full is dropped and counted, and the count is logged.
+class BinaryLog {
 public:
-    static AsyncLogger& getInstance() {
-        static AsyncLogger instance;
-        return instance;
-    }
-    
-    bool isHealthy() const {
-        return loggerHealthy_.load();
-    }
-    
-    void log(const std::string& message) {
-        if (!loggerHealthy_.load()) {
-            std::cout << "[FALLBACK LOG] " << message << std::endl;
-            return;
-        }
-        std::unique_lock<std::timed_mutex> lock(queueMutex_, std::defer_lock);
-        if (lock.try_lock_for(std::chrono::milliseconds(2))) {
-            logQueue_.push(message);
-            cv_.notify_one();
-        } else {
-           #ifdef JUCE_DEBUG
-            std::cout << "[SKIPPED LOG] " << message << std::endl;
-           #endif
-        }
+    static constexpr int kMaxThreads = 16;        // threads beyond this many live ones drop their records
+    static constexpr int kRingBytes = 64 * 1024;  // per thread
+    static constexpr int kMaxArgBytes = 480;      // per record; text arguments are cut to fit
+    static constexpr int kFlushIntervalMs = 20;   // the logger thread's longest nap
+
+    // Desktop/CreatorTool_Logs/CreatorTool_<start time>.log; never destroyed, as threads may still log
+    // during static destruction (the file is completed at exit all the same)
+    static BinaryLog& getInstance();
+
+    // `format` must outlive the process (a string literal); each {} takes the next argument. Arguments
+    // are integers, floating point, bool, const char*, std::string or juce::String; text is copied.
+    // waitMs > 0 waits that long for room instead of dropping straight away (never on the audio thread).
+    template <typename... Args>
+    bool log(int waitMs, const char* format, const Args&... args) noexcept {
+        uint8_t buffer[kMaxArgBytes];
+        ArgWriter w { buffer, buffer + kMaxArgBytes };
+        (w.put(args), ...);
+        return append(format, buffer, (size_t) (w.p - buffer), w.count, waitMs);
     }
-    
-    void logBlocking(const std::string& message, int timeoutMs = 10) {
-        if (!loggerHealthy_.load()) {
-            std::cout << "[FALLBACK LOG] " << message << std::endl;
-            return;
+
+    // Writes to `file` from now on (the current file is completed first)
+    void setOutputFile(const juce::File& file);
+    juce::File getOutputFile() const;
+    bool isHealthy() const noexcept { return healthy.load(); }
+    // Returns once everything logged before the call is written (or timeoutMs passed)
+    bool flush(int timeoutMs = 1000);
+    // Records lost to full rings, or to threads finding no free ring
+    juce::uint64 getDroppedRecords() const noexcept;
+    juce::uint64 getWrittenRecords() const noexcept { return written.load(); }
+
+    // Argument encoding: a tag byte, then 8 bytes, or a 16-bit length and the text
+    enum Tag : uint8_t { kInt = 'i', kUInt = 'u', kFloat = 'f', kBool = 'b', kText = 's' };
+
+private:
+    struct ArgWriter {
+        uint8_t* p;
+        uint8_t* end;
+        int count = 0;
+
+        template <typename T>
+        void put(const T& v) noexcept {
+            if constexpr (std::is_same_v<T, bool>) scalar(kBool, (uint64_t) v);
+            else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) scalar(kInt, (uint64_t) (int64_t) v);
+            else if constexpr (std::is_integral_v<T>) scalar(kUInt, (uint64_t) v);
+            else if constexpr (std::is_enum_v<T>) scalar(kInt, (uint64_t) (int64_t) v);
+            else if constexpr (std::is_floating_point_v<T>) { double d = (double) v; uint64_t bits; std::memcpy(&bits, &d, 8); scalar(kFloat, bits); }
+            else if constexpr (std::is_same_v<T, juce::String>) text(v.toRawUTF8(), v.getNumBytesAsUTF8());
+            else if constexpr (std::is_same_v<T, std::string>) text(v.data(), v.size());
+            else if constexpr (std::is_convertible_v<const T&, const char*>) { const char* s = v; text(s != nullptr ? s : "(null)", s != nullptr ? std::strlen(s) : 6); }
+            else static_assert(std::is_same_v<T, void>, "unsupported log argument type");
         }
-        std::unique_lock<std::timed_mutex> lock(queueMutex_, std::defer_lock);
-        if (lock.try_lock_for(std::chrono::milliseconds(timeoutMs))) {
-            logQueue_.push(message);
-            cv_.notify_one();
-        } else {
-            std::cout << "[TIMEOUT LOG] " << message << std::endl;
+        void scalar(uint8_t tag, uint64_t v) noexcept {
+            if (end - p < 9) return;
+            *p = tag;
+            std::memcpy(p + 1, &v, 8);
+            p += 9;
+            ++count;
         }
-    }
-    
-    ~AsyncLogger() {
-        shouldStop_.store(true);
-        cv_.notify_all();
-        if (logThread_.joinable()) {
-            logThread_.join();
+        void text(const char* s, size_t n) noexcept {
+            if (end - p < 3) return;
+            n = juce::jmin(n, (size_t) (end - p - 3), (size_t) 0xFFFF);
+            const uint16_t len = (uint16_t) n;
+            *p = kText;
+            std::memcpy(p + 1, &len, 2);
+            std::memcpy(p + 3, s, n);
+            p += 3 + n;
+            ++count;
         }
-    }
-    
-    AsyncLogger(const AsyncLogger&) = delete;
-    AsyncLogger& operator=(const AsyncLogger&) = delete;
-    AsyncLogger(AsyncLogger&&) = delete;
-    AsyncLogger& operator=(AsyncLogger&&) = delete;
+    };
+
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+    std::atomic<bool> healthy { true };
+    std::atomic<juce::uint64> written { 0 };
+
+    BinaryLog();
+    ~BinaryLog();
+    bool append(const char* format, const uint8_t* args, size_t argBytes, int numArgs, int waitMs) noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE(BinaryLog)
 };
 
+} // namespace streaming
+
+// Hot threads (audio, encoder callbacks, egress): no string is built and nothing waits.
+//   LogEvent("RTMP: send failed errno={}", errno);
+template <typename... Args>
+inline void LogEvent(const char* format, const Args&... args) {
+    streaming::BinaryLog::getInstance().log(0, format, args...);
+}
+
+// Everywhere else; waits up to 5 ms if this thread's ring is full
 inline void LogMessage(const juce::String& message) {
     DBG(message);
-    AsyncLogger::getInstance().logBlocking(message.toStdString(), 5);
+    streaming::BinaryLog::getInstance().log(5, "{}", message);
 }
 
+// Never waits; prefer LogEvent, which does not build the string either
 inline void LogMessageFromAudioThread(const juce::String& message) {
-    DBG(message);
-    AsyncLogger::getInstance().log(message.toStdString());
+    streaming::BinaryLog::getInstance().log(0, "{}", message);
 }
 
 inline void LogMessageBlocking(const juce::String& message) {
     DBG(message);
-    AsyncLogger::getInstance().logBlocking(message.toStdString());
+    streaming::BinaryLog::getInstance().log(100, "{}", message);
 }
@@ -0,0 +1,52 @@
+#include "MediaBuffer.h"
+#include <cstdlib>
+#include <cstring>
+
+#if HAVE_FFMPEG
+extern "C" {
+ #include <libavutil/buffer.h>
+}
+#endif
+
+using namespace streaming;
+
+std::atomic<juce::uint64> MediaBuffer::copiedBytes { 0 };
+
+MediaBuffer::Ptr MediaBuffer::wrap(const void* data, size_t size, Releaser release, void* opaque) {
+    return new MediaBuffer(static_cast<const uint8_t*>(data), size, release, opaque);
+}
+
+MediaBuffer::Ptr MediaBuffer::copyOf(const void* data, size_t size) {
+    auto* block = static_cast<uint8_t*>(std::malloc(juce::jmax<size_t>(1, size)));
+    if (block == nullptr) return nullptr;
+    if (size > 0) memcpy(block, data, size);
+    noteCopied(size);
+    return new MediaBuffer(block, size, [](void* p) { std::free(p); }, block);
+}
+
+MediaBuffer::Ptr MediaBuffer::fromAVBuffer(AVBufferRef* ref) {
+   #if HAVE_FFMPEG
+    if (ref == nullptr) return nullptr;
+    return new MediaBuffer(ref->data, (size_t) ref->size, [](void* p) { auto* r = static_cast<AVBufferRef*>(p); av_buffer_unref(&r); }, ref);
+   #else
+    juce::ignoreUnused(ref);
+    return nullptr;
+   #endif
+}
+
+MediaBuffer::~MediaBuffer() {
+    if (release != nullptr) release(opaque);
+}
+
+AVBufferRef* MediaBuffer::toAVBuffer() {
+   #if HAVE_FFMPEG
+    incReferenceCount();
+    AVBufferRef* ref = av_buffer_create(const_cast<uint8_t*>(bytes), (decltype(ref->size)) length,
+                                        [](void* self, uint8_t*) { static_cast<MediaBuffer*>(self)->decReferenceCount(); },
+                                        this, AV_BUFFER_FLAG_READONLY);
+    if (ref == nullptr) decReferenceCount();
+    return ref;
+   #else
+    return nullptr;
+   #endif
+}
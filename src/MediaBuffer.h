@@ -0,0 +1,55 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+struct AVBufferRef;
+
+namespace streaming {
+
+// Immutable encoded payload (one access unit or AAC packet) shared by reference from the encoder
+// callback through the pacer, egress queues and muxer to the socket. The bytes stay owned by whatever
+// produced them (a retained CMSampleBuffer, an AVBufferRef, a heap block) and are handed back to it
+// when the last reference goes, so no stage in between has to copy them.
+class MediaBuffer : public juce::ReferenceCountedObject {
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<MediaBuffer>;
+    using Releaser = void (*)(void* opaque);
+
+    // Borrow `data` until the last reference is dropped, then call release(opaque). No copy.
+    static Ptr wrap(const void* data, size_t size, Releaser release, void* opaque);
+    // Fallback for producers whose memory cannot be retained; counted in getCopiedBytes()
+    static Ptr copyOf(const void* data, size_t size);
+    // Takes over one reference of `ref` (the caller's reference is consumed)
+    static Ptr fromAVBuffer(AVBufferRef* ref);
+
+    ~MediaBuffer() override;
+
+    const uint8_t* data() const noexcept { return bytes; }
+    size_t size() const noexcept { return length; }
+    bool contains(const void* p, size_t n) const noexcept {
+        const auto* q = static_cast<const uint8_t*>(p);
+        return q >= bytes && q + n <= bytes + length;
+    }
+
+    // New AVBufferRef over the same bytes that holds a reference to this buffer, for refcounted
+    // AVPackets (libavformat then keeps the ref instead of copying). nullptr without FFmpeg.
+    AVBufferRef* toAVBuffer();
+
+    // Process-wide count of payload bytes memcpy'd by the streaming pipeline (benchmarks/telemetry)
+    static void noteCopied(size_t n) noexcept { copiedBytes.fetch_add((juce::uint64) n, std::memory_order_relaxed); }
+    static juce::uint64 getCopiedBytes() noexcept { return copiedBytes.load(std::memory_order_relaxed); }
+
+private:
+    MediaBuffer(const uint8_t* d, size_t n, Releaser r, void* o) noexcept : bytes(d), length(n), release(r), opaque(o) {}
+
+    const uint8_t* bytes;
+    size_t length;
+    Releaser release;
+    void* opaque;
+
+    static std::atomic<juce::uint64> copiedBytes;
+
+    JUCE_DECLARE_NON_COPYABLE(MediaBuffer)
+};
+
+} // namespace streaming
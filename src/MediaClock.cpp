@@ -0,0 +1,25 @@
+#include "MediaClock.h"
+
+using namespace streaming;
+
+void MediaClock::reset() noexcept {
+    originUs.store(-1, std::memory_order_release);
+    lastSlot = -1;
+}
+
+juce::int64 MediaClock::videoPtsMs(juce::int64 nowUs, int fps) noexcept {
+    fps = juce::jmax(1, fps);
+    juce::int64 origin = originUs.load(std::memory_order_acquire);
+    if (origin < 0) {
+        origin = nowUs;
+        lastSlot = -1;
+        originUs.store(origin, std::memory_order_release);
+    }
+    // Bunched-up frames take the next free slot; late ones leave a gap. A frame more than a whole
+    // slot early (capture faster than fps) is refused rather than pushing video ahead of the clock.
+    const juce::int64 scaledUs = juce::jmax<juce::int64>(0, nowUs - origin) * fps; // elapsed slots * 1e6
+    const juce::int64 slot = juce::jmax(lastSlot + 1, (scaledUs + 500000) / 1000000);
+    if (slot * 1000000 > scaledUs + 1000000) return -1;
+    lastSlot = slot;
+    return toMs(slot, fps);
+}
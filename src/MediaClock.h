@@ -0,0 +1,31 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+namespace streaming {
+
+// The stream timeline shared by audio and video. Time zero is the first video frame handed to an
+// encoder (PrecisionClock microseconds). Both media are placed on it from exact counters instead of
+// per-frame rounded increments: video on the fps grid, audio in samples at the stream rate.
+class MediaClock {
+public:
+    void reset() noexcept;
+    bool isStarted() const noexcept { return originUs.load(std::memory_order_acquire) >= 0; }
+    juce::int64 getOriginMicros() const noexcept { return originUs.load(std::memory_order_acquire); }
+
+    // Capture thread only. Starts the timeline on the first call, then returns the frame's PTS: its
+    // arrival time snapped to the nearest fps grid slot, strictly after the previous frame's. -1 means
+    // the frame came more than a slot early and should be skipped.
+    juce::int64 videoPtsMs(juce::int64 nowUs, int fps) noexcept;
+
+    // floor(count * 1000 / rate) without overflow or accumulated error
+    static juce::int64 toMs(juce::int64 count, juce::int64 rate) noexcept {
+        return count / rate * 1000 + count % rate * 1000 / rate;
+    }
+
+private:
+    std::atomic<juce::int64> originUs { -1 };
+    juce::int64 lastSlot { -1 };
+};
+
+} // namespace streaming
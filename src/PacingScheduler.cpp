@@ -0,0 +1,84 @@
+#include "PacingScheduler.h"
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#if JUCE_MAC || defined(__APPLE__)
+ #include <mach/mach_time.h>
+#elif defined(__unix__)
+ #include <ctime>
+ #include <cerrno>
+#endif
+
+using namespace streaming;
+
+namespace {
+// Below this the remaining wait is slept exactly rather than spent on the signal
+constexpr juce::int64 kFineWaitUs = 1500;
+
+#if JUCE_MAC || defined(__APPLE__)
+const mach_timebase_info_data_t& timebase() noexcept {
+    static const mach_timebase_info_data_t tb = [] { mach_timebase_info_data_t t {}; mach_timebase_info(&t); return t; }();
+    return tb;
+}
+#endif
+} // namespace
+
+juce::int64 PrecisionClock::nowMicros() noexcept {
+   #if JUCE_MAC || defined(__APPLE__)
+    const auto& tb = timebase();
+    return (juce::int64) ((__uint128_t) mach_absolute_time() * tb.numer / tb.denom / 1000);
+   #elif defined(__unix__)
+    timespec ts {};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (juce::int64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+   #else
+    using namespace std::chrono;
+    return (juce::int64) duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+   #endif
+}
+
+void PrecisionClock::sleepUntilMicros(juce::int64 deadlineUs) noexcept {
+   #if JUCE_MAC || defined(__APPLE__)
+    const auto& tb = timebase();
+    mach_wait_until((uint64_t) ((__uint128_t) deadlineUs * 1000 * tb.denom / tb.numer));
+   #elif defined(__unix__)
+    timespec ts {};
+    ts.tv_sec = (time_t) (deadlineUs / 1000000);
+    ts.tv_nsec = (long) (deadlineUs % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+   #else
+    const juce::int64 waitUs = deadlineUs - nowMicros();
+    if (waitUs > 0) std::this_thread::sleep_for(std::chrono::microseconds(waitUs));
+   #endif
+}
+
+bool PrecisionClock::waitUntilMicros(juce::int64 deadlineUs, RealtimeSignal& wake) noexcept {
+    const juce::int64 remaining = deadlineUs - nowMicros();
+    if (remaining > kFineWaitUs && wake.waitMicros(remaining - kFineWaitUs)) return false;
+    sleepUntilMicros(deadlineUs);
+    return true;
+}
+
+//==============================================================================
+void TokenBucket::configure(double bytesPerSecond, double burstBytes, juce::int64 nowUs) noexcept {
+    rate = bytesPerSecond > 0.0 ? bytesPerSecond / 1.0e6 : 0.0;
+    capacity = juce::jmax(1.0, burstBytes);
+    tokens = capacity;
+    lastUs = nowUs;
+}
+
+double TokenBucket::available(juce::int64 nowUs) noexcept {
+    if (!isEnabled()) return 1.0e18;
+    if (nowUs > lastUs) {
+        tokens = juce::jmin(capacity, tokens + (double) (nowUs - lastUs) * rate);
+        lastUs = nowUs;
+    }
+    return tokens;
+}
+
+juce::int64 TokenBucket::microsUntil(double bytes, juce::int64 nowUs) noexcept {
+    if (!isEnabled()) return 0;
+    const double need = juce::jmin(bytes, capacity) - available(nowUs);
+    return need <= 0.0 ? 0 : (juce::int64) std::ceil(need / rate);
+}
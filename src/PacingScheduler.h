@@ -0,0 +1,129 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "RealtimeSignal.h"
+
+namespace streaming {
+
+// Monotonic microsecond clock with absolute-deadline sleeps (clock_nanosleep on Linux,
+// mach_wait_until on macOS). Deadlines are absolute so oversleeping one tick never accumulates.
+struct PrecisionClock {
+    static juce::int64 nowMicros() noexcept;
+    static void sleepUntilMicros(juce::int64 deadlineUs) noexcept;
+
+    // Sleep until the deadline, but return false early if `wake` is notified. The coarse part of the
+    // wait is spent blocked on the signal; only the last stretch is an exact timed sleep.
+    static bool waitUntilMicros(juce::int64 deadlineUs, RealtimeSignal& wake) noexcept;
+};
+
+// Byte token bucket refilled with microsecond resolution. A send larger than the bucket is admitted
+// once the bucket is full and leaves it in debt, so big keyframes delay what follows instead of
+// stalling forever.
+class TokenBucket {
+public:
+    // bytesPerSecond <= 0 disables pacing (everything is available immediately)
+    void configure(double bytesPerSecond, double burstBytes, juce::int64 nowUs) noexcept;
+    bool isEnabled() const noexcept { return rate > 0.0; }
+
+    double available(juce::int64 nowUs) noexcept;
+    // 0 when `bytes` (capped at the bucket size) may be sent now
+    juce::int64 microsUntil(double bytes, juce::int64 nowUs) noexcept;
+    void consume(double bytes) noexcept { if (isEnabled()) tokens -= bytes; }
+
+    double getCapacity() const noexcept { return capacity; }
+
+private:
+    double rate { 0.0 };     // bytes per microsecond
+    double capacity { 0.0 };
+    double tokens { 0.0 };
+    juce::int64 lastUs { 0 };
+};
+
+// Items from several streams released in PTS order at their wall-clock due time. The first item
+// popped anchors the timeline (due = anchor + pts); push() wakes the pacing thread only when the
+// new item becomes the earliest. Storage is reserved up front; push() fails when full.
+template <typename T>
+class PacingQueue {
+public:
+    void prepare(int capacity) {
+        std::lock_guard<std::mutex> lk(mutex);
+        heap.clear();
+        heap.reserve((size_t) juce::jmax(1, capacity));
+        maxItems = (size_t) juce::jmax(1, capacity);
+    }
+
+    void start() {
+        std::lock_guard<std::mutex> lk(mutex);
+        anchorUs = -1;
+        nextSeq = 0;
+        stopped.store(false);
+    }
+
+    void stop() { stopped.store(true); signal.notify(); }
+
+    void clear() {
+        std::lock_guard<std::mutex> lk(mutex);
+        heap.clear();
+    }
+
+    bool push(T&& item, juce::int64 ptsUs) {
+        bool newHead = false;
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            if (heap.size() >= maxItems) return false;
+            heap.push_back({ ptsUs, nextSeq++, std::move(item) });
+            std::push_heap(heap.begin(), heap.end(), later);
+            newHead = heap.front().seq == nextSeq - 1;
+        }
+        if (newHead) signal.notify();
+        return true;
+    }
+
+    // Blocks until the earliest item is due and moves it into `out`. Returns false once stopped.
+    bool waitPop(T& out, juce::int64* ptsUsOut = nullptr) {
+        while (!stopped.load()) {
+            juce::int64 dueUs = -1;
+            {
+                std::lock_guard<std::mutex> lk(mutex);
+                if (!heap.empty()) {
+                    const juce::int64 now = PrecisionClock::nowMicros();
+                    if (anchorUs < 0) anchorUs = now - heap.front().ptsUs;
+                    dueUs = anchorUs + heap.front().ptsUs;
+                    if (dueUs <= now) {
+                        std::pop_heap(heap.begin(), heap.end(), later);
+                        if (ptsUsOut != nullptr) *ptsUsOut = heap.back().ptsUs;
+                        out = std::move(heap.back().item);
+                        heap.pop_back();
+                        return true;
+                    }
+                }
+            }
+            if (dueUs < 0) signal.waitMicros(100000);
+            else PrecisionClock::waitUntilMicros(dueUs, signal);
+        }
+        return false;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lk(mutex);
+        return heap.size();
+    }
+
+private:
+    struct Node { juce::int64 ptsUs; juce::uint64 seq; T item; };
+    // Max-heap comparator inverted: earliest PTS first, FIFO among equal PTS
+    static bool later(const Node& a, const Node& b) noexcept { return a.ptsUs != b.ptsUs ? a.ptsUs > b.ptsUs : a.seq > b.seq; }
+
+    mutable std::mutex mutex;
+    std::vector<Node> heap;
+    size_t maxItems { 0 };
+    juce::uint64 nextSeq { 0 };
+    juce::int64 anchorUs { -1 };
+    std::atomic<bool> stopped { false };
+    RealtimeSignal signal;
+};
+
+} // namespace streaming
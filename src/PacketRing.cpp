@@ -0,0 +1,85 @@
+#include "PacketRing.h"
+#include "PacingScheduler.h"
+
+using namespace streaming;
+
+void PacketRing::allocate(int numSlots, size_t slabBytes) {
+    releaseQueued();
+    juce::uint32 n = 1;
+    while (n < (juce::uint32) juce::jmax(2, numSlots)) n <<= 1;
+    slots.calloc(n);
+    slotMask = n - 1;
+    slab.malloc(slabBytes);
+    slabSize = slabBytes;
+    reset();
+}
+
+void PacketRing::releaseQueued() noexcept {
+    if (slots == nullptr) return;
+    const juce::uint32 w = writeSlot.load(std::memory_order_acquire);
+    for (juce::uint32 r = readSlot.load(std::memory_order_relaxed); r != w; ++r)
+        if (auto* b = slots[r & slotMask].packet.buffer) b->decReferenceCount();
+}
+
+void PacketRing::reset() noexcept {
+    releaseQueued();
+    writeSlot.store(0, std::memory_order_relaxed);
+    readSlot.store(0, std::memory_order_relaxed);
+    bytesWritten = 0;
+    bytesReleased.store(0, std::memory_order_relaxed);
+}
+
+bool PacketRing::push(const void* data, size_t size, juce::int64 ptsMs, int durationMs, bool isVideo, bool keyframe) noexcept {
+    if (slabSize == 0 || size == 0 || size > slabSize) return false;
+    const juce::uint32 w = writeSlot.load(std::memory_order_relaxed);
+    if (w - readSlot.load(std::memory_order_acquire) > slotMask) return false; // all slots in use
+
+    // Payloads are contiguous: if the tail of the slab is too short, skip to its start
+    const size_t offset = (size_t) (bytesWritten % slabSize);
+    const size_t padding = offset + size > slabSize ? slabSize - offset : 0;
+    const juce::uint64 used = bytesWritten - bytesReleased.load(std::memory_order_acquire);
+    if (used + padding + size > slabSize) return false;
+
+    uint8_t* dest = slab.getData() + (padding > 0 ? 0 : offset);
+    memcpy(dest, data, size);
+    MediaBuffer::noteCopied(size);
+    bytesWritten += padding + size;
+
+    Slot& s = slots[w & slotMask];
+    s.packet = { dest, size, ptsMs, durationMs, isVideo, keyframe, nullptr, PrecisionClock::nowMicros() };
+    s.bytesEnd = bytesWritten;
+    writeSlot.store(w + 1, std::memory_order_release);
+    return true;
+}
+
+bool PacketRing::push(const MediaBuffer::Ptr& buffer, juce::int64 ptsMs, int durationMs, bool isVideo, bool keyframe) noexcept {
+    if (buffer == nullptr || slots == nullptr) return false;
+    const juce::uint32 w = writeSlot.load(std::memory_order_relaxed);
+    if (w - readSlot.load(std::memory_order_acquire) > slotMask) return false;
+    buffer->incReferenceCount();
+    Slot& s = slots[w & slotMask];
+    s.packet = { buffer->data(), buffer->size(), ptsMs, durationMs, isVideo, keyframe, buffer.get(), PrecisionClock::nowMicros() };
+    s.bytesEnd = bytesWritten; // no slab space used
+    writeSlot.store(w + 1, std::memory_order_release);
+    return true;
+}
+
+const PacketRing::Packet* PacketRing::front() const noexcept {
+    const juce::uint32 r = readSlot.load(std::memory_order_relaxed);
+    if (r == writeSlot.load(std::memory_order_acquire)) return nullptr;
+    return &slots[r & slotMask].packet;
+}
+
+void PacketRing::pop() noexcept {
+    const juce::uint32 r = readSlot.load(std::memory_order_relaxed);
+    if (r == writeSlot.load(std::memory_order_acquire)) return;
+    Slot& s = slots[r & slotMask];
+    MediaBuffer* b = s.packet.buffer;
+    bytesReleased.store(s.bytesEnd, std::memory_order_release);
+    readSlot.store(r + 1, std::memory_order_release);
+    if (b != nullptr) b->decReferenceCount();
+}
+
+int PacketRing::getNumReady() const noexcept {
+    return (int) (writeSlot.load(std::memory_order_acquire) - readSlot.load(std::memory_order_acquire));
+}
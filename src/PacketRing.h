@@ -0,0 +1,66 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include "MediaBuffer.h"
+
+namespace streaming {
+
+// Bounded single-producer/single-consumer queue of encoded packets. Slot metadata lives in a fixed
+// array and payload bytes in one preallocated slab used as a circular arena, so steady-state
+// push/pop never allocate. push() is wait-free and fails (rather than blocks) when full.
+// Packets that already live in a MediaBuffer are queued by reference and skip the slab.
+class PacketRing {
+public:
+    struct Packet {
+        const uint8_t* data { nullptr }; // points into the slab or `buffer`; valid until pop()
+        size_t size { 0 };
+        juce::int64 ptsMs { 0 };
+        int durationMs { 0 };
+        bool isVideo { false };
+        bool keyframe { false };
+        MediaBuffer* buffer { nullptr }; // set for by-reference packets; the slot holds a reference until pop()
+        juce::int64 queuedUs { 0 };      // PrecisionClock time of the push
+    };
+
+    PacketRing() = default;
+    ~PacketRing() { releaseQueued(); }
+
+    // Not realtime-safe; call while neither side is active. numSlots is rounded up to a power of two.
+    void allocate(int numSlots, size_t slabBytes);
+    void reset() noexcept;
+
+    // Producer
+    bool push(const void* data, size_t size, juce::int64 ptsMs, int durationMs, bool isVideo, bool keyframe) noexcept;
+    bool push(const MediaBuffer::Ptr& buffer, juce::int64 ptsMs, int durationMs, bool isVideo, bool keyframe) noexcept;
+
+    // Consumer: front() is nullptr when empty; pop() releases the front slot and its bytes
+    const Packet* front() const noexcept;
+    void pop() noexcept;
+
+    bool isEmpty() const noexcept { return front() == nullptr; }
+    int getNumReady() const noexcept;
+    size_t getSlabSize() const noexcept { return slabSize; }
+
+private:
+    struct Slot {
+        Packet packet;
+        juce::uint64 bytesEnd { 0 }; // slab position after this packet (including any wrap padding)
+    };
+
+    juce::HeapBlock<Slot> slots;
+    juce::uint32 slotMask { 0 };
+    juce::HeapBlock<uint8_t> slab;
+    size_t slabSize { 0 };
+
+    // Monotonic counters; each side owns one line and only reads the other's
+    alignas(64) std::atomic<juce::uint32> writeSlot { 0 };
+    juce::uint64 bytesWritten { 0 };           // producer-private
+    alignas(64) std::atomic<juce::uint32> readSlot { 0 };
+    std::atomic<juce::uint64> bytesReleased { 0 };
+
+    void releaseQueued() noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE(PacketRing)
+};
+
+} // namespace streaming
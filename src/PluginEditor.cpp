@@ -3,8 +3,13 @@
 #include "MuxUtils.h"
 #include "Logging.h"
 #include "StreamingConfig.h"
+#include <algorithm>
 #include <chrono>
 #include <ctime>
+#include <iterator>
+
+static constexpr double kPreRollChoices[] = { 0.0, 5.0, 10.0, 30.0, 60.0 };
+static constexpr int kCustomPreRollId = 100;
 
 static juce::String makeTimestampedFilename(const juce::String& ext) {
     using namespace std::chrono;
@@ -55,6 +60,16 @@ CreatorToolVSTAudioProcessorEditor::CreatorToolVSTAudioProcessorEditor(CreatorTo
     formatBox.addListener(this);
     addAndMakeVisible(formatBox);
 
+    // Id - 1 indexes kPreRollChoices; a saved value not in the list gets an item of its own
+    for (int i = 0; i < (int) std::size(kPreRollChoices); ++i)
+        preRollBox.addItem(kPreRollChoices[i] > 0.0 ? "Pre-roll " + juce::String((int) kPreRollChoices[i]) + " s" : "Pre-roll off", i + 1);
+    const double preRoll = processor.getPreRollSeconds();
+    const auto* known = std::find(std::begin(kPreRollChoices), std::end(kPreRollChoices), preRoll);
+    if (known == std::end(kPreRollChoices)) preRollBox.addItem("Pre-roll " + juce::String(preRoll, 1) + " s", kCustomPreRollId);
+    preRollBox.setSelectedId(known != std::end(kPreRollChoices) ? (int) (known - std::begin(kPreRollChoices)) + 1 : kCustomPreRollId, juce::dontSendNotification);
+    preRollBox.addListener(this);
+    addAndMakeVisible(preRollBox);
+
     // Live UI
     rtmpUrlEdit.setText("rtmps://live-api.facebook.com:443/rtmp/your-key", juce::dontSendNotification);
     addAndMakeVisible(rtmpUrlEdit);
@@ -63,6 +78,7 @@ CreatorToolVSTAudioProcessorEditor::CreatorToolVSTAudioProcessorEditor(CreatorTo
 
     addAndMakeVisible(folderLabel);
     addAndMakeVisible(statusLabel);
+    addAndMakeVisible(statsLabel);
 
     addAndMakeVisible(video);
 
@@ -82,12 +98,14 @@ CreatorToolVSTAudioProcessorEditor::CreatorToolVSTAudioProcessorEditor(CreatorTo
 
     folderLabel.setJustificationType(juce::Justification::centred);
     statusLabel.setJustificationType(juce::Justification::centred);
+    statsLabel.setJustificationType(juce::Justification::centred);
 
     updateButtons();
     updateFolderLabel();
+    startTimerHz(1);
 }
 
-CreatorToolVSTAudioProcessorEditor::~CreatorToolVSTAudioProcessorEditor() = default;
+CreatorToolVSTAudioProcessorEditor::~CreatorToolVSTAudioProcessorEditor() { stopTimer(); }
 
 void CreatorToolVSTAudioProcessorEditor::paint(juce::Graphics& g) {
     g.fillAll(getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId));
@@ -116,6 +134,7 @@ void CreatorToolVSTAudioProcessorEditor::resized() {
     auto optsRow = area.removeFromTop(36);
     resolutionBox.setBounds(optsRow.removeFromLeft(180).reduced(2));
     formatBox.setBounds(optsRow.removeFromLeft(100).reduced(2));
+    preRollBox.setBounds(optsRow.removeFromLeft(140).reduced(2));
 
     auto liveRow = area.removeFromTop(36);
     rtmpUrlEdit.setBounds(liveRow.removeFromLeft(300).reduced(2));
@@ -128,6 +147,7 @@ void CreatorToolVSTAudioProcessorEditor::resized() {
 
     folderLabel.setBounds(area.removeFromTop(24));
     statusLabel.setBounds(area.removeFromTop(24));
+    statsLabel.setBounds(area.removeFromTop(24));
 
     video.setBounds(area.removeFromTop(160));
 }
@@ -149,6 +169,13 @@ void CreatorToolVSTAudioProcessorEditor::comboBoxChanged(juce::ComboBox* box) {
         LogMessage("UI: container changed -> " + formatBox.getText());
         return;
     }
+    if (box == &preRollBox) {
+        const int index = preRollBox.getSelectedId() - 1;
+        if (index < 0 || index >= (int) std::size(kPreRollChoices)) return; // the saved custom value stays as it is
+        processor.setPreRollSeconds(kPreRollChoices[index]);
+        LogMessage("UI: pre-roll -> " + juce::String(kPreRollChoices[index], 0) + " s");
+        return;
+    }
 }
 
 void CreatorToolVSTAudioProcessorEditor::buttonClicked(juce::Button* button) {
@@ -173,7 +200,7 @@ void CreatorToolVSTAudioProcessorEditor::buttonClicked(juce::Button* button) {
     if (button == &recordButton) {
         auto dir = processor.getDestinationDirectory();
         if (! dir.exists()) dir.createDirectory();
-        auto target = dir.getChildFile("Recording-" + makeTimestampedFilename("wav"));
+        auto target = dir.getChildFile("Recording-" + makeTimestampedFilename(processor.getRecordingFileExtension()));
         if (processor.startRecordingToFile(target)) {
             statusLabel.setText("Recording audio…", juce::dontSendNotification);
             LogMessage("UI: audio record start -> " + target.getFileName());
@@ -293,6 +320,7 @@ void CreatorToolVSTAudioProcessorEditor::updateButtons() {
     const bool isRec = processor.isRecording();
     recordButton.setEnabled(! isRec);
     stopButton.setEnabled(isRec);
+    preRollBox.setEnabled(! isRec); // resizing the history re-prepares the recorder, which ends a take
 
     #if JUCE_MAC
     const bool isScreenRec = processor.isScreenRecording();
@@ -310,6 +338,26 @@ void CreatorToolVSTAudioProcessorEditor::updateButtons() {
     previewButton.setEnabled(processor.getLastRecordedFile().existsAsFile());
 }
 
+// Once a second: where the pipeline loses time and data (latencies are this second's p99)
+void CreatorToolVSTAudioProcessorEditor::timerCallback() {
+    const auto values = processor.sampleTelemetry(statsSampler);
+    auto get = [&values](const char* name) {
+        for (const auto& v : values) if (v.name == name) return v;
+        return streaming::Telemetry::Value();
+    };
+    juce::StringArray parts;
+    if (processor.isRecording())
+        parts.add("audio lost " + juce::String(processor.getDroppedSamples()) + " samples");
+    if (processor.isLiveStreaming()) {
+        parts.add("encode " + juce::String(get("latency.videoEncodeUs").p99 / 1000) + " ms");
+        parts.add("send " + juce::String(get("latency.sendUs").p99 / 1000) + " ms");
+        parts.add("queued " + juce::String((juce::int64) processor.getLiveQueuedBytes() / 1024) + " KB");
+        parts.add("dropped " + juce::String(get("egress.droppedPackets").value + get("pacer.droppedPackets").value) + " packets, "
+                  + juce::String(get("encoder.shedFrames").value + get("egress.shedVideoFrames").value + get("encoder.droppedFrames").value) + " frames");
+    }
+    statsLabel.setText(parts.joinIntoString(" | "), juce::dontSendNotification);
+}
+
 void CreatorToolVSTAudioProcessorEditor::updateFolderLabel() {
     auto dir = processor.getDestinationDirectory();
     folderLabel.setText("Folder: " + dir.getFullPathName(), juce::dontSendNotification);
@@ -4,12 +4,14 @@
 #include <juce_gui_extra/juce_gui_extra.h>
 #include <juce_video/juce_video.h>
 #include <juce_core/juce_core.h>
+#include "Telemetry.h"
 
 class CreatorToolVSTAudioProcessor;
 
 class CreatorToolVSTAudioProcessorEditor : public juce::AudioProcessorEditor,
                                            public juce::Button::Listener,
-                                           public juce::ComboBox::Listener {
+                                           public juce::ComboBox::Listener,
+                                           private juce::Timer {
 public:
     explicit CreatorToolVSTAudioProcessorEditor(CreatorToolVSTAudioProcessor&);
     ~CreatorToolVSTAudioProcessorEditor() override;
@@ -35,6 +37,7 @@ private:
 
     juce::ComboBox resolutionBox;
     juce::ComboBox formatBox; // MOV/MP4
+    juce::ComboBox preRollBox; // seconds of audio a take reaches back
 
     // Live streaming controls
     juce::TextEditor rtmpUrlEdit;
@@ -43,11 +46,14 @@ private:
 
     juce::Label folderLabel;
     juce::Label statusLabel;
+    juce::Label statsLabel; // pipeline telemetry while recording or live
+    streaming::Telemetry::Sampler statsSampler;
 
     juce::VideoComponent video { true };
 
     void updateButtons();
     void updateFolderLabel();
+    void timerCallback() override;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CreatorToolVSTAudioProcessorEditor)
 };
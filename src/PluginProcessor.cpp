@@ -9,6 +9,13 @@ CreatorToolVSTAudioProcessor::CreatorToolVSTAudioProcessor()
 {
     destinationDirectory = juce::File::getSpecialLocation(juce::File::userMusicDirectory)
         .getChildFile("CreatorTool Recordings");
+    // ~5 s at 48 kHz: a consumer that stalls longer than that loses audio rather than stalling the host
+    audioTap.prepare(2, 1 << 18);
+    audioRecorder.setAudioSource(&audioTap);
+    // Pre-roll stays off (no history kept, no tap reader held between takes) until the saved state or
+    // the editor turns it on
+    audioRecorder.setPreRoll(0.0);
+    screenRecorder.setAudioSource(&audioTap);
 }
 
 CreatorToolVSTAudioProcessor::~CreatorToolVSTAudioProcessor() = default;
@@ -45,18 +52,22 @@ void CreatorToolVSTAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer
     for (int ch = getTotalNumInputChannels(); ch < getTotalNumOutputChannels(); ++ch)
         buffer.clear(ch, 0, buffer.getNumSamples());
 
-    if (audioRecorder.isRecording())
-        audioRecorder.pushBuffer(buffer, buffer.getNumSamples());
+    // Playhead position while the transport runs, so takes can start at an exact host sample
+    juce::int64 hostSample = -1;
+    if (auto* playHead = getPlayHead())
+        if (const auto position = playHead->getPosition(); position.hasValue() && position->getIsPlaying())
+            if (const auto timeInSamples = position->getTimeInSamples(); timeInSamples.hasValue())
+                hostSample = *timeInSamples;
 
-    // Feed combined A+V recorder if active
-    if (screenRecorder.isRecording()) {
-        screenRecorder.pushAudio(buffer, buffer.getNumSamples(), currentSampleRate, getTotalNumInputChannels());
-    }
+    // One copy for the WAV recorder, the A+V writer and the live encoder alike; no-op when none is attached
+    audioTap.write(buffer.getArrayOfReadPointers(), juce::jmin(buffer.getNumChannels(), getTotalNumInputChannels()),
+                   buffer.getNumSamples(), currentSampleRate, hostSample);
+}
 
-    // Live audio feed
-    if (liveActive && liveStreamer) {
-        liveStreamer->pushAudioPCM(buffer, buffer.getNumSamples(), currentSampleRate, getTotalNumInputChannels());
-    }
+void CreatorToolVSTAudioProcessor::setNonRealtime(bool isNonRealtime) noexcept {
+    juce::AudioProcessor::setNonRealtime(isNonRealtime);
+    // Offline bounces run faster than real time: the tap waits for its readers instead of dropping
+    audioTap.setNonRealtime(isNonRealtime);
 }
 
 juce::AudioProcessorEditor* CreatorToolVSTAudioProcessor::createEditor() {
@@ -69,6 +80,8 @@ void CreatorToolVSTAudioProcessor::getStateInformation(juce::MemoryBlock& destDa
     juce::ValueTree state("state");
     state.setProperty("destination", destinationDirectory.getFullPathName(), nullptr);
     state.setProperty("lastFile", lastRecordedFile.getFullPathName(), nullptr);
+    state.setProperty("preRoll", audioRecorder.getPreRollSeconds(), nullptr);
+    state.setProperty("format", AudioRecorder::getFileExtension(audioRecorder.getFormat()), nullptr);
     juce::MemoryOutputStream mos(destData, false);
     state.writeToStream(mos);
 }
@@ -83,6 +96,11 @@ void CreatorToolVSTAudioProcessor::setStateInformation(const void* data, int siz
         auto last = juce::File(state.getProperty("lastFile").toString());
         if (last.existsAsFile())
             lastRecordedFile = last;
+
+        if (state.hasProperty("preRoll"))
+            audioRecorder.setPreRoll((double) state.getProperty("preRoll"));
+        if (state.hasProperty("format"))
+            audioRecorder.setFormat(state.getProperty("format").toString() == "flac" ? AudioRecorder::Format::flac : AudioRecorder::Format::wav);
     }
 }
 
@@ -96,6 +114,16 @@ bool CreatorToolVSTAudioProcessor::startRecordingToFile(const juce::File& file)
     return ok;
 }
 
+bool CreatorToolVSTAudioProcessor::startRecordingToFileAt(const juce::File& file, juce::int64 hostSample) {
+    if (currentSampleRate <= 0)
+        return false;
+
+    bool ok = audioRecorder.startRecordingAtHostSample(file, getTotalNumInputChannels(), currentSampleRate, hostSample);
+    if (ok)
+        lastRecordedFile = file;
+    return ok;
+}
+
 void CreatorToolVSTAudioProcessor::stopRecording() {
     audioRecorder.stop();
 }
@@ -109,6 +137,7 @@ bool CreatorToolVSTAudioProcessor::startLiveStreaming(const StreamingConfig& cfg
     if (liveActive) return true;
     liveCfg = cfg;
     liveStreamer.reset(new streaming::LiveStreamer());
+    liveStreamer->setAudioSource(&audioTap);
     if (!liveStreamer->start(liveCfg)) { liveStreamer.reset(); return false; }
     // Bridge frames from ScreenRecorder into LiveStreamer
     screenRecorder.setFrameCallback([this](void* pix, int64_t ptsMs){ if (liveActive && liveStreamer) liveStreamer->pushPixelBuffer(pix, ptsMs); });
@@ -119,6 +148,7 @@ bool CreatorToolVSTAudioProcessor::startLiveStreaming(const StreamingConfig& cfg
         return false;
     }
     liveActive = true;
+    streaming::Telemetry::getInstance().startDump(streaming::BinaryLog::getInstance().getOutputFile().withFileExtension("metrics.jsonl"));
     LogMessage("Live: started");
     return true;
    #else
@@ -133,6 +163,7 @@ void CreatorToolVSTAudioProcessor::stopLiveStreaming() {
     screenRecorder.setFrameCallback(nullptr);
     screenRecorder.stop();
     if (liveStreamer) { liveStreamer->stop(); liveStreamer.reset(); }
+    streaming::Telemetry::getInstance().stopDump();
     liveActive = false;
     LogMessage("Live: stopped");
    #endif
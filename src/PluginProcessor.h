@@ -10,6 +10,7 @@
 #include "ScreenRecorder.h"
 #include "StreamingConfig.h"
 #include "LiveStreamer.h"
+#include "Telemetry.h"
 
 class CreatorToolVSTAudioProcessor : public juce::AudioProcessor {
 public:
@@ -20,6 +21,7 @@ public:
     void releaseResources() override;
     bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
     void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void setNonRealtime(bool isNonRealtime) noexcept override;
 
     juce::AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
@@ -41,8 +43,21 @@ public:
 
     // Audio-only recording
     bool startRecordingToFile(const juce::File& file);
+    // Punch-in: the take starts exactly where the host's playhead reaches hostSample
+    bool startRecordingToFileAt(const juce::File& file, juce::int64 hostSample);
     void stopRecording();
     bool isRecording() const { return audioRecorder.isRecording(); }
+    // Samples the current or last take lost to a full tap
+    int getDroppedSamples() const { return audioRecorder.getDroppedSamples(); }
+    // Seconds of audio kept from before Record is pressed (0: off)
+    void setPreRollSeconds(double seconds) { audioRecorder.setPreRoll(seconds); }
+    double getPreRollSeconds() const { return audioRecorder.getPreRollSeconds(); }
+    // Long sessions: roll takes over into numbered files by duration and/or size (0: no limit)
+    void setRecordingSegmentLimits(double maxSeconds, juce::int64 maxBytes) { audioRecorder.setSegmentLimits(maxSeconds, maxBytes); }
+    // WAV or lossless-compressed FLAC takes; name new takes with getRecordingFileExtension()
+    void setRecordingFormat(AudioRecorder::Format format) { audioRecorder.setFormat(format); }
+    AudioRecorder::Format getRecordingFormat() const { return audioRecorder.getFormat(); }
+    juce::String getRecordingFileExtension() const { return AudioRecorder::getFileExtension(audioRecorder.getFormat()); }
 
     // Video-only (legacy) and combined A+V
     bool startScreenRecording(const juce::File& file) { return screenRecorder.startRecording(file); }
@@ -55,6 +70,11 @@ public:
     bool startLiveStreaming(const StreamingConfig& cfg);
     void stopLiveStreaming();
     bool isLiveStreaming() const { return liveActive; }
+    // This instance's stream only, unlike the process-wide telemetry
+    size_t getLiveQueuedBytes() const { return liveStreamer != nullptr ? liveStreamer->getQueuedBytes() : 0; }
+    // Pipeline metrics (stage latencies, queue depths, drops); each poller brings its own sampler. While
+    // live, a sample is also appended every second to the log file's .metrics.jsonl sibling.
+    juce::Array<streaming::Telemetry::Value> sampleTelemetry(streaming::Telemetry::Sampler& sampler) const { return sampler.sample(); }
 
     // Capture options
     void setCaptureResolution(int width, int height) { screenRecorder.setCaptureResolution(width, height); }
@@ -64,6 +84,8 @@ public:
     juce::File getLastRecordedFile() const { return lastRecordedFile; }
 
 private:
+    // Written once per processBlock; every audio consumer reads it. Declared first so it outlives them.
+    streaming::AudioTap audioTap;
     AudioRecorder audioRecorder;
     ScreenRecorder screenRecorder;
     std::unique_ptr<streaming::LiveStreamer> liveStreamer;
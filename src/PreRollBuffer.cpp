@@ -0,0 +1,93 @@
+#include "PreRollBuffer.h"
+#include "Logging.h"
+#include <cstring>
+
+namespace streaming {
+
+bool PreRollBuffer::prepare(int numChannels, int capacityFrames) {
+    release();
+    if (numChannels < 1 || capacityFrames < 1) return true;
+
+    const size_t samples = (size_t) numChannels * (size_t) capacityFrames;
+    const size_t bytes = samples * sizeof(float);
+    if (bytes > kMapThresholdBytes) {
+        // Sized up front, so the mapping never grows and the footprint is fixed
+        mapFile = juce::File::createTempFile(".preroll");
+        bool sized = false;
+        {
+            juce::FileOutputStream out(mapFile);
+            sized = out.openedOk() && out.setPosition((juce::int64) bytes - 1) && out.writeByte(0);
+        }
+        if (sized) {
+            mapped = std::make_unique<juce::MemoryMappedFile>(mapFile, juce::MemoryMappedFile::readWrite, true);
+            if (mapped->getData() != nullptr && mapped->getSize() >= bytes)
+                data = static_cast<float*>(mapped->getData());
+            else
+                mapped.reset();
+        }
+        if (data == nullptr) {
+            mapFile.deleteFile();
+            LogMessage("PreRoll: could not map " + juce::String((juce::int64) bytes) + " bytes, using the heap");
+        }
+    }
+    if (data == nullptr) {
+        heap.allocate(samples, false);
+        if (heap == nullptr) return false;
+        data = heap.get();
+    }
+    channels = numChannels;
+    capacity = capacityFrames;
+    clear();
+    return true;
+}
+
+void PreRollBuffer::release() {
+    data = nullptr;
+    if (mapped != nullptr) {
+        mapped.reset();
+        mapFile.deleteFile();
+    }
+    heap.free();
+    channels = capacity = 0;
+    clear();
+}
+
+void PreRollBuffer::append(const float* const* src, int numChannels, int numFrames, juce::int64 firstFrame) noexcept {
+    if (capacity == 0 || numFrames <= 0) return;
+    if (firstFrame != end || end == start) start = end = firstFrame;
+    // Only the newest capacity frames of an oversized append survive
+    const int skip = juce::jmax(0, numFrames - capacity);
+    const juce::int64 from = firstFrame + skip;
+    const int n = numFrames - skip;
+
+    const int pos = (int) (from % capacity);
+    const int first = juce::jmin(n, capacity - pos);
+    for (int ch = 0; ch < channels; ++ch) {
+        float* lane = data + (size_t) ch * (size_t) capacity;
+        if (ch < numChannels) {
+            std::memcpy(lane + pos, src[ch] + skip, sizeof(float) * (size_t) first);
+            std::memcpy(lane, src[ch] + skip + first, sizeof(float) * (size_t) (n - first));
+        } else {
+            std::memset(lane + pos, 0, sizeof(float) * (size_t) first);
+            std::memset(lane, 0, sizeof(float) * (size_t) (n - first));
+        }
+    }
+    end = from + n;
+    start = juce::jmax(start, end - capacity);
+}
+
+int PreRollBuffer::read(juce::int64 frame, float* const* dst, int numChannels, int maxFrames) const noexcept {
+    if (frame < start || frame >= end || maxFrames <= 0) return 0;
+    const int n = (int) juce::jmin<juce::int64>(maxFrames, end - frame);
+    const int pos = (int) (frame % capacity);
+    const int first = juce::jmin(n, capacity - pos);
+    for (int ch = 0; ch < numChannels; ++ch) {
+        if (ch >= channels) { std::memset(dst[ch], 0, sizeof(float) * (size_t) n); continue; }
+        const float* lane = data + (size_t) ch * (size_t) capacity;
+        std::memcpy(dst[ch], lane + pos, sizeof(float) * (size_t) first);
+        std::memcpy(dst[ch] + first, lane, sizeof(float) * (size_t) (n - first));
+    }
+    return n;
+}
+
+} // namespace streaming
@@ -0,0 +1,50 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <memory>
+
+namespace streaming {
+
+// The most recent stretch of audio, kept so a take can begin before Record was pressed. A plain ring
+// of float planes with a fixed footprint, owned by a single thread (the recorder's drain), so it needs
+// no locks: the audio thread never sees it. Windows larger than kMapThresholdBytes live in a
+// memory-mapped temp file, so minutes of history cost page cache the OS can write back rather than
+// pinned heap.
+class PreRollBuffer {
+public:
+    static constexpr size_t kMapThresholdBytes = (size_t) 32 << 20;
+
+    PreRollBuffer() = default;
+    ~PreRollBuffer() { release(); }
+
+    // Allocates numChannels planes of capacityFrames; false if neither heap nor mapping worked
+    bool prepare(int numChannels, int capacityFrames);
+    void release();
+    int getCapacity() const noexcept { return capacity; }
+    bool isMapped() const noexcept { return mapped != nullptr; }
+
+    // Forgets the history but keeps the storage
+    void clear() noexcept { start = end = 0; }
+    // Oldest frame held and one past the newest, in the caller's frame numbering
+    juce::int64 getStart() const noexcept { return start; }
+    juce::int64 getEnd() const noexcept { return end; }
+
+    // Appends frames [firstFrame, firstFrame + numFrames), dropping the oldest once full. A gap
+    // (firstFrame != getEnd()) restarts the history, which is always contiguous.
+    void append(const float* const* src, int numChannels, int numFrames, juce::int64 firstFrame) noexcept;
+    // Copies up to maxFrames from `frame` on (which must be held) into numChannels planes; returns
+    // the frames copied, 0 once frame reaches getEnd()
+    int read(juce::int64 frame, float* const* dst, int numChannels, int maxFrames) const noexcept;
+
+private:
+    int channels { 0 };
+    int capacity { 0 };
+    float* data { nullptr };              // channels planes of capacity
+    juce::HeapBlock<float> heap;
+    std::unique_ptr<juce::MemoryMappedFile> mapped;
+    juce::File mapFile;
+    juce::int64 start { 0 }, end { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(PreRollBuffer)
+};
+
+} // namespace streaming
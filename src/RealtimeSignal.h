@@ -0,0 +1,120 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+// This header reaches -fobjc-arc sources (ScreenRecorder.mm, through AudioTap.h, Logging.h and
+// Telemetry.h), where dispatch objects are ARC-managed and dispatch_release() is unavailable
+#if defined(__has_feature)
+ #if __has_feature(objc_arc)
+  #define REALTIME_SIGNAL_ARC 1
+ #endif
+#endif
+#ifndef REALTIME_SIGNAL_ARC
+ #define REALTIME_SIGNAL_ARC 0
+#endif
+
+#if JUCE_MAC || defined(__APPLE__)
+ #include <dispatch/dispatch.h>
+#elif defined(__unix__)
+ #include <semaphore.h>
+ #include <ctime>
+ #include <cerrno>
+#endif
+
+namespace streaming {
+
+// Wakes one consumer thread from any producer, including the audio thread: notify() never locks
+// and only enters the kernel when no wakeup is already pending. Consumers wait on it instead of
+// polling; spurious wakeups are possible, so always re-check the queue after wait() returns.
+class RealtimeSignal {
+public:
+    RealtimeSignal() {
+       #if JUCE_MAC || defined(__APPLE__)
+       #if REALTIME_SIGNAL_ARC
+        sem = (__bridge_retained void*) dispatch_semaphore_create(0);
+       #else
+        sem = (void*) dispatch_semaphore_create(0);
+       #endif
+       #elif defined(__unix__)
+        sem_init(&sem, 0, 0);
+       #endif
+    }
+
+    ~RealtimeSignal() {
+       #if JUCE_MAC || defined(__APPLE__)
+        // libdispatch refuses to release a semaphore below its creation value; drain it first
+        while (dispatch_semaphore_wait(handle(), DISPATCH_TIME_NOW) == 0) {}
+       #if REALTIME_SIGNAL_ARC
+        (void) (__bridge_transfer dispatch_semaphore_t) sem;
+       #else
+        dispatch_release(handle());
+       #endif
+       #elif defined(__unix__)
+        sem_destroy(&sem);
+       #endif
+    }
+
+    void notify() noexcept {
+        if (pending.exchange(true, std::memory_order_acq_rel)) return;
+       #if JUCE_MAC || defined(__APPLE__)
+        dispatch_semaphore_signal(handle());
+       #elif defined(__unix__)
+        sem_post(&sem);
+       #else
+        event.signal();
+       #endif
+    }
+
+    // Returns true if notified, false on timeout. timeoutUs < 0 waits indefinitely.
+    bool waitMicros(juce::int64 timeoutUs) noexcept {
+        bool signalled = false;
+       #if JUCE_MAC || defined(__APPLE__)
+        signalled = dispatch_semaphore_wait(handle(), timeoutUs < 0 ? DISPATCH_TIME_FOREVER
+                                                                     : dispatch_time(DISPATCH_TIME_NOW, timeoutUs * 1000)) == 0;
+       #elif defined(__unix__)
+        if (timeoutUs < 0) {
+            while (sem_wait(&sem) != 0 && errno == EINTR) {}
+            signalled = true;
+        } else {
+            timespec ts {};
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += (time_t) (timeoutUs / 1000000);
+            ts.tv_nsec += (long) (timeoutUs % 1000000) * 1000;
+            if (ts.tv_nsec >= 1000000000L) { ++ts.tv_sec; ts.tv_nsec -= 1000000000L; }
+            int rc;
+            while ((rc = sem_timedwait(&sem, &ts)) != 0 && errno == EINTR) {}
+            signalled = rc == 0;
+        }
+       #else
+        signalled = event.wait(timeoutUs < 0 ? -1.0 : (double) timeoutUs / 1000.0);
+       #endif
+        // RMW so a notify() that found the flag already set still publishes its queue write to us
+        pending.exchange(false, std::memory_order_acq_rel);
+        return signalled;
+    }
+
+    bool wait(int timeoutMs) noexcept { return waitMicros(timeoutMs < 0 ? -1 : (juce::int64) timeoutMs * 1000); }
+
+private:
+    std::atomic<bool> pending { false };
+   #if JUCE_MAC || defined(__APPLE__)
+    // Held as a plain pointer owning one manual reference in every translation unit, ARC or not, so
+    // the inline constructor and destructor manage it the same way whichever copy the linker keeps
+    void* sem { nullptr };
+    dispatch_semaphore_t handle() const noexcept {
+       #if REALTIME_SIGNAL_ARC
+        return (__bridge dispatch_semaphore_t) sem;
+       #else
+        return (dispatch_semaphore_t) sem;
+       #endif
+    }
+   #elif defined(__unix__)
+    sem_t sem;
+   #else
+    juce::WaitableEvent event;
+   #endif
+
+    JUCE_DECLARE_NON_COPYABLE(RealtimeSignal)
+};
+
+} // namespace streaming
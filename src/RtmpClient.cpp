@@ -0,0 +1,1023 @@
+#include "RtmpClient.h"
+#include "Logging.h"
+#include "PacingScheduler.h"
+#include "RealtimeSignal.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#if JUCE_MAC || defined(__APPLE__) || defined(__unix__)
+ #define RTMP_HAVE_SOCKETS 1
+ #include <netdb.h>
+ #include <fcntl.h>
+ #include <poll.h>
+ #include <unistd.h>
+ #include <cerrno>
+ #include <sys/types.h>
+ #include <sys/socket.h>
+ #include <sys/uio.h>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+#else
+ #define RTMP_HAVE_SOCKETS 0
+#endif
+
+#if HAVE_FFMPEG
+extern "C" {
+ #include <libavformat/avformat.h>
+ #include <libavformat/avio.h>
+}
+#endif
+
+using namespace streaming;
+
+namespace {
+constexpr uint32_t kOutChunkSize = 65536;
+constexpr size_t kDefaultMaxQueuedBytes = 4 * 1024 * 1024;
+constexpr int kStallTimeoutMs = 10000;
+constexpr size_t kPacedSliceBytes = 16 * 1024; // smallest paced write once the bucket runs dry
+constexpr size_t kHandshakeSize = 1536;
+constexpr size_t kAvioWriteBytes = 64 * 1024; // rtmps:// writer: largest avio_write per call
+constexpr int kAvioDrainMs = 1000;            // close(): time the writer gets to send what was accepted
+
+// Chunk stream ids (same split libavformat's rtmpproto uses)
+constexpr int kCsControl = 2;
+constexpr int kCsCommand = 3;
+constexpr int kCsAudio = 4;
+constexpr int kCsData = 5;
+constexpr int kCsVideo = 6;
+constexpr int kCsStream = 8;
+
+enum MsgType : uint8_t {
+    kSetChunkSize = 1, kAck = 3, kUserControl = 4, kWindowAckSize = 5, kSetPeerBandwidth = 6,
+    kAudio = 8, kVideo = 9, kDataAmf0 = 18, kCommandAmf0 = 20
+};
+
+inline void wb16(uint8_t* p, uint32_t v) noexcept { p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t) v; }
+inline void wb24(uint8_t* p, uint32_t v) noexcept { p[0] = (uint8_t)(v >> 16); p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t) v; }
+inline void wb32(uint8_t* p, uint32_t v) noexcept { p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t) v; }
+inline uint32_t rb16(const uint8_t* p) noexcept { return ((uint32_t) p[0] << 8) | p[1]; }
+inline uint32_t rb24(const uint8_t* p) noexcept { return ((uint32_t) p[0] << 16) | ((uint32_t) p[1] << 8) | p[2]; }
+inline uint32_t rb32(const uint8_t* p) noexcept { return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3]; }
+
+inline int64_t nowMs() {
+    using namespace std::chrono;
+    return (int64_t) duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// AMF0 encoder for the handful of commands a publisher sends
+struct AmfOut {
+    std::vector<uint8_t>& b;
+    void str(const char* s) { b.push_back(0x02); key(s); }
+    void key(const char* s) { auto n = (uint32_t) strlen(s); uint8_t l[2]; wb16(l, n); b.insert(b.end(), l, l + 2); b.insert(b.end(), s, s + n); }
+    void num(double v) { b.push_back(0x00); uint64_t bits; memcpy(&bits, &v, 8); for (int i = 7; i >= 0; --i) b.push_back((uint8_t)(bits >> (i * 8))); }
+    void null() { b.push_back(0x05); }
+    void beginObject() { b.push_back(0x03); }
+    void endObject() { b.push_back(0); b.push_back(0); b.push_back(0x09); }
+};
+
+// AMF0 decoder: enough to read command names, transaction ids, stream ids and status codes
+struct AmfIn {
+    const uint8_t* p; const uint8_t* end;
+    bool readString(juce::String& out) {
+        if (p + 3 > end || *p != 0x02) return false;
+        uint32_t n = rb16(p + 1);
+        if (p + 3 + n > end) return false;
+        out = juce::String::fromUTF8((const char*) p + 3, (int) n);
+        p += 3 + n; return true;
+    }
+    bool readNumber(double& out) {
+        if (p + 9 > end || *p != 0x00) return false;
+        uint64_t bits = 0; for (int i = 1; i <= 8; ++i) bits = (bits << 8) | p[i];
+        memcpy(&out, &bits, 8); p += 9; return true;
+    }
+    // Skips one value; for objects, reports the "code" property if present
+    bool skipValue(juce::String* codeOut = nullptr) {
+        if (p >= end) return false;
+        switch (*p) {
+            case 0x00: p += 9; return p <= end;
+            case 0x01: p += 2; return p <= end;
+            case 0x02: { if (p + 3 > end) return false; p += 3 + rb16(p + 1); return p <= end; }
+            case 0x05: case 0x06: ++p; return true;
+            case 0x08: p += 4; [[fallthrough]];
+            case 0x03: {
+                ++p;
+                while (p + 3 <= end) {
+                    uint32_t n = rb16(p);
+                    if (n == 0 && p[2] == 0x09) { p += 3; return true; }
+                    if (p + 2 + n > end) return false;
+                    juce::String k = juce::String::fromUTF8((const char*) p + 2, (int) n);
+                    p += 2 + n;
+                    if (codeOut != nullptr && k == "code" && p < end && *p == 0x02) { if (!readString(*codeOut)) return false; continue; }
+                    if (!skipValue(codeOut)) return false;
+                }
+                return false;
+            }
+            default: return false;
+        }
+    }
+};
+
+struct UrlParts { juce::String scheme, host, app, playPath, tcUrl; int port { 1935 }; };
+
+bool parseRtmpUrl(const juce::String& url, UrlParts& out) {
+    int schemeEnd = url.indexOf("://");
+    if (schemeEnd <= 0) return false;
+    out.scheme = url.substring(0, schemeEnd).toLowerCase();
+    juce::String rest = url.substring(schemeEnd + 3);
+    int slash = rest.indexOfChar('/');
+    if (slash <= 0) return false;
+    juce::String hostPort = rest.substring(0, slash);
+    juce::String path = rest.substring(slash + 1);
+    int colon = hostPort.lastIndexOfChar(':');
+    out.port = out.scheme == "rtmps" ? 443 : 1935;
+    if (colon > 0) { out.port = hostPort.substring(colon + 1).getIntValue(); out.host = hostPort.substring(0, colon); }
+    else out.host = hostPort;
+    int last = path.lastIndexOfChar('/');
+    if (last <= 0) return false;
+    out.app = path.substring(0, last);
+    out.playPath = path.substring(last + 1);
+    out.tcUrl = url.substring(0, schemeEnd + 3 + slash + 1 + last);
+    return out.host.isNotEmpty() && out.playPath.isNotEmpty();
+}
+} // namespace
+
+struct RtmpClient::Impl {
+    UrlParts parts;
+    std::atomic<bool> connected { false };
+    bool useAvio { false };
+    bool preferAvio { false };
+    std::atomic<juce::uint64> sentBytes { 0 };
+    size_t maxQueuedBytes { kDefaultMaxQueuedBytes };
+
+#if HAVE_FFMPEG
+    AVIOContext* avio { nullptr };
+    // libavformat blocks in avio_write/avio_flush for up to rw_timeout, so rtmps:// output goes through
+    // a writer thread: sendTag copies the whole tag into this byte ring (bounded by maxQueuedBytes,
+    // like the native spill queue) or rejects it, and never touches the network itself.
+    std::vector<uint8_t> avioRing;
+    std::atomic<size_t> avioHead { 0 }, avioTail { 0 }; // monotonic byte counts: writer / sendTag
+    std::thread avioThread;
+    RealtimeSignal avioWake, avioSpace;
+    std::atomic<bool> avioStop { false }, avioAbort { false }, avioDone { false };
+#endif
+
+#if RTMP_HAVE_SOCKETS
+    int fd { -1 };
+    uint32_t outChunkSize { 128 };
+    uint32_t inChunkSize { 128 };
+    uint32_t streamId { 0 };
+    double nextTxn { 1.0 };
+
+    // Outbound: headers for every chunk of one message, the iovec list, and the bounded spill queue.
+    // The queue is a run of spans in wire order: copied bytes (chunk headers, and messages nobody
+    // keeps alive) taken in turn from `queue`, or a queued tag's own slices, referenced until written.
+    struct Span { const uint8_t* ref; size_t size; SharedFlvTag::Ptr owner; }; // ref null: copied bytes
+    std::vector<uint8_t> headerScratch;
+    std::vector<iovec> iov, flushIov;
+    std::vector<uint8_t> queue;
+    size_t queueHead { 0 }, queueTail { 0 };
+    std::vector<Span> spans;
+    size_t spanHead { 0 }, spilledBytes { 0 };
+    int64_t lastProgressMs { 0 };
+    std::vector<uint8_t> cmd;
+    // Optional send pacing: messages that fit the bucket go straight out, anything larger is
+    // queued and released in slices as tokens accrue
+    TokenBucket bucket;
+    // Kernel's smoothed RTT, refreshed from service() for readers on other threads
+    std::atomic<int> rttMs { -1 };
+    int64_t lastRttSampleMs { 0 };
+
+    struct OutStream { bool started { false }; uint32_t ts { 0 }; uint32_t len { 0 }; uint8_t type { 0 }; uint32_t sid { 0 }; };
+    OutStream outStreams[16];
+
+    // Inbound chunk stream reassembly
+    struct InStream { uint32_t ts { 0 }, len { 0 }, sid { 0 }; uint8_t type { 0 }; bool extTs { false }; std::vector<uint8_t> msg; };
+    InStream inStreams[64];
+    std::vector<uint8_t> inBuf;
+    size_t inLen { 0 };
+    juce::uint64 bytesReceived { 0 }, lastAckSent { 0 };
+    uint32_t serverWindow { 0 };
+
+    // Results the connect sequence waits on
+    double lastResultTxn { -1.0 };
+    double lastResultValue { 0.0 };
+    juce::String lastStatusCode;
+    bool commandError { false };
+
+    void resetState() {
+        outChunkSize = inChunkSize = 128;
+        streamId = 0; nextTxn = 1.0;
+        clearSpill();
+        for (auto& s : outStreams) s = OutStream{};
+        for (auto& s : inStreams) { s.ts = s.len = s.sid = 0; s.type = 0; s.extTs = false; s.msg.clear(); }
+        inLen = 0; bytesReceived = lastAckSent = 0; serverWindow = 0;
+        lastResultTxn = -1.0; lastStatusCode = {}; commandError = false;
+        rttMs.store(-1); lastRttSampleMs = 0;
+        if (headerScratch.size() < 4096) headerScratch.resize(4096);
+        if (iov.capacity() < 512) iov.reserve(512);
+        if (flushIov.capacity() < 512) flushIov.reserve(512);
+        if (spans.capacity() < 256) spans.reserve(256);
+        if (queue.size() < maxQueuedBytes) queue.resize(maxQueuedBytes);
+        if (inBuf.size() < 65536) inBuf.resize(65536);
+    }
+
+    size_t queued() const noexcept { return spilledBytes; }
+
+    void clearSpill() {
+        queueHead = queueTail = 0;
+        spans.clear(); // releases the referenced tags
+        spanHead = spilledBytes = 0;
+    }
+
+    // ---- socket primitives -------------------------------------------------
+    bool openSocket(int timeoutMs) {
+        struct addrinfo hints {}; hints.ai_family = AF_UNSPEC; hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* res = nullptr;
+        juce::String portStr(parts.port);
+        if (getaddrinfo(parts.host.toRawUTF8(), portStr.toRawUTF8(), &hints, &res) != 0 || res == nullptr) {
+            LogMessage("RTMP: resolve failed -> " + parts.host);
+            return false;
+        }
+        const int64_t deadline = nowMs() + timeoutMs;
+        for (auto* ai = res; ai != nullptr && fd < 0; ai = ai->ai_next) {
+            int s = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (s < 0) continue;
+            fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+            int one = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+           #ifdef SO_NOSIGPIPE
+            setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+           #endif
+            int rc = ::connect(s, ai->ai_addr, ai->ai_addrlen);
+            if (rc != 0 && errno == EINPROGRESS) {
+                pollfd pfd { s, POLLOUT, 0 };
+                int wait = (int) juce::jmax<int64_t>(0, deadline - nowMs());
+                if (::poll(&pfd, 1, wait) == 1) {
+                    int err = 0; socklen_t len = sizeof(err);
+                    getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len);
+                    rc = err == 0 ? 0 : -1;
+                } else rc = -1;
+            }
+            if (rc == 0) fd = s; else ::close(s);
+        }
+        freeaddrinfo(res);
+        if (fd < 0) LogMessage("RTMP: TCP connect failed -> " + parts.host + ":" + juce::String(parts.port));
+        return fd >= 0;
+    }
+
+    bool waitFd(short events, int64_t deadline) {
+        pollfd pfd { fd, events, 0 };
+        int wait = (int) juce::jmax<int64_t>(0, deadline - nowMs());
+        int rc = ::poll(&pfd, 1, wait);
+        return rc == 1 && (pfd.revents & (events | POLLHUP | POLLERR)) != 0;
+    }
+
+    bool writeFully(const uint8_t* p, size_t n, int64_t deadline) {
+        while (n > 0) {
+            ssize_t w = ::send(fd, p, n, sendFlags());
+            if (w > 0) { p += w; n -= (size_t) w; continue; }
+            if (w < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+            if (nowMs() >= deadline || !waitFd(POLLOUT, deadline)) return false;
+        }
+        return true;
+    }
+
+    bool readFully(uint8_t* p, size_t n, int64_t deadline) {
+        while (n > 0) {
+            ssize_t r = ::recv(fd, p, n, 0);
+            if (r > 0) { p += r; n -= (size_t) r; bytesReceived += (juce::uint64) r; continue; }
+            if (r == 0) return false;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+            if (nowMs() >= deadline || !waitFd(POLLIN, deadline)) return false;
+        }
+        return true;
+    }
+
+    static int sendFlags() noexcept {
+       #ifdef MSG_NOSIGNAL
+        return MSG_NOSIGNAL;
+       #else
+        return 0;
+       #endif
+    }
+
+    // ---- handshake -----------------------------------------------------------
+    bool handshake(int64_t deadline) {
+        uint8_t c0c1[1 + kHandshakeSize];
+        c0c1[0] = 3;
+        wb32(c0c1 + 1, (uint32_t) nowMs());
+        wb32(c0c1 + 5, 0);
+        uint32_t x = (uint32_t) nowMs() * 2654435761u + 1u;
+        for (size_t i = 9; i < sizeof(c0c1); ++i) { x ^= x << 13; x ^= x >> 17; x ^= x << 5; c0c1[i] = (uint8_t) x; }
+        if (!writeFully(c0c1, sizeof(c0c1), deadline)) return false;
+
+        uint8_t s0s1[1 + kHandshakeSize];
+        if (!readFully(s0s1, sizeof(s0s1), deadline)) return false;
+        if (s0s1[0] != 3) { LogMessage("RTMP: unexpected handshake version " + juce::String((int) s0s1[0])); return false; }
+        // C2 echoes S1 (time, time2 = our read time, random)
+        uint8_t c2[kHandshakeSize];
+        memcpy(c2, s0s1 + 1, kHandshakeSize);
+        wb32(c2 + 4, (uint32_t) nowMs());
+        if (!writeFully(c2, sizeof(c2), deadline)) return false;
+        uint8_t s2[kHandshakeSize];
+        return readFully(s2, sizeof(s2), deadline);
+    }
+
+    // ---- outbound messages ---------------------------------------------------
+    // Chunks body (given as slices) into iovecs: [basic+message header][payload bytes]... and hands the
+    // whole message to writeOrQueue. The message is either fully accepted or not started.
+    bool sendMessage(int csid, uint8_t type, uint32_t ts, uint32_t sid, const IoSlice* body, int numBody, size_t bodyLen,
+                     const SharedFlvTag::Ptr& owner = nullptr) {
+        auto& os = outStreams[csid & 15];
+        const bool extTs = ts >= 0xFFFFFF;
+        const size_t numChunks = bodyLen == 0 ? 1 : (bodyLen + outChunkSize - 1) / outChunkSize;
+        const size_t maxHeaderBytes = numChunks * 16;
+        if (headerScratch.size() < maxHeaderBytes) headerScratch.resize(maxHeaderBytes);
+
+        // fmt 1 (no stream id) when the chunk stream already carries this message stream and time moves forward
+        const bool useFmt1 = os.started && os.sid == sid && ts >= os.ts && (ts - os.ts) < 0xFFFFFF && !extTs;
+        iov.clear();
+        uint8_t* h = headerScratch.data();
+        size_t wire = 0;
+        int sliceIdx = 0; size_t sliceOff = 0;
+        for (size_t c = 0; c < numChunks; ++c) {
+            uint8_t* hs = h;
+            if (c == 0) {
+                if (useFmt1) {
+                    *h++ = (uint8_t)((1 << 6) | csid);
+                    wb24(h, ts - os.ts); h += 3;
+                } else {
+                    *h++ = (uint8_t) csid;
+                    wb24(h, extTs ? 0xFFFFFF : ts); h += 3;
+                }
+                wb24(h, (uint32_t) bodyLen); h += 3;
+                *h++ = type;
+                if (!useFmt1) { h[0] = (uint8_t) sid; h[1] = (uint8_t)(sid >> 8); h[2] = (uint8_t)(sid >> 16); h[3] = (uint8_t)(sid >> 24); h += 4; }
+            } else {
+                *h++ = (uint8_t)((3 << 6) | csid);
+            }
+            if (extTs) { wb32(h, ts); h += 4; }
+            iov.push_back({ hs, (size_t)(h - hs) });
+            wire += (size_t)(h - hs);
+
+            size_t want = juce::jmin<size_t>(outChunkSize, bodyLen - c * outChunkSize);
+            while (want > 0 && sliceIdx < numBody) {
+                size_t avail = body[sliceIdx].size - sliceOff;
+                size_t take = juce::jmin(avail, want);
+                if (take > 0) iov.push_back({ (void*)((const uint8_t*) body[sliceIdx].data + sliceOff), take });
+                want -= take; sliceOff += take; wire += take;
+                if (sliceOff == body[sliceIdx].size) { ++sliceIdx; sliceOff = 0; }
+            }
+        }
+        if (!writeOrQueue(wire, owner)) return false;
+        os.started = true; os.ts = ts; os.len = (uint32_t) bodyLen; os.type = type; os.sid = sid;
+        return true;
+    }
+
+    // `owner`, when set, keeps every body slice alive: an unsent remainder is referenced, not copied
+    bool writeOrQueue(size_t wire, const SharedFlvTag::Ptr& owner) {
+        if (queued() > 0 && queued() + wire > maxQueuedBytes) return false; // would overflow; drop whole message
+        size_t written = 0;
+        const bool paced = bucket.isEnabled();
+        if (queued() == 0 && (!paced || bucket.available(PrecisionClock::nowMicros()) >= (double) wire)) {
+            size_t idx = 0;
+            while (idx < iov.size()) {
+                msghdr mh {};
+                mh.msg_iov = iov.data() + idx;
+                mh.msg_iovlen = (decltype(mh.msg_iovlen)) juce::jmin<size_t>(iov.size() - idx, 1024);
+                ssize_t w = ::sendmsg(fd, &mh, sendFlags());
+                if (w < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                    LogEvent("RTMP: send failed errno={}", errno);
+                    connected.store(false);
+                    return false;
+                }
+                written += (size_t) w;
+                sentBytes.fetch_add((juce::uint64) w);
+                bucket.consume((double) w);
+                lastProgressMs = nowMs();
+                // advance the iovec cursor
+                size_t left = (size_t) w;
+                while (idx < iov.size() && left >= iov[idx].iov_len) { left -= iov[idx].iov_len; ++idx; }
+                if (idx < iov.size() && left > 0) {
+                    iov[idx].iov_base = (uint8_t*) iov[idx].iov_base + left;
+                    iov[idx].iov_len -= left;
+                    break; // kernel buffer full
+                }
+            }
+            if (written == wire) return true;
+            // drop fully written entries so the copy below starts at the remainder
+            iov.erase(iov.begin(), iov.begin() + (std::ptrdiff_t) idx);
+        }
+        // Park the unsent remainder: chunk headers live in the scratch and are copied, a tag's slices are
+        // referenced, so a paced keyframe costs its few chunk headers rather than a copy of the frame
+        const auto* scratchBegin = headerScratch.data();
+        const auto* scratchEnd = scratchBegin + headerScratch.size();
+        auto inScratch = [&](const iovec& v) { return (const uint8_t*) v.iov_base >= scratchBegin && (const uint8_t*) v.iov_base < scratchEnd; };
+        auto copied = [&](const iovec& v) { return owner == nullptr || inScratch(v); };
+        size_t toCopy = 0, tagBytes = 0;
+        for (auto& v : iov) {
+            if (copied(v)) toCopy += v.iov_len;
+            if (copied(v) && !inScratch(v)) tagBytes += v.iov_len;
+        }
+        MediaBuffer::noteCopied(tagBytes); // tag bytes of an unshared chunk; our own chunk headers don't count
+        compactQueue(toCopy);
+        for (auto& v : iov) {
+            if (!copied(v)) { appendSpan((const uint8_t*) v.iov_base, v.iov_len, owner); continue; }
+            memcpy(queue.data() + queueTail, v.iov_base, v.iov_len);
+            queueTail += v.iov_len;
+            appendSpan(nullptr, v.iov_len, nullptr);
+        }
+        return true;
+    }
+
+    void appendSpan(const uint8_t* ref, size_t size, const SharedFlvTag::Ptr& owner) {
+        spilledBytes += size;
+        if (spans.size() > spanHead) {
+            auto& last = spans.back();
+            const bool extendsCopy = ref == nullptr && last.ref == nullptr;
+            const bool extendsRef = ref != nullptr && last.ref != nullptr && last.ref + last.size == ref && last.owner == owner;
+            if (extendsCopy || extendsRef) { last.size += size; return; }
+        }
+        spans.push_back({ ref, size, owner });
+    }
+
+    // Retires `n` written bytes from the front spans, releasing tags whose slices are all out
+    void consumeSpans(size_t n) {
+        spilledBytes -= n;
+        while (n > 0) {
+            auto& span = spans[spanHead];
+            const size_t take = juce::jmin(n, span.size);
+            if (span.ref == nullptr) queueHead += take; else span.ref += take;
+            span.size -= take;
+            n -= take;
+            if (span.size == 0) { span.owner = nullptr; ++spanHead; }
+        }
+        if (spanHead >= 64 && spanHead * 2 >= spans.size()) {
+            spans.erase(spans.begin(), spans.begin() + (std::ptrdiff_t) spanHead);
+            spanHead = 0;
+        }
+    }
+
+    void compactQueue(size_t incoming) {
+        if (queueHead > 0) {
+            const size_t n = queueTail - queueHead; // copied bytes only; referenced spans stay where they are
+            if (n > 0) memmove(queue.data(), queue.data() + queueHead, n);
+            queueHead = 0; queueTail = n;
+        }
+        if (queueTail + incoming > queue.size()) queue.resize(queueTail + incoming); // oversize first spill only
+    }
+
+    // Bytes the bucket lets us write now (everything when unpaced); 0 until a full slice has accrued
+    size_t sendAllowance() noexcept {
+        if (!bucket.isEnabled()) return queued();
+        const double avail = bucket.available(PrecisionClock::nowMicros());
+        const size_t slice = juce::jmin(queued(), kPacedSliceBytes);
+        return avail >= (double) slice ? juce::jmin(queued(), (size_t) avail) : 0;
+    }
+
+    // Milliseconds until the next paced slice may go out (0 when unpaced or ready)
+    int pacingDelayMs() noexcept {
+        if (!bucket.isEnabled() || queued() == 0) return 0;
+        const auto us = bucket.microsUntil((double) juce::jmin(queued(), kPacedSliceBytes), PrecisionClock::nowMicros());
+        return (int) ((us + 999) / 1000);
+    }
+
+    bool flushQueue() {
+        while (queued() > 0) {
+            size_t allowance = sendAllowance();
+            if (allowance == 0) break;
+            // Gather up to the allowance: copied bytes from the queue, referenced slices in place
+            flushIov.clear();
+            size_t copyOffset = queueHead;
+            for (size_t i = spanHead; i < spans.size() && allowance > 0 && flushIov.size() < 1024; ++i) {
+                const auto& span = spans[i];
+                const size_t n = juce::jmin(span.size, allowance);
+                flushIov.push_back({ (void*) (span.ref != nullptr ? span.ref : queue.data() + copyOffset), n });
+                if (span.ref == nullptr) copyOffset += span.size;
+                allowance -= n;
+            }
+            msghdr mh {};
+            mh.msg_iov = flushIov.data();
+            mh.msg_iovlen = (decltype(mh.msg_iovlen)) flushIov.size();
+            ssize_t w = ::sendmsg(fd, &mh, sendFlags());
+            if (w > 0) {
+                consumeSpans((size_t) w); sentBytes.fetch_add((juce::uint64) w); lastProgressMs = nowMs();
+                bucket.consume((double) w);
+                continue;
+            }
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            LogEvent("RTMP: send failed errno={}", errno);
+            connected.store(false);
+            return false;
+        }
+        if (queued() == 0) clearSpill();
+        return true;
+    }
+
+    bool sendControl(uint8_t type, uint32_t value) {
+        uint8_t p[4]; wb32(p, value);
+        IoSlice s { p, 4 };
+        return sendMessage(kCsControl, type, 0, 0, &s, 1, 4);
+    }
+
+    bool sendCommand(int csid, uint32_t sid) {
+        IoSlice s { cmd.data(), cmd.size() };
+        return sendMessage(csid, kCommandAmf0, 0, sid, &s, 1, cmd.size());
+    }
+
+    // ---- inbound -------------------------------------------------------------
+    bool readAvailable() {
+        for (;;) {
+            if (inLen == inBuf.size()) inBuf.resize(inBuf.size() * 2);
+            ssize_t r = ::recv(fd, inBuf.data() + inLen, inBuf.size() - inLen, 0);
+            if (r > 0) { inLen += (size_t) r; bytesReceived += (juce::uint64) r; continue; }
+            if (r == 0) { LogMessage("RTMP: server closed connection"); connected.store(false); return false; }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            connected.store(false);
+            return false;
+        }
+        size_t off = 0;
+        for (;;) {
+            size_t used = 0;
+            int rc = parseChunk(inBuf.data() + off, inLen - off, used);
+            if (rc < 0) { LogMessage("RTMP: malformed inbound chunk"); connected.store(false); return false; }
+            if (rc == 0) break;
+            off += used;
+        }
+        if (off > 0) { memmove(inBuf.data(), inBuf.data() + off, inLen - off); inLen -= off; }
+        if (serverWindow > 0 && bytesReceived - lastAckSent >= serverWindow) {
+            lastAckSent = bytesReceived;
+            sendControl(kAck, (uint32_t) bytesReceived);
+        }
+        return true;
+    }
+
+    // 1 = consumed one chunk, 0 = need more bytes, -1 = protocol error
+    int parseChunk(const uint8_t* p, size_t n, size_t& used) {
+        if (n < 1) return 0;
+        const int fmt = p[0] >> 6;
+        int csid = p[0] & 0x3F;
+        size_t pos = 1;
+        if (csid == 0) { if (n < 2) return 0; csid = 64 + p[1]; pos = 2; }
+        else if (csid == 1) { if (n < 3) return 0; csid = 64 + p[1] + 256 * p[2]; pos = 3; }
+        auto& s = inStreams[csid & 63];
+        const size_t mhLen = fmt == 0 ? 11 : fmt == 1 ? 7 : fmt == 2 ? 3 : 0;
+        if (n < pos + mhLen) return 0;
+        uint32_t tsField = s.extTs ? 0xFFFFFF : 0;
+        if (fmt <= 2) tsField = rb24(p + pos);
+        const bool newMessage = s.msg.empty();
+        if (fmt <= 1) { s.len = rb24(p + pos + 3); s.type = p[pos + 6]; }
+        if (fmt == 0) s.sid = p[pos + 7] | (p[pos + 8] << 8) | (p[pos + 9] << 16) | ((uint32_t) p[pos + 10] << 24);
+        pos += mhLen;
+        if (fmt <= 2) s.extTs = tsField == 0xFFFFFF;
+        if (s.extTs) { if (n < pos + 4) return 0; tsField = rb32(p + pos); pos += 4; }
+        if (s.len > 16 * 1024 * 1024) return -1;
+        const size_t have = s.msg.size();
+        const size_t take = juce::jmin<size_t>(inChunkSize, s.len - have);
+        if (n < pos + take) return 0;
+        if (newMessage && fmt != 3) s.ts = (fmt == 0) ? tsField : s.ts + tsField;
+        s.msg.insert(s.msg.end(), p + pos, p + pos + take);
+        used = pos + take;
+        if (s.msg.size() >= s.len) {
+            handleMessage(s.type, s.msg.data(), s.msg.size(), s.ts);
+            s.msg.clear();
+        }
+        return 1;
+    }
+
+    void handleMessage(uint8_t type, const uint8_t* p, size_t n, uint32_t ts) {
+        switch (type) {
+            case kSetChunkSize: if (n >= 4) inChunkSize = juce::jmax<uint32_t>(1, rb32(p) & 0x7FFFFFFF); break;
+            case kWindowAckSize: if (n >= 4) serverWindow = rb32(p); break;
+            case kSetPeerBandwidth: if (n >= 4) sendControl(kWindowAckSize, rb32(p)); break;
+            case kUserControl:
+                if (n >= 6 && rb16(p) == 6) { // ping request -> pong with the same timestamp
+                    uint8_t pong[6]; wb16(pong, 7); memcpy(pong + 2, p + 2, 4);
+                    IoSlice s { pong, 6 };
+                    sendMessage(kCsControl, kUserControl, 0, 0, &s, 1, 6);
+                }
+                break;
+            case kCommandAmf0: handleCommand(p, n); break;
+            default: break;
+        }
+        juce::ignoreUnused(ts);
+    }
+
+    void handleCommand(const uint8_t* p, size_t n) {
+        AmfIn in { p, p + n };
+        juce::String name; double txn = 0;
+        if (!in.readString(name) || !in.readNumber(txn)) return;
+        if (name == "_result") {
+            in.skipValue(); // command object / null
+            double v = 0; if (in.readNumber(v)) lastResultValue = v;
+            lastResultTxn = txn;
+        } else if (name == "_error") {
+            juce::String code; in.skipValue(); in.skipValue(&code);
+            LogMessage("RTMP: server error " + code);
+            commandError = true;
+            lastResultTxn = txn;
+        } else if (name == "onStatus") {
+            juce::String code; in.skipValue(); in.skipValue(&code);
+            lastStatusCode = code;
+            LogMessage("RTMP: onStatus " + code);
+            if (code.containsIgnoreCase("Failed") || code.containsIgnoreCase("BadName") || code.containsIgnoreCase("Rejected"))
+                commandError = true;
+        }
+    }
+
+    bool pumpUntil(const std::function<bool()>& done, int64_t deadline) {
+        while (!done()) {
+            if (commandError || !connected.load()) return false;
+            if (nowMs() >= deadline) { LogMessage("RTMP: timed out waiting for server"); return false; }
+            short ev = (short)(POLLIN | (queued() > 0 ? POLLOUT : 0));
+            pollfd pfd { fd, ev, 0 };
+            int rc = ::poll(&pfd, 1, (int) juce::jmin<int64_t>(100, juce::jmax<int64_t>(0, deadline - nowMs())));
+            if (rc < 0 && errno != EINTR) return false;
+            if (rc > 0) {
+                if (pfd.revents & (POLLERR | POLLHUP)) { connected.store(false); return false; }
+                if ((pfd.revents & POLLOUT) && !flushQueue()) return false;
+                if ((pfd.revents & POLLIN) && !readAvailable()) return false;
+            }
+        }
+        return true;
+    }
+
+    bool command(const char* name, bool withKey, int csid, uint32_t sid, double& txnOut) {
+        cmd.clear();
+        AmfOut a { cmd };
+        txnOut = nextTxn++;
+        a.str(name); a.num(txnOut); a.null();
+        if (withKey) a.str(parts.playPath.toRawUTF8());
+        return sendCommand(csid, sid);
+    }
+
+    bool connectNative(int timeoutMs) {
+        const int64_t deadline = nowMs() + timeoutMs;
+        resetState();
+        if (!openSocket(timeoutMs)) return false;
+        if (!handshake(deadline)) { LogMessage("RTMP: handshake failed"); return false; }
+        connected.store(true);
+        lastProgressMs = nowMs();
+
+        // Large outbound chunks first, so every media message after connect rides in 1-2 chunks
+        if (!sendControl(kSetChunkSize, kOutChunkSize)) return false;
+        outChunkSize = kOutChunkSize;
+
+        cmd.clear();
+        AmfOut a { cmd };
+        double connectTxn = nextTxn++;
+        a.str("connect"); a.num(connectTxn);
+        a.beginObject();
+        a.key("app"); a.str(parts.app.toRawUTF8());
+        a.key("type"); a.str("nonprivate");
+        a.key("flashVer"); a.str("FMLE/3.0 (compatible; FMSc/1.0)");
+        a.key("tcUrl"); a.str(parts.tcUrl.toRawUTF8());
+        a.endObject();
+        if (!sendCommand(kCsCommand, 0)) return false;
+        if (!pumpUntil([&]{ return lastResultTxn == connectTxn; }, deadline)) { LogMessage("RTMP: connect rejected"); return false; }
+
+        double t = 0;
+        command("releaseStream", true, kCsCommand, 0, t);
+        command("FCPublish", true, kCsCommand, 0, t);
+        double createTxn = 0;
+        if (!command("createStream", false, kCsCommand, 0, createTxn)) return false;
+        if (!pumpUntil([&]{ return lastResultTxn == createTxn; }, deadline)) { LogMessage("RTMP: createStream failed"); return false; }
+        streamId = (uint32_t) lastResultValue;
+
+        cmd.clear();
+        AmfOut pub { cmd };
+        pub.str("publish"); pub.num(nextTxn++); pub.null();
+        pub.str(parts.playPath.toRawUTF8()); pub.str("live");
+        if (!sendCommand(kCsStream, streamId)) return false;
+        if (!pumpUntil([&]{ return lastStatusCode.isNotEmpty(); }, deadline)) return false;
+        if (!lastStatusCode.containsIgnoreCase("Publish.Start")) { LogMessage("RTMP: publish refused -> " + lastStatusCode); return false; }
+        LogMessage("RTMP: publishing (native) stream id=" + juce::String((int) streamId) + " chunk=" + juce::String((int) outChunkSize));
+        return true;
+    }
+
+    void closeNative() {
+        if (fd < 0) return;
+        if (connected.load() && streamId != 0) {
+            double t = 0;
+            command("FCUnpublish", true, kCsCommand, 0, t);
+            command("deleteStream", false, kCsCommand, 0, t);
+            flushQueue();
+        }
+        ::close(fd);
+        fd = -1;
+    }
+
+    bool sendTagNative(const FlvChunk& tag, const SharedFlvTag::Ptr& owner = nullptr) {
+        if (fd < 0 || !connected.load()) return false;
+        if (queued() > 0 && !flushQueue()) return false;
+        if (lastProgressMs > 0 && queued() > 0 && nowMs() - lastProgressMs > kStallTimeoutMs) {
+            LogMessage("RTMP: send stalled for " + juce::String(kStallTimeoutMs) + " ms, dropping connection");
+            connected.store(false);
+            return false;
+        }
+        // Trim the 11-byte tag header and 4-byte trailer off the slices to get the message body
+        IoSlice body[FlvChunk::maxSlices + 1];
+        int nb = 0;
+        static const uint8_t setDataFrame[] = { 0x02, 0x00, 0x0D, '@','s','e','t','D','a','t','a','F','r','a','m','e' };
+        if (tag.tagType == kDataAmf0) body[nb++] = { setDataFrame, sizeof(setDataFrame) };
+        size_t skipFront = FlvChunk::tagHeaderSize;
+        size_t keep = tag.bodySize();
+        size_t bodyLen = (nb > 0 ? sizeof(setDataFrame) : 0) + keep;
+        for (int i = 0; i < tag.numSlices && keep > 0; ++i) {
+            const auto* d = (const uint8_t*) tag.slices[i].data;
+            size_t len = tag.slices[i].size;
+            size_t s = juce::jmin(skipFront, len);
+            skipFront -= s; d += s; len -= s;
+            len = juce::jmin(len, keep);
+            if (len > 0) { body[nb++] = { d, len }; keep -= len; }
+        }
+        const int csid = tag.tagType == kAudio ? kCsAudio : tag.tagType == kVideo ? kCsVideo : kCsData;
+        return sendMessage(csid, tag.tagType, tag.timestampMs, streamId, body, nb, bodyLen, owner);
+    }
+
+    void sampleRtt() {
+        const int64_t now = nowMs();
+        if (now - lastRttSampleMs < 250) return;
+        lastRttSampleMs = now;
+       #if defined(__APPLE__)
+        tcp_connection_info ti {};
+        socklen_t len = sizeof(ti);
+        if (getsockopt(fd, IPPROTO_TCP, TCP_CONNECTION_INFO, &ti, &len) == 0) rttMs.store((int) ti.tcpi_srtt);
+       #elif defined(__linux__)
+        tcp_info ti {};
+        socklen_t len = sizeof(ti);
+        if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0) rttMs.store((int) (ti.tcpi_rtt / 1000));
+       #endif
+    }
+
+    bool serviceNative(int timeoutMs) {
+        if (fd < 0 || !connected.load()) return false;
+        sampleRtt();
+        // While paced output waits on tokens, sleep until the next slice instead of polling for POLLOUT
+        const int paceMs = pacingDelayMs();
+        short ev = (short)(POLLIN | (queued() > 0 && paceMs == 0 ? POLLOUT : 0));
+        pollfd pfd { fd, ev, 0 };
+        int rc = ::poll(&pfd, 1, paceMs > 0 ? juce::jmin(timeoutMs, paceMs) : timeoutMs);
+        if (rc < 0) return errno == EINTR;
+        if (rc > 0) {
+            if (pfd.revents & (POLLERR | POLLHUP)) { connected.store(false); return false; }
+            if ((pfd.revents & POLLOUT) && !flushQueue()) return false;
+            if ((pfd.revents & POLLIN) && !readAvailable()) return false;
+        }
+        if (bucket.isEnabled() && queued() > 0 && pacingDelayMs() == 0 && !flushQueue()) return false; // paced slice came due
+        if (queued() > 0 && nowMs() - lastProgressMs > kStallTimeoutMs) {
+            LogMessage("RTMP: send stalled, dropping connection");
+            connected.store(false);
+            return false;
+        }
+        return true;
+    }
+#endif // RTMP_HAVE_SOCKETS
+
+#if HAVE_FFMPEG
+    // rtmps:// through libavformat's RTMP-over-TLS protocol, fed with the same FLV tags.
+    // The protocol expects an FLV byte stream (it skips the 13-byte file header itself).
+    bool connectAvio(const juce::String& url, int timeoutMs) {
+        AVDictionary* opts = nullptr;
+        av_dict_set(&opts, "rtmp_live", "live", 0);
+        av_dict_set(&opts, "rtmp_flashver", "FMLE/3.0 (compatible; FMSc/1.0)", 0);
+        av_dict_set(&opts, "rtmp_tcurl", parts.tcUrl.toRawUTF8(), 0);
+        av_dict_set(&opts, "tls_server_name", parts.host.toRawUTF8(), 0);
+        av_dict_set(&opts, "rw_timeout", juce::String((juce::int64) timeoutMs * 1000).toRawUTF8(), 0);
+        avioStop.store(false); avioAbort.store(false); avioDone.store(false);
+        const AVIOInterruptCB interrupt { &Impl::avioInterrupted, this };
+        int ret = avio_open2(&avio, url.toRawUTF8(), AVIO_FLAG_WRITE, &interrupt, &opts);
+        av_dict_free(&opts);
+        if (ret < 0) { LogMessage("RTMP: rtmps open failed (" + juce::String(ret) + ")"); avio = nullptr; return false; }
+        if (avioRing.size() < maxQueuedBytes) avioRing.assign(maxQueuedBytes, 0);
+        avioHead.store(0); avioTail.store(0);
+        static const uint8_t flvHeader[13] = { 'F','L','V', 1, 5, 0, 0, 0, 9, 0, 0, 0, 0 };
+        memcpy(avioRing.data(), flvHeader, sizeof(flvHeader));
+        avioTail.store(sizeof(flvHeader));
+        connected.store(true);
+        avioThread = std::thread([this] { avioWriterLoop(); });
+        LogMessage("RTMP: publishing (libavformat" + juce::String(parts.scheme == "rtmps" ? " TLS" : "") + ") -> " + parts.host);
+        return true;
+    }
+
+    // Lets close() cut short a write libavformat is blocked in
+    static int avioInterrupted(void* opaque) { return static_cast<Impl*>(opaque)->avioAbort.load() ? 1 : 0; }
+
+    size_t avioQueued() const noexcept { return avioTail.load(std::memory_order_acquire) - avioHead.load(std::memory_order_acquire); }
+
+    bool sendTagAvio(const FlvChunk& tag) {
+        if (avio == nullptr || !connected.load()) return false;
+        const size_t n = tag.totalSize();
+        const size_t head = avioHead.load(std::memory_order_acquire), tail = avioTail.load(std::memory_order_relaxed);
+        // An empty ring means the writer is done reading it, so a tag larger than the whole ring may
+        // grow it (first oversize message only, as with the native spill queue)
+        if (head == tail && n > avioRing.size()) avioRing.resize(n);
+        const size_t cap = avioRing.size();
+        if (tail - head + n > cap) return false; // full: the caller services and retries, or drops
+        MediaBuffer::noteCopied(n);
+        size_t off = tail % cap;
+        for (int i = 0; i < tag.numSlices; ++i) {
+            const auto* src = static_cast<const uint8_t*>(tag.slices[i].data);
+            size_t len = tag.slices[i].size;
+            while (len > 0) {
+                const size_t take = juce::jmin(len, cap - off);
+                memcpy(avioRing.data() + off, src, take);
+                src += take; len -= take;
+                off = (off + take) % cap;
+            }
+        }
+        avioTail.store(tail + n, std::memory_order_release);
+        avioWake.notify();
+        return true;
+    }
+
+    // Writer thread: drains the ring into libavformat and flushes whenever it runs dry
+    void avioWriterLoop() {
+        for (;;) {
+            const size_t head = avioHead.load(std::memory_order_relaxed);
+            const size_t tail = avioTail.load(std::memory_order_acquire);
+            if (head == tail) {
+                avio_flush(avio);
+                if (avio->error < 0 || avioStop.load()) break;
+                avioWake.wait(100);
+                continue;
+            }
+            const size_t cap = avioRing.size(), off = head % cap;
+            const size_t n = juce::jmin(tail - head, cap - off, kAvioWriteBytes);
+            avio_write(avio, avioRing.data() + off, (int) n);
+            avioHead.store(head + n, std::memory_order_release);
+            sentBytes.fetch_add((juce::uint64) n);
+            avioSpace.notify();
+            if (avio->error < 0) break;
+        }
+        if (avio->error < 0 && !avioAbort.load()) LogEvent("RTMP: rtmps write failed ({})", avio->error);
+        if (avio->error < 0) connected.store(false);
+        avioDone.store(true);
+        avioSpace.notify();
+    }
+
+    bool serviceAvio(int timeoutMs) {
+        if (timeoutMs > 0 && connected.load() && avioQueued() > 0) avioSpace.wait(timeoutMs);
+        return connected.load();
+    }
+
+    void closeAvio() {
+        if (avio == nullptr) return;
+        // Give the writer a moment to send what sendTag accepted (and unpublish cleanly), then cut it off
+        avioStop.store(true);
+        avioWake.notify();
+        const int64_t deadline = nowMs() + kAvioDrainMs;
+        while (!avioDone.load() && nowMs() < deadline) avioSpace.wait(20);
+        if (!avioDone.load()) avioAbort.store(true);
+        if (avioThread.joinable()) avioThread.join();
+        avio_closep(&avio);
+    }
+#endif
+};
+
+RtmpClient::RtmpClient() : impl(std::make_unique<Impl>()) {}
+RtmpClient::~RtmpClient() { close(); }
+
+bool RtmpClient::connect(const StreamingConfig& cfg) {
+    return connect(cfg.rtmpUrl);
+}
+
+bool RtmpClient::connect(const juce::String& url, int timeoutMs) {
+    close();
+    const juce::String trimmed = url.trim();
+    if (!parseRtmpUrl(trimmed, impl->parts)) { LogMessage("RTMP: cannot parse URL"); return false; }
+    impl->sentBytes.store(0);
+    if (impl->parts.scheme == "rtmps") {
+       #if HAVE_FFMPEG
+        impl->useAvio = true;
+        return impl->connectAvio(trimmed, timeoutMs);
+       #else
+        LogMessage("RTMP: rtmps requires FFmpeg (HAVE_FFMPEG off)");
+        return false;
+       #endif
+    }
+    if (impl->parts.scheme != "rtmp") { LogMessage("RTMP: unsupported scheme " + impl->parts.scheme); return false; }
+   #if HAVE_FFMPEG
+    if (impl->preferAvio) { impl->useAvio = true; return impl->connectAvio(trimmed, timeoutMs); }
+   #endif
+   #if RTMP_HAVE_SOCKETS
+    impl->useAvio = false;
+    if (!impl->connectNative(timeoutMs)) { impl->closeNative(); impl->connected.store(false); return false; }
+    return true;
+   #else
+    juce::ignoreUnused(timeoutMs);
+    LogMessage("RTMP: native client not available on this platform");
+    return false;
+   #endif
+}
+
+bool RtmpClient::sendTag(const FlvChunk& tag) {
+    if (tag.tagType == 0) return isConnected(); // FLV file header: not part of an RTMP stream
+   #if HAVE_FFMPEG
+    if (impl->useAvio) return impl->sendTagAvio(tag);
+   #endif
+   #if RTMP_HAVE_SOCKETS
+    return impl->sendTagNative(tag);
+   #else
+    return false;
+   #endif
+}
+
+bool RtmpClient::sendTag(const SharedFlvTag::Ptr& tag) {
+    if (tag == nullptr) return false;
+    const FlvChunk chunk = tag->asChunk();
+    if (chunk.tagType == 0) return isConnected();
+   #if HAVE_FFMPEG
+    if (impl->useAvio) return impl->sendTagAvio(chunk);
+   #endif
+   #if RTMP_HAVE_SOCKETS
+    return impl->sendTagNative(chunk, tag);
+   #else
+    return false;
+   #endif
+}
+
+bool RtmpClient::sendChunk(const void* data, size_t size) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    size_t pos = 0;
+    if (size >= 13 && p[0] == 'F' && p[1] == 'L' && p[2] == 'V') pos = 13;
+    while (pos + FlvChunk::tagHeaderSize + FlvChunk::trailerSize <= size) {
+        const uint32_t dataSize = rb24(p + pos + 1);
+        const size_t tagSize = FlvChunk::tagHeaderSize + dataSize + FlvChunk::trailerSize;
+        if (pos + tagSize > size) break;
+        FlvChunk tag;
+        tag.slices[0] = { p + pos, tagSize };
+        tag.numSlices = 1;
+        tag.tagType = p[pos];
+        tag.timestampMs = rb24(p + pos + 4) | ((uint32_t) p[pos + 7] << 24);
+        if (!sendTag(tag)) return false;
+        pos += tagSize;
+    }
+    return pos == size;
+}
+
+bool RtmpClient::service(int timeoutMs) {
+   #if HAVE_FFMPEG
+    if (impl->useAvio) return impl->serviceAvio(timeoutMs);
+   #endif
+   #if RTMP_HAVE_SOCKETS
+    return impl->serviceNative(timeoutMs);
+   #else
+    juce::ignoreUnused(timeoutMs);
+    return false;
+   #endif
+}
+
+bool RtmpClient::isConnected() const { return impl->connected.load(); }
+
+size_t RtmpClient::queuedBytes() const {
+   #if HAVE_FFMPEG
+    if (impl->useAvio) return impl->avioQueued();
+   #endif
+   #if RTMP_HAVE_SOCKETS
+    return impl->queued();
+   #else
+    return 0;
+   #endif
+}
+
+juce::uint64 RtmpClient::bytesSent() const { return impl->sentBytes.load(); }
+
+int RtmpClient::getRttMs() const {
+   #if RTMP_HAVE_SOCKETS
+    return impl->useAvio ? -1 : impl->rttMs.load();
+   #else
+    return -1;
+   #endif
+}
+
+void RtmpClient::setMaxQueuedBytes(size_t bytes) {
+    impl->maxQueuedBytes = juce::jmax<size_t>(64 * 1024, bytes);
+}
+
+void RtmpClient::setUseLibavformat(bool shouldUse) {
+    impl->preferAvio = shouldUse;
+}
+
+void RtmpClient::setPacingRate(double bytesPerSecond, size_t burstBytes) {
+   #if RTMP_HAVE_SOCKETS
+    impl->bucket.configure(bytesPerSecond, (double) burstBytes, PrecisionClock::nowMicros());
+   #else
+    juce::ignoreUnused(bytesPerSecond, burstBytes);
+   #endif
+}
+
+void RtmpClient::close() {
+   #if HAVE_FFMPEG
+    impl->closeAvio();
+   #endif
+   #if RTMP_HAVE_SOCKETS
+    impl->closeNative();
+   #endif
+    impl->connected.store(false);
+}
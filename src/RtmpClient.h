@@ -1,27 +1,123 @@
 #pragma once
 #include <juce_core/juce_core.h>
 #include "StreamingConfig.h"
+#include "FlvMuxer.h"
+#include "EncoderControl.h"
+#include "MediaBuffer.h"
+#include <mutex>
 
 namespace streaming {
 
+// One muxed FLV tag (header + body + trailer). Produced once per frame and shared by reference across
+// every endpoint queue. When the frame payload lives in a MediaBuffer the tag references it and only
+// the few header/trailer bytes are copied; otherwise the whole tag is copied once for all N endpoints.
+struct SharedFlvTag : public juce::ReferenceCountedObject {
+    using Ptr = juce::ReferenceCountedObjectPtr<SharedFlvTag>;
+
+    juce::HeapBlock<uint8_t> bytes;  // the copied slices
+    MediaBuffer::Ptr payload;        // keeps referenced slices alive
+    IoSlice slices[FlvChunk::maxSlices];
+    int numSlices { 0 };
+    size_t size { 0 };
+    uint8_t tagType { 0 };
+    uint32_t timestampMs { 0 };
+    bool keyframe { false };
+    bool isConfig { false }; // onMetaData or a codec sequence header: replayed after a reconnect
+
+    // Slices that lie inside `payload` are referenced, everything else is copied
+    static Ptr fromChunk(const FlvChunk& chunk, const MediaBuffer::Ptr& payload = nullptr);
+    static Ptr fromBytes(const uint8_t* tag, size_t tagSize); // one complete tag, trailer included
+    FlvChunk asChunk() const noexcept;
+    uint8_t byteAt(size_t offset) const noexcept;
+};
+
+// Publishing RTMP client. rtmp:// runs natively on a non-blocking socket (handshake, connect/
+// createStream/publish, 64 KiB outbound chunks, writev sends); rtmps:// goes through libavformat's
+// TLS RTMP protocol when HAVE_FFMPEG is set, written from a thread of its own. Sends never wait on
+// the network: output the kernel (or that thread) does not take immediately is parked in a bounded
+// queue that service() drains.
 class RtmpClient {
 public:
-    RtmpClient() = default;
-    ~RtmpClient() = default;
+    RtmpClient();
+    ~RtmpClient();
 
     bool connect(const StreamingConfig& cfg); // rtmpUrl
+    bool connect(const juce::String& url, int timeoutMs = 10000);
+
+    // One muxed FLV tag as an RTMP message (zero-copy from the chunk slices). Returns false if the
+    // connection failed or the queue cannot take the whole message (nothing is sent in that case).
+    bool sendTag(const FlvChunk& tag);
+    // Same, for a shared tag: whatever has to wait (pacing, a full socket) keeps a reference to the
+    // tag's slices and only the chunk headers are copied; the chunk overload copies the remainder
+    bool sendTag(const SharedFlvTag::Ptr& tag);
+    // Complete FLV tags as a byte stream (a leading FLV file header is skipped)
     bool sendChunk(const void* data, size_t size);
+
+    // Flush queued output and handle inbound control messages, waiting up to timeoutMs for the socket
+    bool service(int timeoutMs);
+
+    bool isConnected() const;
+    size_t queuedBytes() const;
+    juce::uint64 bytesSent() const;
+    int getRttMs() const; // smoothed TCP RTT of the native socket, -1 when unknown (or rtmps://)
+    void setMaxQueuedBytes(size_t bytes);
+    // Route rtmp:// through libavformat too, as rtmps:// always is (HAVE_FFMPEG; applies from the next connect)
+    void setUseLibavformat(bool shouldUse);
+    // Token-bucket pacing of socket writes (0 disables): oversized messages such as keyframes are
+    // spread over time in slices rather than burst into the socket at once
+    void setPacingRate(double bytesPerSecond, size_t burstBytes);
     void close();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+
+    JUCE_DECLARE_NON_COPYABLE(RtmpClient)
 };
 
+// Fans one encoded/muxed stream out to several RTMP endpoints. Each endpoint owns a send thread,
+// a client and a bounded queue: a slow endpoint sheds whole GOPs, a dead one reconnects with
+// backoff, and neither ever blocks the producer or the other endpoints.
 class RtmpMultiPublisher {
 public:
-    bool connectAll(const StreamingConfig& cfg); // uses endpoints or relay
-    bool sendChunkAll(const void* data, size_t size); // fan-out
+    struct EndpointStats {
+        juce::String url;
+        bool connected { false };
+        juce::uint64 bytesSent { 0 };
+        juce::uint64 droppedTags { 0 };
+        int reconnects { 0 };
+        size_t backlogBytes { 0 };
+        int backlogMs { 0 };   // media time queued behind the socket
+        int rttMs { -1 };
+    };
+
+    RtmpMultiPublisher();
+    ~RtmpMultiPublisher();
+
+    // uses relay (if enabled), else enabled endpoints, else rtmpUrl. True once at least one connected.
+    bool connectAll(const StreamingConfig& cfg);
+    bool sendTag(const FlvChunk& tag); // fan-out of one muxed tag
+    bool sendTag(const FlvChunk& tag, const MediaBuffer::Ptr& payload); // same, sharing the payload slice
+    bool sendChunkAll(const void* data, size_t size); // fan-out of complete FLV tags
     void closeAll();
+
+    // Encoder the endpoints ask for an IDR when they start shedding a GOP (set after connectAll)
+    void setEncoderControl(EncoderControl* encoder);
+
+    int getNumEndpoints() const;
+    juce::Array<EndpointStats> getStats() const;
+
 private:
-    struct Conn { std::unique_ptr<RtmpClient> client; bool ok { false }; };
-    juce::Array<Conn> conns;
+    class Endpoint;
+    juce::OwnedArray<Endpoint> endpoints;
+
+    // Latest stream headers, replayed to an endpoint whenever it (re)connects
+    mutable std::mutex headerMutex;
+    SharedFlvTag::Ptr metadata, audioConfig, videoConfig;
+
+    bool publish(const SharedFlvTag::Ptr& tag);
+
+    JUCE_DECLARE_NON_COPYABLE(RtmpMultiPublisher)
 };
 
 } // namespace streaming
@@ -0,0 +1,355 @@
+#include "RtmpClient.h"
+#include "GopDropper.h"
+#include "Logging.h"
+#include "Telemetry.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+
+using namespace streaming;
+
+namespace {
+constexpr int kConnectTimeoutMs = 5000;
+constexpr int kInitialBackoffMs = 500;
+constexpr size_t kMinBacklogBytes = 1024 * 1024;
+// Keep the socket-side queue short so the backlog lives in the endpoint queue, where it can be shed by GOP
+constexpr size_t kClientQueueBytes = 512 * 1024;
+
+inline uint32_t tagTimestamp(const uint8_t* tag) noexcept {
+    return ((uint32_t) tag[4] << 16) | ((uint32_t) tag[5] << 8) | tag[6] | ((uint32_t) tag[7] << 24);
+}
+} // namespace
+
+//==============================================================================
+SharedFlvTag::Ptr SharedFlvTag::fromChunk(const FlvChunk& chunk, const MediaBuffer::Ptr& payload) {
+    const size_t total = chunk.totalSize();
+    if (chunk.tagType == 0 || total < FlvChunk::tagHeaderSize + FlvChunk::trailerSize + 1) return nullptr;
+    Ptr t = new SharedFlvTag();
+    size_t copied = 0;
+    for (int i = 0; i < chunk.numSlices; ++i)
+        if (payload == nullptr || !payload->contains(chunk.slices[i].data, chunk.slices[i].size)) copied += chunk.slices[i].size;
+    t->bytes.malloc(juce::jmax<size_t>(1, copied));
+    uint8_t* out = t->bytes.getData();
+    for (int i = 0; i < chunk.numSlices; ++i) {
+        const IoSlice& s = chunk.slices[i];
+        if (s.size == 0) continue;
+        if (payload != nullptr && payload->contains(s.data, s.size)) { t->slices[t->numSlices++] = s; continue; }
+        memcpy(out, s.data, s.size);
+        t->slices[t->numSlices++] = { out, s.size };
+        out += s.size;
+    }
+    if (copied < total) t->payload = payload;
+    MediaBuffer::noteCopied(copied);
+    t->size = total;
+    t->tagType = chunk.tagType;
+    t->timestampMs = chunk.timestampMs;
+    t->keyframe = chunk.keyframe;
+    // Second body byte is the AAC/AVC packet type; 0 marks a sequence header
+    t->isConfig = t->tagType == 18 || ((t->tagType == 8 || t->tagType == 9) && t->size > FlvChunk::tagHeaderSize + FlvChunk::trailerSize + 1
+                                       && t->byteAt(FlvChunk::tagHeaderSize + 1) == 0);
+    return t;
+}
+
+uint8_t SharedFlvTag::byteAt(size_t offset) const noexcept {
+    for (int i = 0; i < numSlices; ++i) {
+        if (offset < slices[i].size) return static_cast<const uint8_t*>(slices[i].data)[offset];
+        offset -= slices[i].size;
+    }
+    return 0;
+}
+
+SharedFlvTag::Ptr SharedFlvTag::fromBytes(const uint8_t* tag, size_t tagSize) {
+    FlvChunk chunk;
+    chunk.slices[0] = { tag, tagSize };
+    chunk.numSlices = 1;
+    chunk.tagType = tag[0];
+    chunk.timestampMs = tagTimestamp(tag);
+    chunk.keyframe = tag[0] == 9 && tagSize > FlvChunk::tagHeaderSize && (tag[FlvChunk::tagHeaderSize] >> 4) == 1;
+    return fromChunk(chunk);
+}
+
+FlvChunk SharedFlvTag::asChunk() const noexcept {
+    FlvChunk c;
+    for (int i = 0; i < numSlices; ++i) c.slices[i] = slices[i];
+    c.numSlices = numSlices;
+    c.tagType = tagType;
+    c.timestampMs = timestampMs;
+    c.keyframe = keyframe;
+    return c;
+}
+
+//==============================================================================
+class RtmpMultiPublisher::Endpoint : public juce::Thread {
+public:
+    Endpoint(RtmpMultiPublisher& o, const juce::String& u, const StreamingConfig& cfg)
+        : juce::Thread("RTMP Endpoint"), owner(o), url(u) {
+        maxBacklogMs = (uint32_t) juce::jmax(250, cfg.endpointMaxBacklogMs);
+        maxBackoffMs = juce::jmax(kInitialBackoffMs, cfg.endpointReconnectMaxDelayMs);
+        // Twice the nominal byte budget of the backlog window, so bitrate spikes don't trip it
+        const double bytesPerMs = (double) (cfg.videoBitrateKbps + cfg.audioBitrateKbps) / 8.0;
+        maxBacklogBytes = juce::jmax(kMinBacklogBytes, (size_t) (bytesPerMs * maxBacklogMs * 2.0));
+        client.setMaxQueuedBytes(kClientQueueBytes);
+        // Pace at 1.5x the nominal rate so a backlog can still drain; keyframes are spread over ~100 ms slices
+        const double pacedBytesPerSec = bytesPerMs * 1000.0 * 1.5;
+        client.setPacingRate(pacedBytesPerSec, (size_t) (pacedBytesPerSec / 10.0));
+    }
+
+    ~Endpoint() override { stop(); }
+
+    void stop() {
+        signalThreadShouldExit();
+        cv.notify_all();
+        notify();
+        stopThread(kConnectTimeoutMs + 2000);
+    }
+
+    // Producer side: never blocks on the network, only on this endpoint's queue lock
+    void enqueue(const SharedFlvTag::Ptr& tag) {
+        std::lock_guard<std::mutex> lk(queueMutex);
+        // Offline: headers are replayed from the owner's cache on reconnect, media is stale anyway
+        if (!online.load()) { ++dropped; return; }
+        const bool over = queuedBytes + tag->size > maxBacklogBytes || backlogSpanMs(tag->timestampMs) > maxBacklogMs;
+        if (tag->tagType == 9 && !tag->isConfig) {
+            // A new GOP starts: if we're behind, everything queued before it is worthless
+            if (tag->keyframe && (queueGop.isDropping() || over)) purgeQueuedVideo();
+            if (!queueGop.admit(tag->keyframe, over)) { ++dropped; return; }
+        } else if (tag->tagType == 8 && !tag->isConfig && queuedBytes + tag->size > maxBacklogBytes * 2) {
+            ++dropped; // audio only goes once the endpoint is hopelessly behind
+            return;
+        }
+        queue.push_back(tag);
+        queuedBytes += tag->size;
+        cv.notify_one();
+    }
+
+    EndpointStats getStats() const {
+        EndpointStats s;
+        s.url = url;
+        s.connected = online.load();
+        s.bytesSent = client.bytesSent();
+        s.rttMs = client.getRttMs();
+        s.reconnects = reconnects.load();
+        std::lock_guard<std::mutex> lk(queueMutex);
+        s.droppedTags = dropped;
+        s.backlogBytes = queuedBytes;
+        if (!queue.empty()) s.backlogMs = (int) backlogSpanMs(queue.back()->timestampMs);
+        return s;
+    }
+
+    // 0 while the first attempt is in flight, 1 connected, -1 failed
+    std::atomic<int> firstAttempt { 0 };
+
+    void setEncoderControl(EncoderControl* e) { queueGop.setEncoderControl(e); sendGop.setEncoderControl(e); }
+
+    void run() override {
+        int backoffMs = kInitialBackoffMs;
+        while (!threadShouldExit()) {
+            if (!client.isConnected()) {
+                if (online.exchange(false)) {
+                    LogMessage("RTMP[" + host() + "]: disconnected, reconnecting");
+                    clearQueue();
+                }
+                if (firstAttempt.load() != 0) {
+                    wait(backoffMs);
+                    if (threadShouldExit()) break;
+                    reconnects.fetch_add(1);
+                    reconnectsMetric.add();
+                }
+                const bool ok = client.connect(url, kConnectTimeoutMs);
+                if (!ok) {
+                    if (firstAttempt.load() == 0) firstAttempt.store(-1);
+                    backoffMs = juce::jmin(backoffMs * 2, maxBackoffMs);
+                    continue;
+                }
+                backoffMs = kInitialBackoffMs;
+                sendGop.requireKeyframe(); // also asks the encoder for an IDR now that someone is listening
+                // Online before the header snapshot: a header published in between is then queued as well
+                // (sent twice, which is harmless) rather than dropped by enqueue()
+                {
+                    std::lock_guard<std::mutex> lk(queueMutex);
+                    online.store(true);
+                }
+                replayHeaders();
+                // Only now: connectAll() returns on this, and the headers sent right after must be enqueued
+                if (firstAttempt.load() == 0) firstAttempt.store(1);
+                continue;
+            }
+
+            SharedFlvTag::Ptr tag;
+            {
+                std::unique_lock<std::mutex> lk(queueMutex);
+                cv.wait_for(lk, std::chrono::milliseconds(20), [this] { return !queue.empty() || threadShouldExit(); });
+                if (!queue.empty()) {
+                    tag = std::move(queue.front());
+                    queue.pop_front();
+                    queuedBytes -= tag->size;
+                }
+                droppedTagsMetric.add(dropped - droppedReported);
+                droppedReported = dropped;
+            }
+            if (tag == nullptr) { client.service(0); continue; }
+            // After a (re)connect the decoder needs an IDR before any inter frame
+            if (tag->tagType == 9 && !tag->isConfig && !sendGop.admit(tag->keyframe, false)) { countDropped(); continue; }
+            while (!client.sendTag(tag)) {
+                if (!client.isConnected() || threadShouldExit()) break;
+                client.service(50); // socket queue full: wait for the kernel to take some
+            }
+            client.service(0);
+            const juce::uint64 sent = client.bytesSent();
+            bytesSentMetric.add(sent >= sentReported ? sent - sentReported : sent); // the client's count restarts with each connection
+            sentReported = sent;
+        }
+        online.store(false);
+        client.close();
+    }
+
+private:
+    RtmpMultiPublisher& owner;
+    const juce::String url;
+    RtmpClient client;
+
+    mutable std::mutex queueMutex;
+    std::condition_variable cv;
+    std::deque<SharedFlvTag::Ptr> queue;
+    size_t queuedBytes { 0 };
+    GopDropper queueGop; // producer side, under queueMutex
+    GopDropper sendGop;  // send thread: restarts video at a keyframe after each (re)connect
+    juce::uint64 dropped { 0 };
+
+    // Telemetry, summed over every endpoint; the send thread reports what the counters above gained
+    Telemetry::Counter& bytesSentMetric = Telemetry::getInstance().counter("rtmp.bytesSent");
+    Telemetry::Counter& droppedTagsMetric = Telemetry::getInstance().counter("rtmp.droppedTags");
+    Telemetry::Counter& reconnectsMetric = Telemetry::getInstance().counter("rtmp.reconnects");
+    juce::uint64 droppedReported { 0 }, sentReported { 0 };
+
+    std::atomic<bool> online { false };
+    std::atomic<int> reconnects { 0 };
+    size_t maxBacklogBytes { kMinBacklogBytes };
+    uint32_t maxBacklogMs { 2000 };
+    int maxBackoffMs { 30000 };
+
+    juce::String host() const { return url.fromFirstOccurrenceOf("://", false, false).upToFirstOccurrenceOf("/", false, false); }
+
+    uint32_t backlogSpanMs(uint32_t newestMs) const {
+        for (const auto& t : queue)
+            if (!t->isConfig) return newestMs > t->timestampMs ? newestMs - t->timestampMs : 0;
+        return 0;
+    }
+
+    void purgeQueuedVideo() {
+        auto it = std::remove_if(queue.begin(), queue.end(), [this](const SharedFlvTag::Ptr& t) {
+            if (t->tagType != 9 || t->isConfig) return false;
+            queuedBytes -= t->size; ++dropped; return true;
+        });
+        queue.erase(it, queue.end());
+    }
+
+    void clearQueue() {
+        std::lock_guard<std::mutex> lk(queueMutex);
+        dropped += queue.size();
+        queue.clear();
+        queuedBytes = 0;
+    }
+
+    void countDropped() { std::lock_guard<std::mutex> lk(queueMutex); ++dropped; }
+
+    void replayHeaders() {
+        SharedFlvTag::Ptr headers[3];
+        {
+            std::lock_guard<std::mutex> lk(owner.headerMutex);
+            headers[0] = owner.metadata; headers[1] = owner.videoConfig; headers[2] = owner.audioConfig;
+        }
+        for (auto& h : headers)
+            if (h != nullptr) client.sendTag(h);
+    }
+};
+
+//==============================================================================
+RtmpMultiPublisher::RtmpMultiPublisher() = default;
+RtmpMultiPublisher::~RtmpMultiPublisher() { closeAll(); }
+
+bool RtmpMultiPublisher::connectAll(const StreamingConfig& cfg) {
+    closeAll();
+    juce::StringArray urls;
+    if (cfg.useLocalRelay && cfg.relayUrl.isNotEmpty()) urls.add(cfg.relayUrl);
+    else {
+        for (const auto& ep : cfg.endpoints)
+            if (ep.enabled && ep.url.trim().isNotEmpty()) urls.addIfNotAlreadyThere(ep.url.trim());
+        if (urls.isEmpty() && cfg.rtmpUrl.isNotEmpty()) urls.add(cfg.rtmpUrl);
+    }
+    if (urls.isEmpty()) { LogMessage("RTMP: no endpoints configured"); return false; }
+
+    for (const auto& u : urls) {
+        auto* ep = endpoints.add(new Endpoint(*this, u, cfg));
+        ep->startThread();
+    }
+    // Connect in parallel; wait until every endpoint has had its first go
+    const auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32) kConnectTimeoutMs + 1000;
+    int connected = 0;
+    for (;;) {
+        int pending = 0; connected = 0;
+        for (auto* ep : endpoints) {
+            const int s = ep->firstAttempt.load();
+            if (s == 0) ++pending; else if (s > 0) ++connected;
+        }
+        if (pending == 0 || juce::Time::getMillisecondCounter() > deadline) break;
+        juce::Thread::sleep(10);
+    }
+    LogMessage("RTMP: " + juce::String(connected) + "/" + juce::String(endpoints.size()) + " endpoints connected");
+    if (connected == 0) { closeAll(); return false; }
+    return true;
+}
+
+bool RtmpMultiPublisher::publish(const SharedFlvTag::Ptr& tag) {
+    if (tag == nullptr || endpoints.isEmpty()) return false;
+    if (tag->isConfig) {
+        std::lock_guard<std::mutex> lk(headerMutex);
+        if (tag->tagType == 18) metadata = tag;
+        else if (tag->tagType == 9) videoConfig = tag;
+        else audioConfig = tag;
+    }
+    for (auto* ep : endpoints) ep->enqueue(tag);
+    return true;
+}
+
+bool RtmpMultiPublisher::sendTag(const FlvChunk& tag) {
+    return sendTag(tag, nullptr);
+}
+
+bool RtmpMultiPublisher::sendTag(const FlvChunk& tag, const MediaBuffer::Ptr& payload) {
+    if (tag.tagType == 0) return !endpoints.isEmpty(); // FLV file header: not part of an RTMP stream
+    return publish(SharedFlvTag::fromChunk(tag, payload));
+}
+
+bool RtmpMultiPublisher::sendChunkAll(const void* data, size_t size) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    size_t pos = 0;
+    if (size >= 13 && p[0] == 'F' && p[1] == 'L' && p[2] == 'V') pos = 13;
+    while (pos + FlvChunk::tagHeaderSize + FlvChunk::trailerSize <= size) {
+        const size_t dataSize = ((size_t) p[pos + 1] << 16) | ((size_t) p[pos + 2] << 8) | p[pos + 3];
+        const size_t tagSize = FlvChunk::tagHeaderSize + dataSize + FlvChunk::trailerSize;
+        if (pos + tagSize > size) break;
+        if (!publish(SharedFlvTag::fromBytes(p + pos, tagSize))) return false;
+        pos += tagSize;
+    }
+    return pos == size;
+}
+
+void RtmpMultiPublisher::closeAll() {
+    for (auto* ep : endpoints) ep->signalThreadShouldExit();
+    endpoints.clear(); // each Endpoint joins its thread on destruction
+    std::lock_guard<std::mutex> lk(headerMutex);
+    metadata = nullptr; audioConfig = nullptr; videoConfig = nullptr;
+}
+
+void RtmpMultiPublisher::setEncoderControl(EncoderControl* encoder) {
+    for (auto* ep : endpoints) ep->setEncoderControl(encoder);
+}
+
+int RtmpMultiPublisher::getNumEndpoints() const { return endpoints.size(); }
+
+juce::Array<RtmpMultiPublisher::EndpointStats> RtmpMultiPublisher::getStats() const {
+    juce::Array<EndpointStats> out;
+    for (auto* ep : endpoints) out.add(ep->getStats());
+    return out;
+}
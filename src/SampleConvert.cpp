@@ -0,0 +1,176 @@
+#define SAMPLECONVERT_BUILD_SSE2 1
+#include "SampleConvertKernels.h"
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+namespace SampleConvert {
+
+Dither::Dither(uint32_t seed) {
+    // splitmix32 so that neighbouring seeds still give unrelated, non-zero lanes
+    for (auto& s : state) {
+        uint32_t z = (seed += 0x9E3779B9u);
+        z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+        z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+        z ^= z >> 16;
+        s = z != 0 ? z : 0x6D2B79F5u;
+    }
+}
+
+namespace detail {
+
+const KernelTable& scalarKernels() { static const KernelTable t = Kernels<ScalarIsa>::table(Isa::scalar); return t; }
+#if SAMPLECONVERT_X86
+const KernelTable& sse2Kernels() { static const KernelTable t = Kernels<Sse2Isa>::table(Isa::sse2); return t; }
+#endif
+#if SAMPLECONVERT_NEON
+const KernelTable& neonKernels() { static const KernelTable t = Kernels<NeonIsa>::table(Isa::neon); return t; }
+#endif
+
+} // namespace detail
+
+namespace {
+
+using detail::KernelTable;
+
+constexpr Quant kInt24 { 8388607.0f, -8388608.0f, 8388607.0f, 0 };
+// 2147483520 is the largest float below 2^31
+constexpr Quant kInt32 { 2147483648.0f, -2147483648.0f, 2147483520.0f, 0 };
+constexpr int kChunkSamples = 2048;
+
+bool isSupported(Isa isa) {
+    switch (isa) {
+        case Isa::scalar: return true;
+#if SAMPLECONVERT_X86
+        case Isa::sse2: return true;
+        case Isa::avx2: return juce::SystemStats::hasAVX2();
+#endif
+#if SAMPLECONVERT_NEON
+        case Isa::neon: return true;
+#endif
+        default: return false;
+    }
+}
+
+const KernelTable* tableFor(Isa isa) {
+    switch (isa) {
+#if SAMPLECONVERT_X86
+        case Isa::sse2: return &detail::sse2Kernels();
+        case Isa::avx2: return &detail::avx2Kernels();
+#endif
+#if SAMPLECONVERT_NEON
+        case Isa::neon: return &detail::neonKernels();
+#endif
+        default: return &detail::scalarKernels();
+    }
+}
+
+std::atomic<const KernelTable*> active { nullptr };
+
+const KernelTable& kernels() {
+    if (auto* t = active.load(std::memory_order_acquire)) return *t;
+#if SAMPLECONVERT_X86
+    const KernelTable* best = tableFor(isSupported(Isa::avx2) ? Isa::avx2 : Isa::sse2);
+#elif SAMPLECONVERT_NEON
+    const KernelTable* best = tableFor(Isa::neon);
+#else
+    const KernelTable* best = tableFor(Isa::scalar);
+#endif
+    // Racing first callers all pick the same table, so a plain store is enough
+    active.store(best, std::memory_order_release);
+    return *best;
+}
+
+// Any channel count, one frame at a time; only used for >2 channels
+template <bool D, class T>
+void genericToInt(const float* const* src, int numChannels, int numFrames, T* dst, const Quant& q, Dither* d) {
+    Rng<ScalarIsa, D> rng(d);
+    for (int i = 0; i < numFrames; ++i)
+        for (int ch = 0; ch < numChannels; ++ch)
+            *dst++ = (T) quantiseOne<D>(src[ch][i], q, rng);
+    rng.save();
+}
+
+void toInt32Quant(const float* const* src, int numChannels, int numFrames, int32_t* dst, const Quant& q, Dither* d) {
+    const auto& k = kernels();
+    const int di = d != nullptr ? 1 : 0;
+    if (numChannels == 1) k.monoToInt32[di](src[0], dst, numFrames, q, d);
+    else if (numChannels == 2) k.stereoToInt32[di](src[0], src[1], dst, numFrames, q, d);
+    else if (d != nullptr) genericToInt<true>(src, numChannels, numFrames, dst, q, d);
+    else genericToInt<false>(src, numChannels, numFrames, dst, q, d);
+}
+
+} // namespace
+
+Isa getIsa() { return kernels().isa; }
+
+const char* getIsaName(Isa isa) {
+    switch (isa) {
+        case Isa::sse2: return "SSE2";
+        case Isa::avx2: return "AVX2";
+        case Isa::neon: return "NEON";
+        default: return "scalar";
+    }
+}
+
+bool setIsa(Isa isa) {
+    if (! isSupported(isa)) return false;
+    active.store(tableFor(isa), std::memory_order_release);
+    return true;
+}
+
+void interleave(const float* const* src, int numChannels, int numFrames, float* dst) {
+    if (numChannels == 1) { std::memcpy(dst, src[0], sizeof(float) * (size_t) numFrames); return; }
+    if (numChannels == 2) { kernels().interleave2(src[0], src[1], dst, numFrames); return; }
+    for (int i = 0; i < numFrames; ++i)
+        for (int ch = 0; ch < numChannels; ++ch) *dst++ = src[ch][i];
+}
+
+void deinterleave(const float* src, int numChannels, int numFrames, float* const* dst) {
+    if (numChannels == 1) { std::memcpy(dst[0], src, sizeof(float) * (size_t) numFrames); return; }
+    if (numChannels == 2) { kernels().deinterleave2(src, dst[0], dst[1], numFrames); return; }
+    for (int i = 0; i < numFrames; ++i)
+        for (int ch = 0; ch < numChannels; ++ch) dst[ch][i] = *src++;
+}
+
+void toInt16(const float* const* src, int numChannels, int numFrames, int16_t* dst, Dither* dither) {
+    const auto& k = kernels();
+    const int di = dither != nullptr ? 1 : 0;
+    if (numChannels == 1) k.monoToInt16[di](src[0], dst, numFrames, dither);
+    else if (numChannels == 2) k.stereoToInt16[di](src[0], src[1], dst, numFrames, dither);
+    else if (dither != nullptr) genericToInt<true>(src, numChannels, numFrames, dst, detail::kInt16, dither);
+    else genericToInt<false>(src, numChannels, numFrames, dst, detail::kInt16, dither);
+}
+
+void toInt24(const float* const* src, int numChannels, int numFrames, uint8_t* dst, Dither* dither) {
+    // Quantise to int32 in stack-sized chunks, then pack the low three bytes
+    int32_t tmp[kChunkSamples];
+    const float* planes[64];
+    numChannels = juce::jmin(numChannels, 64);
+    const int chunkFrames = kChunkSamples / numChannels;
+    for (int done = 0; done < numFrames; ) {
+        const int n = juce::jmin(chunkFrames, numFrames - done);
+        for (int ch = 0; ch < numChannels; ++ch) planes[ch] = src[ch] + done;
+        toInt32Quant(planes, numChannels, n, tmp, kInt24, dither);
+        for (int i = 0; i < n * numChannels; ++i) {
+            const auto v = (uint32_t) tmp[i];
+            *dst++ = (uint8_t) v;
+            *dst++ = (uint8_t) (v >> 8);
+            *dst++ = (uint8_t) (v >> 16);
+        }
+        done += n;
+    }
+}
+
+void toInt32(const float* const* src, int numChannels, int numFrames, int32_t* dst, Dither* dither) {
+    toInt32Quant(src, numChannels, numFrames, dst, kInt32, dither);
+}
+
+void toFixedPoint(const float* src, int numSamples, int32_t* dst, int bits, Dither* dither) {
+    bits = juce::jlimit(8, 32, bits);
+    if (bits == 32) { toInt32Quant(&src, 1, numSamples, dst, kInt32, dither); return; }
+    const float full = (float) (1u << (bits - 1));
+    const Quant q { full - 1.0f, -full, full - 1.0f, 32 - bits };
+    toInt32Quant(&src, 1, numSamples, dst, q, dither);
+}
+
+} // namespace SampleConvert
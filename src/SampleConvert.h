@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+
+// Sample-format conversion and (de)interleaving shared by every audio sink. Kernels are picked once at
+// runtime (AVX2 / SSE2 on x86, NEON on arm64, scalar elsewhere); mono and stereo have dedicated
+// paths, other channel counts fall back to a scalar loop. All functions are realtime-safe: no
+// allocation, no locks. Float input is nominally [-1, 1]; integer output saturates to the type range.
+namespace SampleConvert {
+
+// TPDF dither (+-1 LSB at the target depth) from per-lane xorshift generators. Not thread-safe:
+// one instance per writer thread.
+struct Dither {
+    explicit Dither(uint32_t seed = 0x9E3779B9u);
+    alignas(32) uint32_t state[16];
+};
+
+enum class Isa { scalar, sse2, avx2, neon };
+Isa getIsa();
+const char* getIsaName(Isa isa);
+// Benchmarks only: force a kernel set. Returns false (and changes nothing) if the CPU lacks it.
+bool setIsa(Isa isa);
+
+// Planar <-> interleaved float, numFrames frames of numChannels samples
+void interleave(const float* const* src, int numChannels, int numFrames, float* dst);
+void deinterleave(const float* src, int numChannels, int numFrames, float* const* dst);
+
+// Planar float -> interleaved integer PCM. toInt24 writes packed little-endian 3-byte samples.
+void toInt16(const float* const* src, int numChannels, int numFrames, int16_t* dst, Dither* dither = nullptr);
+void toInt24(const float* const* src, int numChannels, int numFrames, uint8_t* dst, Dither* dither = nullptr);
+void toInt32(const float* const* src, int numChannels, int numFrames, int32_t* dst, Dither* dither = nullptr);
+
+// One channel quantised to `bits` (8..32) and left-justified in int32, as JUCE's integer
+// AudioFormatWriter::write() expects
+void toFixedPoint(const float* src, int numSamples, int32_t* dst, int bits, Dither* dither = nullptr);
+
+} // namespace SampleConvert
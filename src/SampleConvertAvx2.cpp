@@ -0,0 +1,35 @@
+// AVX2 kernels. Only this unit is compiled for AVX2 (MSVC needs no flag for the intrinsics); the
+// dispatcher in SampleConvert.cpp calls into it only after SystemStats::hasAVX2().
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+
+// System headers first, so none of their inline functions are built for AVX2
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#include "SampleConvert.h"
+
+#if defined(__clang__)
+ #pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+ #pragma GCC push_options
+ #pragma GCC target("avx2")
+#endif
+
+#define SAMPLECONVERT_BUILD_AVX2 1
+#include "SampleConvertKernels.h"
+
+namespace SampleConvert {
+namespace detail {
+
+const KernelTable& avx2Kernels() { static const KernelTable t = Kernels<Avx2Isa>::table(Isa::avx2); return t; }
+
+} // namespace detail
+} // namespace SampleConvert
+
+#if defined(__clang__)
+ #pragma clang attribute pop
+#elif defined(__GNUC__)
+ #pragma GCC pop_options
+#endif
+
+#endif
@@ -0,0 +1,334 @@
+#pragma once
+// Internal to SampleConvert*.cpp. The kernels are written once against a small per-ISA traits type
+// and instantiated in each translation unit with that unit's instruction set (SampleConvertAvx2.cpp
+// is compiled for AVX2). Everything is in an anonymous namespace so no instantiation built for one
+// ISA can be merged into another unit by the linker.
+#include "SampleConvert.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+ #define SAMPLECONVERT_X86 1
+ #include <immintrin.h>
+#else
+ #define SAMPLECONVERT_X86 0
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+ #define SAMPLECONVERT_NEON 1
+ #include <arm_neon.h>
+#else
+ #define SAMPLECONVERT_NEON 0
+#endif
+
+namespace SampleConvert {
+namespace detail {
+
+// Scale, then clamp to [lo, hi] and round to nearest (even); `shift` left-justifies the result
+struct Quant { float scale, lo, hi; int shift; };
+
+struct KernelTable {
+    Isa isa;
+    void (*interleave2)(const float* l, const float* r, float* dst, int n);
+    void (*deinterleave2)(const float* src, float* l, float* r, int n);
+    // [0] without dither, [1] with
+    void (*monoToInt32[2])(const float* src, int32_t* dst, int n, const Quant& q, Dither* d);
+    void (*stereoToInt32[2])(const float* l, const float* r, int32_t* dst, int n, const Quant& q, Dither* d);
+    void (*monoToInt16[2])(const float* src, int16_t* dst, int n, Dither* d);
+    void (*stereoToInt16[2])(const float* l, const float* r, int16_t* dst, int n, Dither* d);
+};
+
+const KernelTable& scalarKernels();
+#if SAMPLECONVERT_X86
+const KernelTable& sse2Kernels();
+const KernelTable& avx2Kernels();
+#endif
+#if SAMPLECONVERT_NEON
+const KernelTable& neonKernels();
+#endif
+
+constexpr Quant kInt16 { 32767.0f, -32768.0f, 32767.0f, 0 };
+
+} // namespace detail
+} // namespace SampleConvert
+
+namespace {
+
+using SampleConvert::Dither;
+using SampleConvert::detail::Quant;
+
+struct ScalarIsa {
+    using F = float;
+    using I = int32_t;
+    static constexpr int W = 1;
+    static F load(const float* p) { return *p; }
+    static void store(float* p, F v) { *p = v; }
+    static F set1(float v) { return v; }
+    static F add(F a, F b) { return a + b; }
+    static F sub(F a, F b) { return a - b; }
+    static F mul(F a, F b) { return a * b; }
+    static F clamp(F x, F lo, F hi) { return x < lo ? lo : (x > hi ? hi : x); }
+    static I cvt(F x) { return (I) std::lrintf(x); }
+    static I shl(I x, int n) { return (I) ((uint32_t) x << n); }
+    static void storeI(int32_t* p, I v) { *p = v; }
+    static I loadU(const uint32_t* p) { return (I) *p; }
+    static void storeU(uint32_t* p, I v) { *p = (uint32_t) v; }
+    static I bxor(I a, I b) { return a ^ b; }
+    template <int N> static I sll(I x) { return (I) ((uint32_t) x << N); }
+    template <int N> static I srl(I x) { return (I) ((uint32_t) x >> N); }
+    static F uniform(I x) {
+        const uint32_t bits = ((uint32_t) x >> 9) | 0x3f800000u;
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f - 1.0f;
+    }
+    static void zip(F a, F b, F& lo, F& hi) { lo = a; hi = b; }
+    static void unzip(F x, F y, F& a, F& b) { a = x; b = y; }
+    static void storePacked16(int16_t* p, I a, I b) { p[0] = (int16_t) a; p[1] = (int16_t) b; }
+};
+
+#if SAMPLECONVERT_X86 && defined(SAMPLECONVERT_BUILD_SSE2)
+struct Sse2Isa {
+    using F = __m128;
+    using I = __m128i;
+    static constexpr int W = 4;
+    static F load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, F v) { _mm_storeu_ps(p, v); }
+    static F set1(float v) { return _mm_set1_ps(v); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F clamp(F x, F lo, F hi) { return _mm_min_ps(_mm_max_ps(x, lo), hi); }
+    static I cvt(F x) { return _mm_cvtps_epi32(x); }
+    static I shl(I x, int n) { return _mm_sll_epi32(x, _mm_cvtsi32_si128(n)); }
+    static void storeI(int32_t* p, I v) { _mm_storeu_si128((__m128i*) p, v); }
+    static I loadU(const uint32_t* p) { return _mm_loadu_si128((const __m128i*) p); }
+    static void storeU(uint32_t* p, I v) { _mm_storeu_si128((__m128i*) p, v); }
+    static I bxor(I a, I b) { return _mm_xor_si128(a, b); }
+    template <int N> static I sll(I x) { return _mm_slli_epi32(x, N); }
+    template <int N> static I srl(I x) { return _mm_srli_epi32(x, N); }
+    static F uniform(I x) { return _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x3f800000))), _mm_set1_ps(1.0f)); }
+    static void zip(F a, F b, F& lo, F& hi) { lo = _mm_unpacklo_ps(a, b); hi = _mm_unpackhi_ps(a, b); }
+    static void unzip(F x, F y, F& a, F& b) { a = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0)); b = _mm_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1)); }
+    static void storePacked16(int16_t* p, I a, I b) { _mm_storeu_si128((__m128i*) p, _mm_packs_epi32(a, b)); }
+};
+#endif
+
+#if SAMPLECONVERT_X86 && defined(SAMPLECONVERT_BUILD_AVX2)
+struct Avx2Isa {
+    using F = __m256;
+    using I = __m256i;
+    static constexpr int W = 8;
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+    static F set1(float v) { return _mm256_set1_ps(v); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F clamp(F x, F lo, F hi) { return _mm256_min_ps(_mm256_max_ps(x, lo), hi); }
+    static I cvt(F x) { return _mm256_cvtps_epi32(x); }
+    static I shl(I x, int n) { return _mm256_sll_epi32(x, _mm_cvtsi32_si128(n)); }
+    static void storeI(int32_t* p, I v) { _mm256_storeu_si256((__m256i*) p, v); }
+    static I loadU(const uint32_t* p) { return _mm256_loadu_si256((const __m256i*) p); }
+    static void storeU(uint32_t* p, I v) { _mm256_storeu_si256((__m256i*) p, v); }
+    static I bxor(I a, I b) { return _mm256_xor_si256(a, b); }
+    template <int N> static I sll(I x) { return _mm256_slli_epi32(x, N); }
+    template <int N> static I srl(I x) { return _mm256_srli_epi32(x, N); }
+    static F uniform(I x) { return _mm256_sub_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(x, 9), _mm256_set1_epi32(0x3f800000))), _mm256_set1_ps(1.0f)); }
+    // unpack works within 128-bit lanes; the permutes restore frame order across them
+    static void zip(F a, F b, F& lo, F& hi) {
+        const F t0 = _mm256_unpacklo_ps(a, b), t1 = _mm256_unpackhi_ps(a, b);
+        lo = _mm256_permute2f128_ps(t0, t1, 0x20);
+        hi = _mm256_permute2f128_ps(t0, t1, 0x31);
+    }
+    static void unzip(F x, F y, F& a, F& b) {
+        a = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0))), 0xD8));
+        b = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1))), 0xD8));
+    }
+    static void storePacked16(int16_t* p, I a, I b) { _mm256_storeu_si256((__m256i*) p, _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8)); }
+};
+#endif
+
+#if SAMPLECONVERT_NEON
+struct NeonIsa {
+    using F = float32x4_t;
+    using I = int32x4_t;
+    static constexpr int W = 4;
+    static F load(const float* p) { return vld1q_f32(p); }
+    static void store(float* p, F v) { vst1q_f32(p, v); }
+    static F set1(float v) { return vdupq_n_f32(v); }
+    static F add(F a, F b) { return vaddq_f32(a, b); }
+    static F sub(F a, F b) { return vsubq_f32(a, b); }
+    static F mul(F a, F b) { return vmulq_f32(a, b); }
+    static F clamp(F x, F lo, F hi) { return vminq_f32(vmaxq_f32(x, lo), hi); }
+    static I cvt(F x) { return vcvtnq_s32_f32(x); }
+    static I shl(I x, int n) { return vshlq_s32(x, vdupq_n_s32(n)); }
+    static void storeI(int32_t* p, I v) { vst1q_s32(p, v); }
+    static I loadU(const uint32_t* p) { return vreinterpretq_s32_u32(vld1q_u32(p)); }
+    static void storeU(uint32_t* p, I v) { vst1q_u32(p, vreinterpretq_u32_s32(v)); }
+    static I bxor(I a, I b) { return veorq_s32(a, b); }
+    template <int N> static I sll(I x) { return vshlq_n_s32(x, N); }
+    template <int N> static I srl(I x) { return vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(x), N)); }
+    static F uniform(I x) { return vsubq_f32(vreinterpretq_f32_s32(vorrq_s32(srl<9>(x), vdupq_n_s32(0x3f800000))), vdupq_n_f32(1.0f)); }
+    static void zip(F a, F b, F& lo, F& hi) { lo = vzip1q_f32(a, b); hi = vzip2q_f32(a, b); }
+    static void unzip(F x, F y, F& a, F& b) { a = vuzp1q_f32(x, y); b = vuzp2q_f32(x, y); }
+    static void storePacked16(int16_t* p, I a, I b) { vst1q_s16(p, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b))); }
+};
+#endif
+
+// Lanes [0, W) of Dither::state drive one uniform stream, [8, 8 + W) the other; their difference is
+// triangular on (-1, 1) LSB
+template <class V, bool Enabled>
+struct Rng {
+    typename V::I a {}, b {};
+    Dither* d;
+    explicit Rng(Dither* dither) : d(dither) {
+        if (Enabled) { a = V::loadU(d->state); b = V::loadU(d->state + 8); }
+    }
+    static typename V::I step(typename V::I x) {
+        x = V::bxor(x, V::template sll<13>(x));
+        x = V::bxor(x, V::template srl<17>(x));
+        return V::bxor(x, V::template sll<5>(x));
+    }
+    typename V::F noise() {
+        a = step(a);
+        b = step(b);
+        return V::sub(V::uniform(a), V::uniform(b));
+    }
+    void save() {
+        if (Enabled) { V::storeU(d->state, a); V::storeU(d->state + 8, b); }
+    }
+};
+
+template <bool D>
+int32_t quantiseOne(float x, const Quant& q, Rng<ScalarIsa, D>& rng) {
+    if (D) x = x * q.scale + rng.noise();
+    else x = x * q.scale;
+    return ScalarIsa::shl(ScalarIsa::cvt(ScalarIsa::clamp(x, q.lo, q.hi)), q.shift);
+}
+
+template <class V>
+struct Kernels {
+    using F = typename V::F;
+
+    template <bool D>
+    static F prep(F x, F scale, F lo, F hi, Rng<V, D>& rng) {
+        x = V::mul(x, scale);
+        if (D) x = V::add(x, rng.noise());
+        return V::clamp(x, lo, hi);
+    }
+
+    static void interleave2(const float* l, const float* r, float* dst, int n) {
+        int i = 0;
+        for (; i + V::W <= n; i += V::W) {
+            F lo, hi;
+            V::zip(V::load(l + i), V::load(r + i), lo, hi);
+            V::store(dst + 2 * i, lo);
+            V::store(dst + 2 * i + V::W, hi);
+        }
+        for (; i < n; ++i) { dst[2 * i] = l[i]; dst[2 * i + 1] = r[i]; }
+    }
+
+    static void deinterleave2(const float* src, float* l, float* r, int n) {
+        int i = 0;
+        for (; i + V::W <= n; i += V::W) {
+            F a, b;
+            V::unzip(V::load(src + 2 * i), V::load(src + 2 * i + V::W), a, b);
+            V::store(l + i, a);
+            V::store(r + i, b);
+        }
+        for (; i < n; ++i) { l[i] = src[2 * i]; r[i] = src[2 * i + 1]; }
+    }
+
+    template <bool D>
+    static void monoToInt32(const float* src, int32_t* dst, int n, const Quant& q, Dither* d) {
+        int i = 0;
+        {
+            Rng<V, D> rng(d);
+            const F scale = V::set1(q.scale), lo = V::set1(q.lo), hi = V::set1(q.hi);
+            for (; i + V::W <= n; i += V::W)
+                V::storeI(dst + i, V::shl(V::cvt(prep<D>(V::load(src + i), scale, lo, hi, rng)), q.shift));
+            rng.save();
+        }
+        Rng<ScalarIsa, D> tail(d);
+        for (; i < n; ++i) dst[i] = quantiseOne<D>(src[i], q, tail);
+        tail.save();
+    }
+
+    template <bool D>
+    static void stereoToInt32(const float* l, const float* r, int32_t* dst, int n, const Quant& q, Dither* d) {
+        int i = 0;
+        {
+            Rng<V, D> rng(d);
+            const F scale = V::set1(q.scale), lo = V::set1(q.lo), hi = V::set1(q.hi);
+            for (; i + V::W <= n; i += V::W) {
+                const F fl = prep<D>(V::load(l + i), scale, lo, hi, rng);
+                const F fr = prep<D>(V::load(r + i), scale, lo, hi, rng);
+                F zlo, zhi;
+                V::zip(fl, fr, zlo, zhi);
+                V::storeI(dst + 2 * i, V::shl(V::cvt(zlo), q.shift));
+                V::storeI(dst + 2 * i + V::W, V::shl(V::cvt(zhi), q.shift));
+            }
+            rng.save();
+        }
+        Rng<ScalarIsa, D> tail(d);
+        for (; i < n; ++i) {
+            dst[2 * i] = quantiseOne<D>(l[i], q, tail);
+            dst[2 * i + 1] = quantiseOne<D>(r[i], q, tail);
+        }
+        tail.save();
+    }
+
+    template <bool D>
+    static void monoToInt16(const float* src, int16_t* dst, int n, Dither* d) {
+        constexpr Quant q = SampleConvert::detail::kInt16;
+        int i = 0;
+        {
+            Rng<V, D> rng(d);
+            const F scale = V::set1(q.scale), lo = V::set1(q.lo), hi = V::set1(q.hi);
+            for (; i + 2 * V::W <= n; i += 2 * V::W) {
+                const auto a = V::cvt(prep<D>(V::load(src + i), scale, lo, hi, rng));
+                const auto b = V::cvt(prep<D>(V::load(src + i + V::W), scale, lo, hi, rng));
+                V::storePacked16(dst + i, a, b);
+            }
+            rng.save();
+        }
+        Rng<ScalarIsa, D> tail(d);
+        for (; i < n; ++i) dst[i] = (int16_t) quantiseOne<D>(src[i], q, tail);
+        tail.save();
+    }
+
+    template <bool D>
+    static void stereoToInt16(const float* l, const float* r, int16_t* dst, int n, Dither* d) {
+        constexpr Quant q = SampleConvert::detail::kInt16;
+        int i = 0;
+        {
+            Rng<V, D> rng(d);
+            const F scale = V::set1(q.scale), lo = V::set1(q.lo), hi = V::set1(q.hi);
+            for (; i + V::W <= n; i += V::W) {
+                const F fl = prep<D>(V::load(l + i), scale, lo, hi, rng);
+                const F fr = prep<D>(V::load(r + i), scale, lo, hi, rng);
+                F zlo, zhi;
+                V::zip(fl, fr, zlo, zhi);
+                V::storePacked16(dst + 2 * i, V::cvt(zlo), V::cvt(zhi));
+            }
+            rng.save();
+        }
+        Rng<ScalarIsa, D> tail(d);
+        for (; i < n; ++i) {
+            dst[2 * i] = (int16_t) quantiseOne<D>(l[i], q, tail);
+            dst[2 * i + 1] = (int16_t) quantiseOne<D>(r[i], q, tail);
+        }
+        tail.save();
+    }
+
+    static SampleConvert::detail::KernelTable table(SampleConvert::Isa isa) {
+        return { isa, &interleave2, &deinterleave2,
+                 { &monoToInt32<false>, &monoToInt32<true> },
+                 { &stereoToInt32<false>, &stereoToInt32<true> },
+                 { &monoToInt16<false>, &monoToInt16<true> },
+                 { &stereoToInt16<false>, &stereoToInt16<true> } };
+    }
+};
+
+} // namespace
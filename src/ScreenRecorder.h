@@ -2,6 +2,10 @@
 #include <juce_core/juce_core.h>
 #include <juce_audio_basics/juce_audio_basics.h>
 #include <functional>
+#include <memory>
+
+// Declared only: this header is included from ARC Objective-C++, and AudioTap.h brings in dispatch code
+namespace streaming { class AudioTap; }
 
 class ScreenRecorder {
 public:
@@ -20,8 +24,8 @@ public:
     void stop();
     bool isRecording() const;
 
-    // Feed audio from processBlock when combined is active
-    void pushAudio(const juce::AudioBuffer<float>& buffer, int numSamples, double sampleRate, int numChannels);
+    // Tap the combined writer reads its audio from; set before startCombined
+    void setAudioSource(streaming::AudioTap* tap);
 
     // Set frame callback for live streaming (called on SCK sample handler queue)
     void setFrameCallback(std::function<void(void* cvPixelBufferRef, int64_t ptsMs)> cb);
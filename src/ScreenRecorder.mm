@@ -1,5 +1,8 @@
 #include "ScreenRecorder.h"
+#include "AudioTap.h"
 #include "Logging.h"
+#include "SampleConvert.h"
+#include "Telemetry.h"
 
 #if JUCE_MAC
  #import <AVFoundation/AVFoundation.h>
@@ -11,6 +14,12 @@
   #define HAVE_SCKIT 0
  #endif
 
+// Frames per tap read, which is also how many the drain waits for (or the timeout, whichever is first)
+constexpr int kAudioChunkFrames = 4096;
+constexpr int kAudioDrainTimeoutMs = 20;
+// Longest an offline render waits for AVAssetWriter to accept one chunk
+constexpr int kAudioReadyWaitMs = 500;
+
 @interface JUCECaptureDelegate : NSObject<AVCaptureFileOutputRecordingDelegate>
 @property (nonatomic, copy) void (^didFinish)(NSURL* outputURL, NSError* error);
 @end
@@ -86,19 +95,25 @@ struct ScreenRecorder::Impl {
     BOOL startedWriting = NO;
     CMTime baseVideoPTS { kCMTimeInvalid };
 
-    // Audio ring buffer and drain thread (int16 interleaved)
-    std::unique_ptr<juce::AbstractFifo> audioFifo;
-    juce::HeapBlock<int16_t> audioRing;
-    int audioRingCapacityFrames { 0 };
+    // Audio: this writer's cursor on the shared tap, drained and converted to int16 by its own thread
+    streaming::AudioTap* audioSource { nullptr };
+    streaming::AudioTap::Reader audioReader;
+    juce::AudioBuffer<float> audioChunk;   // one read's worth, planar float
+    juce::HeapBlock<float*> audioChunkPtrs;
     bool useMp4Container { false };
+    streaming::Telemetry::GaugeShare tapBacklogMetric { streaming::Telemetry::getInstance().gauge("screen.tapBacklogFrames") };
+    streaming::Telemetry::GaugeShare tapDroppedMetric { streaming::Telemetry::getInstance().gauge("screen.droppedSamples") };
+    streaming::Telemetry::Counter& writerDroppedMetric = streaming::Telemetry::getInstance().counter("screen.writerDroppedFrames");
 
     struct AudioDrainThread : public juce::Thread {
         Impl& owner;
         explicit AudioDrainThread(Impl& o) : juce::Thread("A+V Audio Drain"), owner(o) {}
         void run() override {
             while (! threadShouldExit()) {
+                owner.audioReader.wait(kAudioDrainTimeoutMs);
+                owner.tapBacklogMetric.set(owner.audioReader.getUnreadFrames());
                 owner.drainAudioOnce();
-                wait(2);
+                owner.tapDroppedMetric.set((juce::int64) owner.audioReader.getSkippedFrames());
             }
             owner.drainAudioOnce();
         }
@@ -117,24 +132,30 @@ struct ScreenRecorder::Impl {
 
     void stopAudioDrain() {
         if (audioDrainThread) {
+            audioDrainThread->signalThreadShouldExit();
+            audioReader.wake();
             audioDrainThread->stopThread(2000);
             audioDrainThread.reset();
         }
     }
 
     void drainAudioOnce() {
-        if (audioInput == nil || writer == nil || !startedWriting || !combined.load() || audioFifo == nullptr) return;
+        // Until the first video frame starts the session, audio waits in the tap
+        if (audioInput == nil || writer == nil || !startedWriting || !combined.load() || !audioReader.isAttached()) return;
         const int channels = combinedNumChannels;
         if (channels <= 0) return;
-        int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
-        audioFifo->prepareToRead(audioRingCapacityFrames, start1, size1, start2, size2);
-        const auto framesAvail = size1 + size2;
-        if (framesAvail == 0) { audioFifo->finishedRead(0); return; }
 
-        auto appendChunk = [&](int start, int count) {
+        auto appendChunk = [&](int count) {
             if (count <= 0) return;
             const size_t frameBytes = sizeof(int16_t) * (size_t)channels;
-            const void* basePtr = audioRing.getData() + (size_t)start * (size_t)channels;
+            const size_t bytes = (size_t)count * frameBytes;
+
+            // CoreMedia owns the samples, so the writer may hold on to them as long as it likes
+            CMBlockBufferRef blockBuf = nullptr;
+            if (CMBlockBufferCreateWithMemoryBlock(kCFAllocatorDefault, nullptr, bytes, kCFAllocatorDefault, nullptr, 0, bytes, kCMBlockBufferAssureMemoryNowFlag, &blockBuf) != kCMBlockBufferNoErr || !blockBuf) return;
+            char* dst = nullptr;
+            if (CMBlockBufferGetDataPointer(blockBuf, 0, nullptr, nullptr, &dst) != kCMBlockBufferNoErr || dst == nullptr) { CFRelease(blockBuf); return; }
+            SampleConvert::toInt16(audioChunk.getArrayOfReadPointers(), channels, count, (int16_t*)dst);
 
             CMTime audioOffset = CMTIME_IS_VALID(baseVideoPTS) ? baseVideoPTS : kCMTimeZero;
             CMTime ptsFromStart = CMTimeMake((int64_t)audioSamplesPushed, (int32_t)combinedSampleRate);
@@ -154,9 +175,6 @@ struct ScreenRecorder::Impl {
             CMAudioFormatDescriptionRef formatDesc = nullptr;
             CMAudioFormatDescriptionCreate(kCFAllocatorDefault, &asbd, 0, nullptr, 0, nullptr, nullptr, &formatDesc);
 
-            CMBlockBufferRef blockBuf = nullptr;
-            CMBlockBufferCreateWithMemoryBlock(kCFAllocatorDefault, (void*)basePtr, (size_t)count * asbd.mBytesPerFrame, kCFAllocatorNull, nullptr, 0, (size_t)count * asbd.mBytesPerFrame, 0, &blockBuf);
-
             CMSampleBufferRef sampleBuf = nullptr;
             CMSampleTimingInfo timing = { .duration = CMTimeMake(1, (int32_t)combinedSampleRate), .presentationTimeStamp = pts, .decodeTimeStamp = kCMTimeInvalid };
             CMSampleBufferCreate(kCFAllocatorDefault, blockBuf, true, nullptr, nullptr, formatDesc, (CMItemCount)count, 1, &timing, 0, nullptr, &sampleBuf);
@@ -165,16 +183,21 @@ struct ScreenRecorder::Impl {
             CFRelease(blockBuf);
 
             if (sampleBuf) {
+                // Offline the render waits on this thread through the tap, so wait for the writer rather than drop
+                for (int i = 0; i < kAudioReadyWaitMs && ![audioInput isReadyForMoreMediaData] && audioSource->isNonRealtime(); ++i)
+                    juce::Thread::sleep(1);
                 if ([audioInput isReadyForMoreMediaData]) {
                     [audioInput appendSampleBuffer:sampleBuf];
+                } else {
+                    writerDroppedMetric.add((juce::uint64) count); // the writer was not ready for it
                 }
                 CFRelease(sampleBuf);
             }
         };
 
-        appendChunk(start1, size1);
-        appendChunk(start2, size2);
-        audioFifo->finishedRead(framesAvail);
+        streaming::AudioTap::BlockInfo info;
+        while (const int count = audioReader.read(audioChunkPtrs.getData(), channels, kAudioChunkFrames, info))
+            appendChunk(count);
     }
 
     static BOOL handleSample(void* selfPtr, CMSampleBufferRef sbuf) {
@@ -309,13 +332,14 @@ struct ScreenRecorder::Impl {
         audioSamplesPushed = 0;
         baseVideoPTS = kCMTimeInvalid;
 
-        // Init audio ring if combined
+        // Attach to the audio tap if combined
         if (combined.load()) {
-            const int targetFrames = juce::jmax(32768, (int) (2.0 * sampleRate));
-            audioRingCapacityFrames = targetFrames;
-            audioFifo.reset(new juce::AbstractFifo(audioRingCapacityFrames));
-            audioRing.allocate((size_t)audioRingCapacityFrames * (size_t)combinedNumChannels, true);
-            startAudioDrain();
+            audioChunk.setSize(combinedNumChannels, kAudioChunkFrames);
+            audioChunkPtrs.allocate((size_t)combinedNumChannels, true);
+            for (int c = 0; c < combinedNumChannels; ++c) audioChunkPtrs[c] = audioChunk.getWritePointer(c);
+            audioReader.setWakeThreshold(kAudioChunkFrames);
+            if (audioSource == nullptr || !audioReader.attach(*audioSource)) { LogMessage("SCK: no audio source, recording video only"); combined.store(false); }
+            else startAudioDrain();
         }
 
         running.store(true);
@@ -460,38 +484,6 @@ struct ScreenRecorder::Impl {
        #endif
     }
 
-    void pushAudio(const juce::AudioBuffer<float>& buffer, int numSamples, double sampleRate, int numChannels) {
-    #if HAVE_SCKIT
-        juce::ignoreUnused(sampleRate, numChannels);
-        if (!combined.load() || writer == nil || audioInput == nil || audioFifo == nullptr) return;
-        if (numSamples <= 0) return;
-        const int channels = combinedNumChannels;
-        const int chAvail = juce::jmin(buffer.getNumChannels(), channels);
-        int start1 = 0, size1 = 0, start2 = 0, size2 = 0;
-        audioFifo->prepareToWrite(numSamples, start1, size1, start2, size2);
-        if (size1 + size2 < numSamples) {
-            // drop
-            return;
-        }
-        auto writeChunk = [&](int start, int count, int offsetInBuffer) {
-            if (count <= 0) return;
-            int16_t* dest = audioRing.getData() + ((size_t)start * (size_t)channels);
-            for (int i = 0; i < count; ++i) {
-                for (int c = 0; c < channels; ++c) {
-                    float f = (c < chAvail) ? buffer.getReadPointer(c)[i + offsetInBuffer] : 0.0f;
-                    f = juce::jlimit(-1.0f, 1.0f, f);
-                    dest[i * channels + c] = (int16_t) juce::roundToInt(f * 32767.0f);
-                }
-            }
-        };
-        writeChunk(start1, size1, 0);
-        writeChunk(start2, size2, size1);
-        audioFifo->finishedWrite(size1 + size2);
-    #else
-        juce::ignoreUnused(buffer, numSamples, sampleRate, numChannels);
-    #endif
-    }
-
     void stop() {
         LogMessage("stop requested");
         if (!running.load()) {
@@ -508,6 +500,8 @@ struct ScreenRecorder::Impl {
         if (audioInput != nil) [audioInput markAsFinished];
         if (writer != nil) [writer finishWritingWithCompletionHandler:^{ LogMessage("SCK: writer finished"); }];
         stopAudioDrain();
+        if (const auto lost = audioReader.getSkippedFrames(); lost > 0)
+            LogMessage("SCK: audio lost " + juce::String((juce::int64) lost) + " samples to a full tap");
         cleanupSCK();
 #endif
     }
@@ -518,7 +512,7 @@ struct ScreenRecorder::Impl {
     }
 #if HAVE_SCKIT
     void cleanupSCK() {
-        scOutput = nil; scStream = nil; videoAdaptor = nil; videoInput = nil; audioInput = nil; writer = nil; startedWriting = NO; baseVideoPTS = kCMTimeInvalid; combined.store(false); audioSamplesPushed = 0; combinedSampleRate = 0.0; combinedNumChannels = 0; audioFifo.reset(); audioRingCapacityFrames = 0; audioRing.free(); if (scQueue) { scQueue = nullptr; } if (writerQueue) { writerQueue = nullptr; }
+        scOutput = nil; scStream = nil; videoAdaptor = nil; videoInput = nil; audioInput = nil; writer = nil; startedWriting = NO; baseVideoPTS = kCMTimeInvalid; combined.store(false); audioSamplesPushed = 0; combinedSampleRate = 0.0; combinedNumChannels = 0; audioReader.detach(); audioChunk.setSize(0, 0); audioChunkPtrs.free(); if (scQueue) { scQueue = nullptr; } if (writerQueue) { writerQueue = nullptr; }
     }
 #endif
 
@@ -544,8 +538,12 @@ bool ScreenRecorder::startStreamOnly() {
     return impl->startStreamOnly();
 }
 
-void ScreenRecorder::pushAudio(const juce::AudioBuffer<float>& buffer, int numSamples, double sampleRate, int numChannels) {
-    impl->pushAudio(buffer, numSamples, sampleRate, numChannels);
+void ScreenRecorder::setAudioSource(streaming::AudioTap* tap) {
+   #if HAVE_SCKIT
+    impl->audioSource = tap;
+   #else
+    juce::ignoreUnused(tap);
+   #endif
 }
 
 void ScreenRecorder::setCaptureResolution(int width, int height) {
@@ -571,7 +569,6 @@ bool ScreenRecorder::isRecording() const {
 struct ScreenRecorder::Impl {
     bool start(const juce::File&) { return false; }
     bool startCombined(const juce::File&, double, int) { return false; }
-    void pushAudio(const juce::AudioBuffer<float>&, int, double, int) {}
     void stop() {}
     bool isRunning() const { return false; }
 };
@@ -581,7 +578,7 @@ ScreenRecorder::~ScreenRecorder() { stop(); }
 
 bool ScreenRecorder::startRecording(const juce::File&) { return false; }
 bool ScreenRecorder::startCombined(const juce::File&, double, int) { return false; }
-void ScreenRecorder::pushAudio(const juce::AudioBuffer<float>&, int, double, int) {}
+void ScreenRecorder::setAudioSource(streaming::AudioTap*) {}
 void ScreenRecorder::stop() {}
 bool ScreenRecorder::isRecording() const { return false; }
 
@@ -13,6 +13,10 @@ struct StreamingConfig {
     bool useLocalRelay { false };
     juce::String relayUrl;           // e.g. rtmp://127.0.0.1/live/stream
 
+    // Per-endpoint send backlog before that endpoint starts dropping video up to the next keyframe
+    int endpointMaxBacklogMs { 2000 };
+    int endpointReconnectMaxDelayMs { 30000 }; // reconnect backoff ceiling
+
     int videoWidth { 1920 };
     int videoHeight { 1080 };
     int fps { 30 };
@@ -20,8 +24,14 @@ struct StreamingConfig {
     int keyframeIntervalSec { 2 };   // GOP 2s
     bool constantBitrate { true };
     bool useHardwareEncoder { true };
+    // Adaptive bitrate: video follows measured egress between abrMinVideoKbps and videoBitrateKbps
+    bool adaptiveBitrate { true };
+    int abrMinVideoKbps { 1000 };
 
     int audioSampleRate { 48000 };
     int audioChannels { 2 };
     int audioBitrateKbps { 160 };    // 160 kbps
+
+    // onMetaData "encoder" string; empty leaves the key out (what libavformat's flvenc does with -bitexact)
+    juce::String flvEncoderName { "CreatorTool FlvMuxer" };
 };
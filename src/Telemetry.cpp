@@ -0,0 +1,167 @@
+#include "Telemetry.h"
+#include "Logging.h"
+
+namespace streaming {
+
+int Telemetry::Histogram::bucketFor(juce::int64 v) noexcept {
+    const auto u = (juce::uint64) juce::jlimit<juce::int64>(0, ((juce::int64) 1 << kMaxBits) - 1, v);
+    if (u < (juce::uint64) kSubBuckets) return (int) u;
+    int top = 63;
+    while (((u >> top) & 1) == 0) --top;
+    const int shift = top - kSubBits;
+    return (shift + 1) * kSubBuckets + (int) ((u >> shift) & (kSubBuckets - 1));
+}
+
+juce::int64 Telemetry::Histogram::bucketTop(int b) noexcept {
+    if (b < kSubBuckets) return b;
+    const int shift = b / kSubBuckets - 1;
+    const juce::int64 lower = (juce::int64) (kSubBuckets + b % kSubBuckets) << shift;
+    return lower + ((juce::int64) 1 << shift) - 1;
+}
+
+Telemetry& Telemetry::getInstance() {
+    // Never destroyed, as threads may still record during static destruction; the dump stops at exit
+    static Telemetry* instance = new Telemetry();
+    static struct Closer { ~Closer() { instance->stopDump(); } } closer;
+    return *instance;
+}
+
+Telemetry::Metric& Telemetry::find(const juce::String& name, Kind kind) {
+    std::lock_guard<std::mutex> lock(registerMutex);
+    const int n = numMetrics.load(std::memory_order_relaxed);
+    for (int i = 0; i < n; ++i)
+        if (metrics[i]->name == name) {
+            jassert(metrics[i]->kind == kind);
+            return *metrics[i];
+        }
+    if (n == kMaxMetrics) {
+        auto& spare = overflow[(int) kind];
+        if (spare == nullptr) {
+            LogMessage("TELEMETRY: registry full, not reporting " + name);
+            spare = std::make_unique<Metric>(name, kind);
+        }
+        return *spare;
+    }
+    metrics[n] = std::make_unique<Metric>(name, kind);
+    numMetrics.store(n + 1, std::memory_order_release); // readers see the metric complete
+    return *metrics[n];
+}
+
+Telemetry::Counter& Telemetry::counter(const juce::String& name) { return find(name, Kind::counter).counter; }
+Telemetry::Gauge& Telemetry::gauge(const juce::String& name) { return find(name, Kind::gauge).gauge; }
+Telemetry::Histogram& Telemetry::histogram(const juce::String& name) { return find(name, Kind::histogram).histogram; }
+
+juce::Array<Telemetry::Value> Telemetry::Sampler::sample() {
+    auto& t = getInstance();
+    const int n = t.numMetrics.load(std::memory_order_acquire);
+    previous.resize((size_t) n);
+    juce::Array<Value> out;
+    out.ensureStorageAllocated(n);
+    std::vector<juce::uint32> interval((size_t) Histogram::kNumBuckets);
+    for (int i = 0; i < n; ++i) {
+        const auto& m = *t.metrics[i];
+        Value v;
+        v.name = m.name;
+        v.kind = m.kind;
+        if (m.kind == Kind::counter) v.value = (juce::int64) m.counter.get();
+        else if (m.kind == Kind::gauge) v.value = m.gauge.get();
+        else {
+            // Counts since this sampler's last look; recorders keep going while we read
+            auto& prev = previous[(size_t) i];
+            if (prev.counts.empty()) prev.counts.assign((size_t) Histogram::kNumBuckets, 0);
+            juce::uint64 count = 0;
+            int highest = -1;
+            for (int b = 0; b < Histogram::kNumBuckets; ++b) {
+                const juce::uint32 c = m.histogram.getBucketCount(b);
+                interval[(size_t) b] = c - prev.counts[(size_t) b];
+                prev.counts[(size_t) b] = c;
+                count += interval[(size_t) b];
+                if (interval[(size_t) b] > 0) highest = b;
+            }
+            const juce::uint64 sum = m.histogram.getSum();
+            v.count = count;
+            if (count > 0) {
+                v.mean = (juce::int64) ((sum - prev.sum) / count);
+                v.max = Histogram::bucketTop(highest);
+                const juce::uint64 targets[] = { (count + 1) / 2, (count * 9 + 9) / 10, (count * 99 + 99) / 100 };
+                juce::int64* results[] = { &v.p50, &v.p90, &v.p99 };
+                juce::uint64 seen = 0;
+                int q = 0;
+                for (int b = 0; b <= highest && q < 3; ++b) {
+                    seen += interval[(size_t) b];
+                    while (q < 3 && seen >= targets[q]) *results[q++] = Histogram::bucketTop(b);
+                }
+            }
+            prev.sum = sum;
+        }
+        out.add(v);
+    }
+    return out;
+}
+
+juce::String Telemetry::Sampler::toJson(const juce::Array<Value>& values, juce::int64 timeMs) {
+    juce::String s;
+    s << "{\"timeMs\":" << timeMs;
+    for (const auto& v : values) {
+        s << ",\"" << v.name << "\":";
+        if (v.kind != Kind::histogram) s << v.value;
+        else s << "{\"count\":" << (juce::int64) v.count << ",\"mean\":" << v.mean << ",\"p50\":" << v.p50
+               << ",\"p90\":" << v.p90 << ",\"p99\":" << v.p99 << ",\"max\":" << v.max << "}";
+    }
+    return s << "}";
+}
+
+juce::String Telemetry::Sampler::toCsvHeader(const juce::Array<Value>& values) {
+    juce::String s = "timeMs";
+    for (const auto& v : values) {
+        if (v.kind != Kind::histogram) s << "," << v.name;
+        else for (auto* field : { "count", "mean", "p50", "p90", "p99", "max" }) s << "," << v.name << "." << field;
+    }
+    return s;
+}
+
+juce::String Telemetry::Sampler::toCsvRow(const juce::Array<Value>& values, juce::int64 timeMs) {
+    juce::String s;
+    s << timeMs;
+    for (const auto& v : values) {
+        if (v.kind != Kind::histogram) s << "," << v.value;
+        else s << "," << (juce::int64) v.count << "," << v.mean << "," << v.p50 << "," << v.p90 << "," << v.p99 << "," << v.max;
+    }
+    return s;
+}
+
+bool Telemetry::startDump(const juce::File& file, int intervalMs) {
+    stopDump();
+    std::lock_guard<std::mutex> lock(dumpMutex);
+    auto out = std::make_unique<juce::FileOutputStream>(file);
+    if (!out->openedOk()) { LogMessage("TELEMETRY: cannot write " + file.getFullPathName()); return false; }
+    const bool csv = file.hasFileExtension("csv");
+    dumping.store(true);
+    dumpThread = std::thread([this, csv, intervalMs, out = std::move(out)] {
+        Sampler sampler;
+        sampler.sample(); // each row covers one interval, not everything recorded so far
+        int columns = -1;
+        while (dumping.load()) {
+            dumpWake.wait(juce::jmax(10, intervalMs));
+            const auto values = sampler.sample();
+            const auto nowMs = juce::Time::currentTimeMillis();
+            if (!csv) *out << Sampler::toJson(values, nowMs) << "\n";
+            else {
+                if (values.size() != columns) { *out << Sampler::toCsvHeader(values) << "\n"; columns = values.size(); }
+                *out << Sampler::toCsvRow(values, nowMs) << "\n";
+            }
+            out->flush();
+        }
+    });
+    LogMessage("TELEMETRY: dumping to " + file.getFullPathName() + " every " + juce::String(intervalMs) + " ms");
+    return true;
+}
+
+void Telemetry::stopDump() {
+    std::lock_guard<std::mutex> lock(dumpMutex);
+    dumping.store(false);
+    dumpWake.notify();
+    if (dumpThread.joinable()) dumpThread.join();
+}
+
+} // namespace streaming
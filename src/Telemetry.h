@@ -0,0 +1,142 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "RealtimeSignal.h"
+
+namespace streaming {
+
+// Process-wide pipeline metrics: counters, gauges and latency histograms. Recording is a relaxed
+// atomic operation (no lock, no allocation, audio thread included); reading only loads, so sampling
+// never contends with the threads being measured. Metrics are registered by name once (that locks)
+// and live for the rest of the process, so a reference to one can be kept anywhere.
+class Telemetry {
+public:
+    static constexpr int kMaxMetrics = 128;
+
+    class Counter {
+    public:
+        void add(juce::uint64 n = 1) noexcept { value.fetch_add(n, std::memory_order_relaxed); }
+        juce::uint64 get() const noexcept { return value.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<juce::uint64> value { 0 };
+    };
+
+    class Gauge {
+    public:
+        void set(juce::int64 v) noexcept { value.store(v, std::memory_order_relaxed); }
+        void add(juce::int64 d) noexcept { value.fetch_add(d, std::memory_order_relaxed); }
+        juce::int64 get() const noexcept { return value.load(std::memory_order_relaxed); }
+    private:
+        std::atomic<juce::int64> value { 0 };
+    };
+
+    // One instance's part of a gauge that several instances (plugin instances, writers) feed: set()
+    // moves the gauge by the change since this part's last set(), and destruction withdraws the
+    // part, so the gauge reads the sum over live instances. set() from one thread at a time.
+    class GaugeShare {
+    public:
+        explicit GaugeShare(Gauge& g) noexcept : gauge(g) {}
+        ~GaugeShare() { gauge.add(-last.load(std::memory_order_relaxed)); }
+        void set(juce::int64 v) noexcept { gauge.add(v - last.exchange(v, std::memory_order_relaxed)); }
+        // This instance's own value
+        juce::int64 get() const noexcept { return last.load(std::memory_order_relaxed); }
+    private:
+        Gauge& gauge;
+        std::atomic<juce::int64> last { 0 };
+        JUCE_DECLARE_NON_COPYABLE(GaugeShare)
+    };
+
+    // HDR-style: each power of two is split into 16 linear buckets, so any value is kept to within
+    // 1/16 of itself, from 0 up to 2^40 (values in microseconds: ~12 days)
+    class Histogram {
+    public:
+        static constexpr int kSubBits = 4, kSubBuckets = 1 << kSubBits;
+        static constexpr int kMaxBits = 40;
+        static constexpr int kNumBuckets = (kMaxBits - kSubBits + 1) * kSubBuckets;
+
+        void record(juce::int64 v) noexcept {
+            counts[bucketFor(v)].fetch_add(1, std::memory_order_relaxed);
+            total.fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add((juce::uint64) juce::jmax<juce::int64>(0, v), std::memory_order_relaxed);
+        }
+        juce::uint64 getCount() const noexcept { return total.load(std::memory_order_relaxed); }
+        juce::uint64 getSum() const noexcept { return sum.load(std::memory_order_relaxed); }
+        juce::uint32 getBucketCount(int b) const noexcept { return counts[b].load(std::memory_order_relaxed); }
+
+        static int bucketFor(juce::int64 v) noexcept;
+        // Highest value that lands in bucket b
+        static juce::int64 bucketTop(int b) noexcept;
+
+    private:
+        std::atomic<juce::uint32> counts[kNumBuckets] {};
+        std::atomic<juce::uint64> total { 0 }, sum { 0 };
+    };
+
+    enum class Kind { counter, gauge, histogram };
+
+    static Telemetry& getInstance();
+
+    // Same name, same metric. Register at setup, not per call: this locks. Names are "stage.what";
+    // histograms hold microseconds. Past kMaxMetrics a metric still works but is never reported.
+    Counter& counter(const juce::String& name);
+    Gauge& gauge(const juce::String& name);
+    Histogram& histogram(const juce::String& name);
+
+    struct Value {
+        juce::String name;
+        Kind kind { Kind::counter };
+        juce::int64 value { 0 };           // counter or gauge
+        juce::uint64 count { 0 };          // histogram: values recorded in the interval
+        juce::int64 mean { 0 }, p50 { 0 }, p90 { 0 }, p99 { 0 }, max { 0 };
+    };
+
+    // A reader's view; each reader (the editor, the dump) keeps its own, so histograms summarise what
+    // was recorded since that reader last sampled them
+    class Sampler {
+    public:
+        juce::Array<Value> sample();
+        static juce::String toJson(const juce::Array<Value>& values, juce::int64 timeMs);
+        static juce::String toCsvHeader(const juce::Array<Value>& values);
+        static juce::String toCsvRow(const juce::Array<Value>& values, juce::int64 timeMs);
+    private:
+        struct Previous { std::vector<juce::uint32> counts; juce::uint64 count = 0, sum = 0; };
+        std::vector<Previous> previous;
+    };
+
+    // Appends a sample to `file` every intervalMs on a thread of its own: JSON Lines, or CSV when
+    // the file ends in .csv (a new header row whenever metrics were added)
+    bool startDump(const juce::File& file, int intervalMs = 1000);
+    void stopDump();
+
+private:
+    struct Metric {
+        juce::String name;
+        Kind kind;
+        Counter counter;
+        Gauge gauge;
+        Histogram histogram;
+        Metric(const juce::String& n, Kind k) : name(n), kind(k) {}
+    };
+    std::unique_ptr<Metric> metrics[kMaxMetrics];
+    std::atomic<int> numMetrics { 0 };
+    std::mutex registerMutex;
+    std::unique_ptr<Metric> overflow[3];
+
+    std::mutex dumpMutex;
+    std::thread dumpThread;
+    RealtimeSignal dumpWake;
+    std::atomic<bool> dumping { false };
+
+    Telemetry() = default;
+    ~Telemetry() = default;
+    Metric& find(const juce::String& name, Kind kind);
+
+    JUCE_DECLARE_NON_COPYABLE(Telemetry)
+};
+
+} // namespace streaming
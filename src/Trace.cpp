@@ -0,0 +1,95 @@
+#include "Trace.h"
+#include "Logging.h"
+#include <cstdlib>
+#include <mutex>
+#include <utility>
+
+namespace streaming {
+
+namespace {
+constexpr int kNumSites = 128;
+constexpr juce::int64 kWindowMs = 1000;
+
+// Call sites share a small table; two sites on one entry just restart each other's window
+struct Site {
+    const void* id = nullptr;
+    juce::int64 windowStartMs = 0;
+    int shown = 0;         // lines written in the current window
+    int lastHash = 0;      // of the last line written
+    int repeats = 0;       // of that line since, not yet reported
+    int overRate = 0;      // other lines dropped since the last one written
+};
+
+std::mutex sitesMutex;
+Site sites[kNumSites];
+std::atomic<juce::uint64> suppressed { 0 };
+
+const char* const levelNames[] = { "off", "error", "warning", "info", "verbose", "debug", "trace" };
+const char* const subsystemNames[] = { "rtmp", "tls", "flv", "ffmpeg" };
+}
+
+Trace::Level Trace::getMaxLevel() noexcept {
+    int l = off;
+    for (auto& level : levels) l = juce::jmax(l, level.load(std::memory_order_relaxed));
+    return (Level) l;
+}
+
+const char* Trace::getName(Subsystem s) noexcept { return subsystemNames[s]; }
+
+bool Trace::configure(const juce::String& spec) {
+    bool ok = true;
+    for (auto entry : juce::StringArray::fromTokens(spec, ",", "")) {
+        entry = entry.trim().toLowerCase();
+        if (entry.isEmpty()) continue;
+        const bool named = entry.containsChar('=');
+        const auto name = named ? entry.upToFirstOccurrenceOf("=", false, false).trim() : juce::String("all");
+        const auto levelName = named ? entry.fromFirstOccurrenceOf("=", false, false).trim() : entry;
+        int level = -1;
+        for (int l = off; l <= trace; ++l) if (levelName == levelNames[l]) level = l;
+        if (level < 0) { ok = false; continue; }
+        bool matched = false;
+        for (int s = 0; s < kNumSubsystems; ++s)
+            if (name == "all" || name == subsystemNames[s]) { setLevel((Subsystem) s, (Level) level); matched = true; }
+        ok = ok && matched;
+    }
+    return ok;
+}
+
+void Trace::configureFromEnvironment() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        const char* spec = std::getenv("CREATOR_TRACE");
+        if (spec == nullptr) return;
+        if (!configure(spec)) LogMessage("TRACE: could not fully parse CREATOR_TRACE=" + juce::String(spec));
+        LogMessage("TRACE: levels rtmp=" + juce::String(levelNames[getLevel(rtmp)]) + " tls=" + levelNames[getLevel(tls)]
+                   + " flv=" + levelNames[getLevel(flv)] + " ffmpeg=" + levelNames[getLevel(ffmpeg)]);
+    });
+}
+
+void Trace::write(Subsystem s, Level l, const void* site, const juce::String& text) {
+    if (!enabled(s, l)) return;
+    const auto nowMs = (juce::int64) juce::Time::getMillisecondCounter();
+    const int hash = text.hashCode();
+    int repeats = 0, overRate = 0;
+    {
+        std::lock_guard<std::mutex> lock(sitesMutex);
+        auto& e = sites[((size_t) site >> 3) % kNumSites];
+        if (e.id != site) { e = Site(); e.id = site; e.windowStartMs = nowMs; }
+        const bool newWindow = nowMs - e.windowStartMs >= kWindowMs;
+        if (newWindow) { e.windowStartMs = nowMs; e.shown = 0; }
+        // A repeated line shows at most once per window, with its count
+        if (!newWindow && e.shown > 0 && hash == e.lastHash) { ++e.repeats; suppressed.fetch_add(1); return; }
+        if (e.shown >= kLinesPerSecond) { ++e.overRate; suppressed.fetch_add(1); return; }
+        repeats = std::exchange(e.repeats, 0);
+        overRate = std::exchange(e.overRate, 0);
+        e.lastHash = hash;
+        ++e.shown;
+    }
+    if (repeats > 0) LogEvent("TRACE[{}] (last line repeated {} times)", subsystemNames[s], repeats);
+    if (overRate > 0) LogEvent("TRACE[{}] ({} lines from this site over the rate limit)", subsystemNames[s], overRate);
+    LogEvent("TRACE[{}] {}", subsystemNames[s], text);
+}
+
+juce::uint64 Trace::getSuppressedLines() noexcept { return suppressed.load(); }
+
+} // namespace streaming
@@ -0,0 +1,38 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+
+namespace streaming {
+
+// Diagnostic tracing, gated per subsystem at runtime. The gate is one relaxed load, so a disabled
+// line costs nothing beyond the check; a line that passes is dropped if it repeats the previous line
+// from the same call site or that site is over its rate, and the suppressed count is logged later.
+class Trace {
+public:
+    enum Subsystem { rtmp, tls, flv, ffmpeg, kNumSubsystems }; // ffmpeg: libav* lines from anywhere else
+    enum Level { off, error, warning, info, verbose, debug, trace };
+
+    static constexpr int kLinesPerSecond = 20; // per call site
+
+    static bool enabled(Subsystem s, Level l) noexcept { return l != off && (int) l <= levels[s].load(std::memory_order_relaxed); }
+    static void setLevel(Subsystem s, Level l) noexcept { levels[s].store((int) l, std::memory_order_relaxed); }
+    static Level getLevel(Subsystem s) noexcept { return (Level) levels[s].load(std::memory_order_relaxed); }
+    // Most verbose level of any subsystem, for libraries with a global gate of their own
+    static Level getMaxLevel() noexcept;
+
+    // "rtmp=debug,tls=trace", "all=info" or "off"; later entries win. False if any entry was not understood.
+    static bool configure(const juce::String& spec);
+    // Applies CREATOR_TRACE, if set; only the first call does anything, so explicit settings made after it stand
+    static void configureFromEnvironment();
+
+    // `site` identifies the call site (its format string); `text` is the formatted line
+    static void write(Subsystem s, Level l, const void* site, const juce::String& text);
+    static juce::uint64 getSuppressedLines() noexcept;
+
+    static const char* getName(Subsystem s) noexcept;
+
+private:
+    static inline std::atomic<int> levels[kNumSubsystems] { { warning }, { warning }, { warning }, { warning } };
+};
+
+} // namespace streaming
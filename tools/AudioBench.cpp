@@ -0,0 +1,1341 @@
+#include "../src/AudioRecorder.h"
+#include "../src/AudioTap.h"
+#include "../src/AudioEncodeStage.h"
+#include "../src/FlacWriter.h"
+#include "../src/Logging.h"
+#include "../src/AsyncResampler.h"
+#include "../src/DriftEstimator.h"
+#include "../src/RealtimeSignal.h"
+#include "../src/SampleConvert.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+ #include <sys/resource.h>
+#endif
+
+// Offline benchmarks for the audio sinks; no plugin host needed.
+//   AudioBench recorder [--seconds N] [--speed X] [--channels C] [--rate SR] [--block B] [--out file.wav]
+//   AudioBench convert [--seconds N]
+//   AudioBench aac [--seconds N] [--speed X] [--channels C] [--rate SR] [--block B]
+//   AudioBench drift [--seconds N] [--rate SR] [--block B]
+//   AudioBench tap [--seconds N] [--speed X] [--channels C] [--rate SR] [--block B]
+//   AudioBench toggle [--cycles N] [--speed X] [--rate SR] [--block B] [--out file.wav]
+//   AudioBench bounce [--seconds N] [--speed X] [--rate SR] [--block B] [--out file.wav]
+//   AudioBench preroll [--seconds N] [--speed X] [--rate SR] [--block B] [--out file.wav]
+//   AudioBench segments [--seconds N] [--speed X] [--rate SR] [--block B] [--out first.wav]
+//   AudioBench flac [--seconds N] [--workers W] [--rate SR] [--block B] [--out file]
+//   AudioBench log [--seconds N] [--rate SR] [--out keep]
+// --speed is the multiple of real time the blocks are pushed at (0 = as fast as possible).
+// convert times the SampleConvert kernels on every ISA this CPU has against the scalar loops they
+// replaced, for mono and stereo at 64..4096-sample blocks; --seconds is the budget per measurement.
+// recorder and aac feed their sink through an AudioTap, as processBlock does. aac reports the cost
+// of each tap write() and fails (exit 3) if the simulated audio thread allocated anything.
+// drift simulates 44.1 / 48 kHz hosts whose device clock is off by -200, 0 and +200 ppm, with
+// callback jitter, feeding DriftEstimator and AsyncResampler towards a --rate stream on a virtual
+// clock (an hour takes seconds). It reports the A/V offset the audio timeline accumulates with and
+// without compensation and the resampler's SNR on a 997 Hz tone; exit 4 if the offset exceeds 5 ms.
+// tap times the audio thread per block with 1, 2 and 3 consumers (WAV recorder, A+V writer, live
+// AAC), each converting on its own thread, against the per-consumer ring and conversion processBlock
+// used to do for each of them; exit 3 on an audio-thread allocation, 2 if a reader lost frames.
+// toggle starts and stops AudioRecorder takes --cycles times against a simulated audio callback,
+// at the next frame, at a given tap frame and at a given host position, and checks every file is
+// sample-accurate and bit-exact between its edge fades; exit 5 on a mismatch, 3 on an allocation,
+// 2 if a paced run lapped the drain.
+// bounce renders a stamped signal into a take as an offline host would (default 50x real time),
+// once with the tap in realtime mode and once non-realtime, and reads the files back; exit 5 unless
+// the non-realtime file is complete and bit-exact.
+// preroll times the audio thread with AudioRecorder's pre-roll off and on while --seconds of history
+// fill (default 120 s, memory-mapped, at 16x real time), then presses Record twice with the host
+// still playing: once for the history alone and once running 2 s into live audio. It reports flush
+// throughput and checks each file is complete and bit-exact across the seam; exit 5 on a mismatch
+// or a short pre-roll, 3 on an allocation, 2 if a paced run dropped samples.
+// segments records one take rolled over into files every 7.77 s and every 1 MB (offline, --seconds
+// at max speed, lossless) and every 1.3 s in real time at --speed, then reads the files back in order:
+// exit 5 unless each holds exactly its segment, the sequence is gapless and bit-exact across every
+// seam and no spare file is left over; 2 if the realtime run dropped samples.
+// flac records the same offline take (default 300 s of a music-like signal) as WAV, as FLAC encoded
+// on the drain thread and as FLAC on an encoder pool of --workers threads (default one per core beyond
+// the first, at least one). It reports compression ratio (file over 24-bit PCM), encode MB/s per core (PCM in over time
+// spent encoding, summed over threads) and end-to-end MB/s, and decodes every FLAC file with
+// juce::FlacAudioFormat; exit 5 unless it matches the WAV sample for sample, 2 on drops.
+// log logs 100 records per 1 ms simulated audio callback (100k/s) through the old string-queue
+// logger and through BinaryLog, as a prebuilt juce::String and as LogEvent arguments, and reports
+// ns per call, the callback's p99/worst and what was written or dropped; exit 5 if a record is
+// unaccounted for, 3 if LogEvent allocated on the audio thread. --out keeps the log files.
+
+// Allocation probe: counts heap allocations made while the calling thread has tProbeAllocations
+// set. On glibc malloc itself is interposed, which also catches C allocations; elsewhere only
+// operator new is.
+namespace {
+thread_local bool tProbeAllocations = false;
+std::atomic<long> gProbedAllocations { 0 };
+inline void noteAllocation() noexcept { if (tProbeAllocations) gProbedAllocations.fetch_add(1, std::memory_order_relaxed); }
+}
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void* malloc(size_t n) { noteAllocation(); return __libc_malloc(n); }
+void* calloc(size_t c, size_t n) { noteAllocation(); return __libc_calloc(c, n); }
+void* realloc(void* p, size_t n) { noteAllocation(); return __libc_realloc(p, n); }
+}
+#else
+void* operator new(std::size_t n) {
+    noteAllocation();
+    if (void* p = std::malloc(n > 0 ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t n) { return operator new(n); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept { noteAllocation(); return std::malloc(n > 0 ? n : 1); }
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept { noteAllocation(); return std::malloc(n > 0 ? n : 1); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+#endif
+
+namespace {
+
+struct Args {
+    double seconds = 600.0;
+    double speed = 8.0;
+    int channels = 2;
+    int rate = 48000;
+    int block = 512;
+    int cycles = 2000;
+    int workers = -1;
+    juce::String out;
+};
+
+struct CpuSample {
+    double cpuSec = 0.0;
+    long voluntarySwitches = 0;
+    long threadVoluntarySwitches = 0; // the calling thread only, where available
+};
+
+CpuSample sampleCpu() {
+    CpuSample s;
+#if defined(__unix__) || defined(__APPLE__)
+    rusage ru {};
+    getrusage(RUSAGE_SELF, &ru);
+    s.cpuSec = (double) ru.ru_utime.tv_sec + (double) ru.ru_utime.tv_usec * 1e-6
+             + (double) ru.ru_stime.tv_sec + (double) ru.ru_stime.tv_usec * 1e-6;
+    s.voluntarySwitches = ru.ru_nvcsw;
+   #ifdef RUSAGE_THREAD
+    rusage rt {};
+    getrusage(RUSAGE_THREAD, &rt);
+    s.threadVoluntarySwitches = rt.ru_nvcsw;
+   #endif
+#endif
+    return s;
+}
+
+int benchRecorder(const Args& a) {
+    juce::File file = a.out.isNotEmpty() ? juce::File(a.out)
+                                         : juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("AudioBench_recorder.wav");
+    streaming::AudioTap tap;
+    tap.prepare(a.channels, 1 << 18);
+    AudioRecorder rec;
+    rec.prepare(a.rate);
+    rec.setAudioSource(&tap);
+    if (! rec.startRecording(file, a.channels, a.rate)) {
+        std::printf("recorder: cannot open %s\n", file.getFullPathName().toRawUTF8());
+        return 1;
+    }
+
+    juce::AudioBuffer<float> block(a.channels, a.block);
+    for (int ch = 0; ch < a.channels; ++ch)
+        for (int i = 0; i < a.block; ++i)
+            block.setSample(ch, i, 0.25f * (float) std::sin(2.0 * juce::MathConstants<double>::pi * 997.0 * i / a.rate + ch));
+
+    const auto numBlocks = (juce::int64) (a.seconds * a.rate / a.block);
+    const auto blockPeriod = std::chrono::duration<double>(a.speed > 0.0 ? (double) a.block / a.rate / a.speed : 0.0);
+    double pushTotalUs = 0.0, pushWorstUs = 0.0;
+
+    const auto c0 = sampleCpu();
+    const auto t0 = std::chrono::steady_clock::now();
+    auto next = t0;
+    for (juce::int64 i = 0; i < numBlocks; ++i) {
+        const auto p0 = std::chrono::steady_clock::now();
+        tap.write(block.getArrayOfReadPointers(), a.channels, a.block, a.rate);
+        const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - p0).count();
+        pushTotalUs += us;
+        pushWorstUs = juce::jmax(pushWorstUs, us);
+        if (a.speed > 0.0) {
+            next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockPeriod);
+            std::this_thread::sleep_until(next);
+        }
+    }
+    const auto pushed = sampleCpu();
+    rec.stop();
+    const auto c1 = sampleCpu();
+    const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    const double recordedSec = (double) numBlocks * a.block / a.rate;
+    const double cpuSec = c1.cpuSec - c0.cpuSec;
+    const auto bytes = file.getSize();
+    // Everything but the pushing thread's own sleeps: the drain thread's wakeups and disk waits
+    const long otherSwitches = (c1.voluntarySwitches - c0.voluntarySwitches) - (pushed.threadVoluntarySwitches - c0.threadVoluntarySwitches);
+
+    std::printf("recorder: %.0f s of %d ch @ %d Hz in %d-sample blocks, pushed at %s\n", recordedSec, a.channels, a.rate, a.block,
+                a.speed > 0.0 ? juce::String(a.speed, 1).toRawUTF8() : "max");
+    std::printf("  wall %.2f s, file %lld bytes, throughput %.1f MB/s (%.1fx real time)\n", wallSec, (long long) bytes,
+                (double) bytes / wallSec / 1e6, recordedSec / wallSec);
+    std::printf("  cpu %.3f s, %.2f s per recorded hour\n", cpuSec, cpuSec / recordedSec * 3600.0);
+    std::printf("  voluntary context switches outside the push thread: %ld (%.2f per recorded second)\n", otherSwitches, otherSwitches / recordedSec);
+    std::printf("  tap write mean %.2f us, worst %.2f us, dropped samples %d\n", pushTotalUs / juce::jmax<juce::int64>(1, numBlocks), pushWorstUs,
+                rec.getDroppedSamples());
+    if (a.out.isEmpty()) file.deleteFile();
+    return rec.getDroppedSamples() > 0 && a.speed > 0.0 ? 2 : 0;
+}
+
+// The per-sample loops the sinks used before SampleConvert, kept as the baseline
+void legacyToInt16(const float* const* src, int channels, int frames, int16_t* dst) {
+    for (int i = 0; i < frames; ++i)
+        for (int c = 0; c < channels; ++c)
+            dst[i * channels + c] = (int16_t) juce::roundToInt(juce::jlimit(-1.0f, 1.0f, src[c][i]) * 32767.0f);
+}
+
+void legacyToInt24(const float* const* src, int channels, int frames, int32_t* dst) {
+    for (int c = 0; c < channels; ++c)
+        for (int i = 0; i < frames; ++i)
+            dst[c * frames + i] = juce::roundToInt(juce::jlimit(-1.0f, 1.0f, src[c][i]) * (float) 0x7fffffff);
+}
+
+void legacyInterleave(const float* const* src, int channels, int frames, float* dst) {
+    for (int i = 0; i < frames; ++i)
+        for (int c = 0; c < channels; ++c) dst[i * channels + c] = src[c][i];
+}
+
+// Nanoseconds per sample, over as many repetitions as fit in `budgetSec`
+template <class Fn>
+double timePerSample(Fn&& fn, int samplesPerCall, double budgetSec) {
+    for (int i = 0; i < 16; ++i) fn(); // warm caches and the dispatcher
+    juce::int64 calls = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+    do {
+        for (int i = 0; i < 64; ++i) fn();
+        calls += 64;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    } while (elapsed < budgetSec);
+    return elapsed * 1e9 / ((double) calls * samplesPerCall);
+}
+
+int benchConvert(const Args& a) {
+    constexpr int kMaxBlock = 4096;
+    const double budget = juce::jlimit(0.01, 2.0, a.seconds);
+    juce::AudioBuffer<float> in(2, kMaxBlock);
+    juce::Random rng(1);
+    for (int ch = 0; ch < 2; ++ch)
+        for (int i = 0; i < kMaxBlock; ++i) in.setSample(ch, i, rng.nextFloat() * 2.2f - 1.1f);
+    std::vector<int16_t> out16((size_t) 2 * kMaxBlock);
+    std::vector<int32_t> out32((size_t) 2 * kMaxBlock);
+    std::vector<uint8_t> out24((size_t) 6 * kMaxBlock);
+    std::vector<float> outF((size_t) 2 * kMaxBlock);
+    const float* planes[2] = { in.getReadPointer(0), in.getReadPointer(1) };
+    SampleConvert::Dither dither;
+
+    const SampleConvert::Isa isas[] = { SampleConvert::Isa::scalar, SampleConvert::Isa::sse2, SampleConvert::Isa::avx2, SampleConvert::Isa::neon };
+    const auto best = SampleConvert::getIsa();
+    std::printf("convert: ns per sample (lower is better), dispatcher picks %s; legacy = the scalar loops the sinks used\n",
+                SampleConvert::getIsaName(best));
+    std::printf("  %-8s %-10s %6s %9s", "layout", "op", "block", "legacy");
+    for (auto isa : isas)
+        if (SampleConvert::setIsa(isa)) std::printf(" %9s", SampleConvert::getIsaName(isa));
+    std::printf("\n");
+
+    const char* ops[] = { "int16", "int16+tpdf", "int24", "int32", "interleave" };
+    for (int channels = 1; channels <= 2; ++channels) {
+        for (const char* op : ops) {
+            const juce::String name(op);
+            for (int block = 64; block <= kMaxBlock; block *= 4) {
+                const int samples = block * channels;
+                auto runKernel = [&] {
+                    if (name == "int16") SampleConvert::toInt16(planes, channels, block, out16.data());
+                    else if (name == "int16+tpdf") SampleConvert::toInt16(planes, channels, block, out16.data(), &dither);
+                    else if (name == "int24") SampleConvert::toInt24(planes, channels, block, out24.data());
+                    else if (name == "int32") SampleConvert::toInt32(planes, channels, block, out32.data());
+                    else SampleConvert::interleave(planes, channels, block, outF.data());
+                };
+                auto runLegacy = [&] {
+                    if (name.startsWith("int16")) legacyToInt16(planes, channels, block, out16.data());
+                    else if (name == "interleave") legacyInterleave(planes, channels, block, outF.data());
+                    else legacyToInt24(planes, channels, block, out32.data()); // JUCE's float -> int32 step
+                };
+                std::printf("  %-8s %-10s %6d %9.3f", channels == 1 ? "mono" : "stereo", op, block, timePerSample(runLegacy, samples, budget));
+                for (auto isa : isas)
+                    if (SampleConvert::setIsa(isa)) std::printf(" %9.3f", timePerSample(runKernel, samples, budget));
+                std::printf("\n");
+            }
+        }
+    }
+    SampleConvert::setIsa(best);
+    return 0;
+}
+
+int benchAac(const Args& a) {
+    using streaming::AudioEncodeStage;
+    constexpr int kBitrateKbps = 128;
+    std::atomic<juce::uint64> packets { 0 }, packetBytes { 0 };
+    streaming::AudioTap tap;
+    tap.prepare(a.channels, 1 << 16);
+    AudioEncodeStage stage;
+    const bool started = stage.start(tap, a.rate, a.channels, kBitrateKbps, nullptr, [&](streaming::MediaBuffer::Ptr p, juce::int64) {
+        packets.fetch_add(1);
+        packetBytes.fetch_add(p->size());
+    });
+    if (! started) {
+        std::printf("aac: no AAC encoder in this build (needs macOS or FFmpeg)\n");
+        return 1;
+    }
+
+    juce::AudioBuffer<float> block(a.channels, a.block);
+    for (int ch = 0; ch < a.channels; ++ch)
+        for (int i = 0; i < a.block; ++i)
+            block.setSample(ch, i, 0.25f * (float) std::sin(2.0 * juce::MathConstants<double>::pi * 997.0 * i / a.rate + ch));
+    const auto numBlocks = (int) (a.seconds * a.rate / a.block);
+    const auto blockPeriod = std::chrono::duration<double>(a.speed > 0.0 ? (double) a.block / a.rate / a.speed : 0.0);
+    std::vector<float> pushUs((size_t) juce::jmax(1, numBlocks)); // sized up front: the audio thread only stores
+
+    // Stands in for the host's audio callback: only the tap write, timed, with the allocation probe armed
+    std::thread audioThread([&] {
+        const float* const* planes = block.getArrayOfReadPointers();
+        auto next = std::chrono::steady_clock::now();
+        tProbeAllocations = true;
+        for (int i = 0; i < numBlocks; ++i) {
+            const auto p0 = std::chrono::steady_clock::now();
+            tap.write(planes, a.channels, a.block, a.rate);
+            pushUs[(size_t) i] = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - p0).count();
+            if (a.speed > 0.0) {
+                next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockPeriod);
+                std::this_thread::sleep_until(next);
+            }
+        }
+        tProbeAllocations = false;
+    });
+    const auto t0 = std::chrono::steady_clock::now();
+    audioThread.join();
+    const double pushSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    // Let the encoder catch up with everything that made it into the tap
+    const auto expectedFrames = (juce::uint64) (((juce::int64) numBlocks * a.block - (juce::int64) stage.getDroppedSamples()) / AudioEncodeStage::kFrameSize);
+    for (int i = 0; i < 500 && stage.getEncodedFrames() < expectedFrames; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const auto frames = stage.getEncodedFrames();
+    const auto dropped = stage.getDroppedSamples();
+    const auto codecName = stage.getCodecName();
+    stage.stop();
+
+    std::vector<float> sorted(pushUs.begin(), pushUs.begin() + numBlocks);
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    for (float us : sorted) total += us;
+    const auto pct = [&](double q) { return sorted.empty() ? 0.0 : (double) sorted[(size_t) juce::jmin<double>((double) sorted.size() - 1, q * (double) sorted.size())]; };
+    const double recordedSec = (double) numBlocks * a.block / a.rate;
+    const long allocations = gProbedAllocations.load();
+
+    std::printf("aac: %s, %.0f s of %d ch @ %d Hz in %d-sample blocks, pushed at %s (%.2f s wall)\n", codecName.toRawUTF8(), recordedSec, a.channels, a.rate,
+                a.block, a.speed > 0.0 ? juce::String(a.speed, 1).toRawUTF8() : "max", pushSec);
+    std::printf("  tap write() per block: mean %.3f us, p50 %.3f, p99 %.3f, p99.9 %.3f, worst %.3f us\n", total / juce::jmax<double>(1.0, (double) sorted.size()),
+                pct(0.5), pct(0.99), pct(0.999), sorted.empty() ? 0.0 : (double) sorted.back());
+    std::printf("  encoded %llu AAC frames (%llu expected), %llu packets, %.1f kbps, dropped samples %llu\n", (unsigned long long) frames,
+                (unsigned long long) expectedFrames, (unsigned long long) packets.load(),
+                recordedSec > 0.0 ? (double) packetBytes.load() * 8.0 / recordedSec / 1000.0 : 0.0, (unsigned long long) dropped);
+    std::printf("  heap allocations on the audio thread: %ld\n", allocations);
+    if (allocations > 0) return 3;
+    return dropped > 0 && a.speed > 0.0 ? 2 : 0;
+}
+
+struct DriftResult {
+    double finalOffsetMs = 0.0, worstOffsetMs = 0.0, ppm = 0.0, snrDb = 0.0;
+};
+
+// One simulated stream on a virtual clock. Offset = audio timeline (output samples / stream rate)
+// minus the true time at which the matching input was captured.
+DriftResult simulateDrift(double hostRate, double skewPpm, double streamRate, int block, double seconds) {
+    constexpr double kWarmupSec = 60.0;
+    constexpr double kToneHz = 997.0;
+    constexpr double kJitterUs = 1500.0;
+    const double deviceRate = hostRate * (1.0 + skewPpm * 1.0e-6);
+    streaming::DriftEstimator drift;
+    drift.reset(hostRate);
+    streaming::AsyncResampler resampler;
+    resampler.prepare(1, streamRate / hostRate, block);
+
+    juce::HeapBlock<float> in((size_t) block), out((size_t) resampler.getMaxOutput(block));
+    const float* inPtr[1] = { in.get() };
+    float* outPtr[1] = { out.get() };
+    juce::Random rng(7);
+    juce::int64 produced = 0, inputFrames = 0;
+    double errPower = 0.0, sigPower = 0.0;
+    DriftResult r;
+    const double toneStep = juce::MathConstants<double>::twoPi * kToneHz / deviceRate; // per input frame
+    const auto numBlocks = (juce::int64) (seconds * deviceRate / block);
+    for (juce::int64 k = 0; k < numBlocks; ++k) {
+        for (int i = 0; i < block; ++i) in[i] = (float) (0.5 * std::sin(toneStep * (double) (inputFrames + i)));
+        inputFrames += block;
+        // The callback for this block fires once its last frame exists, plus scheduling jitter
+        const double arrivalUs = 1.0e9 + (double) inputFrames / deviceRate * 1.0e6 + rng.nextDouble() * kJitterUs;
+        drift.onBlock(block, (juce::int64) arrivalUs);
+
+        const double ratio = streaming::DriftEstimator::ratioFor(drift.read(), resampler.getInputPosition(), produced, streamRate, hostRate);
+        resampler.setRatio(ratio);
+        const double startPos = resampler.getInputPosition();
+        const int n = resampler.process(inPtr, block, outPtr, resampler.getMaxOutput(block));
+        const double t = (double) produced / streamRate - startPos / deviceRate;
+        if ((double) inputFrames / deviceRate > kWarmupSec) {
+            r.worstOffsetMs = juce::jmax(r.worstOffsetMs, std::abs(t) * 1000.0);
+            for (int i = 0; i < n; ++i) {
+                const double ideal = 0.5 * std::sin(toneStep * (startPos + i / ratio));
+                errPower += (out[i] - ideal) * (out[i] - ideal);
+                sigPower += ideal * ideal;
+            }
+        }
+        produced += n;
+        r.finalOffsetMs = t * 1000.0;
+    }
+    r.ppm = streaming::DriftEstimator::ppm(drift.read(), hostRate);
+    r.snrDb = errPower > 0.0 ? 10.0 * std::log10(sigPower / errPower) : 0.0;
+    return r;
+}
+
+int benchDrift(const Args& a) {
+    constexpr double kMaxOffsetMs = 5.0;
+    const double streamRate = (double) a.rate;
+    std::printf("drift: %.0f s per case, %d-frame callbacks, stream %.0f Hz; offset = audio timeline - capture time (after 60 s)\n",
+                a.seconds, a.block, streamRate);
+    std::printf("  %8s %6s %12s %12s %12s %12s %8s\n", "host", "skew", "uncomp. ms", "final ms", "worst ms", "measured", "SNR dB");
+    bool ok = true;
+    for (double host : { 44100.0, 48000.0 }) {
+        for (double ppm : { -200.0, 0.0, 200.0 }) {
+            const auto r = simulateDrift(host, ppm, streamRate, a.block, a.seconds);
+            // Counting samples at the nominal rate (no estimator) drifts by the full skew
+            const double uncompensatedMs = a.seconds * ppm * 1.0e-6 * 1000.0;
+            std::printf("  %8.0f %+6.0f %12.1f %12.3f %12.3f %+9.1f ppm %8.1f\n", host, ppm, uncompensatedMs, r.finalOffsetMs, r.worstOffsetMs, r.ppm, r.snrDb);
+            ok = ok && r.worstOffsetMs <= kMaxOffsetMs;
+        }
+    }
+    return ok ? 0 : 4;
+}
+
+// What each consumer makes of the audio: the WAV recorder's 24-bit samples, the A+V writer's
+// interleaved int16 and the live encoder's interleaved float
+enum class Sink { wav, movie, aac };
+constexpr Sink kSinks[] = { Sink::wav, Sink::movie, Sink::aac };
+constexpr int kTapChunk = 4096;
+constexpr int kLegacyRing = 1 << 16;
+
+struct SinkScratch {
+    std::vector<uint8_t> out24;
+    std::vector<int16_t> out16;
+    std::vector<float> outF;
+    explicit SinkScratch(int channels)
+        : out24((size_t) 3 * channels * kTapChunk), out16((size_t) channels * kTapChunk), outF((size_t) channels * kTapChunk) {}
+
+    void convert(Sink sink, const float* const* planes, int channels, int frames) noexcept {
+        if (sink == Sink::wav) SampleConvert::toInt24(planes, channels, frames, out24.data());
+        else if (sink == Sink::movie) SampleConvert::toInt16(planes, channels, frames, out16.data());
+        else SampleConvert::interleave(planes, channels, frames, outF.data());
+    }
+};
+
+// The per-consumer ring processBlock fed before the tap: the recorder and the AAC stage copied
+// planar float and signalled their threads, the A+V writer converted to int16 on the audio thread
+// and its drain polled every 2 ms
+struct LegacySink {
+    Sink kind;
+    int channels;
+    int wakeThreshold;
+    juce::AbstractFifo fifo { kLegacyRing };
+    juce::AudioBuffer<float> planar;
+    std::vector<int16_t> ring16;
+    streaming::RealtimeSignal signal;
+    std::atomic<juce::int64> dropped { 0 };
+
+    LegacySink(Sink k, int ch)
+        : kind(k), channels(ch), wakeThreshold(k == Sink::wav ? kTapChunk : streaming::AudioEncodeStage::kFrameSize),
+          planar(ch, k == Sink::movie ? 1 : kLegacyRing), ring16(k == Sink::movie ? (size_t) kLegacyRing * ch : 0) {}
+
+    // Audio thread
+    void push(const float* const* src, int frames) noexcept {
+        int s1 = 0, n1 = 0, s2 = 0, n2 = 0;
+        fifo.prepareToWrite(frames, s1, n1, s2, n2);
+        if (n1 + n2 < frames) { dropped.fetch_add(frames, std::memory_order_relaxed); return; }
+        auto put = [&](int start, int count, int offset) {
+            if (count <= 0) return;
+            const float* planes[2] = { src[0] + offset, src[channels - 1] + offset };
+            if (kind == Sink::movie) SampleConvert::toInt16(planes, channels, count, ring16.data() + (size_t) start * channels);
+            else for (int c = 0; c < channels; ++c) std::memcpy(planar.getWritePointer(c) + start, planes[c], sizeof(float) * (size_t) count);
+        };
+        put(s1, n1, 0);
+        put(s2, n2, n1);
+        fifo.finishedWrite(n1 + n2);
+        if (kind != Sink::movie && fifo.getNumReady() >= wakeThreshold) signal.notify();
+    }
+
+    // Consumer thread: waits as the old sink did, then does the conversion left off the audio thread
+    void drain(SinkScratch& scratch) noexcept {
+        if (kind == Sink::movie) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        else signal.wait(20);
+        while (fifo.getNumReady() > 0) {
+            int s1 = 0, n1 = 0, s2 = 0, n2 = 0;
+            fifo.prepareToRead(juce::jmin(fifo.getNumReady(), kTapChunk), s1, n1, s2, n2);
+            for (const auto& [start, count] : { std::pair<int, int> { s1, n1 }, std::pair<int, int> { s2, n2 } }) {
+                if (count <= 0 || kind == Sink::movie) continue;
+                const float* planes[2] = { planar.getReadPointer(0) + start, planar.getReadPointer(channels - 1) + start };
+                scratch.convert(kind, planes, channels, count);
+            }
+            fifo.finishedRead(n1 + n2);
+        }
+    }
+};
+
+struct BlockStats {
+    double meanUs = 0.0, p99Us = 0.0, worstUs = 0.0;
+    long allocations = 0;
+};
+
+// Runs perBlock() once per block on a fresh thread paced like a host callback, with the
+// allocation probe armed
+template <class Fn>
+BlockStats runAudioThread(const Args& a, int numBlocks, Fn&& perBlock) {
+    std::vector<float> us((size_t) juce::jmax(1, numBlocks));
+    const auto blockPeriod = std::chrono::duration<double>(a.speed > 0.0 ? (double) a.block / a.rate / a.speed : 0.0);
+    const long allocationsBefore = gProbedAllocations.load();
+    std::thread audioThread([&] {
+        auto next = std::chrono::steady_clock::now();
+        tProbeAllocations = true;
+        for (int i = 0; i < numBlocks; ++i) {
+            const auto p0 = std::chrono::steady_clock::now();
+            perBlock();
+            us[(size_t) i] = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - p0).count();
+            if (a.speed > 0.0) {
+                next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockPeriod);
+                std::this_thread::sleep_until(next);
+            }
+        }
+        tProbeAllocations = false;
+    });
+    audioThread.join();
+
+    BlockStats st;
+    st.allocations = gProbedAllocations.load() - allocationsBefore;
+    us.resize((size_t) numBlocks);
+    std::sort(us.begin(), us.end());
+    if (us.empty()) return st;
+    double total = 0.0;
+    for (float v : us) total += v;
+    st.meanUs = total / (double) us.size();
+    st.p99Us = us[juce::jmin(us.size() - 1, (size_t) (0.99 * (double) us.size()))];
+    st.worstUs = us.back();
+    return st;
+}
+
+int benchTap(const Args& a) {
+    const int channels = juce::jlimit(1, 2, a.channels);
+    juce::AudioBuffer<float> block(channels, a.block);
+    for (int ch = 0; ch < channels; ++ch)
+        for (int i = 0; i < a.block; ++i)
+            block.setSample(ch, i, 0.25f * (float) std::sin(2.0 * juce::MathConstants<double>::pi * 997.0 * i / a.rate + ch));
+    const float* const* planes = block.getArrayOfReadPointers();
+    const auto numBlocks = (int) (a.seconds * a.rate / a.block);
+
+    std::printf("tap: audio thread per %d-sample block, %d ch @ %d Hz, %.0f s per run pushed at %s\n", a.block, channels, a.rate, a.seconds,
+                a.speed > 0.0 ? juce::String(a.speed, 1).toRawUTF8() : "max");
+    std::printf("  per-sink = a ring and conversion per consumer on the audio thread; tap = one copy, consumers convert\n");
+    std::printf("  %9s %-9s %9s %9s %9s %12s %7s\n", "consumers", "path", "mean us", "p99 us", "worst us", "lost frames", "allocs");
+
+    int result = 0;
+    for (int consumers = 1; consumers <= 3; ++consumers) {
+        std::atomic<bool> done { false };
+        {
+            std::vector<std::unique_ptr<LegacySink>> sinks;
+            std::vector<std::thread> threads;
+            for (int k = 0; k < consumers; ++k) sinks.push_back(std::make_unique<LegacySink>(kSinks[k], channels));
+            for (auto& sink : sinks)
+                threads.emplace_back([&done, &sink, channels] {
+                    SinkScratch scratch(channels);
+                    while (! done.load()) sink->drain(scratch);
+                });
+            const auto st = runAudioThread(a, numBlocks, [&] { for (auto& sink : sinks) sink->push(planes, a.block); });
+            done.store(true);
+            for (auto& sink : sinks) sink->signal.notify();
+            for (auto& t : threads) t.join();
+            juce::int64 lost = 0;
+            for (auto& sink : sinks) lost += sink->dropped.load();
+            std::printf("  %9d %-9s %9.3f %9.3f %9.3f %12lld %7ld\n", consumers, "per-sink", st.meanUs, st.p99Us, st.worstUs, (long long) lost, st.allocations);
+        }
+
+        done.store(false);
+        streaming::AudioTap tap;
+        tap.prepare(channels, 1 << 16);
+        {
+            std::vector<std::unique_ptr<streaming::AudioTap::Reader>> readers;
+            std::vector<std::thread> threads;
+            for (int k = 0; k < consumers; ++k) {
+                readers.push_back(std::make_unique<streaming::AudioTap::Reader>());
+                readers.back()->setWakeThreshold(kSinks[k] == Sink::aac ? streaming::AudioEncodeStage::kFrameSize : kTapChunk);
+                readers.back()->attach(tap);
+            }
+            for (int k = 0; k < consumers; ++k)
+                threads.emplace_back([&done, reader = readers[(size_t) k].get(), sink = kSinks[k], channels] {
+                    SinkScratch scratch(channels);
+                    juce::AudioBuffer<float> chunk(channels, kTapChunk);
+                    streaming::AudioTap::BlockInfo info;
+                    while (! done.load()) {
+                        reader->wait(20);
+                        while (const int n = reader->read(chunk.getArrayOfWritePointers(), channels, kTapChunk, info))
+                            scratch.convert(sink, chunk.getArrayOfReadPointers(), channels, n);
+                    }
+                });
+            const auto st = runAudioThread(a, numBlocks, [&] { tap.write(planes, channels, a.block, a.rate); });
+            done.store(true);
+            for (auto& r : readers) r->wake();
+            for (auto& t : threads) t.join();
+            juce::uint64 lost = 0;
+            for (auto& r : readers) { lost += r->getSkippedFrames(); r->detach(); }
+            std::printf("  %9d %-9s %9.3f %9.3f %9.3f %12llu %7ld\n", consumers, "tap", st.meanUs, st.p99Us, st.worstUs, (unsigned long long) lost, st.allocations);
+            if (st.allocations > 0) result = 3;
+            else if (lost > 0 && a.speed > 0.0 && result == 0) result = 2;
+        }
+    }
+    return result;
+}
+
+// Every sample names where it came from, exactly in float and at 24 bits: channel 0 its tap frame,
+// channel 1 its host timeline position
+constexpr int kStampPeriod = 1 << 20;
+inline float stamp(juce::int64 position) noexcept {
+    return (float) ((int) (position % kStampPeriod) - kStampPeriod / 2) / (float) (1 << 23);
+}
+
+int benchToggle(const Args& a) {
+    constexpr int kChannels = 2;
+    constexpr int kMaxTake = 4096;
+    streaming::AudioTap tap;
+    tap.prepare(kChannels, 1 << 16);
+    AudioRecorder rec;
+    rec.setAudioSource(&tap);
+    rec.prepare(a.rate);
+    const juce::File file = a.out.isNotEmpty() ? juce::File(a.out)
+                                               : juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("AudioBench_toggle.wav");
+
+    // Simulated host callback: the transport always plays, the tap only counts frames while a take is attached
+    std::atomic<bool> done { false };
+    std::atomic<juce::int64> hostNow { 0 };
+    double totalUs = 0.0, worstUs = 0.0;
+    juce::int64 blocks = 0;
+    const long allocationsBefore = gProbedAllocations.load();
+    std::thread audioThread([&] {
+        juce::AudioBuffer<float> block(kChannels, a.block);
+        const auto blockPeriod = std::chrono::duration<double>(a.speed > 0.0 ? (double) a.block / a.rate / a.speed : 0.0);
+        auto next = std::chrono::steady_clock::now();
+        juce::int64 host = 0;
+        tProbeAllocations = true;
+        while (! done.load()) {
+            const juce::int64 frame = tap.getWritePosition();
+            for (int i = 0; i < a.block; ++i) {
+                block.setSample(0, i, stamp(frame + i));
+                block.setSample(1, i, stamp(host + i));
+            }
+            const auto p0 = std::chrono::steady_clock::now();
+            tap.write(block.getArrayOfReadPointers(), kChannels, a.block, a.rate, host);
+            const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - p0).count();
+            totalUs += us;
+            worstUs = juce::jmax(worstUs, us);
+            ++blocks;
+            host += a.block;
+            hostNow.store(host);
+            if (a.speed > 0.0) {
+                next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockPeriod);
+                std::this_thread::sleep_until(next);
+            }
+        }
+        tProbeAllocations = false;
+    });
+
+    // Takes alternate between starting now, at a tap frame just ahead and at a host position just ahead
+    juce::Random rng(42);
+    juce::WavAudioFormat wav;
+    int failures = 0, takes = 0, lappedTakes = 0;
+    juce::int64 dropped = 0;
+    juce::int64 framesChecked = 0;
+    auto fail = [&](int cycle, const char* what, juce::int64 got, juce::int64 expected) {
+        if (failures++ < 10) std::printf("  take %d: %s %lld, expected %lld\n", cycle, what, (long long) got, (long long) expected);
+    };
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int cycle = 0; cycle < a.cycles; ++cycle) {
+        const int kind = cycle % 3;
+        const int length = rng.nextInt(kMaxTake + 1);
+        const juce::int64 ahead = a.block + rng.nextInt(kMaxTake);
+        juce::int64 requested = -1;
+        bool ok = false;
+        if (kind == 0) ok = rec.startRecording(file, kChannels, a.rate);
+        else if (kind == 1) ok = rec.startRecording(file, kChannels, a.rate, requested = tap.getWritePosition() + ahead);
+        else ok = rec.startRecordingAtHostSample(file, kChannels, a.rate, requested = hostNow.load() + ahead);
+        if (! ok) { fail(cycle, "start failed", 0, 1); continue; }
+
+        // Tap-frame takes stop at a frame; host-aligned ones once the playhead has passed start + length
+        juce::int64 stopFrame = -1;
+        if (kind == 2) {
+            while (hostNow.load() < requested + length) std::this_thread::sleep_for(std::chrono::microseconds(200));
+        } else {
+            stopFrame = (kind == 1 ? requested : tap.getWritePosition()) + length;
+        }
+        rec.stop(stopFrame);
+        const auto take = rec.getLastTake();
+        ++takes;
+        // A drain lapped by the ring has a gap to show for it, not a wrong sample
+        if (const int lost = rec.getDroppedSamples(); lost > 0) { dropped += lost; ++lappedTakes; continue; }
+
+        if (kind == 1 && take.startFrame != requested) fail(cycle, "started at tap frame", take.startFrame, requested);
+        if (stopFrame >= 0 && take.endFrame != stopFrame) fail(cycle, "stopped at tap frame", take.endFrame, stopFrame);
+        std::unique_ptr<juce::AudioFormatReader> in(wav.createReaderFor(new juce::FileInputStream(file), true));
+        if (in == nullptr) { fail(cycle, "unreadable file", 0, 1); continue; }
+        const auto numFrames = (int) in->lengthInSamples;
+        if (numFrames != take.endFrame - take.startFrame) { fail(cycle, "file length", numFrames, take.endFrame - take.startFrame); continue; }
+        if (numFrames == 0) continue;
+        juce::AudioBuffer<float> got(kChannels, numFrames);
+        in->read(&got, 0, numFrames, 0, true, true);
+
+        // Bit-exact between the fades, and the fades never louder than the signal. Takes too short
+        // to have an unfaded middle only get the second check.
+        const int fade = juce::jlimit(1, 512, juce::roundToInt(a.rate * 0.002));
+        const bool hasMiddle = numFrames > 2 * fade;
+        const juce::int64 middleHost = (juce::int64) std::lround(got.getSample(1, numFrames / 2) * (1 << 23)) + kStampPeriod / 2;
+        const juce::int64 hostStart = ((middleHost - numFrames / 2) % kStampPeriod + kStampPeriod) % kStampPeriod;
+        for (int i = 0; i < numFrames; ++i) {
+            const float expected0 = stamp(take.startFrame + i), expected1 = stamp(hostStart + i);
+            const bool edge = ! hasMiddle || i < fade || i >= numFrames - fade;
+            const bool good = edge ? std::abs(got.getSample(0, i)) <= std::abs(expected0) && (! hasMiddle || std::abs(got.getSample(1, i)) <= std::abs(expected1))
+                                   : got.getSample(0, i) == expected0 && got.getSample(1, i) == expected1;
+            if (! good) { fail(cycle, "wrong sample at", i, numFrames); break; }
+        }
+        if (kind == 2 && hasMiddle && hostStart != requested % kStampPeriod)
+            fail(cycle, "started at host sample", hostStart % kStampPeriod, requested % kStampPeriod);
+        framesChecked += numFrames;
+    }
+    const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    done.store(true);
+    audioThread.join();
+    const long allocations = gProbedAllocations.load() - allocationsBefore;
+    if (a.out.isEmpty()) file.deleteFile();
+
+    std::printf("toggle: %d takes of 0..%d frames (now / at a tap frame / at a host sample), %d-sample blocks @ %d Hz pushed at %s, %.2f s wall\n",
+                takes, kMaxTake, a.block, a.rate, a.speed > 0.0 ? juce::String(a.speed, 1).toRawUTF8() : "max", wallSec);
+    std::printf("  tap write() per block: mean %.3f us, worst %.3f us over %lld blocks\n", totalUs / (double) juce::jmax<juce::int64>(1, blocks), worstUs,
+                (long long) blocks);
+    std::printf("  %lld frames verified, %d failures, %d takes lapped by the ring (%lld samples dropped), heap allocations on the audio thread: %ld\n",
+                (long long) framesChecked, failures, lappedTakes, (long long) dropped, allocations);
+    if (allocations > 0) return 3;
+    if (failures > 0) return 5;
+    return dropped > 0 && a.speed > 0.0 ? 2 : 0;
+}
+
+struct BounceResult {
+    double wallSec = 0.0, backpressureSec = 0.0;
+    juce::int64 frames = 0, fileFrames = 0, mismatches = 0;
+    int dropped = 0;
+};
+
+// One offline render into a take: stamped blocks as fast as --speed allows, then the file read back
+BounceResult runBounce(const Args& a, bool nonRealtime, const juce::File& file) {
+    constexpr int kChannels = 2;
+    streaming::AudioTap tap;
+    tap.prepare(kChannels, 1 << 16);
+    tap.setNonRealtime(nonRealtime);
+    AudioRecorder rec;
+    rec.setAudioSource(&tap);
+    rec.prepare(a.rate);
+    BounceResult r;
+    if (! rec.startRecording(file, kChannels, a.rate)) return r;
+
+    juce::AudioBuffer<float> block(kChannels, a.block);
+    const auto numBlocks = (juce::int64) (a.seconds * a.rate / a.block);
+    const auto blockPeriod = std::chrono::duration<double>(a.speed > 0.0 ? (double) a.block / a.rate / a.speed : 0.0);
+    const auto t0 = std::chrono::steady_clock::now();
+    auto next = t0;
+    for (juce::int64 b = 0; b < numBlocks; ++b) {
+        const juce::int64 frame = b * a.block;
+        for (int i = 0; i < a.block; ++i) {
+            block.setSample(0, i, stamp(frame + i));
+            block.setSample(1, i, stamp(frame + i + kStampPeriod / 3));
+        }
+        tap.write(block.getArrayOfReadPointers(), kChannels, a.block, a.rate);
+        if (a.speed > 0.0) {
+            next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockPeriod);
+            std::this_thread::sleep_until(next);
+        }
+    }
+    r.frames = numBlocks * a.block;
+    rec.stop(r.frames);
+    r.wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    r.backpressureSec = (double) tap.getBackpressureMicros() * 1e-6;
+    r.dropped = rec.getDroppedSamples();
+
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatReader> in(wav.createReaderFor(new juce::FileInputStream(file), true));
+    if (in == nullptr) return r;
+    r.fileFrames = in->lengthInSamples;
+    constexpr int kChunk = 1 << 16;
+    juce::AudioBuffer<float> got(kChannels, kChunk);
+    for (juce::int64 pos = 0; pos < r.fileFrames; pos += kChunk) {
+        const int n = (int) juce::jmin<juce::int64>(kChunk, r.fileFrames - pos);
+        in->read(&got, 0, n, pos, true, true);
+        for (int i = 0; i < n; ++i)
+            if (got.getSample(0, i) != stamp(pos + i) || got.getSample(1, i) != stamp(pos + i + kStampPeriod / 3)) ++r.mismatches;
+    }
+    return r;
+}
+
+int benchBounce(const Args& a) {
+    const juce::File file = a.out.isNotEmpty() ? juce::File(a.out)
+                                               : juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("AudioBench_bounce.wav");
+    std::printf("bounce: %.0f s of 2 ch @ %d Hz in %d-sample blocks, rendered at %s\n", a.seconds, a.rate, a.block,
+                a.speed > 0.0 ? (juce::String(a.speed, 1) + "x real time").toRawUTF8() : "max");
+    std::printf("  realtime takes fade their first and last 2 ms, so they mismatch there even without drops\n");
+    std::printf("  %-12s %9s %10s %13s %10s %10s\n", "tap", "wall s", "x realtime", "waited s", "dropped", "mismatches");
+    int result = 0;
+    for (const bool nonRealtime : { false, true }) {
+        const auto r = runBounce(a, nonRealtime, file);
+        const bool exact = r.fileFrames == r.frames && r.mismatches == 0 && r.dropped == 0;
+        std::printf("  %-12s %9.2f %10.1f %13.3f %10d %10lld%s\n", nonRealtime ? "non-realtime" : "realtime", r.wallSec,
+                    r.wallSec > 0.0 ? (double) r.frames / a.rate / r.wallSec : 0.0, r.backpressureSec, r.dropped, (long long) r.mismatches,
+                    r.fileFrames != r.frames ? (" (file has " + juce::String(r.fileFrames) + " of " + juce::String(r.frames) + " frames)").toRawUTF8() : "");
+        if (nonRealtime && ! exact) result = 5;
+    }
+    if (a.out.isEmpty()) file.deleteFile();
+    return result;
+}
+
+// Pre-roll: what keeping the history costs the audio thread, then Record pressed with it full, once
+// for the history alone and once running on into live audio across the seam
+int benchPreRoll(const Args& a) {
+    constexpr int kChannels = 2;
+    constexpr double kLiveSeconds = 2.0;
+    const juce::File file = a.out.isNotEmpty() ? juce::File(a.out)
+                                               : juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("AudioBench_preroll.wav");
+    // Stamped blocks point into a precomputed period, so the timed write() is all the audio thread does
+    std::vector<float> stamps((size_t) (kStampPeriod + a.block));
+    for (size_t i = 0; i < stamps.size(); ++i) stamps[i] = stamp((juce::int64) i);
+    streaming::AudioTap tap;
+    tap.prepare(kChannels, 1 << 18);
+    auto writeBlock = [&] {
+        const juce::int64 frame = tap.getWritePosition();
+        const float* planes[kChannels] = { stamps.data() + frame % kStampPeriod, stamps.data() + (frame + kStampPeriod / 3) % kStampPeriod };
+        tap.write(planes, kChannels, a.block, a.rate);
+    };
+
+    AudioRecorder rec;
+    rec.setAudioSource(&tap);
+    rec.prepare(a.rate);
+    const auto fillBlocks = (int) std::ceil(a.seconds * 1.05 * a.rate / a.block);
+    const auto off = runAudioThread(a, juce::jmax(1, fillBlocks / 4), writeBlock);
+    rec.setPreRoll(a.seconds);
+    const auto on = runAudioThread(a, fillBlocks, writeBlock);
+
+    std::printf("preroll: %.0f s of 2 ch @ %d Hz (%.1f MB window, %s) in %d-sample blocks pushed at %s\n", rec.getPreRollSeconds(), a.rate,
+                rec.getPreRollSeconds() * a.rate * kChannels * sizeof(float) / 1e6, rec.isPreRollMapped() ? "memory-mapped" : "heap", a.block,
+                a.speed > 0.0 ? (juce::String(a.speed, 1) + "x real time").toRawUTF8() : "max");
+    std::printf("  %-22s %9s %9s %9s %7s\n", "audio thread", "mean us", "p99 us", "worst us", "allocs");
+    std::printf("  %-22s %9.3f %9.3f %9.3f %7ld\n", "pre-roll off", off.meanUs, off.p99Us, off.worstUs, off.allocations);
+    std::printf("  %-22s %9.3f %9.3f %9.3f %7ld\n", "pre-roll on", on.meanUs, on.p99Us, on.worstUs, on.allocations);
+
+    // The host keeps playing while the history is flushed
+    std::atomic<bool> done { false };
+    std::atomic<long> allocations { 0 };
+    std::thread audioThread([&] {
+        const auto blockPeriod = std::chrono::duration<double>(a.speed > 0.0 ? (double) a.block / a.rate / a.speed : 0.0);
+        auto next = std::chrono::steady_clock::now();
+        const long before = gProbedAllocations.load();
+        tProbeAllocations = true;
+        while (! done.load()) {
+            writeBlock();
+            if (a.speed > 0.0) {
+                next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockPeriod);
+                std::this_thread::sleep_until(next);
+            }
+        }
+        tProbeAllocations = false;
+        allocations.store(gProbedAllocations.load() - before);
+    });
+
+    std::printf("  %-22s %9s %9s %9s %9s %9s %8s\n", "take", "frames", "pre-roll", "flush s", "MB/s", "x rt", "errors");
+    int result = 0;
+    juce::WavAudioFormat wav;
+    for (const double liveSeconds : { 0.0, kLiveSeconds }) {
+        const auto t0 = std::chrono::steady_clock::now();
+        if (! rec.startRecording(file, kChannels, a.rate)) { std::printf("preroll: cannot open %s\n", file.getFullPathName().toRawUTF8()); result = 1; break; }
+        rec.stop(tap.getWritePosition() + (juce::int64) (liveSeconds * a.rate));
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        const auto take = rec.getLastTake();
+        const int dropped = rec.getDroppedSamples();
+
+        // Bit-exact between the 2 ms edge fades, and contiguous from the oldest pre-roll frame on
+        juce::int64 errors = 0;
+        const auto frames = take.endFrame - take.startFrame;
+        std::unique_ptr<juce::AudioFormatReader> in(wav.createReaderFor(new juce::FileInputStream(file), true));
+        if (in == nullptr || in->lengthInSamples != frames) errors = 1;
+        else {
+            const int fade = juce::jlimit(1, 512, juce::roundToInt(a.rate * 0.002));
+            constexpr int kChunk = 1 << 16;
+            juce::AudioBuffer<float> got(kChannels, kChunk);
+            for (juce::int64 pos = 0; pos < frames; pos += kChunk) {
+                const int n = (int) juce::jmin<juce::int64>(kChunk, frames - pos);
+                in->read(&got, 0, n, pos, true, true);
+                for (int i = 0; i < n; ++i) {
+                    const auto at = pos + i, frame = take.startFrame + at;
+                    if (at < fade || at >= frames - fade) continue;
+                    if (got.getSample(0, i) != stamp(frame) || got.getSample(1, i) != stamp(frame + kStampPeriod / 3)) ++errors;
+                }
+            }
+        }
+        // With live audio the take also waits for the host, so only the history alone measures the flush
+        const double mb = (double) frames * kChannels * 3 / 1e6;
+        if (liveSeconds > 0.0)
+            std::printf("  %-22s %9lld %9lld %9.3f %9s %9s %8lld\n", "pre-roll + 2 s live", (long long) frames, (long long) take.preRollFrames, sec, "-", "-", (long long) errors);
+        else
+            std::printf("  %-22s %9lld %9lld %9.3f %9.1f %9.1f %8lld\n", "pre-roll only", (long long) frames, (long long) take.preRollFrames, sec, mb / sec,
+                        (double) frames / a.rate / sec, (long long) errors);
+        if (dropped > 0) std::printf("  %d samples dropped\n", dropped);
+        if (errors > 0 || take.preRollFrames != (juce::int64) std::ceil(a.seconds * a.rate)) result = 5;
+        else if (dropped > 0 && a.speed > 0.0 && result == 0) result = 2;
+    }
+    done.store(true);
+    audioThread.join();
+    if (a.out.isEmpty()) file.deleteFile();
+    std::printf("  heap allocations on the audio thread: %ld\n", on.allocations + off.allocations + allocations.load());
+    if (on.allocations + off.allocations + allocations.load() > 0) return 3;
+    return result;
+}
+
+struct SegmentRun {
+    const char* name;
+    bool nonRealtime;
+    double seconds, speed, limitSeconds;
+    juce::int64 limitBytes;
+};
+
+// One take rolled over into segments, then every file read back in order: each must hold exactly
+// the segment length (the last one the rest) and together a gapless, bit-exact copy of the stamps
+int runSegments(const Args& a, const SegmentRun& run, const juce::File& first) {
+    constexpr int kChannels = 2;
+    streaming::AudioTap tap;
+    tap.prepare(kChannels, 1 << 18);
+    tap.setNonRealtime(run.nonRealtime);
+    AudioRecorder rec;
+    rec.setAudioSource(&tap);
+    rec.prepare(a.rate);
+    rec.setSegmentLimits(run.limitSeconds, run.limitBytes);
+    if (! rec.startRecording(first, kChannels, a.rate)) { std::printf("segments: cannot open %s\n", first.getFullPathName().toRawUTF8()); return 1; }
+
+    juce::AudioBuffer<float> block(kChannels, a.block);
+    const auto numBlocks = (juce::int64) (run.seconds * a.rate / a.block);
+    const auto blockPeriod = std::chrono::duration<double>(run.speed > 0.0 ? (double) a.block / a.rate / run.speed : 0.0);
+    const auto t0 = std::chrono::steady_clock::now();
+    auto next = t0;
+    for (juce::int64 b = 0; b < numBlocks; ++b) {
+        const juce::int64 frame = tap.getWritePosition();
+        for (int i = 0; i < a.block; ++i) {
+            block.setSample(0, i, stamp(frame + i));
+            block.setSample(1, i, stamp(frame + i + kStampPeriod / 3));
+        }
+        tap.write(block.getArrayOfReadPointers(), kChannels, a.block, a.rate);
+        if (run.speed > 0.0) {
+            next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(blockPeriod);
+            std::this_thread::sleep_until(next);
+        }
+    }
+    rec.stop();
+    const double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    const auto take = rec.getLastTake();
+    const int dropped = rec.getDroppedSamples();
+
+    juce::int64 segmentFrames = std::numeric_limits<juce::int64>::max();
+    if (run.limitSeconds > 0.0) segmentFrames = std::llround(run.limitSeconds * a.rate);
+    if (run.limitBytes > 0) segmentFrames = juce::jmin(segmentFrames, run.limitBytes / (kChannels * 3));
+    const auto frames = take.endFrame - take.startFrame;
+    const auto expectedSegments = (int) ((frames + segmentFrames - 1) / segmentFrames);
+
+    // Realtime takes fade their outer edges; the seams in between must be untouched either way
+    const int fade = run.nonRealtime ? 0 : juce::jlimit(1, 512, juce::roundToInt(a.rate * 0.002));
+    juce::WavAudioFormat wav;
+    juce::int64 pos = 0, mismatches = 0, badLengths = 0;
+    constexpr int kChunk = 1 << 16;
+    juce::AudioBuffer<float> got(kChannels, kChunk);
+    for (int index = 1; index <= take.segments; ++index) {
+        const auto file = AudioRecorder::getSegmentFile(first, index);
+        std::unique_ptr<juce::AudioFormatReader> in(wav.createReaderFor(new juce::FileInputStream(file), true));
+        if (in == nullptr) { ++badLengths; continue; }
+        const auto length = in->lengthInSamples;
+        if (length != (index < take.segments ? segmentFrames : frames - segmentFrames * (take.segments - 1))) ++badLengths;
+        for (juce::int64 at = 0; at < length; at += kChunk) {
+            const int n = (int) juce::jmin<juce::int64>(kChunk, length - at);
+            in->read(&got, 0, n, at, true, true);
+            for (int i = 0; i < n; ++i) {
+                const auto offset = pos + at + i, frame = take.startFrame + offset;
+                if (offset < fade || offset >= frames - fade) continue;
+                if (got.getSample(0, i) != stamp(frame) || got.getSample(1, i) != stamp(frame + kStampPeriod / 3)) ++mismatches;
+            }
+        }
+        pos += length;
+        in.reset();
+        if (a.out.isEmpty()) file.deleteFile();
+    }
+    // Nothing may be left of the file opened ahead for a segment that never came
+    const auto spare = AudioRecorder::getSegmentFile(first, take.segments + 1);
+    const bool leftover = spare.existsAsFile();
+    spare.deleteFile();
+
+    const bool exact = take.segments == expectedSegments && pos == frames && badLengths == 0 && mismatches == 0 && ! leftover;
+    std::printf("  %-24s %9.2f %8d %12lld %12lld %8d %10lld%s\n", run.name, wallSec, take.segments, (long long) segmentFrames, (long long) pos, dropped,
+                (long long) mismatches, exact ? "" : (" (expected " + juce::String(expectedSegments) + " segments, " + juce::String(frames) + " frames, "
+                                                      + juce::String(badLengths) + " bad lengths" + (leftover ? ", spare file left" : "") + ")").toRawUTF8());
+    if (! exact) return 5;
+    return dropped > 0 ? 2 : 0;
+}
+
+int benchSegments(const Args& a) {
+    const juce::File first = a.out.isNotEmpty() ? juce::File(a.out)
+                                                : juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("AudioBench_segments.wav");
+    // Limits that never line up with the block size, so switches fall mid-block
+    const SegmentRun runs[] = {
+        { "offline, every 7.77 s", true, a.seconds, 0.0, 7.77, 0 },
+        { "offline, every 1 MB", true, a.seconds, 0.0, 0.0, 1000000 },
+        { "realtime, every 1.3 s", false, juce::jmin(a.seconds, 20.0), a.speed, 1.3, 0 },
+    };
+    std::printf("segments: 2 ch @ %d Hz in %d-sample blocks, offline runs of %.0f s at max speed, realtime at %s\n", a.rate, a.block, a.seconds,
+                a.speed > 0.0 ? (juce::String(a.speed, 1) + "x real time").toRawUTF8() : "max");
+    std::printf("  %-24s %9s %8s %12s %12s %8s %10s\n", "run", "wall s", "files", "frames/file", "frames", "dropped", "mismatches");
+    int result = 0;
+    for (const auto& run : runs) {
+        const int r = runSegments(a, run, first);
+        if (r == 5 || (r != 0 && result == 0)) result = r;
+    }
+    return result;
+}
+
+// A few detuned partials under a slow swell with a noise floor, different per channel: compresses
+// roughly as a mix would, unlike silence or the stamp ramp
+std::vector<float> makeMusic(int channel, int frames, int rate) {
+    static const double partials[] = { 110.0, 220.7, 331.1, 441.9, 662.4, 1327.3, 2651.0 };
+    std::vector<float> out((size_t) frames);
+    juce::Random noise(17 + channel);
+    for (int i = 0; i < frames; ++i) {
+        const double t = (double) i / rate;
+        double v = 0.0;
+        for (int k = 0; k < 7; ++k)
+            v += 0.25 / (k + 1) * std::sin(juce::MathConstants<double>::twoPi * partials[k] * (1.0 + 0.003 * channel) * t + k * channel);
+        v *= 0.6 + 0.4 * std::sin(juce::MathConstants<double>::twoPi * (0.21 + 0.05 * channel) * t);
+        out[(size_t) i] = (float) (v + (noise.nextFloat() - 0.5f) * 4.0e-4f);
+    }
+    return out;
+}
+
+struct FlacTakeResult {
+    double wallSec = 0.0, encodeSec = 0.0;
+    juce::int64 frames = 0, fileBytes = 0;
+    int workers = 0, dropped = 0;
+    bool opened = false;
+};
+
+// One offline take of the music loop as fast as the non-realtime tap lets it go
+FlacTakeResult runFlacTake(const Args& a, const std::vector<float>* music, AudioRecorder::Format format, int workers, const juce::File& file) {
+    constexpr int kChannels = 2;
+    streaming::AudioTap tap;
+    tap.prepare(kChannels, 1 << 18);
+    tap.setNonRealtime(true);
+    AudioRecorder rec;
+    rec.setFormat(format, workers);
+    rec.setAudioSource(&tap);
+    rec.prepare(a.rate);
+    FlacTakeResult r;
+    if (! (r.opened = rec.startRecording(file, kChannels, a.rate))) return r;
+
+    const auto loop = (juce::int64) music[0].size();
+    const auto numBlocks = (juce::int64) (a.seconds * a.rate / a.block);
+    juce::AudioBuffer<float> block(kChannels, a.block);
+    const auto t0 = std::chrono::steady_clock::now();
+    for (juce::int64 b = 0; b < numBlocks; ++b) {
+        for (int ch = 0; ch < kChannels; ++ch)
+            for (int i = 0; i < a.block; ++i) block.setSample(ch, i, music[ch][(size_t) ((b * a.block + i) % loop)]);
+        tap.write(block.getArrayOfReadPointers(), kChannels, a.block, a.rate);
+    }
+    r.frames = numBlocks * a.block;
+    rec.stop(r.frames);
+    r.wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    r.dropped = rec.getDroppedSamples();
+    if (const auto* pool = rec.getFlacPool(); pool != nullptr && format == AudioRecorder::Format::flac) {
+        r.encodeSec = (double) pool->getEncodeMicros() * 1e-6;
+        r.workers = pool->getNumWorkers();
+    }
+    r.fileBytes = file.getSize();
+    return r;
+}
+
+// Decodes a FLAC take with JUCE's FLAC reader and compares it sample for sample with the WAV take
+// of the same audio (both readers scale 24-bit samples alike, so equal files give equal floats)
+juce::int64 compareFlacWithWav(const juce::File& flacFile, const juce::File& wavFile, juce::int64 frames, juce::String& error) {
+    juce::FlacAudioFormat flacFormat;
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::AudioFormatReader> flac(flacFormat.createReaderFor(new juce::FileInputStream(flacFile), true));
+    std::unique_ptr<juce::AudioFormatReader> reference(wavFormat.createReaderFor(new juce::FileInputStream(wavFile), true));
+    if (flac == nullptr || reference == nullptr || flac->numChannels != 2) { error = "cannot open the takes"; return -1; }
+    if (flac->lengthInSamples != frames || reference->lengthInSamples != frames) {
+        error = "FLAC has " + juce::String(flac->lengthInSamples) + " frames, WAV has " + juce::String(reference->lengthInSamples);
+        return -1;
+    }
+
+    juce::AudioBuffer<float> decoded(2, 4096), expected(2, 4096);
+    juce::int64 mismatches = 0;
+    for (juce::int64 pos = 0; pos < frames; pos += 4096) {
+        const int n = (int) juce::jmin<juce::int64>(4096, frames - pos);
+        if (! flac->read(&decoded, 0, n, pos, true, true)) { error = "FLAC read failed at frame " + juce::String(pos); return -1; }
+        reference->read(&expected, 0, n, pos, true, true);
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < n; ++i)
+                if (decoded.getSample(ch, i) != expected.getSample(ch, i)) ++mismatches;
+    }
+    return mismatches;
+}
+
+// The same offline take as WAV, as FLAC encoded on the drain thread and as FLAC on the encoder pool;
+// every FLAC file is decoded and must match the WAV sample for sample
+int benchFlac(const Args& a) {
+    constexpr int kChannels = 2;
+    const juce::File base = a.out.isNotEmpty() ? juce::File(a.out)
+                                               : juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("AudioBench_flac.wav");
+    const auto wavFile = base.withFileExtension("wav"), flacFile = base.withFileExtension("flac");
+    // An odd loop length, so frames never line up with it
+    const int loopFrames = (int) (7.3 * a.rate);
+    const std::vector<float> music[kChannels] = { makeMusic(0, loopFrames, a.rate), makeMusic(1, loopFrames, a.rate) };
+    const int poolWorkers = a.workers >= 0 ? a.workers : juce::jlimit(1, streaming::FlacEncodePool::kMaxWorkers, juce::SystemStats::getNumCpus() - 1);
+
+    std::printf("flac: %.0f s of 2 ch 24-bit @ %d Hz music-like signal in %d-sample blocks, offline at max speed, %d cores\n", a.seconds, a.rate,
+                a.block, juce::SystemStats::getNumCpus());
+    std::printf("  %-14s %8s %9s %10s %10s %9s %7s %18s %10s\n", "run", "workers", "wall s", "x realtime", "MB/s e2e", "file MB", "ratio",
+                "encode MB/s/core", "mismatches");
+    const auto wav = runFlacTake(a, music, AudioRecorder::Format::wav, -1, wavFile);
+    if (! wav.opened) { std::printf("flac: cannot open %s\n", wavFile.getFullPathName().toRawUTF8()); return 1; }
+    const double pcmMB = (double) wav.frames * kChannels * 3 / 1e6;
+    std::printf("  %-14s %8s %9.2f %10.1f %10.1f %9.1f %7.3f %18s %10s\n", "wav", "-", wav.wallSec, (double) wav.frames / a.rate / wav.wallSec,
+                pcmMB / wav.wallSec, (double) wav.fileBytes / 1e6, (double) wav.fileBytes / 1e6 / pcmMB, "-", "-");
+
+    int result = wav.dropped > 0 ? 2 : 0;
+    for (const int workers : { 0, poolWorkers }) {
+        const auto r = runFlacTake(a, music, AudioRecorder::Format::flac, workers, flacFile);
+        if (! r.opened) { std::printf("flac: cannot open %s\n", flacFile.getFullPathName().toRawUTF8()); return 1; }
+        juce::String error;
+        const auto mismatches = compareFlacWithWav(flacFile, wavFile, r.frames, error);
+        std::printf("  %-14s %8d %9.2f %10.1f %10.1f %9.1f %7.3f %18.1f %10lld%s\n", workers == 0 ? "flac, inline" : "flac, pool", r.workers, r.wallSec,
+                    (double) r.frames / a.rate / r.wallSec, pcmMB / r.wallSec, (double) r.fileBytes / 1e6, (double) r.fileBytes / 1e6 / pcmMB,
+                    r.encodeSec > 0.0 ? pcmMB / r.encodeSec : 0.0, (long long) juce::jmax<juce::int64>(0, mismatches),
+                    error.isNotEmpty() ? (" (" + error + ")").toRawUTF8() : "");
+        if (mismatches != 0) result = 5;
+        else if (r.dropped > 0 && result == 0) result = 2;
+        if (a.out.isEmpty()) flacFile.deleteFile();
+    }
+    if (a.out.isEmpty()) wavFile.deleteFile();
+    return result;
+}
+
+// The logger LogMessageFromAudioThread used before BinaryLog: a std::string per call queued under a
+// timed mutex, and a thread that stamps each line with ctime() and ends it with std::endl
+class LegacyLogger {
+public:
+    explicit LegacyLogger(const juce::File& file) : out(file.getFullPathName().toStdString(), std::ios::app), thread([this] { run(); }) {}
+    ~LegacyLogger() {
+        stopping.store(true);
+        cv.notify_all();
+        thread.join();
+    }
+    void log(const std::string& message) {
+        std::unique_lock<std::timed_mutex> lock(mutex, std::defer_lock);
+        if (lock.try_lock_for(std::chrono::milliseconds(2))) {
+            queue.push(message);
+            cv.notify_one();
+        } else {
+            dropped.fetch_add(1);
+        }
+    }
+    std::atomic<long> written { 0 }, dropped { 0 };
+
+private:
+    std::ofstream out;
+    std::queue<std::string> queue;
+    std::timed_mutex mutex;
+    std::condition_variable_any cv;
+    std::atomic<bool> stopping { false };
+    std::thread thread;
+
+    void run() {
+        std::unique_lock<std::timed_mutex> lock(mutex);
+        while (! stopping.load() || ! queue.empty()) {
+            cv.wait(lock, [this] { return ! queue.empty() || stopping.load(); });
+            while (! queue.empty()) {
+                const std::string message = queue.front();
+                queue.pop();
+                lock.unlock();
+                const time_t now = time(nullptr);
+                std::string stamp(ctime(&now));
+                if (! stamp.empty() && stamp.back() == '\n') stamp.pop_back();
+                out << "[" << stamp << "] " << message << std::endl;
+                written.fetch_add(1);
+                lock.lock();
+            }
+        }
+    }
+};
+
+// The audio thread logging kPerCallback records per 1 ms callback (100k records/s) through the old
+// string queue, through BinaryLog with a prebuilt juce::String and through LogEvent with raw arguments
+int benchLog(const Args& a) {
+    constexpr int kPerCallback = 100;
+    Args paced = a;
+    paced.block = juce::jmax(1, a.rate / 1000);
+    paced.speed = 1.0;
+    const int callbacks = (int) (a.seconds * 1000.0);
+    const auto calls = (juce::int64) callbacks * kPerCallback;
+    const auto dir = juce::File::getSpecialLocation(juce::File::tempDirectory);
+    const auto legacyFile = dir.getChildFile("AudioBench_log_legacy.txt"), binaryFile = dir.getChildFile("AudioBench_log.txt");
+    legacyFile.deleteFile();
+    binaryFile.deleteFile();
+
+    auto& log = streaming::BinaryLog::getInstance();
+    log.setOutputFile(binaryFile);
+    std::printf("log: %d records per 1 ms callback (%d k/s) for %.0f s from a simulated audio thread\n", kPerCallback, kPerCallback, a.seconds);
+    std::printf("  %-22s %10s %14s %14s %10s %10s %8s\n", "path", "ns/call", "p99 callback", "worst callback", "written", "dropped", "allocs");
+
+    int result = 0;
+    auto report = [&](const char* name, const BlockStats& st, juce::int64 written, juce::int64 dropped) {
+        std::printf("  %-22s %10.0f %11.1f us %11.1f us %10lld %10lld %8ld\n", name, st.meanUs * 1000.0 / kPerCallback, st.p99Us, st.worstUs,
+                    (long long) written, (long long) dropped, st.allocations);
+        if (written + dropped != calls) {
+            std::printf("  %s accounted for %lld of %lld records\n", name, (long long) (written + dropped), (long long) calls);
+            result = 5;
+        }
+    };
+
+    {
+        LegacyLogger legacy(legacyFile);
+        int i = 0;
+        const auto st = runAudioThread(paced, callbacks, [&] {
+            for (int k = 0; k < kPerCallback; ++k, ++i)
+                legacy.log(("AUDIO: block " + juce::String(i) + " peak " + juce::String(-6.0 - (i % 97) * 0.01, 2) + " dB").toStdString());
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        report("string queue (old)", st, legacy.written.load(), legacy.dropped.load());
+    }
+
+    for (const bool raw : { false, true }) {
+        const auto writtenBefore = (juce::int64) log.getWrittenRecords(), droppedBefore = (juce::int64) log.getDroppedRecords();
+        int i = 0;
+        // A first record claims the thread's ring before the probe is armed
+        const auto st = runAudioThread(paced, callbacks, [&, first = true]() mutable {
+            if (first) { tProbeAllocations = false; LogEvent("AUDIO: logging from this thread"); tProbeAllocations = true; first = false; }
+            for (int k = 0; k < kPerCallback; ++k, ++i) {
+                if (raw) LogEvent("AUDIO: block {} peak {} dB", i, -6.0 - (i % 97) * 0.01);
+                else LogMessageFromAudioThread("AUDIO: block " + juce::String(i) + " peak " + juce::String(-6.0 - (i % 97) * 0.01, 2) + " dB");
+            }
+        });
+        log.flush();
+        const auto written = (juce::int64) log.getWrittenRecords() - writtenBefore - 1;
+        report(raw ? "BinaryLog, LogEvent" : "BinaryLog, String", st, written, (juce::int64) log.getDroppedRecords() - droppedBefore);
+        if (raw && st.allocations > 0) result = 3;
+    }
+    if (a.out.isEmpty()) {
+        legacyFile.deleteFile();
+        binaryFile.deleteFile();
+    }
+    return result;
+}
+
+void printUsage() {
+    std::printf("Usage: AudioBench recorder [--seconds N] [--speed X] [--channels C] [--rate SR] [--block B] [--out file.wav]\n"
+                "       AudioBench convert [--seconds per-measurement budget, default 0.05]\n"
+                "       AudioBench aac [--seconds N, default 60] [--speed X] [--channels C] [--rate SR] [--block B]\n"
+                "       AudioBench drift [--seconds N, default 3600] [--rate stream SR] [--block B]\n"
+                "       AudioBench tap [--seconds N, default 30] [--speed X] [--channels C] [--rate SR] [--block B]\n"
+                "       AudioBench toggle [--cycles N, default 2000] [--speed X] [--rate SR] [--block B] [--out file.wav]\n"
+                "       AudioBench bounce [--seconds N, default 600] [--speed X, default 50] [--rate SR] [--block B] [--out file.wav]\n"
+                "       AudioBench preroll [--seconds pre-roll, default 120] [--speed X, default 16] [--rate SR] [--block B] [--out file.wav]\n"
+                "       AudioBench segments [--seconds N, default 600] [--speed X] [--rate SR] [--block B] [--out first.wav]\n"
+                "       AudioBench flac [--seconds N, default 300] [--workers W] [--rate SR] [--block B] [--out file]\n"
+                "       AudioBench log [--seconds N, default 5] [--rate SR] [--out keep]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) { printUsage(); return 1; }
+    const juce::String mode(argv[1]);
+    Args a;
+    bool secondsGiven = false, speedGiven = false;
+    for (int i = 2; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--seconds") == 0 && hasValue) { a.seconds = juce::String(argv[++i]).getDoubleValue(); secondsGiven = true; }
+        else if (std::strcmp(argv[i], "--speed") == 0 && hasValue) { a.speed = juce::String(argv[++i]).getDoubleValue(); speedGiven = true; }
+        else if (std::strcmp(argv[i], "--channels") == 0 && hasValue) a.channels = juce::jmax(1, juce::String(argv[++i]).getIntValue());
+        else if (std::strcmp(argv[i], "--rate") == 0 && hasValue) a.rate = juce::jmax(8000, juce::String(argv[++i]).getIntValue());
+        else if (std::strcmp(argv[i], "--block") == 0 && hasValue) a.block = juce::jmax(16, juce::String(argv[++i]).getIntValue());
+        else if (std::strcmp(argv[i], "--cycles") == 0 && hasValue) a.cycles = juce::jmax(1, juce::String(argv[++i]).getIntValue());
+        else if (std::strcmp(argv[i], "--workers") == 0 && hasValue) a.workers = juce::jmax(0, juce::String(argv[++i]).getIntValue());
+        else if (std::strcmp(argv[i], "--out") == 0 && hasValue) a.out = argv[++i];
+    }
+    if (mode == "recorder") return benchRecorder(a);
+    if (mode == "convert") {
+        if (! secondsGiven) a.seconds = 0.05;
+        return benchConvert(a);
+    }
+    if (mode == "aac") {
+        if (! secondsGiven) a.seconds = 60.0;
+        return benchAac(a);
+    }
+    if (mode == "drift") {
+        if (! secondsGiven) a.seconds = 3600.0;
+        return benchDrift(a);
+    }
+    if (mode == "tap") {
+        if (! secondsGiven) a.seconds = 30.0;
+        return benchTap(a);
+    }
+    if (mode == "toggle") return benchToggle(a);
+    if (mode == "bounce") {
+        if (! speedGiven) a.speed = 50.0;
+        return benchBounce(a);
+    }
+    if (mode == "preroll") {
+        if (! secondsGiven) a.seconds = 120.0;
+        if (! speedGiven) a.speed = 16.0;
+        return benchPreRoll(a);
+    }
+    if (mode == "segments") return benchSegments(a);
+    if (mode == "log") {
+        if (! secondsGiven) a.seconds = 5.0;
+        return benchLog(a);
+    }
+    if (mode == "flac") {
+        if (! secondsGiven) a.seconds = 300.0;
+        return benchFlac(a);
+    }
+    printUsage();
+    return 1;
+}
@@ -0,0 +1,325 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+ #include <arpa/inet.h>
+ #include <netinet/in.h>
+ #include <poll.h>
+ #include <sys/socket.h>
+ #include <unistd.h>
+ #define LOOPBACK_RTMP_SERVER 1
+#endif
+
+// Stand-in RTMP ingest for the benchmarks: listens on 127.0.0.1 (ephemeral port), answers the
+// simple handshake and connect/createStream/publish the way nginx-rtmp does for a publisher, and
+// then only reads. Media messages are counted, hashed (FNV-1a over audio/video bodies, in order)
+// and time-stamped on arrival so a test can check integrity and per-packet latency. An optional
+// read rate turns it into a slow ingest; a server that was never started is a dead one. Serves one
+// connection at a time; a client that reconnects is picked up again.
+class LoopbackRtmpServer {
+public:
+    struct Arrival { uint8_t type; uint32_t timestampMs; uint32_t size; juce::int64 arrivalNs; };
+
+    struct Stats {
+        int connections { 0 };
+        int handshakes { 0 };       // completed C0-C2 exchanges
+        int publishes { 0 };        // NetStream.Publish.Start sent
+        juce::String app, streamName;
+        juce::uint64 mediaMessages { 0 }; // audio + video
+        juce::uint64 mediaBytes { 0 };
+        juce::uint64 metadataMessages { 0 };
+        juce::uint64 bytesReceived { 0 };
+        juce::uint64 hash { kFnvOffset };
+    };
+
+    static constexpr juce::uint64 kFnvOffset = 1469598103934665603ull;
+    static juce::uint64 fnv1a(juce::uint64 h, const uint8_t* p, size_t n) noexcept {
+        for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 1099511628211ull; }
+        return h;
+    }
+
+    static juce::int64 nowNs() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+    LoopbackRtmpServer() = default;
+    ~LoopbackRtmpServer() { stop(); }
+
+    // readBytesPerSecond > 0 throttles what the server takes off the socket (with a small receive buffer)
+    bool start(double readBytesPerSecond = 0.0, size_t expectedMessages = 1 << 16) {
+#if LOOPBACK_RTMP_SERVER
+        readRate = readBytesPerSecond;
+        arrivals.reserve(expectedMessages);
+        listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) return false;
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (readRate > 0.0) { int rcv = 64 * 1024; setsockopt(listenFd, SOL_SOCKET, SO_RCVBUF, &rcv, sizeof(rcv)); }
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (::bind(listenFd, (sockaddr*) &addr, sizeof(addr)) != 0 || ::listen(listenFd, 4) != 0
+            || getsockname(listenFd, (sockaddr*) &addr, &len) != 0) { ::close(listenFd); listenFd = -1; return false; }
+        port = ntohs(addr.sin_port);
+        stopping.store(false);
+        thread = std::thread([this] { run(); });
+        return true;
+#else
+        juce::ignoreUnused(readBytesPerSecond, expectedMessages);
+        return false;
+#endif
+    }
+
+    void stop() {
+        stopping.store(true);
+        if (thread.joinable()) thread.join();
+#if LOOPBACK_RTMP_SERVER
+        if (listenFd >= 0) { ::close(listenFd); listenFd = -1; }
+#endif
+    }
+
+    int getPort() const { return port; }
+    juce::String url(const juce::String& streamName) const { return "rtmp://127.0.0.1:" + juce::String(port) + "/live/" + streamName; }
+
+    Stats getStats() const { std::lock_guard<std::mutex> lk(statsMutex); return stats; }
+    std::vector<Arrival> getArrivals() const { std::lock_guard<std::mutex> lk(statsMutex); return arrivals; }
+
+private:
+    double readRate { 0.0 };
+    int listenFd { -1 }, port { 0 };
+    std::atomic<bool> stopping { false };
+    std::thread thread;
+    mutable std::mutex statsMutex;
+    Stats stats;
+    std::vector<Arrival> arrivals;
+
+#if LOOPBACK_RTMP_SERVER
+    // Per-connection state
+    struct ChunkStream { uint32_t ts { 0 }, delta { 0 }, len { 0 }, sid { 0 }; uint8_t type { 0 }; bool extTs { false }; std::vector<uint8_t> msg; };
+    int fd { -1 };
+    uint32_t inChunkSize { 128 };
+    uint32_t ackWindow { 0 };
+    juce::uint64 received { 0 }, lastAck { 0 };
+    juce::int64 readStartNs { 0 };
+    std::vector<ChunkStream> streams;
+
+    void run() {
+        while (!stopping.load()) {
+            pollfd pfd { listenFd, POLLIN, 0 };
+            if (::poll(&pfd, 1, 50) <= 0) continue;
+            fd = ::accept(listenFd, nullptr, nullptr);
+            if (fd < 0) continue;
+            { std::lock_guard<std::mutex> lk(statsMutex); ++stats.connections; }
+            serve();
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    bool recvAll(uint8_t* p, size_t n) {
+        while (n > 0) {
+            if (stopping.load()) return false;
+            pollfd pfd { fd, POLLIN, 0 };
+            const int rc = ::poll(&pfd, 1, 50);
+            if (rc < 0 && errno != EINTR) return false;
+            if (rc <= 0) continue;
+            const size_t want = readRate > 0.0 ? juce::jmin<size_t>(n, 16 * 1024) : n;
+            const ssize_t r = ::recv(fd, p, want, 0);
+            if (r <= 0) return false;
+            p += r; n -= (size_t) r; received += (juce::uint64) r;
+            if (readRate > 0.0) {
+                // Hold the average read rate: sleep until these bytes would have been due
+                const auto dueNs = readStartNs + (juce::int64) ((double) received / readRate * 1e9);
+                const auto waitNs = dueNs - nowNs();
+                if (waitNs > 0) std::this_thread::sleep_for(std::chrono::nanoseconds(waitNs));
+            }
+        }
+        return true;
+    }
+
+    bool sendAll(const uint8_t* p, size_t n) {
+        while (n > 0) {
+            const ssize_t w = ::send(fd, p, n, 0);
+            if (w <= 0) return false;
+            p += w; n -= (size_t) w;
+        }
+        return true;
+    }
+
+    // One message in 128-byte chunks (the server never raises its own chunk size)
+    bool sendMessage(int csid, uint8_t type, uint32_t sid, const std::vector<uint8_t>& body) {
+        std::vector<uint8_t> out { (uint8_t) csid, 0, 0, 0, (uint8_t) (body.size() >> 16), (uint8_t) (body.size() >> 8), (uint8_t) body.size(), type,
+                                   (uint8_t) sid, (uint8_t) (sid >> 8), (uint8_t) (sid >> 16), (uint8_t) (sid >> 24) };
+        for (size_t off = 0; off < body.size(); off += 128) {
+            if (off > 0) out.push_back((uint8_t) (0xC0 | csid));
+            out.insert(out.end(), body.begin() + (std::ptrdiff_t) off, body.begin() + (std::ptrdiff_t) juce::jmin(body.size(), off + 128));
+        }
+        return sendAll(out.data(), out.size());
+    }
+
+    bool sendControl(uint8_t type, uint32_t value, int extraByte = -1) {
+        std::vector<uint8_t> b { (uint8_t) (value >> 24), (uint8_t) (value >> 16), (uint8_t) (value >> 8), (uint8_t) value };
+        if (extraByte >= 0) b.push_back((uint8_t) extraByte);
+        return sendMessage(2, type, 0, b);
+    }
+
+    static void amfString(std::vector<uint8_t>& b, const char* s, bool marker = true) {
+        const auto n = strlen(s);
+        if (marker) b.push_back(0x02);
+        b.push_back((uint8_t) (n >> 8)); b.push_back((uint8_t) n);
+        b.insert(b.end(), s, s + n);
+    }
+    static void amfNumber(std::vector<uint8_t>& b, double v) {
+        uint64_t bits; memcpy(&bits, &v, 8);
+        b.push_back(0x00);
+        for (int i = 7; i >= 0; --i) b.push_back((uint8_t) (bits >> (i * 8)));
+    }
+    static void amfStatus(std::vector<uint8_t>& b, const char* code) {
+        b.push_back(0x03);
+        amfString(b, "level", false); amfString(b, "status");
+        amfString(b, "code", false); amfString(b, code);
+        b.push_back(0); b.push_back(0); b.push_back(0x09);
+    }
+
+    // Reads an AMF0 string at p (marker included); false if there is none
+    static bool readAmfString(const uint8_t*& p, const uint8_t* end, juce::String& out) {
+        if (end - p < 3 || p[0] != 0x02) return false;
+        const size_t n = ((size_t) p[1] << 8) | p[2];
+        if ((size_t) (end - p) < 3 + n) return false;
+        out = juce::String::fromUTF8((const char*) p + 3, (int) n);
+        p += 3 + n;
+        return true;
+    }
+
+    bool handshake() {
+        std::vector<uint8_t> c0c1(1537), c2(1536), s(1 + 1536 + 1536, 0);
+        if (!recvAll(c0c1.data(), c0c1.size()) || c0c1[0] != 3) return false;
+        s[0] = 3;                                            // S0
+        for (size_t i = 9; i < 1537; ++i) s[i] = (uint8_t) (i * 131u); // S1: time and zero fields 0, filler
+        memcpy(s.data() + 1537, c0c1.data() + 1, 1536);      // S2 echoes C1
+        if (!sendAll(s.data(), s.size()) || !recvAll(c2.data(), c2.size())) return false;
+        std::lock_guard<std::mutex> lk(statsMutex);
+        ++stats.handshakes;
+        return true;
+    }
+
+    void serve() {
+        inChunkSize = 128; ackWindow = 0; received = lastAck = 0;
+        streams.assign(64, ChunkStream {});
+        readStartNs = nowNs();
+        if (!handshake()) return;
+        for (;;) {
+            uint8_t b0;
+            if (!recvAll(&b0, 1)) return;
+            const int fmt = b0 >> 6;
+            int csid = b0 & 0x3F;
+            uint8_t ext[2];
+            if (csid == 0) { if (!recvAll(ext, 1)) return; csid = 64 + ext[0]; }
+            else if (csid == 1) { if (!recvAll(ext, 2)) return; csid = 64 + ext[0] + 256 * ext[1]; }
+            auto& cs = streams[(size_t) (csid & 63)];
+            uint8_t h[11];
+            const size_t hLen = fmt == 0 ? 11 : fmt == 1 ? 7 : fmt == 2 ? 3 : 0;
+            if (hLen > 0 && !recvAll(h, hLen)) return;
+            uint32_t tsField = 0;
+            if (fmt <= 2) { tsField = ((uint32_t) h[0] << 16) | ((uint32_t) h[1] << 8) | h[2]; cs.extTs = tsField == 0xFFFFFF; }
+            if (fmt <= 1) { cs.len = ((uint32_t) h[3] << 16) | ((uint32_t) h[4] << 8) | h[5]; cs.type = h[6]; }
+            if (fmt == 0) cs.sid = h[7] | (h[8] << 8) | (h[9] << 16) | ((uint32_t) h[10] << 24);
+            if (cs.extTs) {
+                uint8_t e[4];
+                if (!recvAll(e, 4)) return;
+                tsField = ((uint32_t) e[0] << 24) | ((uint32_t) e[1] << 16) | ((uint32_t) e[2] << 8) | e[3];
+            }
+            if (cs.msg.empty()) {
+                if (fmt == 0) cs.ts = tsField;
+                else if (fmt <= 2) { cs.delta = tsField; cs.ts += tsField; }
+                else cs.ts += cs.delta;
+            }
+            if (cs.len > 16 * 1024 * 1024) return;
+            const size_t have = cs.msg.size(), take = juce::jmin<size_t>(inChunkSize, cs.len - have);
+            cs.msg.resize(have + take);
+            if (take > 0 && !recvAll(cs.msg.data() + have, take)) return;
+            if (cs.msg.size() < cs.len) continue;
+            const bool ok = handleMessage(cs);
+            cs.msg.clear();
+            if (!ok) return;
+            if (ackWindow > 0 && received - lastAck >= ackWindow) { lastAck = received; sendControl(3, (uint32_t) received); }
+        }
+    }
+
+    bool handleMessage(const ChunkStream& cs) {
+        const uint8_t* p = cs.msg.data();
+        const uint8_t* end = p + cs.msg.size();
+        const auto rb32 = [](const uint8_t* q) { return ((uint32_t) q[0] << 24) | ((uint32_t) q[1] << 16) | ((uint32_t) q[2] << 8) | q[3]; };
+        switch (cs.type) {
+            case 1: if (cs.msg.size() >= 4) inChunkSize = juce::jmax<uint32_t>(1, rb32(p) & 0x7FFFFFFF); return true;
+            case 5: if (cs.msg.size() >= 4) ackWindow = rb32(p); return true;
+            case 8: case 9: {
+                std::lock_guard<std::mutex> lk(statsMutex);
+                ++stats.mediaMessages;
+                stats.mediaBytes += cs.msg.size();
+                stats.bytesReceived = received;
+                stats.hash = fnv1a(stats.hash, p, cs.msg.size());
+                arrivals.push_back({ cs.type, cs.ts, (uint32_t) cs.msg.size(), nowNs() });
+                return true;
+            }
+            case 18: { std::lock_guard<std::mutex> lk(statsMutex); ++stats.metadataMessages; return true; }
+            case 20: break;
+            default: return true;
+        }
+        juce::String name;
+        if (!readAmfString(p, end, name) || end - p < 9 || *p != 0x00) return true;
+        uint64_t bits = 0;
+        for (int i = 1; i <= 8; ++i) bits = (bits << 8) | p[i];
+        double txn; memcpy(&txn, &bits, 8);
+        p += 9;
+        std::vector<uint8_t> reply;
+        if (name == "connect") {
+            // Command object: pick out "app"
+            juce::String app;
+            if (p < end && *p == 0x03) {
+                ++p;
+                while (end - p >= 3 && !(p[0] == 0 && p[1] == 0 && p[2] == 0x09)) {
+                    const size_t n = ((size_t) p[0] << 8) | p[1];
+                    if ((size_t) (end - p) < 2 + n) break;
+                    const juce::String key = juce::String::fromUTF8((const char*) p + 2, (int) n);
+                    p += 2 + n;
+                    juce::String value;
+                    if (readAmfString(p, end, value)) { if (key == "app") app = value; }
+                    else if (p < end && *p == 0x00) p += 9;
+                    else if (p < end && *p == 0x01) p += 2;
+                    else break;
+                }
+            }
+            { std::lock_guard<std::mutex> lk(statsMutex); stats.app = app; }
+            sendControl(5, 2500000);
+            sendControl(6, 2500000, 2);
+            amfString(reply, "_result"); amfNumber(reply, txn); reply.push_back(0x05);
+            amfStatus(reply, "NetConnection.Connect.Success");
+            return sendMessage(3, 20, 0, reply);
+        }
+        if (name == "createStream") {
+            amfString(reply, "_result"); amfNumber(reply, txn); reply.push_back(0x05); amfNumber(reply, 1.0);
+            return sendMessage(3, 20, 0, reply);
+        }
+        if (name == "publish") {
+            juce::String stream;
+            if (p < end && *p == 0x05) ++p;
+            readAmfString(p, end, stream);
+            amfString(reply, "onStatus"); amfNumber(reply, 0.0); reply.push_back(0x05);
+            amfStatus(reply, "NetStream.Publish.Start");
+            if (!sendMessage(5, 20, 1, reply)) return false;
+            std::lock_guard<std::mutex> lk(statsMutex);
+            stats.streamName = stream;
+            ++stats.publishes;
+            return true;
+        }
+        return true; // releaseStream, FCPublish, FCUnpublish, deleteStream: no reply needed
+    }
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE(LoopbackRtmpServer)
+};
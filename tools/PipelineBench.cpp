@@ -0,0 +1,1967 @@
+#include "../src/AbrController.h"
+#include "../src/AudioRecorder.h"
+#include "../src/AudioTap.h"
+#include "../src/EncoderControl.h"
+#include "../src/FfmpegRtmpWriter.h"
+#include "../src/FlvMuxer.h"
+#include "../src/GopDropper.h"
+#include "../src/LoadGenerator.h"
+#include "../src/Logging.h"
+#include "../src/MediaBuffer.h"
+#include "../src/PacingScheduler.h"
+#include "../src/PacketRing.h"
+#include "../src/RtmpClient.h"
+#include "../src/SampleConvert.h"
+#include "../src/Trace.h"
+#include "LoopbackRtmpServer.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <utility>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+ #include <arpa/inet.h>
+ #include <csignal>
+ #include <netinet/in.h>
+ #include <netinet/tcp.h>
+ #include <sys/resource.h>
+ #include <sys/socket.h>
+ #include <sys/uio.h>
+ #include <unistd.h>
+ #define PIPELINE_BENCH_SOCKETS 1
+#endif
+
+#if HAVE_FFMPEG
+extern "C" {
+ #include <libavcodec/avcodec.h>
+ #include <libavformat/avformat.h>
+ #include <libavutil/opt.h>
+}
+#endif
+
+// Regression suite for the streaming and recording hot paths: fixed, seeded workloads, each run
+// --repeat times, with the median of every metric written as JSON for comparing releases. No plugin
+// host, encoder or server needed; the only sinks are a temp file and a loopback TCP socket.
+//   PipelineBench [--cases recorder,interleave,ring,copies,egress,flv,gopdrop,frames,log,tracegate,abr,rtmp,fanout,writers] [--repeat N] [--seconds N] [--speed X] [--json file]
+// recorder  pushes --seconds (default 120) of stereo 48 kHz audio in 512-frame blocks through an
+//           AudioTap into AudioRecorder at --speed (default 32) times real time: tap write latency
+//           on the pushing thread, CPU per recorded hour, stop() latency and drops.
+// interleave  SampleConvert::toInt16 on 1024-frame stereo blocks, as the A+V writer converts the tap
+//           for its file: ns per call (percentiles over batches of 16 calls) and samples per second.
+// ring      PacketRing against the mutex + std::deque of vector copies it replaced: one thread pushes 50k
+//           egress-shaped packets (video 2:1 over audio, a keyframe every 90) copied in, one every 50 us,
+//           while another polls, takes and releases them; then the ring again with packets queued by
+//           reference, as the writer queues video. Push call ns (successful calls), take ns and
+//           push-to-consumer handoff ns for each, and how often the ring was full.
+// copies    --seconds (default 60) of 1080p60 H.264 at 9 Mbit/s through the stages that used to copy every
+//           access unit (encoder output into a MediaBuffer, the egress ring push, the fan-out tag and,
+//           at --speed (default 16), RtmpClient sending through an endpoint's token bucket to a loopback
+//           server), once copying as before and once by reference: payload bytes copied per stream
+//           second per stage (MediaBuffer::getCopiedBytes) and ns per frame (the first three stages).
+// egress    the FfmpegRtmpWriter egress shape without FFmpeg: a 6 Mbps / 30 fps video producer (by
+//           reference, GOP of 60) and a 160 kbps AAC producer (copied) push into one PacketRing each;
+//           one thread merges them by PTS, waits for each packet's due time, applies the GOP dropper
+//           and the token bucket, muxes with FlvMuxer and writes to a loopback socket. --seconds of
+//           stream (default 60) at --speed (default 16): queue and lateness percentiles, inter-send
+//           jitter (each send gap against its due gap) as percentiles and a bucketed histogram, drops,
+//           throughput, bytes copied.
+// flv       FlvMuxer over 20k AVCC and 20k Annex B frames into a temp file: ns per tag and MB/s. With
+//           FFmpeg, also 20 s of interleaved 30 fps video (keyframes, B-frame offsets) and AAC through
+//           FlvMuxer and libavformat's bitexact flvenc into memory, AVCC and Annex B input: ns per tag
+//           for both, and exit 5 unless the files are byte-identical (flvenc adds only its end-of-sequence tag).
+// gopdrop   FFmpeg only: 20 s of a 1 Mbit/s H.264 test pattern from libx264 (else libopenh264, else
+//           the build's default H.264 encoder; skipped if that cannot be opened), each access
+//           unit through a PacketRing and GopDropper fed by a simulated link that runs more than 1 s
+//           behind in two congested windows, then decoded with libavcodec. Shed and decoded frames,
+//           gaps, IDR requests and any corrupt frames, with per-frame drops as a control. Exit 5 unless
+//           the GOP-aware stream opened a gap and decoded every admitted frame without errors.
+// frames    LoadGenerator drawing 600 1080p frames spread over its 60 s "capacity" scenario (pans, cuts,
+//           noise spikes, a still), in BGRA and NV12: us per frame and frames/s. A second generator
+//           redraws every 10th frame in reverse order and 60 s of audio is rendered in 512- and
+//           441-frame blocks; exit 5 unless both match.
+// log       one thread issuing 1M LogEvent calls as fast as it can into BinaryLog: ns per call,
+//           records/s written and the share dropped.
+// tracegate the egress thread at 1080p60 / 9 Mbit/s plus AAC (--seconds, default 30, at --speed, default 16)
+//           muxing into a loopback socket and handing modelled libav* rtmp/tls lines to the FFmpeg log
+//           bridge three ways: ungated as before (every line formatted and logged), gated by Trace at
+//           the default level, and with rtmp and tls tracing on. Egress thread CPU per stream hour, the
+//           bridge's own share and ns per line, and what the gate saves as a share of one core. The
+//           lines are a model, so the bridge and savings keys start with "model" and are not a
+//           measurement of FfmpegRtmpWriter against FFmpeg's own logging.
+// abr       AbrController fed 500 ms samples from a simulated bottleneck (queue delay, RTT growing with
+//           the standing queue) that narrows from 8 to 2.5 Mbit/s at 60 s and widens again at 150 s, in
+//           simulated time: time to the ceiling, to back off and to recover, the settled target and
+//           queue delay. Exit 5 unless it backs off within 10 s, settles at 50-100% of the narrow link
+//           below the congestion threshold and climbs back to the ceiling.
+// rtmp      RtmpClient publishing --seconds (default 20) of 6 Mbps / 30 fps video and AAC to the loopback
+//           RTMP stand-in server (LoopbackRtmpServer.h), natively and, with FFmpeg, through libavformat's
+//           writer thread: once at --speed (default 8) for per-packet latency (sendTag call to server
+//           arrival), once flat out for sustained Mbit/s; sendTag call time in both. Then natively once more
+//           with the client's token bucket set as a fan-out endpoint sets it, shared tags in, so every
+//           keyframe waits and goes out in paced slices. Exit 5 unless the handshake and publish completed
+//           and every media message arrived intact and in order.
+// fanout    RtmpMultiPublisher fanning the same stream (--seconds, default 20, at --speed, default 4) out to
+//           two fast loopback servers, one that reads at half the stream rate and one dead port:
+//           publisher sendTag call time, per-message latency on the fast endpoints, aggregate Mbit/s,
+//           what the slow endpoint shed and the dead one's reconnects. Exit 5 unless both fast
+//           endpoints got every message intact and the slow one stayed connected.
+// writers   FfmpegRtmpWriter stress, FFmpeg only: four writers publish --seconds (default 10) of 6 Mbps video
+//           and AAC in real time to their own loopback server, each fed by a video and an audio thread;
+//           one server reads at a quarter of the stream rate. Then 20 cycles of close() while both
+//           producers push unpaced. Latency and video inter-arrival gaps on the fast writers, what the
+//           slow one shed, close() time. Exit 5 unless every fast writer delivered every frame with no
+//           gap over 250 ms and every close left its rings empty.
+// Exit 5 if a sink lost bytes or a file came out short, 2 if a paced run dropped anything. A case this
+// build cannot run is listed as skipped (status "skipped" in the JSON), never as passed.
+
+namespace {
+
+struct Args {
+    juce::String cases = "recorder,interleave,ring,copies,egress,flv,gopdrop,frames,log,tracegate,abr,rtmp,fanout,writers";
+    int repeat = 3;
+    double seconds = -1.0; // per-case default
+    double speed = -1.0;
+    juce::String json;
+};
+
+// A case that cannot run in this build (no sockets, no FFmpeg) returns this; it is reported as skipped
+// rather than passed
+constexpr int kSkipped = -1;
+
+double secondsOr(const Args& a, double fallback) { return a.seconds > 0.0 ? a.seconds : fallback; }
+double speedOr(const Args& a, double fallback) { return a.speed > 0.0 ? a.speed : fallback; }
+
+juce::int64 nowNs() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+double processCpuSec() {
+#if PIPELINE_BENCH_SOCKETS
+    rusage ru {};
+    getrusage(RUSAGE_SELF, &ru);
+    return (double) ru.ru_utime.tv_sec + (double) ru.ru_utime.tv_usec * 1e-6 + (double) ru.ru_stime.tv_sec + (double) ru.ru_stime.tv_usec * 1e-6;
+#else
+    return 0.0;
+#endif
+}
+
+// CPU time of the calling thread alone, for charging work to the one thread that did it
+double threadCpuSec() {
+#if PIPELINE_BENCH_SOCKETS
+    timespec ts {};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+#endif
+    return 0.0;
+}
+
+// Raw samples, reserved before the timed loop so recording one never allocates
+struct Samples {
+    explicit Samples(size_t expected) { values.reserve(expected); }
+    void add(double v) { values.push_back(v); }
+    double percentile(double p) {
+        if (values.empty()) return 0.0;
+        std::sort(values.begin(), values.end());
+        return values[juce::jlimit<size_t>(0, values.size() - 1, (size_t) std::ceil(p / 100.0 * (double) values.size()) - 1)];
+    }
+    std::vector<double> values;
+};
+
+// One run's numbers, in the order they were set
+struct Metrics {
+    void set(const juce::String& key, double v) { keys.add(key); values.push_back(v); }
+    void latency(const juce::String& key, Samples& s) {
+        double sum = 0.0;
+        for (double v : s.values) sum += v;
+        set(key + ".mean", s.values.empty() ? 0.0 : sum / (double) s.values.size());
+        set(key + ".p50", s.percentile(50.0));
+        set(key + ".p90", s.percentile(90.0));
+        set(key + ".p99", s.percentile(99.0));
+        set(key + ".p999", s.percentile(99.9));
+        set(key + ".max", s.percentile(100.0));
+    }
+    juce::StringArray keys;
+    std::vector<double> values;
+};
+
+double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    return v.empty() ? 0.0 : (v.size() % 2 == 1 ? v[v.size() / 2] : 0.5 * (v[v.size() / 2 - 1] + v[v.size() / 2]));
+}
+
+// ---- recorder --------------------------------------------------------------------------------
+
+int runRecorder(const Args& a, Metrics& m) {
+    constexpr int kChannels = 2, kRate = 48000, kBlock = 512;
+    const double seconds = secondsOr(a, 120.0), speed = speedOr(a, 32.0);
+    const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("PipelineBench_recorder.wav");
+    streaming::AudioTap tap;
+    tap.prepare(kChannels, 1 << 18);
+    AudioRecorder rec;
+    rec.prepare(kRate);
+    rec.setAudioSource(&tap);
+    if (! rec.startRecording(file, kChannels, kRate)) { std::printf("recorder: cannot open %s\n", file.getFullPathName().toRawUTF8()); return 5; }
+
+    juce::AudioBuffer<float> block(kChannels, kBlock);
+    for (int ch = 0; ch < kChannels; ++ch)
+        for (int i = 0; i < kBlock; ++i) block.setSample(ch, i, 0.25f * (float) std::sin(2.0 * juce::MathConstants<double>::pi * 997.0 * i / kRate + ch));
+
+    const auto numBlocks = (juce::int64) (seconds * kRate / kBlock);
+    const auto periodUs = (double) kBlock / kRate / speed * 1e6;
+    Samples writeNs((size_t) numBlocks);
+    const double cpu0 = processCpuSec();
+    const auto t0 = streaming::PrecisionClock::nowMicros();
+    for (juce::int64 i = 0; i < numBlocks; ++i) {
+        const auto p0 = nowNs();
+        tap.write(block.getArrayOfReadPointers(), kChannels, kBlock, kRate);
+        writeNs.add((double) (nowNs() - p0));
+        streaming::PrecisionClock::sleepUntilMicros(t0 + (juce::int64) ((double) (i + 1) * periodUs));
+    }
+    const auto s0 = nowNs();
+    rec.stop();
+    const double stopMs = (double) (nowNs() - s0) * 1e-6;
+    const double cpuSec = processCpuSec() - cpu0;
+    const double recordedSec = (double) numBlocks * kBlock / kRate;
+    const auto bytes = file.getSize();
+    file.deleteFile();
+
+    m.set("audioSeconds", recordedSec);
+    m.set("speed", speed);
+    m.latency("tapWriteNs", writeNs);
+    m.set("stopMs", stopMs);
+    m.set("cpuSecPerRecordedHour", cpuSec / recordedSec * 3600.0);
+    m.set("droppedSamples", rec.getDroppedSamples());
+    // 16-bit stereo at the least, plus the header
+    if (bytes < (juce::int64) numBlocks * kBlock * kChannels * 2) { std::printf("recorder: file is %lld bytes, short\n", (long long) bytes); return 5; }
+    return rec.getDroppedSamples() > 0 ? 2 : 0;
+}
+
+// ---- interleave ------------------------------------------------------------------------------
+
+int runInterleave(const Args&, Metrics& m) {
+    constexpr int kChannels = 2, kFrames = 1024, kBatch = 16, kBatches = 20000;
+    std::vector<float> planar((size_t) kChannels * kFrames);
+    juce::uint32 x = 0x12345678u;
+    for (auto& s : planar) { x = x * 1664525u + 1013904223u; s = (float) ((double) x / 4294967296.0 * 2.2 - 1.1); } // a few samples clip
+    const float* src[kChannels] = { planar.data(), planar.data() + kFrames };
+    std::vector<int16_t> out((size_t) kChannels * kFrames);
+
+    for (int i = 0; i < 256; ++i) SampleConvert::toInt16(src, kChannels, kFrames, out.data()); // warm caches and the dispatcher
+    Samples callNs(kBatches);
+    const auto t0 = nowNs();
+    for (int b = 0; b < kBatches; ++b) {
+        const auto b0 = nowNs();
+        for (int i = 0; i < kBatch; ++i) SampleConvert::toInt16(src, kChannels, kFrames, out.data());
+        callNs.add((double) (nowNs() - b0) / kBatch);
+    }
+    const double sec = (double) (nowNs() - t0) * 1e-9;
+    m.latency("toInt16CallNs", callNs);
+    m.set("msamplesPerSec", (double) kBatches * kBatch * kFrames * kChannels / sec / 1e6);
+    return 0;
+}
+
+// ---- ring ------------------------------------------------------------------------------------
+
+// The queue PacketRing replaced in the writer: a mutex-guarded deque of per-packet vector copies
+class DequeQueue {
+public:
+    struct Packet { std::vector<uint8_t> data; juce::int64 ptsMs; bool isVideo, keyframe; };
+    bool push(const void* data, size_t size, juce::int64 ptsMs, bool isVideo, bool keyframe) {
+        const auto* p = static_cast<const uint8_t*>(data);
+        std::lock_guard<std::mutex> lk(mutex);
+        queue.push_back({ std::vector<uint8_t>(p, p + size), ptsMs, isVideo, keyframe });
+        return true;
+    }
+    bool pop(Packet& out) {
+        std::lock_guard<std::mutex> lk(mutex);
+        if (queue.empty()) return false;
+        out = std::move(queue.front());
+        queue.pop_front();
+        return true;
+    }
+private:
+    std::mutex mutex;
+    std::deque<Packet> queue;
+};
+
+// One producer pushes an egress-shaped packet mix every kIntervalUs while one consumer polls: the
+// producer's call time, the consumer's take-and-release time and the handoff from push to consumer
+template <typename Push, typename Take>
+void measureQueue(const std::vector<size_t>& sizes, const std::vector<uint8_t>& payload, Push&& push, Take&& take, const juce::String& key, Metrics& m) {
+    constexpr juce::int64 kIntervalUs = 50;
+    const size_t count = sizes.size();
+    std::vector<juce::int64> pushNs(count);
+    Samples pushCallNs(count), takeNs(count), handoffNs(count);
+    juce::uint64 fullRetries = 0;
+    std::thread consumer([&] {
+        for (size_t i = 0; i < count;) {
+            const auto t0 = nowNs();
+            if (! take()) { std::this_thread::yield(); continue; }
+            const auto t1 = nowNs();
+            takeNs.add((double) (t1 - t0));
+            handoffNs.add((double) (t1 - pushNs[i]));
+            ++i;
+        }
+    });
+    const auto startUs = streaming::PrecisionClock::nowMicros() + 1000;
+    for (size_t i = 0; i < count; ++i) {
+        streaming::PrecisionClock::sleepUntilMicros(startUs + (juce::int64) i * kIntervalUs);
+        pushNs[i] = nowNs();
+        for (;;) {
+            const auto c0 = nowNs();
+            const bool ok = push(payload.data(), sizes[i], (juce::int64) i, i % 3 != 2, i % 90 == 0);
+            const auto c1 = nowNs();
+            if (ok) { pushCallNs.add((double) (c1 - c0)); break; }
+            ++fullRetries;
+            std::this_thread::yield();
+        }
+    }
+    consumer.join();
+    m.latency(key + ".pushNs", pushCallNs);
+    m.latency(key + ".takeNs", takeNs);
+    m.latency(key + ".handoffNs", handoffNs);
+    m.set(key + ".fullRetries", (double) fullRetries);
+}
+
+int runRing(const Args&, Metrics& m) {
+    constexpr int kPackets = 50000;
+    // Two video packets to each audio one; P frames ~25 KB +-25%, a keyframe 8x that every 90th packet, AAC 683 bytes
+    std::vector<size_t> sizes(kPackets);
+    juce::uint32 x = 0xC0FFEEu;
+    for (int i = 0; i < kPackets; ++i) {
+        x = x * 1664525u + 1013904223u;
+        sizes[(size_t) i] = i % 3 == 2 ? 683 : (size_t) (25000.0 * (i % 90 == 0 ? 8.0 : 1.0) * (0.75 + 0.5 * (double) x / 4294967296.0));
+    }
+    const std::vector<uint8_t> payload(*std::max_element(sizes.begin(), sizes.end()), 0x5a);
+
+    // Slot and slab sizes as FfmpegRtmpWriter allocates its video ring
+    streaming::PacketRing ring;
+    ring.allocate(512, 8u << 20);
+    measureQueue(sizes, payload,
+                 [&](const void* data, size_t size, juce::int64 pts, bool video, bool key) { return ring.push(data, size, pts, 33, video, key); },
+                 [&] { if (ring.front() == nullptr) return false; ring.pop(); return true; },
+                 "packetRing", m);
+    // Video as the writer queues it from the encoder: by reference, nothing copied
+    measureQueue(sizes, payload,
+                 [&](const void* data, size_t size, juce::int64 pts, bool video, bool key) {
+                     return ring.push(streaming::MediaBuffer::wrap(data, size, nullptr, nullptr), pts, 33, video, key);
+                 },
+                 [&] { if (ring.front() == nullptr) return false; ring.pop(); return true; },
+                 "packetRingByRef", m);
+
+    DequeQueue deque;
+    DequeQueue::Packet out;
+    measureQueue(sizes, payload,
+                 [&](const void* data, size_t size, juce::int64 pts, bool video, bool key) { return deque.push(data, size, pts, video, key); },
+                 [&] { if (! deque.pop(out)) return false; out.data = {}; return true; },
+                 "mutexDeque", m);
+    return 0;
+}
+
+// ---- copies ----------------------------------------------------------------------------------
+
+// 1080p60 H.264 at 9 Mbit/s (GOP 120, keyframes 8x a P frame, +-25%) through the three stages that
+// used to copy every access unit, each once the old way and once by reference. Bytes come from
+// MediaBuffer::getCopiedBytes(), the counter the pipeline itself keeps.
+#if PIPELINE_BENCH_SOCKETS
+// The RtmpClient send stage: every frame, at `speed` times real time, into a client paced as a fan-out
+// endpoint paces (1.5x the stream rate, 0.15 s burst), so keyframes wait in its spill queue. Returns
+// the bytes copied by the sends, or -1 if the loopback server did not get every frame.
+double rtmpSendCopiedBytes(const std::vector<size_t>& sizes, const std::vector<uint8_t>& encoderOutput, const StreamingConfig& cfg, int gop, double speed, bool byReference) {
+    LoopbackRtmpServer server;
+    if (! server.start(0.0, sizes.size() + 16)) return -1.0;
+    streaming::RtmpClient client;
+    const double nominalBytesPerSec = (double) cfg.videoBitrateKbps * 125.0 * 1.5;
+    client.setPacingRate(nominalBytesPerSec * speed, (size_t) (nominalBytesPerSec / 10.0));
+    if (! client.connect(server.url("bench"), 5000)) return -1.0;
+    streaming::FlvMuxer muxer;
+    muxer.start(cfg);
+    streaming::FlvChunk chunk;
+    juce::uint64 copied = 0;
+    const auto startUs = streaming::PrecisionClock::nowMicros();
+    bool ok = true;
+    for (size_t i = 0; ok && i < sizes.size(); ++i) {
+        const auto ptsMs = (juce::int64) i * 1000 / cfg.fps;
+        streaming::PrecisionClock::sleepUntilMicros(startUs + (juce::int64) ((double) ptsMs * 1000.0 / speed));
+        const auto frame = streaming::MediaBuffer::wrap(encoderOutput.data(), sizes[i], nullptr, nullptr);
+        ok = muxer.pushVideo({ frame->data(), frame->size(), ptsMs, 0, i % (size_t) gop == 0, false }, chunk);
+        const auto tag = ok && byReference ? streaming::SharedFlvTag::fromChunk(chunk, frame) : nullptr;
+        for (; ok;) {
+            const auto c0 = streaming::MediaBuffer::getCopiedBytes();
+            const bool sent = tag != nullptr ? client.sendTag(tag) : client.sendTag(chunk);
+            copied += streaming::MediaBuffer::getCopiedBytes() - c0;
+            if (sent) { client.service(0); break; }
+            ok = client.isConnected();
+            client.service(5);
+        }
+    }
+    while (ok && client.queuedBytes() > 0 && client.isConnected()) client.service(20);
+    const auto deadline = nowNs() + 10000000000LL;
+    auto st = server.getStats();
+    while (st.mediaMessages < sizes.size() && nowNs() < deadline) { std::this_thread::sleep_for(std::chrono::milliseconds(2)); st = server.getStats(); }
+    client.close();
+    server.stop();
+    return ok && st.mediaMessages == sizes.size() ? (double) copied : -1.0;
+}
+#endif
+
+int runCopies(const Args& a, Metrics& m) {
+    constexpr int kFps = 60, kGop = 120, kVideoKbps = 9000;
+    const double seconds = secondsOr(a, 60.0), speed = speedOr(a, 16.0);
+    const int numFrames = (int) (seconds * kFps);
+    std::vector<size_t> sizes((size_t) numFrames);
+    juce::uint32 x = 0x2545F491u;
+    const double pBytes = (double) kVideoKbps * 125.0 / kFps * kGop / (kGop - 1 + 8);
+    for (int i = 0; i < numFrames; ++i) {
+        x = x * 1664525u + 1013904223u;
+        sizes[(size_t) i] = (size_t) (pBytes * (i % kGop == 0 ? 8.0 : 1.0) * (0.75 + 0.5 * (double) x / 4294967296.0));
+    }
+    const std::vector<uint8_t> encoderOutput(*std::max_element(sizes.begin(), sizes.end()), 0x5a);
+    StreamingConfig cfg;
+    cfg.fps = kFps;
+    cfg.videoBitrateKbps = kVideoKbps;
+    streaming::PacketRing ring;
+    ring.allocate(512, 8u << 20);
+
+    // Encoder callback -> MediaBuffer, egress ring push, fan-out tag; one pass per mode
+    for (const bool byReference : { false, true }) {
+        const juce::String mode = byReference ? "byReference" : "copied";
+        streaming::FlvMuxer muxer;
+        muxer.start(cfg);
+        streaming::FlvChunk chunk;
+        juce::uint64 copied[4] = {};
+        Samples frameNs((size_t) numFrames);
+        for (int i = 0; i < numFrames; ++i) {
+            const size_t size = sizes[(size_t) i];
+            const auto ptsMs = (juce::int64) i * 1000 / kFps;
+            const bool key = i % kGop == 0;
+            const auto t0 = nowNs();
+            auto c0 = streaming::MediaBuffer::getCopiedBytes();
+            const auto frame = byReference ? streaming::MediaBuffer::wrap(encoderOutput.data(), size, nullptr, nullptr)
+                                           : streaming::MediaBuffer::copyOf(encoderOutput.data(), size);
+            auto c1 = streaming::MediaBuffer::getCopiedBytes();
+            copied[0] += c1 - c0;
+            const bool pushed = byReference ? ring.push(frame, ptsMs, 1000 / kFps, true, key)
+                                            : ring.push(frame->data(), frame->size(), ptsMs, 1000 / kFps, true, key);
+            if (pushed) ring.pop();
+            c0 = streaming::MediaBuffer::getCopiedBytes();
+            copied[1] += c0 - c1;
+            if (! muxer.pushVideo({ frame->data(), frame->size(), ptsMs, 0, key, false }, chunk)) { std::printf("copies: muxer rejected frame %d\n", i); return 5; }
+            const auto tag = streaming::SharedFlvTag::fromChunk(chunk, byReference ? frame : nullptr);
+            c1 = streaming::MediaBuffer::getCopiedBytes();
+            copied[2] += c1 - c0;
+            frameNs.add((double) (nowNs() - t0));
+            if (tag == nullptr || ! pushed) { std::printf("copies: frame %d lost\n", i); return 5; }
+        }
+        m.set(mode + ".encoderOutBytesPerSec", (double) copied[0] / seconds);
+        m.set(mode + ".egressRingBytesPerSec", (double) copied[1] / seconds);
+        m.set(mode + ".fanoutTagBytesPerSec", (double) copied[2] / seconds);
+       #if PIPELINE_BENCH_SOCKETS
+        const double sendCopied = rtmpSendCopiedBytes(sizes, encoderOutput, cfg, kGop, speed, byReference);
+        if (sendCopied < 0.0) { std::printf("copies: %s RtmpClient send lost frames\n", mode.toRawUTF8()); return 5; }
+        copied[3] = (juce::uint64) sendCopied;
+        m.set(mode + ".rtmpSendBytesPerSec", sendCopied / seconds);
+       #endif
+        m.set(mode + ".totalBytesPerSec", (double) (copied[0] + copied[1] + copied[2] + copied[3]) / seconds);
+        m.latency(mode + ".frameNs", frameNs);
+    }
+    m.set("streamSeconds", seconds);
+    m.set("payloadBytesPerSec", (double) std::accumulate(sizes.begin(), sizes.end(), (size_t) 0) / seconds);
+    return 0;
+}
+
+// ---- egress ----------------------------------------------------------------------------------
+
+#if PIPELINE_BENCH_SOCKETS
+// Loopback TCP: a reader thread accepts one connection and counts what arrives
+class LoopbackSink {
+public:
+    bool open() {
+        listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (listenFd < 0 || ::bind(listenFd, (sockaddr*) &addr, len) != 0 || ::listen(listenFd, 1) != 0
+            || ::getsockname(listenFd, (sockaddr*) &addr, &len) != 0) return false;
+        reader = std::thread([this] {
+            const int c = ::accept(listenFd, nullptr, nullptr);
+            if (c < 0) return;
+            std::vector<char> buf(1 << 16);
+            for (ssize_t r; (r = ::recv(c, buf.data(), buf.size(), 0)) > 0;) received.fetch_add((juce::uint64) r);
+            ::close(c);
+        });
+        fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return ::connect(fd, (sockaddr*) &addr, len) == 0;
+    }
+
+    // Blocking writev of the chunk's slices, as the RTMP client sends a muxed tag
+    bool send(const streaming::FlvChunk& chunk) {
+        iovec iov[streaming::FlvChunk::maxSlices];
+        int n = 0, first = 0;
+        for (int i = 0; i < chunk.numSlices; ++i) iov[n++] = { const_cast<void*>(chunk.slices[i].data), chunk.slices[i].size };
+        for (size_t left = chunk.totalSize(); left > 0;) {
+            const ssize_t w = ::writev(fd, iov + first, n - first);
+            if (w < 0) { if (errno == EINTR) continue; return false; }
+            sent += (juce::uint64) w;
+            left -= (size_t) w;
+            // Step past what went out; a partly written slice continues where it stopped
+            for (auto done = (size_t) w; done > 0;) {
+                if (done >= iov[first].iov_len) done -= iov[first++].iov_len;
+                else { iov[first].iov_base = (uint8_t*) iov[first].iov_base + done; iov[first].iov_len -= done; done = 0; }
+            }
+        }
+        return true;
+    }
+
+    // Closes the sending side and waits until the reader has seen everything
+    juce::uint64 close() {
+        if (fd >= 0) ::close(fd);
+        if (reader.joinable()) reader.join();
+        if (listenFd >= 0) ::close(listenFd);
+        fd = listenFd = -1;
+        return received.load();
+    }
+
+    ~LoopbackSink() { close(); }
+
+    juce::uint64 sent = 0;
+
+private:
+    int listenFd = -1, fd = -1;
+    std::thread reader;
+    std::atomic<juce::uint64> received { 0 };
+};
+#endif
+
+int runEgress(const Args& a, Metrics& m) {
+#if PIPELINE_BENCH_SOCKETS
+    constexpr int kFps = 30, kGop = 60, kVideoKbps = 6000, kAudioKbps = 160, kAudioRate = 48000, kMaxVideoLateMs = 1000;
+    const double seconds = secondsOr(a, 60.0), speed = speedOr(a, 16.0);
+    const int numVideo = (int) (seconds * kFps), numAudio = (int) (seconds * kAudioRate / 1024);
+
+    // Seeded frame sizes averaging the nominal rate: keyframes 8x a P frame, +-25% jitter
+    std::vector<size_t> videoSizes((size_t) numVideo);
+    juce::uint32 x = 0x9E3779B9u;
+    const double pBytes = (double) kVideoKbps * 125.0 / kFps * kGop / (kGop - 1 + 8);
+    for (int i = 0; i < numVideo; ++i) {
+        x = x * 1664525u + 1013904223u;
+        videoSizes[(size_t) i] = (size_t) (pBytes * (i % kGop == 0 ? 8.0 : 1.0) * (0.75 + 0.5 * (double) x / 4294967296.0));
+    }
+    const size_t audioBytes = (size_t) kAudioKbps * 125 * 1024 / kAudioRate;
+    // Every frame borrows the same pool (the muxer passes AVCC payloads through untouched)
+    std::vector<uint8_t> pool(*std::max_element(videoSizes.begin(), videoSizes.end()) + 16, 0x5a), audio(audioBytes, 0x21);
+
+    streaming::PacketRing videoRing, audioRing;
+    videoRing.allocate(512, 1 << 20);
+    audioRing.allocate(512, 1 << 20);
+    streaming::RealtimeSignal signal;
+    std::atomic<int> producersLeft { 2 };
+    std::atomic<juce::uint64> ringDrops { 0 };
+    const auto copiedBefore = streaming::MediaBuffer::getCopiedBytes();
+
+    LoopbackSink sink;
+    if (! sink.open()) { std::printf("egress: cannot open a loopback socket\n"); return 5; }
+    StreamingConfig cfg;
+    cfg.fps = kFps;
+    cfg.videoBitrateKbps = kVideoKbps;
+    cfg.audioBitrateKbps = kAudioKbps;
+    streaming::FlvMuxer muxer;
+    muxer.start(cfg);
+    streaming::FlvChunk chunk;
+    const uint8_t avcC[] = { 1, 0x64, 0, 0x28, 0xff, 0xe1, 0, 4, 0x67, 0x64, 0, 0x28, 1, 0, 4, 0x68, 0xee, 0x3c, 0x80 };
+    const uint8_t asc[] = { 0x11, 0x90 };
+    if (! muxer.writeMetadata(chunk) || ! sink.send(chunk)) return 5;
+    if (! muxer.pushVideo({ avcC, sizeof(avcC), 0, 0, true, true }, chunk) || ! sink.send(chunk)) return 5;
+    if (! muxer.pushAudio({ asc, sizeof(asc), 0, true }, chunk) || ! sink.send(chunk)) return 5;
+
+    // Producers push each packet at its stream time divided by the speed, as the encoders would
+    const auto startUs = streaming::PrecisionClock::nowMicros() + 20000;
+    auto produce = [&](bool video) {
+        const int count = video ? numVideo : numAudio;
+        for (int i = 0; i < count; ++i) {
+            const auto ptsMs = video ? (juce::int64) i * 1000 / kFps : (juce::int64) i * 1024 * 1000 / kAudioRate;
+            streaming::PrecisionClock::sleepUntilMicros(startUs + (juce::int64) ((double) ptsMs * 1000.0 / speed));
+            bool pushed;
+            if (video) {
+                const size_t size = videoSizes[(size_t) i];
+                const auto buffer = streaming::MediaBuffer::wrap(pool.data(), size, nullptr, nullptr);
+                pushed = videoRing.push(buffer, ptsMs, 1000 / kFps, true, i % kGop == 0);
+            } else {
+                pushed = audioRing.push(audio.data(), audio.size(), ptsMs, 1024 * 1000 / kAudioRate, false, false);
+            }
+            if (! pushed) ringDrops.fetch_add(1);
+            signal.notify();
+        }
+        producersLeft.fetch_sub(1);
+        signal.notify();
+    };
+    const auto expected = (size_t) (numVideo + numAudio);
+    Samples queueUs(expected), lateUs(expected), sendUs(expected), jitterUs(expected);
+    juce::int64 lastSendUs = 0, lastDueUs = 0;
+    streaming::GopDropper gop;
+    gop.reset();
+    streaming::TokenBucket bucket;
+    const double bytesPerSec = (double) (kVideoKbps + kAudioKbps) * 1000.0 / 8.0 * speed;
+    bucket.configure(bytesPerSec, std::max(1024.0, bytesPerSec), streaming::PrecisionClock::nowMicros());
+    juce::uint64 shed = 0;
+    bool sendFailed = false;
+
+    std::thread videoThread(produce, true), audioThread(produce, false);
+    const double cpu0 = processCpuSec();
+    juce::int64 originUs = 0;
+    bool aligned = false;
+    for (;;) {
+        const auto* v = videoRing.front();
+        const auto* au = audioRing.front();
+        if (v == nullptr && au == nullptr) {
+            if (producersLeft.load() == 0 && videoRing.isEmpty() && audioRing.isEmpty()) break;
+            signal.wait(100);
+            continue;
+        }
+        const bool takeVideo = v != nullptr && (au == nullptr || v->ptsMs <= au->ptsMs);
+        auto& ring = takeVideo ? videoRing : audioRing;
+        const auto& pkt = *(takeVideo ? v : au);
+        if (! aligned) { originUs = streaming::PrecisionClock::nowMicros() - (juce::int64) ((double) pkt.ptsMs * 1000.0 / speed); aligned = true; }
+        const juce::int64 dueUs = originUs + (juce::int64) ((double) pkt.ptsMs * 1000.0 / speed);
+        const juce::int64 nowUs = streaming::PrecisionClock::nowMicros();
+        if (dueUs > nowUs) { streaming::PrecisionClock::waitUntilMicros(dueUs, signal); continue; }
+
+        // Lateness is judged in stream time, as at 1x
+        if (pkt.isVideo && ! gop.admit(pkt.keyframe, (double) (nowUs - dueUs) * speed > kMaxVideoLateMs * 1000.0)) { ++shed; ring.pop(); continue; }
+        const juce::int64 tokenWaitUs = bucket.microsUntil((double) pkt.size, nowUs);
+        if (tokenWaitUs > 0) streaming::PrecisionClock::sleepUntilMicros(nowUs + tokenWaitUs);
+        bucket.consume((double) pkt.size);
+
+        const auto sendStartUs = streaming::PrecisionClock::nowMicros();
+        queueUs.add((double) (sendStartUs - pkt.queuedUs));
+        lateUs.add((double) (sendStartUs - dueUs));
+        // Jitter: how far each gap between sends strays from the gap between the packets' due times
+        if (lastSendUs != 0) jitterUs.add((double) std::abs((sendStartUs - lastSendUs) - (dueUs - lastDueUs)));
+        lastSendUs = sendStartUs;
+        lastDueUs = dueUs;
+        const bool muxed = pkt.isVideo ? muxer.pushVideo({ pkt.data, pkt.size, pkt.ptsMs, 0, pkt.keyframe, false }, chunk)
+                                       : muxer.pushAudio({ pkt.data, pkt.size, pkt.ptsMs, false }, chunk);
+        sendFailed = sendFailed || ! muxed || ! sink.send(chunk);
+        sendUs.add((double) (streaming::PrecisionClock::nowMicros() - sendStartUs));
+        ring.pop();
+    }
+    const double cpuSec = processCpuSec() - cpu0;
+    videoThread.join();
+    audioThread.join();
+    const auto sent = sink.sent;
+    const auto received = sink.close();
+
+    m.set("streamSeconds", seconds);
+    m.set("speed", speed);
+    m.set("packets", (double) queueUs.values.size());
+    m.latency("queueUs", queueUs);
+    m.latency("lateUs", lateUs);
+    m.latency("muxSendUs", sendUs);
+    m.latency("sendJitterUs", jitterUs);
+    // Share of send gaps per jitter bucket; ltNus covers the range from the previous edge up to N us
+    const double jitterEdgesUs[] = { 10.0, 50.0, 100.0, 250.0, 500.0, 1000.0, 5000.0 };
+    size_t below = 0;
+    for (const double edge : jitterEdgesUs) {
+        const size_t n = (size_t) std::count_if(jitterUs.values.begin(), jitterUs.values.end(), [edge](double v) { return v < edge; });
+        m.set("sendJitterHist.lt" + juce::String((int) edge) + "us", jitterUs.values.empty() ? 0.0 : (double) (n - below) / (double) jitterUs.values.size());
+        below = n;
+    }
+    m.set("sendJitterHist.ge5000us", jitterUs.values.empty() ? 0.0 : (double) (jitterUs.values.size() - below) / (double) jitterUs.values.size());
+    m.set("cpuSecPerStreamHour", cpuSec / seconds * 3600.0);
+    m.set("ringDrops", (double) ringDrops.load());
+    m.set("shedVideoFrames", (double) shed);
+    m.set("copiedBytes", (double) (streaming::MediaBuffer::getCopiedBytes() - copiedBefore));
+    if (sendFailed || received != sent) {
+        std::printf("egress: sent %llu bytes, loopback received %llu\n", (unsigned long long) sent, (unsigned long long) received);
+        return 5;
+    }
+    return ringDrops.load() > 0 || shed > 0 ? 2 : 0;
+#else
+    juce::ignoreUnused(a, m);
+    std::printf("egress: needs POSIX sockets, skipped\n");
+    return kSkipped;
+#endif
+}
+
+// ---- flv -------------------------------------------------------------------------------------
+
+#if HAVE_FFMPEG
+// RBSP bit writer for a synthetic SPS/PPS that ff_isom_write_avcc can parse
+struct BitWriter {
+    std::vector<uint8_t> bytes;
+    int bits = 0;
+    void bit(int b) { if (bits % 8 == 0) bytes.push_back(0); if (b) bytes.back() |= (uint8_t) (0x80 >> (bits % 8)); ++bits; }
+    void u(int n, uint32_t v) { while (n-- > 0) bit((int) ((v >> n) & 1)); }
+    void ue(uint32_t v) { int len = 0; for (uint32_t x = v + 1; x > 1; x >>= 1) ++len; u(len, 0); u(len + 1, v + 1); }
+    void se(int v) { ue(v > 0 ? (uint32_t) (2 * v - 1) : (uint32_t) (-2 * v)); }
+    // Trailing bits, then the NAL header and emulation prevention bytes
+    std::vector<uint8_t> nal(uint8_t header) {
+        bit(1);
+        while (bits % 8 != 0) bit(0);
+        std::vector<uint8_t> out { header };
+        int zeros = 0;
+        for (const auto b : bytes) {
+            if (zeros >= 2 && b <= 3) { out.push_back(3); zeros = 0; }
+            out.push_back(b);
+            zeros = b == 0 ? zeros + 1 : 0;
+        }
+        return out;
+    }
+};
+
+// High profile 4.0, 1920x1080 (68 MB rows cropped by 8 lines), POC type 2, no VUI
+std::vector<uint8_t> syntheticSps() {
+    BitWriter w;
+    w.u(8, 100); w.u(8, 0); w.u(8, 40);
+    w.ue(0);                   // seq_parameter_set_id
+    w.ue(1); w.ue(0); w.ue(0); // 4:2:0, 8-bit luma and chroma
+    w.u(1, 0); w.u(1, 0);      // no transform bypass, no scaling matrices
+    w.ue(0);                   // log2_max_frame_num - 4
+    w.ue(2);                   // pic_order_cnt_type
+    w.ue(1); w.u(1, 0);        // one reference frame, no gaps
+    w.ue(119); w.ue(67);       // 120x68 macroblocks
+    w.u(1, 1); w.u(1, 1);      // frame_mbs_only, direct_8x8_inference
+    w.u(1, 1); w.ue(0); w.ue(0); w.ue(0); w.ue(4);
+    w.u(1, 0);                 // no VUI
+    return w.nal(0x67);
+}
+
+std::vector<uint8_t> syntheticPps() {
+    BitWriter w;
+    w.ue(0); w.ue(0); w.u(1, 0); w.u(1, 0); w.ue(0); w.ue(0); w.ue(0); w.u(1, 0); w.u(2, 0);
+    w.se(0); w.se(0); w.se(0); w.u(1, 1); w.u(1, 0); w.u(1, 0);
+    return w.nal(0x68);
+}
+
+// One stream muxed twice: FlvMuxer into a vector, libavformat's flvenc (bitexact, as the Pro writer
+// configures it minus the encoder tag) into a dynamic buffer.
+int compareWithFlvenc(bool annexB, Metrics& m) {
+    constexpr int kSeconds = 20, kFps = 30, kGop = 60, kAacFrame = 1024;
+    const char* label = annexB ? "annexB" : "avcc";
+    StreamingConfig cfg;
+    cfg.flvEncoderName = {};
+
+    const auto sps = syntheticSps(), pps = syntheticPps();
+    std::vector<uint8_t> videoConfig;
+    if (annexB) {
+        for (const auto* nal : { &sps, &pps }) {
+            videoConfig.insert(videoConfig.end(), { 0, 0, 0, 1 });
+            videoConfig.insert(videoConfig.end(), nal->begin(), nal->end());
+        }
+    } else {
+        videoConfig = { 1, sps[1], sps[2], sps[3], 0xff, 0xe1, (uint8_t) (sps.size() >> 8), (uint8_t) sps.size() };
+        videoConfig.insert(videoConfig.end(), sps.begin(), sps.end());
+        videoConfig.insert(videoConfig.end(), { 1, (uint8_t) (pps.size() >> 8), (uint8_t) pps.size() });
+        videoConfig.insert(videoConfig.end(), pps.begin(), pps.end());
+        videoConfig.insert(videoConfig.end(), { 0xfd, 0xf8, 0xf8, 0 });
+    }
+    const uint8_t audioConfig[] = { 0x11, 0x90 }; // AAC LC, 48 kHz, stereo
+
+    // Seeded payloads: an SEI and a slice per frame (start codes or 4-byte lengths), raw AAC without an ADTS sync word
+    juce::Random rng (17);
+    struct Unit { bool video; juce::int64 dtsMs; int ctsMs; bool key; std::vector<uint8_t> data; };
+    std::vector<Unit> units;
+    const int videoFrames = kSeconds * kFps, audioFrames = kSeconds * cfg.audioSampleRate / kAacFrame;
+    for (int v = 0, a = 0; v < videoFrames || a < audioFrames;) {
+        const juce::int64 vMs = (juce::int64) v * 1000 / kFps, aMs = (juce::int64) a * kAacFrame * 1000 / cfg.audioSampleRate;
+        Unit u;
+        u.video = v < videoFrames && (a >= audioFrames || vMs <= aMs);
+        if (u.video) {
+            u.dtsMs = vMs; u.key = v % kGop == 0; u.ctsMs = (v % 3 == 1) ? 67 : 0;
+            const int sliceBytes = (u.key ? 60000 : 20000) + rng.nextInt(4000), seiBytes = 16;
+            for (const auto& [type, bytes] : { std::pair<uint8_t, int> (0x06, seiBytes), std::pair<uint8_t, int> (u.key ? 0x65 : 0x41, sliceBytes) }) {
+                if (annexB) u.data.insert(u.data.end(), { 0, 0, 0, 1 });
+                else u.data.insert(u.data.end(), { (uint8_t) (bytes >> 24), (uint8_t) (bytes >> 16), (uint8_t) (bytes >> 8), (uint8_t) bytes });
+                u.data.push_back(type);
+                for (int i = 1; i < bytes; ++i) u.data.push_back((uint8_t) (0x20 + rng.nextInt(0xc0))); // no start code emulation
+            }
+            ++v;
+        } else {
+            u.dtsMs = aMs; u.ctsMs = 0; u.key = false;
+            u.data.resize((size_t) (300 + rng.nextInt(200)));
+            for (auto& b : u.data) b = (uint8_t) (0x20 + rng.nextInt(0xc0));
+            ++a;
+        }
+        units.push_back(std::move(u));
+    }
+
+    // FlvMuxer, header order as flvenc writes it: signature, onMetaData, then codec headers in stream order
+    std::vector<uint8_t> ours;
+    ours.reserve(64 << 20);
+    streaming::FlvMuxer muxer;
+    streaming::FlvChunk chunk;
+    auto append = [&](const streaming::FlvChunk& c) { const auto n = ours.size(); ours.resize(n + c.totalSize()); c.copyTo(ours.data() + n); };
+    muxer.start(cfg);
+    muxer.writeFileHeader(chunk); append(chunk);
+    muxer.writeMetadata(chunk); append(chunk);
+    if (! muxer.pushVideo({ videoConfig.data(), videoConfig.size(), 0, 0, true, true }, chunk)) { std::printf("flv: %s config rejected\n", label); return 5; }
+    append(chunk);
+    muxer.pushAudio({ audioConfig, sizeof(audioConfig), 0, true }, chunk); append(chunk);
+    Samples oursNs(units.size());
+    for (const auto& u : units) {
+        const auto t0 = nowNs();
+        const bool ok = u.video ? muxer.pushVideo({ u.data.data(), u.data.size(), u.dtsMs, u.ctsMs, u.key, false }, chunk)
+                                : muxer.pushAudio({ u.data.data(), u.data.size(), u.dtsMs, false }, chunk);
+        if (ok) append(chunk);
+        oursNs.add((double) (nowNs() - t0));
+        if (! ok) { std::printf("flv: %s frame rejected\n", label); return 5; }
+    }
+
+    // flvenc with the same parameters; av_write_frame keeps the caller's order, as the writer's egress does
+    AVFormatContext* fmt = nullptr;
+    if (avformat_alloc_output_context2(&fmt, nullptr, "flv", nullptr) < 0 || fmt == nullptr) { std::printf("flv: no flv muxer in libavformat\n"); return 5; }
+    fmt->flags |= AVFMT_FLAG_BITEXACT;
+    AVStream* vs = avformat_new_stream(fmt, nullptr);
+    AVStream* as = avformat_new_stream(fmt, nullptr);
+    vs->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    vs->codecpar->codec_id = AV_CODEC_ID_H264;
+    vs->codecpar->width = cfg.videoWidth;
+    vs->codecpar->height = cfg.videoHeight;
+    vs->codecpar->bit_rate = (int64_t) cfg.videoBitrateKbps * 1000;
+    vs->avg_frame_rate = { cfg.fps, 1 };
+    vs->time_base = { 1, 1000 };
+    as->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+    as->codecpar->codec_id = AV_CODEC_ID_AAC;
+    as->codecpar->sample_rate = cfg.audioSampleRate;
+    av_channel_layout_default(&as->codecpar->ch_layout, cfg.audioChannels);
+    as->codecpar->bit_rate = (int64_t) cfg.audioBitrateKbps * 1000;
+    as->time_base = { 1, 1000 };
+    auto setExtradata = [](AVCodecParameters* par, const uint8_t* data, size_t size) {
+        par->extradata = (uint8_t*) av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
+        std::memcpy(par->extradata, data, size);
+        par->extradata_size = (int) size;
+    };
+    setExtradata(vs->codecpar, videoConfig.data(), videoConfig.size());
+    setExtradata(as->codecpar, audioConfig, sizeof(audioConfig));
+
+    AVDictionary* opts = nullptr;
+    av_dict_set(&opts, "flvflags", "no_duration_filesize", 0);
+    int result = 0;
+    Samples flvencNs(units.size());
+    uint8_t* theirs = nullptr;
+    int theirsSize = 0;
+    AVPacket* pkt = av_packet_alloc();
+    if (avio_open_dyn_buf(&fmt->pb) < 0 || avformat_write_header(fmt, &opts) < 0) { std::printf("flv: flvenc header failed\n"); result = 5; }
+    for (size_t i = 0; result == 0 && i < units.size(); ++i) {
+        const auto& u = units[i];
+        AVStream* st = u.video ? vs : as;
+        pkt->data = const_cast<uint8_t*>(u.data.data());
+        pkt->size = (int) u.data.size();
+        pkt->stream_index = st->index;
+        pkt->dts = av_rescale_q(u.dtsMs, { 1, 1000 }, st->time_base);
+        pkt->pts = av_rescale_q(u.dtsMs + u.ctsMs, { 1, 1000 }, st->time_base);
+        pkt->flags = u.key || ! u.video ? AV_PKT_FLAG_KEY : 0;
+        const auto t0 = nowNs();
+        const int err = av_write_frame(fmt, pkt);
+        flvencNs.add((double) (nowNs() - t0));
+        if (err < 0) { std::printf("flv: flvenc rejected packet %d\n", (int) i); result = 5; }
+    }
+    if (fmt->pb != nullptr) {
+        if (result == 0) av_write_trailer(fmt);
+        theirsSize = avio_close_dyn_buf(fmt->pb, &theirs);
+        fmt->pb = nullptr;
+    }
+    av_packet_free(&pkt);
+    av_dict_free(&opts);
+    avformat_free_context(fmt);
+
+    // flvenc's trailer is one 16-byte H.264 end-of-sequence tag (plus its PreviousTagSize) after the last frame
+    constexpr size_t kEosTag = 16 + 4;
+    const juce::String key = juce::String("flvenc.") + label;
+    if (result == 0) {
+        const size_t n = (size_t) juce::jmax(0, theirsSize);
+        size_t firstDiff = 0;
+        while (firstDiff < juce::jmin(n, ours.size()) && theirs[firstDiff] == ours[firstDiff]) ++firstDiff;
+        const bool identical = n == ours.size() + kEosTag && firstDiff == ours.size() && theirs[ours.size()] == 9;
+        m.set(key + ".identical", identical ? 1.0 : 0.0);
+        m.set(key + ".bytes", (double) ours.size());
+        if (! identical) {
+            std::printf("flv: %s differs from flvenc at byte %d (ours %d bytes, flvenc %d)\n", label, (int) firstDiff, (int) ours.size(), (int) n);
+            result = 5;
+        }
+    }
+    av_free(theirs);
+    m.latency(key + ".oursTagNs", oursNs);
+    m.latency(key + ".flvencTagNs", flvencNs);
+    return result;
+}
+#endif
+
+int runFlv(const Args&, Metrics& m) {
+    constexpr int kFrames = 20000, kFrameBytes = 25000;
+    const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("PipelineBench.flv");
+    file.deleteFile();
+    int result = 0;
+    for (const bool annexB : { false, true }) {
+        // Two NAL units per frame (an SEI and the slice) with 4-byte prefixes: lengths or start codes
+        std::vector<uint8_t> frame((size_t) kFrameBytes, 0x5a);
+        const uint32_t seiBytes = 20, sliceBytes = (uint32_t) kFrameBytes - 8 - seiBytes;
+        const uint8_t* prefixes[2];
+        uint8_t lengths[2][4] = { { 0, 0, 0, (uint8_t) seiBytes }, { (uint8_t) (sliceBytes >> 24), (uint8_t) (sliceBytes >> 16), (uint8_t) (sliceBytes >> 8), (uint8_t) sliceBytes } };
+        const uint8_t startCode[4] = { 0, 0, 0, 1 };
+        prefixes[0] = annexB ? startCode : lengths[0];
+        prefixes[1] = annexB ? startCode : lengths[1];
+        std::memcpy(frame.data(), prefixes[0], 4);
+        frame[4] = 0x06;
+        std::memcpy(frame.data() + 4 + seiBytes, prefixes[1], 4);
+        frame[8 + seiBytes] = 0x65;
+        const uint8_t annexBConfig[] = { 0, 0, 0, 1, 0x67, 0x64, 0, 0x28, 0, 0, 0, 1, 0x68, 0xee, 0x3c, 0x80 };
+        const uint8_t avcC[] = { 1, 0x64, 0, 0x28, 0xff, 0xe1, 0, 4, 0x67, 0x64, 0, 0x28, 1, 0, 4, 0x68, 0xee, 0x3c, 0x80 };
+
+        StreamingConfig cfg;
+        streaming::FlvMuxer muxer;
+        muxer.start(cfg);
+        streaming::FlvChunk chunk;
+        juce::FileOutputStream out(file);
+        if (! out.openedOk()) { std::printf("flv: cannot write %s\n", file.getFullPathName().toRawUTF8()); return 5; }
+        auto write = [&](const streaming::FlvChunk& c) {
+            for (int i = 0; i < c.numSlices; ++i) out.write(c.slices[i].data, c.slices[i].size);
+        };
+        muxer.writeFileHeader(chunk); write(chunk);
+        muxer.writeMetadata(chunk); write(chunk);
+        if (annexB) muxer.pushVideo({ annexBConfig, sizeof(annexBConfig), 0, 0, true, true }, chunk);
+        else muxer.pushVideo({ avcC, sizeof(avcC), 0, 0, true, true }, chunk);
+        write(chunk);
+        muxer.pushVideo({ frame.data(), frame.size(), 0, 0, true, false }, chunk); // grows the rewrite scratch once
+
+        Samples tagNs(kFrames);
+        juce::uint64 muxedBytes = 0;
+        juce::int64 muxNs = 0;
+        const auto t0 = nowNs();
+        for (int i = 0; i < kFrames; ++i) {
+            const auto p0 = nowNs();
+            const bool ok = muxer.pushVideo({ frame.data(), frame.size(), (juce::int64) i * 33, 0, i % 60 == 0, false }, chunk);
+            const auto ns = nowNs() - p0;
+            if (! ok) { result = 5; break; }
+            tagNs.add((double) ns);
+            muxNs += ns;
+            muxedBytes += chunk.totalSize();
+            write(chunk);
+        }
+        out.flush();
+        const double sec = (double) (nowNs() - t0) * 1e-9;
+        const juce::String key = annexB ? "annexB" : "avcc";
+        m.latency(key + ".tagNs", tagNs);
+        m.set(key + ".muxMBps", (double) muxedBytes / ((double) muxNs * 1e-9) / 1e6);
+        m.set(key + ".fileMBps", (double) muxedBytes / sec / 1e6);
+        if (out.getPosition() < (juce::int64) muxedBytes) { std::printf("flv: file came out short\n"); result = 5; }
+    }
+    file.deleteFile();
+#if HAVE_FFMPEG
+    for (const bool annexB : { false, true })
+        if (result == 0) result = compareWithFlvenc(annexB, m);
+#else
+    std::printf("flv: built without FFmpeg, flvenc comparison skipped\n");
+#endif
+    return result;
+}
+
+// ---- gopdrop ---------------------------------------------------------------------------------
+
+#if HAVE_FFMPEG
+// Stands in for the encoder backend: an IDR request forces the next frame to an I picture
+struct KeyframeRequests : streaming::EncoderControl {
+    bool setTargetBitrate(int) override { return false; }
+    int getTargetBitrate() const override { return 0; }
+    void requestKeyframe() override { pending.store(true); ++requests; }
+    std::atomic<bool> pending { false };
+    int requests { 0 };
+};
+
+// libx264 first, then libopenh264: the default H.264 encoder of a build without them can be a hardware
+// one (VAAPI, V4L2 M2M, NVENC) that needs a device or hardware frames this bench does not set up
+const AVCodec* findSoftwareH264Encoder() {
+    for (const char* name : { "libx264", "libopenh264" })
+        if (const AVCodec* c = avcodec_find_encoder_by_name(name)) return c;
+    return avcodec_find_encoder(AV_CODEC_ID_H264);
+}
+
+// Encodes kFrames of a moving test pattern with libavcodec, queues each access unit through a
+// PacketRing and a send-side verdict from a simulated link, and decodes whatever is admitted. The
+// link drains at 4 Mbit/s except in two windows at 0.3 Mbit/s, so the 1 Mbit/s stream falls more than
+// 1 s behind there, as in the writer's egress. gopAware sheds through GopDropper (with IDR requests);
+// otherwise only the late inter frames themselves are dropped, as a control.
+int decodeThroughQueue(bool gopAware, const juce::String& key, Metrics& m) {
+    constexpr int kWidth = 640, kHeight = 360, kFps = 30, kGop = 60, kFrames = 600, kMaxLateMs = 1000;
+    const AVCodec* encoder = findSoftwareH264Encoder();
+    const AVCodec* decoder = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (encoder == nullptr || decoder == nullptr) { std::printf("gopdrop: libavcodec has no H.264 %s, skipped\n", encoder == nullptr ? "encoder" : "decoder"); return kSkipped; }
+    static bool named = false;
+    if (! std::exchange(named, true)) std::printf("gopdrop: encoding with %s\n", encoder->name);
+
+    AVCodecContext* enc = avcodec_alloc_context3(encoder);
+    enc->width = kWidth;
+    enc->height = kHeight;
+    enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc->time_base = { 1, kFps };
+    enc->framerate = { kFps, 1 };
+    enc->gop_size = kGop;
+    enc->max_b_frames = 0;
+    enc->bit_rate = 1000000;
+    enc->thread_count = 1;
+    // Both are ignored by encoders without them: one packet per frame, and I requests become IDRs
+    if (encoder->priv_class != nullptr) {
+        av_opt_set(enc->priv_data, "tune", "zerolatency", 0);
+        av_opt_set(enc->priv_data, "forced-idr", "1", 0);
+    }
+    AVCodecContext* dec = avcodec_alloc_context3(decoder);
+    dec->thread_count = 1;
+    dec->flags |= AV_CODEC_FLAG_OUTPUT_CORRUPT; // frames built on a missing reference come out flagged
+    dec->err_recognition = AV_EF_CRCCHECK | AV_EF_BITSTREAM;
+    // An encoder this build cannot open (no device behind a hardware one) is missing, not failing
+    const bool encoderOpen = avcodec_open2(enc, encoder, nullptr) >= 0;
+    if (! encoderOpen || avcodec_open2(dec, decoder, nullptr) < 0) {
+        std::printf("gopdrop: cannot open the %s %s%s\n", encoderOpen ? decoder->name : encoder->name, encoderOpen ? "decoder" : "encoder",
+                    encoderOpen ? "" : ", skipped");
+        avcodec_free_context(&enc);
+        avcodec_free_context(&dec);
+        return encoderOpen ? 5 : kSkipped;
+    }
+
+    AVFrame* picture = av_frame_alloc();
+    picture->format = AV_PIX_FMT_YUV420P;
+    picture->width = kWidth;
+    picture->height = kHeight;
+    av_frame_get_buffer(picture, 0);
+    AVFrame* decoded = av_frame_alloc();
+    AVPacket* pkt = av_packet_alloc();
+    AVPacket* admittedPkt = av_packet_alloc();
+    streaming::PacketRing ring;
+    ring.allocate(64, 4u << 20);
+    streaming::GopDropper gop;
+    gop.reset();
+    KeyframeRequests control;
+    if (gopAware) gop.setEncoderControl(&control);
+
+    double linkQueueBits = 0.0;
+    int admitted = 0, dropped = 0, keyframes = 0, decodedFrames = 0, corruptFrames = 0, decodeErrors = 0, run = 0, longestRun = 0;
+    auto drainDecoder = [&] {
+        while (avcodec_receive_frame(dec, decoded) == 0) {
+            ++decodedFrames;
+            if ((decoded->flags & AV_FRAME_FLAG_CORRUPT) != 0 || decoded->decode_error_flags != 0) ++corruptFrames;
+            av_frame_unref(decoded);
+        }
+    };
+    // Queue, verdict, decode: the egress side of one access unit
+    auto egress = [&](int frameIndex) {
+        const auto* p = ring.front();
+        if (p == nullptr) return;
+        const bool congested = (frameIndex >= 120 && frameIndex < 210) || (frameIndex >= 360 && frameIndex < 420);
+        const double capacityBitsPerFrame = (congested ? 300000.0 : 4000000.0) / kFps;
+        const bool behind = linkQueueBits / capacityBitsPerFrame * 1000.0 / kFps > kMaxLateMs;
+        const bool admit = gopAware ? gop.admit(p->keyframe, behind) : (p->keyframe || ! behind);
+        if (admit) {
+            ++admitted;
+            run = 0;
+            linkQueueBits += (double) p->size * 8.0;
+            av_new_packet(admittedPkt, (int) p->size);
+            std::memcpy(admittedPkt->data, p->data, p->size);
+            admittedPkt->pts = admittedPkt->dts = p->ptsMs;
+            if (p->keyframe) admittedPkt->flags |= AV_PKT_FLAG_KEY;
+            if (avcodec_send_packet(dec, admittedPkt) < 0) ++decodeErrors;
+            av_packet_unref(admittedPkt);
+            drainDecoder();
+        } else {
+            ++dropped;
+            longestRun = std::max(longestRun, ++run);
+        }
+        linkQueueBits = std::max(0.0, linkQueueBits - capacityBitsPerFrame);
+        ring.pop();
+    };
+
+    for (int i = 0; i <= kFrames; ++i) {
+        AVFrame* in = nullptr;
+        if (i < kFrames) {
+            // Diagonal gradient scrolling right and a bright square crossing the picture
+            av_frame_make_writable(picture);
+            for (int y = 0; y < kHeight; ++y)
+                for (int x = 0; x < kWidth; ++x)
+                    picture->data[0][y * picture->linesize[0] + x] = (uint8_t) ((x + y + i * 4) & 0xff);
+            for (int y = 100; y < 180; ++y)
+                for (int x = (i * 3) % (kWidth - 80), e = x + 80; x < e; ++x)
+                    picture->data[0][y * picture->linesize[0] + x] = 235;
+            for (int c = 1; c <= 2; ++c)
+                for (int y = 0; y < kHeight / 2; ++y)
+                    std::memset(picture->data[c] + y * picture->linesize[c], 128 + (c == 1 ? y / 4 : -y / 4), kWidth / 2);
+            picture->pts = i;
+            picture->pict_type = control.pending.exchange(false) ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+            in = picture;
+        }
+        if (avcodec_send_frame(enc, in) < 0) break;
+        while (avcodec_receive_packet(enc, pkt) == 0) {
+            const bool key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+            keyframes += key ? 1 : 0;
+            const int frameIndex = (int) pkt->pts;
+            ring.push(pkt->data, (size_t) pkt->size, (juce::int64) frameIndex * 1000 / kFps, 1000 / kFps, true, key);
+            av_packet_unref(pkt);
+            egress(frameIndex);
+        }
+    }
+    avcodec_send_packet(dec, nullptr);
+    drainDecoder();
+
+    av_packet_free(&pkt);
+    av_packet_free(&admittedPkt);
+    av_frame_free(&picture);
+    av_frame_free(&decoded);
+    avcodec_free_context(&enc);
+    avcodec_free_context(&dec);
+
+    m.set(key + ".keyframes", keyframes);
+    m.set(key + ".droppedFrames", dropped);
+    m.set(key + ".longestDropRun", longestRun);
+    m.set(key + ".decodedFrames", decodedFrames);
+    m.set(key + ".corruptFrames", corruptFrames);
+    m.set(key + ".decodeErrors", decodeErrors);
+    if (gopAware) {
+        m.set(key + ".gaps", (double) gop.getGaps());
+        m.set(key + ".idrRequests", control.requests);
+    }
+    if (! gopAware) return 0;
+    const bool clean = decodeErrors == 0 && corruptFrames == 0 && decodedFrames == admitted;
+    if (! clean) std::printf("gopdrop: %d of %d admitted frames decoded, %d corrupt, %d decode errors\n", decodedFrames, admitted, corruptFrames, decodeErrors);
+    if (gop.getGaps() == 0) std::printf("gopdrop: the simulated congestion never opened a gap\n");
+    return clean && gop.getGaps() > 0 ? 0 : 5;
+}
+#endif
+
+int runGopDrop(const Args&, Metrics& m) {
+#if HAVE_FFMPEG
+    const int result = decodeThroughQueue(true, "gopAware", m);
+    if (result == kSkipped) return kSkipped;
+    decodeThroughQueue(false, "frameDrops", m);
+    return result;
+#else
+    juce::ignoreUnused(m);
+    std::printf("gopdrop: needs FFmpeg, skipped\n");
+    return kSkipped;
+#endif
+}
+
+// ---- frames ----------------------------------------------------------------------------------
+
+int runFrames(const Args&, Metrics& m) {
+    constexpr int kFps = 60, kFrames = 600, kStride = 6;
+    streaming::LoadGenerator::Scenario scenario;
+    juce::String error;
+    if (! streaming::LoadGenerator::Scenario::load("capacity", scenario, error)) { std::printf("frames: %s\n", error.toRawUTF8()); return 5; }
+    int result = 0;
+    for (const auto format : { streaming::LoadGenerator::Format::bgra, streaming::LoadGenerator::Format::nv12 }) {
+        streaming::LoadGenerator::Options o;
+        o.width = 1920;
+        o.height = 1080;
+        o.fps = kFps;
+        o.format = format;
+        streaming::LoadGenerator gen, again;
+        gen.prepare(o, scenario);
+        again.prepare(o, scenario);
+
+        Samples renderUs(kFrames);
+        std::vector<juce::uint64> hashes;
+        juce::int64 totalNs = 0;
+        for (int i = 0; i < kFrames; ++i) {
+            const auto p0 = nowNs();
+            const auto& frame = gen.renderVideo((juce::int64) i * kStride);
+            const auto ns = nowNs() - p0;
+            totalNs += ns;
+            renderUs.add((double) ns * 1e-3);
+            if (i % 10 == 0) hashes.push_back(streaming::LoadGenerator::hashFrame(frame));
+        }
+        for (int i = kFrames - 10; i >= 0; i -= 10)
+            if (streaming::LoadGenerator::hashFrame(again.renderVideo((juce::int64) i * kStride)) != hashes[(size_t) i / 10]) {
+                std::printf("frames: frame %d differs on a second generator\n", i * kStride);
+                result = 5;
+                break;
+            }
+        const juce::String key = format == streaming::LoadGenerator::Format::bgra ? "bgra1080" : "nv12_1080";
+        m.latency(key + ".renderUs", renderUs);
+        m.set(key + ".fps", kFrames / ((double) totalNs * 1e-9));
+    }
+
+    // The same samples whatever the block size; one hash per pass and channel, so the block size
+    // does not change the order the bytes are hashed in
+    juce::uint64 hashes[2][2] = { { 14695981039346656037ull, 14695981039346656037ull }, { 14695981039346656037ull, 14695981039346656037ull } };
+    double audioNsPerFrame = 0.0;
+    for (int pass = 0; pass < 2; ++pass) {
+        streaming::LoadGenerator gen;
+        streaming::LoadGenerator::Options o;
+        gen.prepare(o, scenario);
+        const int block = pass == 0 ? 512 : 441, total = 60 * o.sampleRate;
+        juce::AudioBuffer<float> buffer(2, block);
+        const auto t0 = nowNs();
+        for (int done = 0; done < total; done += block) {
+            const int n = juce::jmin(block, total - done);
+            gen.renderAudio(buffer.getArrayOfWritePointers(), 2, n);
+            for (int c = 0; c < 2; ++c) {
+                const auto* bytes = reinterpret_cast<const uint8_t*>(buffer.getReadPointer(c));
+                for (size_t b = 0; b < (size_t) n * sizeof(float); ++b) hashes[pass][c] = (hashes[pass][c] ^ bytes[b]) * 1099511628211ull;
+            }
+        }
+        if (pass == 0) audioNsPerFrame = (double) (nowNs() - t0) / total;
+    }
+    m.set("audio.nsPerFrame", audioNsPerFrame);
+    if (hashes[0][0] != hashes[1][0] || hashes[0][1] != hashes[1][1]) { std::printf("frames: audio depends on the block size\n"); result = 5; }
+    return result;
+}
+
+// ---- log -------------------------------------------------------------------------------------
+
+int runLog(const Args&, Metrics& m) {
+    constexpr int kCalls = 1000000, kBatch = 100;
+    const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("PipelineBench_log.txt");
+    file.deleteFile();
+    auto& log = streaming::BinaryLog::getInstance();
+    const auto previous = log.getOutputFile();
+    log.setOutputFile(file);
+    LogEvent("BENCH: logging from this thread"); // claims the thread's ring outside the timing
+    log.flush();
+
+    const auto writtenBefore = log.getWrittenRecords(), droppedBefore = log.getDroppedRecords();
+    Samples callNs(kCalls / kBatch);
+    const auto t0 = nowNs();
+    for (int i = 0; i < kCalls; i += kBatch) {
+        const auto b0 = nowNs();
+        for (int k = i; k < i + kBatch; ++k) LogEvent("BENCH: packet {} pts {} size {}", k, (juce::int64) k * 33, 25000.0 + (k % 97));
+        callNs.add((double) (nowNs() - b0) / kBatch);
+    }
+    const auto callEnd = nowNs();
+    log.flush(10000);
+    const double sec = (double) (nowNs() - t0) * 1e-9;
+    const auto written = (double) (log.getWrittenRecords() - writtenBefore), dropped = (double) (log.getDroppedRecords() - droppedBefore);
+    log.setOutputFile(previous);
+    file.deleteFile();
+
+    m.latency("callNs", callNs);
+    m.set("callsPerSec", (double) kCalls / ((double) (callEnd - t0) * 1e-9));
+    m.set("writtenPerSec", written / sec);
+    m.set("droppedShare", dropped / kCalls);
+    if (written + dropped < kCalls) { std::printf("log: %.0f of %d records accounted for\n", written + dropped, kCalls); return 5; }
+    return 0;
+}
+
+// ---- tracegate -------------------------------------------------------------------------------
+
+// The FFmpeg log bridge as it was (av_log forced to TRACE, every line formatted, trimmed and logged)
+// and as it is (Trace gate first), plus with rtmp and tls tracing switched on
+enum class LogBridge { ungated, gated, tracing };
+
+void bridgeLine(LogBridge bridge, streaming::Trace::Subsystem s, const char* fmt, ...) {
+    va_list vl;
+    va_start(vl, fmt);
+    if (bridge == LogBridge::ungated) {
+        char msg[1024];
+        vsnprintf(msg, sizeof(msg), fmt, vl);
+        juce::String line(msg);
+        line = line.trim();
+        if (line.isNotEmpty()) LogMessage("FFMPEG-LOG: " + line);
+    } else if (streaming::Trace::enabled(s, streaming::Trace::trace)) {
+        char msg[1024];
+        vsnprintf(msg, sizeof(msg), fmt, vl);
+        const auto line = juce::String(msg).trim();
+        if (line.isNotEmpty()) streaming::Trace::write(s, streaming::Trace::trace, fmt, line);
+    }
+    va_end(vl);
+}
+
+// The egress thread at 1080p60 / 9 Mbit/s video (GOP 120) plus 160 kbps AAC: packets merged by PTS,
+// paced at --speed, muxed and written to a loopback socket, then the libav* lines for that packet
+// handed to the bridge. Without FFmpeg the lines are modelled: one rtmp line per packet and one tls
+// line per started 16 KiB TLS record, each with changing numbers so dedup cannot fold them. In the
+// writer av_log's own level also drops gated lines before the callback, so gated is an upper bound.
+int runTraceGate(const Args& a, Metrics& m) {
+#if PIPELINE_BENCH_SOCKETS
+    using streaming::Trace;
+    constexpr int kFps = 60, kGop = 120, kVideoKbps = 9000, kAudioKbps = 160, kAudioRate = 48000, kTlsRecord = 16384;
+    const double seconds = secondsOr(a, 30.0), speed = speedOr(a, 16.0);
+    const int numVideo = (int) (seconds * kFps), numAudio = (int) (seconds * kAudioRate / 1024);
+    std::vector<size_t> videoSizes((size_t) numVideo);
+    juce::uint32 x = 0x2545F491u;
+    const double pBytes = (double) kVideoKbps * 125.0 / kFps * kGop / (kGop - 1 + 8);
+    for (int i = 0; i < numVideo; ++i) {
+        x = x * 1664525u + 1013904223u;
+        videoSizes[(size_t) i] = (size_t) (pBytes * (i % kGop == 0 ? 8.0 : 1.0) * (0.75 + 0.5 * (double) x / 4294967296.0));
+    }
+    const size_t audioBytes = (size_t) kAudioKbps * 125 * 1024 / kAudioRate;
+    const std::vector<uint8_t> pool(*std::max_element(videoSizes.begin(), videoSizes.end()), 0x5a), audio(audioBytes, 0x21);
+
+    const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("PipelineBench_tracegate.txt");
+    file.deleteFile();
+    auto& log = streaming::BinaryLog::getInstance();
+    const auto previousFile = log.getOutputFile();
+    log.setOutputFile(file);
+    LogEvent("BENCH: logging from this thread"); // claims the thread's ring outside the timing
+    log.flush();
+    const auto rtmpLevel = Trace::getLevel(Trace::rtmp), tlsLevel = Trace::getLevel(Trace::tls);
+
+    StreamingConfig cfg;
+    cfg.fps = kFps;
+    cfg.videoBitrateKbps = kVideoKbps;
+    cfg.audioBitrateKbps = kAudioKbps;
+    // What the two clock reads around each packet's lines cost by themselves, taken off the bridge time
+    Samples clockPairSec(1000);
+    for (int i = 0; i < 1000; ++i) { const double c0 = threadCpuSec(); clockPairSec.add(threadCpuSec() - c0); }
+    const double clockSec = clockPairSec.percentile(50.0);
+    int result = 0;
+    double cpuSec[3] = {}, bridgeSec[3] = {};
+    juce::uint64 lines = 0;
+    for (const auto bridge : { LogBridge::ungated, LogBridge::gated, LogBridge::tracing }) {
+        const auto b = (int) bridge;
+        const juce::String mode = bridge == LogBridge::ungated ? "ungated" : bridge == LogBridge::gated ? "gated" : "tracing";
+        // gated runs at the shipping default
+        Trace::setLevel(Trace::rtmp, bridge == LogBridge::tracing ? Trace::trace : Trace::warning);
+        Trace::setLevel(Trace::tls, bridge == LogBridge::tracing ? Trace::trace : Trace::warning);
+        const auto droppedBefore = log.getDroppedRecords(), suppressedBefore = Trace::getSuppressedLines();
+
+        LoopbackSink sink;
+        if (! sink.open()) { std::printf("tracegate: cannot open a loopback socket\n"); result = 5; break; }
+        streaming::FlvMuxer muxer;
+        muxer.start(cfg);
+        streaming::FlvChunk chunk;
+        lines = 0;
+        const auto startUs = streaming::PrecisionClock::nowMicros() + 20000;
+        const double cpu0 = threadCpuSec(), process0 = processCpuSec();
+        for (int v = 0, au = 0; v < numVideo || au < numAudio;) {
+            const auto videoPts = (juce::int64) v * 1000 / kFps, audioPts = (juce::int64) au * 1024 * 1000 / kAudioRate;
+            const bool video = au >= numAudio || (v < numVideo && videoPts <= audioPts);
+            const auto ptsMs = video ? videoPts : audioPts;
+            streaming::PrecisionClock::sleepUntilMicros(startUs + (juce::int64) ((double) ptsMs * 1000.0 / speed));
+            const size_t size = video ? videoSizes[(size_t) v] : audioBytes;
+            const bool muxed = video ? muxer.pushVideo({ pool.data(), size, ptsMs, 0, v % kGop == 0, false }, chunk)
+                                     : muxer.pushAudio({ audio.data(), size, ptsMs, false }, chunk);
+            if (! muxed || ! sink.send(chunk)) { std::printf("tracegate: packet at %lld ms not sent\n", (long long) ptsMs); result = 5; break; }
+
+            const double b0 = threadCpuSec();
+            bridgeLine(bridge, Trace::rtmp, "Sending packet type %d, size %d, channel %d, timestamp %u\n", video ? 9 : 8, (int) size, video ? 6 : 4, (unsigned) ptsMs);
+            const int records = (int) ((chunk.totalSize() + kTlsRecord - 1) / kTlsRecord);
+            for (int r = 0; r < records; ++r)
+                bridgeLine(bridge, Trace::tls, "tls write of %d bytes, record %d of %d\n", juce::jmin(kTlsRecord, (int) chunk.totalSize() - r * kTlsRecord), r + 1, records);
+            bridgeSec[b] += juce::jmax(0.0, threadCpuSec() - b0 - clockSec);
+            lines += (juce::uint64) (1 + records);
+            if (video) ++v; else ++au;
+        }
+        cpuSec[b] = threadCpuSec() - cpu0;
+        const double processSec = processCpuSec() - process0;
+        const auto sent = sink.sent;
+        if (sink.close() != sent) { std::printf("tracegate: the sink lost bytes\n"); result = 5; }
+        if (result != 0) break;
+        log.flush(10000);
+
+        m.set(mode + ".cpuSecPerStreamHour", cpuSec[b] / seconds * 3600.0);
+        // Process CPU also counts the socket reader and the logger thread formatting what got through
+        m.set(mode + ".processCpuSecPerStreamHour", processSec / seconds * 3600.0);
+        m.set(mode + ".modelBridgeCpuSecPerStreamHour", bridgeSec[b] / seconds * 3600.0);
+        m.set(mode + ".modelBridgeNsPerLine", bridgeSec[b] * 1e9 / (double) lines);
+        if (bridge == LogBridge::ungated) m.set(mode + ".droppedRecords", (double) (log.getDroppedRecords() - droppedBefore));
+        if (bridge == LogBridge::tracing) m.set(mode + ".suppressedShare", (double) (Trace::getSuppressedLines() - suppressedBefore) / (double) lines);
+    }
+    Trace::setLevel(Trace::rtmp, rtmpLevel);
+    Trace::setLevel(Trace::tls, tlsLevel);
+    log.setOutputFile(previousFile);
+    file.deleteFile();
+    if (result != 0) return result;
+
+    // The egress thread's share of one core at real time, and what the gate saves of it. "model" keys
+    // come from the modelled lines, not from FfmpegRtmpWriter with FFmpeg's own logging.
+    static bool noted = false;
+    if (! std::exchange(noted, true))
+        std::printf("tracegate: libav* lines are modelled (one rtmp line per packet, one tls line per 16 KiB record); "
+                    "the model* keys are a model of the bridge, not a measurement of FFmpeg's logging\n");
+    m.set("modelLinesPerStreamSec", (double) lines / seconds);
+    m.set("ungatedCorePercent", cpuSec[0] / seconds * 100.0);
+    m.set("gatedCorePercent", cpuSec[1] / seconds * 100.0);
+    m.set("modelSavedCpuSecPerStreamHour", (bridgeSec[0] - bridgeSec[1]) / seconds * 3600.0);
+    m.set("modelSavedCorePercent", (bridgeSec[0] - bridgeSec[1]) / seconds * 100.0);
+    return 0;
+#else
+    juce::ignoreUnused(a, m);
+    std::printf("tracegate: needs POSIX sockets, skipped\n");
+    return kSkipped;
+#endif
+}
+
+// ---- abr -------------------------------------------------------------------------------------
+
+// AbrController driving a simulated bottleneck: the encoder sends at the target plus audio into a FIFO
+// drained at the link capacity (seeded +-10% wobble per 100 ms). Samples every 500 ms, as LiveStreamer
+// takes them, with queue delay and an RTT that grows with the standing queue. Simulated time, so it is
+// instant and exactly repeatable.
+int runAbr(const Args&, Metrics& m) {
+    constexpr int kStepMs = 100, kSampleMs = 500, kAudioKbps = 160, kBaseRttMs = 40;
+    constexpr int kDropAtMs = 60000, kRestoreAtMs = 150000, kEndMs = 240000, kHighKbps = 8000, kLowKbps = 2500;
+    StreamingConfig cfg;
+    cfg.videoBitrateKbps = 6000;
+    cfg.audioBitrateKbps = kAudioKbps;
+    streaming::AbrController abr;
+    const auto settings = streaming::AbrController::settingsFromConfig(cfg);
+    abr.reset(settings);
+
+    juce::Random rng (7);
+    double queueBits = 0.0;
+    juce::uint64 sentBytes = 0;
+    int decreases = 0, increases = 0, settledDecreases = 0;
+    int firstCeilingMs = -1, backoffMs = -1, recoveryMs = -1, maxSettledDelayMs = 0;
+    Samples settledKbps(200), delayMs(kEndMs / kSampleMs);
+    for (int t = 0; t < kEndMs; t += kStepMs) {
+        const double capacityKbps = (t < kDropAtMs || t >= kRestoreAtMs ? kHighKbps : kLowKbps) * (0.9 + 0.2 * rng.nextDouble());
+        queueBits += (double) (abr.getTargetKbps() + kAudioKbps) * kStepMs;
+        const double out = std::min(queueBits, capacityKbps * kStepMs);
+        queueBits -= out;
+        sentBytes += (juce::uint64) (out / 8.0);
+        if ((t + kStepMs) % kSampleMs != 0) continue;
+
+        streaming::TransportSample s;
+        s.timeMs = t + kStepMs;
+        s.bytesSent = sentBytes;
+        s.queuedBytes = (size_t) (queueBits / 8.0);
+        s.queueDelayMs = (int) (queueBits / (double) (abr.getTargetKbps() + kAudioKbps));
+        s.rttMs = kBaseRttMs + (int) (queueBits / capacityKbps);
+        delayMs.add(s.queueDelayMs);
+        const auto d = abr.update(s);
+        if (d.action == streaming::AbrController::Action::decrease) ++decreases;
+        if (d.action == streaming::AbrController::Action::increase) ++increases;
+
+        const int target = abr.getTargetKbps();
+        if (firstCeilingMs < 0 && s.timeMs < kDropAtMs && target >= settings.ceilingKbps) firstCeilingMs = (int) s.timeMs;
+        if (backoffMs < 0 && s.timeMs > kDropAtMs && target + kAudioKbps <= kLowKbps) backoffMs = (int) s.timeMs - kDropAtMs;
+        // Settled: the last 60 s of the narrow link
+        if (s.timeMs > kRestoreAtMs - 60000 && s.timeMs <= kRestoreAtMs) {
+            settledKbps.add(target);
+            maxSettledDelayMs = std::max(maxSettledDelayMs, s.queueDelayMs);
+            if (d.action == streaming::AbrController::Action::decrease) ++settledDecreases;
+        }
+        if (recoveryMs < 0 && s.timeMs > kRestoreAtMs && target >= settings.ceilingKbps) recoveryMs = (int) s.timeMs - kRestoreAtMs;
+    }
+
+    // percentile() leaves the values sorted
+    const double settledMedian = settledKbps.percentile(50.0), settledMin = settledKbps.values.empty() ? 0.0 : settledKbps.values.front();
+    m.set("firstCeilingMs", firstCeilingMs);
+    m.set("backoffMs", backoffMs);
+    m.set("settledKbps.p50", settledMedian);
+    m.set("settledKbps.min", settledMin);
+    m.set("settledKbps.max", settledKbps.percentile(100.0));
+    m.set("settledLinkShare", (settledMedian + kAudioKbps) / kLowKbps);
+    m.set("settledDecreases", settledDecreases);
+    m.set("settledMaxQueueDelayMs", maxSettledDelayMs);
+    m.set("recoveryMs", recoveryMs);
+    m.latency("queueDelayMs", delayMs);
+    m.set("decreases", decreases);
+    m.set("increases", increases);
+
+    // Reach the ceiling on the wide link, back off within 10 s of the drop, hold 50-100% of the narrow
+    // link without standing congestion, and climb back to the ceiling once it widens again
+    juce::StringArray failures;
+    if (firstCeilingMs < 0) failures.add("never reached the ceiling on the wide link");
+    if (backoffMs < 0 || backoffMs > 10000) failures.add("backed off in " + juce::String(backoffMs) + " ms");
+    if (settledMedian + kAudioKbps > kLowKbps || settledMedian + kAudioKbps < 0.5 * kLowKbps) failures.add("settled at " + juce::String(settledMedian) + " kbps");
+    if (maxSettledDelayMs >= settings.congestedDelayMs) failures.add("queue delay reached " + juce::String(maxSettledDelayMs) + " ms after settling");
+    if (recoveryMs < 0) failures.add("did not recover after the link widened");
+    for (const auto& f : failures) std::printf("abr: %s\n", f.toRawUTF8());
+    return failures.isEmpty() ? 0 : 5;
+}
+
+// ---- rtmp ------------------------------------------------------------------------------------
+
+#if PIPELINE_BENCH_SOCKETS
+// Seeded A/V stream for the RTMP cases: 30 fps video with a GOP of 60 (keyframes 8x a P frame, +-25%)
+// and 1024-sample AAC, interleaved by timestamp. Payloads are views into one random pool at varying
+// offsets, so the server's hash catches reordered or damaged messages.
+struct SyntheticStream {
+    static constexpr int kFps = 30, kGop = 60, kAudioRate = 48000;
+    struct Unit { bool video; juce::int64 ptsMs; bool keyframe; size_t offset, size; };
+
+    SyntheticStream(double seconds, int videoKbps, int audioKbps = 160) {
+        cfg.fps = kFps;
+        cfg.videoBitrateKbps = videoKbps;
+        cfg.audioBitrateKbps = audioKbps;
+        const int numVideo = (int) (seconds * kFps), numAudio = (int) (seconds * kAudioRate / 1024);
+        const double pBytes = (double) videoKbps * 125.0 / kFps * kGop / (kGop - 1 + 8);
+        const size_t audioBytes = (size_t) audioKbps * 125 * 1024 / kAudioRate;
+        juce::Random rng (29);
+        size_t largest = audioBytes;
+        for (int v = 0, au = 0; v < numVideo || au < numAudio;) {
+            const juce::int64 vMs = (juce::int64) v * 1000 / kFps, aMs = (juce::int64) au * 1024 * 1000 / kAudioRate;
+            const bool video = v < numVideo && (au >= numAudio || vMs <= aMs);
+            Unit u { video, video ? vMs : aMs, video && v % kGop == 0, (size_t) rng.nextInt(4096), audioBytes };
+            if (video) u.size = (size_t) (pBytes * (u.keyframe ? 8.0 : 1.0) * (0.75 + 0.5 * rng.nextDouble()));
+            largest = std::max(largest, u.size);
+            units.push_back(u);
+            if (video) ++v; else ++au;
+        }
+        pool.resize(largest + 4096);
+        for (auto& b : pool) b = (uint8_t) rng.nextInt(256);
+    }
+
+    // Metadata and both sequence headers, in the order every publisher sends them
+    template <typename Send>
+    bool sendHeaders(streaming::FlvMuxer& muxer, Send&& send) const {
+        static const uint8_t avcC[] = { 1, 0x64, 0, 0x28, 0xff, 0xe1, 0, 4, 0x67, 0x64, 0, 0x28, 1, 0, 4, 0x68, 0xee, 0x3c, 0x80 };
+        static const uint8_t asc[] = { 0x11, 0x90 };
+        streaming::FlvChunk chunk;
+        return muxer.writeMetadata(chunk) && send(chunk)
+            && muxer.pushVideo({ avcC, sizeof(avcC), 0, 0, true, true }, chunk) && send(chunk)
+            && muxer.pushAudio({ asc, sizeof(asc), 0, true }, chunk) && send(chunk);
+    }
+
+    bool mux(streaming::FlvMuxer& muxer, const Unit& u, streaming::FlvChunk& chunk) const {
+        return u.video ? muxer.pushVideo({ pool.data() + u.offset, u.size, u.ptsMs, 0, u.keyframe, false }, chunk)
+                       : muxer.pushAudio({ pool.data() + u.offset, u.size, u.ptsMs, false }, chunk);
+    }
+
+    // FNV-1a over an RTMP message body (the tag minus its header and trailer), as the server hashes it
+    static juce::uint64 hashBody(juce::uint64 h, const streaming::FlvChunk& chunk) {
+        size_t skip = streaming::FlvChunk::tagHeaderSize, keep = chunk.bodySize();
+        for (int i = 0; i < chunk.numSlices && keep > 0; ++i) {
+            const auto* p = static_cast<const uint8_t*>(chunk.slices[i].data);
+            size_t n = chunk.slices[i].size;
+            const size_t s = std::min(skip, n);
+            skip -= s; p += s; n = std::min(n - s, keep);
+            h = LoopbackRtmpServer::fnv1a(h, p, n);
+            keep -= n;
+        }
+        return h;
+    }
+
+    StreamingConfig cfg;
+    std::vector<Unit> units;
+    std::vector<uint8_t> pool;
+};
+
+// Waits (bounded) until the server has seen `messages` media messages
+LoopbackRtmpServer::Stats awaitServer(const LoopbackRtmpServer& server, juce::uint64 messages, int timeoutMs) {
+    const auto deadline = nowNs() + (juce::int64) timeoutMs * 1000000;
+    auto st = server.getStats();
+    while (st.mediaMessages < messages && nowNs() < deadline) { std::this_thread::sleep_for(std::chrono::milliseconds(2)); st = server.getStats(); }
+    return st;
+}
+
+// One publish of the whole stream: paced at `speed` times real time, or flat out when speed <= 0.
+// tokenBucket publishes shared tags through the client's own pacing, as a fan-out endpoint does: the
+// rate is the endpoint's 1.5x of the stream (times `speed`), the burst its 0.15 s of the nominal rate,
+// so every keyframe outgrows the bucket and goes out in paced slices.
+int publishToLoopback(const SyntheticStream& stream, bool libavformat, double speed, const juce::String& key, Metrics& m, bool tokenBucket = false) {
+    LoopbackRtmpServer server;
+    if (! server.start(0.0, stream.units.size() + 16)) { std::printf("rtmp: cannot start the loopback server\n"); return 5; }
+    streaming::RtmpClient client;
+    client.setUseLibavformat(libavformat);
+    if (tokenBucket) {
+        const double nominalBytesPerSec = (double) (stream.cfg.videoBitrateKbps + stream.cfg.audioBitrateKbps) * 125.0 * 1.5;
+        client.setPacingRate(nominalBytesPerSec * speed, (size_t) (nominalBytesPerSec / 10.0));
+    }
+    if (! client.connect(server.url("bench"), 5000)) { std::printf("rtmp: %s connect failed\n", key.toRawUTF8()); return 5; }
+    const auto poolBuffer = streaming::MediaBuffer::wrap(stream.pool.data(), stream.pool.size(), nullptr, nullptr);
+    size_t maxQueued = 0;
+
+    Samples callNs(stream.units.size()), latencyUs(stream.units.size());
+    std::vector<juce::int64> firstTryNs;
+    firstTryNs.reserve(stream.units.size() + 2);
+    juce::uint64 hash = LoopbackRtmpServer::kFnvOffset, mediaMessages = 0;
+    // Retries a full queue the way an endpoint thread does; every call is timed on its own. Audio and
+    // video tags (sequence headers included) are what the server hashes and time-stamps.
+    auto send = [&](const streaming::FlvChunk& chunk) {
+        if (chunk.tagType == 8 || chunk.tagType == 9) {
+            firstTryNs.push_back(nowNs());
+            hash = SyntheticStream::hashBody(hash, chunk);
+            ++mediaMessages;
+        }
+        const auto tag = tokenBucket ? streaming::SharedFlvTag::fromChunk(chunk, poolBuffer) : nullptr;
+        for (;;) {
+            const auto c0 = nowNs();
+            const bool ok = tag != nullptr ? client.sendTag(tag) : client.sendTag(chunk);
+            callNs.add((double) (nowNs() - c0));
+            maxQueued = std::max(maxQueued, client.queuedBytes());
+            if (ok) { client.service(0); return true; }
+            if (! client.isConnected()) return false;
+            client.service(5);
+        }
+    };
+    streaming::FlvMuxer muxer;
+    muxer.start(stream.cfg);
+    bool ok = stream.sendHeaders(muxer, send);
+    streaming::FlvChunk chunk;
+    const auto startUs = streaming::PrecisionClock::nowMicros();
+    const auto t0 = nowNs();
+    for (size_t i = 0; ok && i < stream.units.size(); ++i) {
+        const auto& u = stream.units[i];
+        if (speed > 0.0) streaming::PrecisionClock::sleepUntilMicros(startUs + (juce::int64) ((double) u.ptsMs * 1000.0 / speed));
+        ok = stream.mux(muxer, u, chunk) && send(chunk);
+    }
+    while (ok && client.queuedBytes() > 0 && client.isConnected()) client.service(20);
+    const auto st = awaitServer(server, mediaMessages, 10000);
+    const auto arrivals = server.getArrivals();
+    client.close();
+    server.stop();
+
+    const bool intact = ok && st.handshakes == 1 && st.publishes == 1 && st.app == "live" && st.streamName == "bench"
+                        && st.mediaMessages == mediaMessages && st.hash == hash && arrivals.size() == firstTryNs.size();
+    if (! intact) {
+        std::printf("rtmp: %s handshakes %d publishes %d app '%s' stream '%s', %llu/%llu messages, hash %s\n", key.toRawUTF8(), st.handshakes, st.publishes,
+                    st.app.toRawUTF8(), st.streamName.toRawUTF8(), (unsigned long long) st.mediaMessages, (unsigned long long) mediaMessages, st.hash == hash ? "ok" : "differs");
+        return 5;
+    }
+    for (size_t i = 0; i < arrivals.size(); ++i) latencyUs.add((double) (arrivals[i].arrivalNs - firstTryNs[i]) * 1e-3);
+    const double sec = (double) (arrivals.back().arrivalNs - t0) * 1e-9;
+    m.set(key + ".mbps", (double) st.bytesReceived * 8.0 / sec / 1e6);
+    m.latency(key + ".sendCallNs", callNs);
+    m.latency(key + ".latencyUs", latencyUs);
+    if (tokenBucket) m.set(key + ".maxQueuedBytes", (double) maxQueued);
+    return 0;
+}
+#endif
+
+int runRtmp(const Args& a, Metrics& m) {
+#if PIPELINE_BENCH_SOCKETS
+    const double seconds = secondsOr(a, 20.0), speed = speedOr(a, 8.0);
+    const SyntheticStream stream(seconds, 6000);
+    m.set("streamSeconds", seconds);
+    m.set("speed", speed);
+    int result = 0;
+   #if HAVE_FFMPEG
+    for (const bool libavformat : { false, true })
+   #else
+    for (const bool libavformat : { false })
+   #endif
+    {
+        const juce::String transport = libavformat ? "libavformat" : "native";
+        result = juce::jmax(result, publishToLoopback(stream, libavformat, speed, transport + ".paced", m));
+        result = juce::jmax(result, publishToLoopback(stream, libavformat, 0.0, transport + ".flatOut", m));
+    }
+    result = juce::jmax(result, publishToLoopback(stream, false, speed, "native.tokenBucket", m, true));
+    return result;
+#else
+    juce::ignoreUnused(a, m);
+    std::printf("rtmp: needs POSIX sockets, skipped\n");
+    return kSkipped;
+#endif
+}
+
+// ---- fanout ----------------------------------------------------------------------------------
+
+int runFanout(const Args& a, Metrics& m) {
+#if PIPELINE_BENCH_SOCKETS
+    const double seconds = secondsOr(a, 20.0), speed = speedOr(a, 4.0);
+    const SyntheticStream stream(seconds, 6000);
+    const double streamBytesPerSec = (double) (stream.cfg.videoBitrateKbps + stream.cfg.audioBitrateKbps) * 125.0 * speed;
+
+    // Two fast sinks, one reading at half the stream rate, and a port nobody listens on any more
+    LoopbackRtmpServer fast[2], slow, gone;
+    const size_t expected = stream.units.size() + 16;
+    if (! fast[0].start(0.0, expected) || ! fast[1].start(0.0, expected) || ! slow.start(streamBytesPerSec * 0.5, expected) || ! gone.start()) {
+        std::printf("fanout: cannot start the loopback servers\n");
+        return 5;
+    }
+    const juce::String deadUrl = gone.url("dead");
+    gone.stop();
+    // Endpoints pace at 1.5x and size their backlog from the configured rates: give them the rate the
+    // stream really arrives at
+    StreamingConfig cfg = stream.cfg;
+    cfg.videoBitrateKbps = (int) (cfg.videoBitrateKbps * speed);
+    cfg.audioBitrateKbps = (int) (cfg.audioBitrateKbps * speed);
+    for (const auto& url : { fast[0].url("fast0"), fast[1].url("fast1"), slow.url("slow"), deadUrl })
+        cfg.endpoints.add({ url, true });
+    streaming::RtmpMultiPublisher publisher;
+    if (! publisher.connectAll(cfg)) { std::printf("fanout: no endpoint connected\n"); return 5; }
+
+    Samples callNs(stream.units.size() + 3);
+    std::vector<juce::int64> publishNs;
+    publishNs.reserve(stream.units.size() + 2);
+    juce::uint64 hash = LoopbackRtmpServer::kFnvOffset, mediaMessages = 0;
+    auto send = [&](const streaming::FlvChunk& chunk) {
+        if (chunk.tagType == 8 || chunk.tagType == 9) {
+            publishNs.push_back(nowNs());
+            hash = SyntheticStream::hashBody(hash, chunk);
+            ++mediaMessages;
+        }
+        const auto c0 = nowNs();
+        const bool ok = publisher.sendTag(chunk);
+        callNs.add((double) (nowNs() - c0));
+        return ok;
+    };
+    streaming::FlvMuxer muxer;
+    muxer.start(stream.cfg);
+    bool ok = stream.sendHeaders(muxer, send);
+    streaming::FlvChunk chunk;
+    const auto startUs = streaming::PrecisionClock::nowMicros();
+    const auto t0 = nowNs();
+    for (size_t i = 0; ok && i < stream.units.size(); ++i) {
+        streaming::PrecisionClock::sleepUntilMicros(startUs + (juce::int64) ((double) stream.units[i].ptsMs * 1000.0 / speed));
+        ok = stream.mux(muxer, stream.units[i], chunk) && send(chunk);
+    }
+    const LoopbackRtmpServer::Stats fastStats[2] = { awaitServer(fast[0], mediaMessages, 10000), awaitServer(fast[1], mediaMessages, 10000) };
+    const double sec = (double) (nowNs() - t0) * 1e-9;
+    const auto endpoints = publisher.getStats();
+    const auto slowStats = slow.getStats();
+    publisher.closeAll();
+
+    Samples latencyUs(publishNs.size() * 2);
+    bool intact = ok;
+    for (int f = 0; f < 2; ++f) {
+        const auto arrivals = fast[f].getArrivals();
+        const bool complete = fastStats[f].mediaMessages == mediaMessages && fastStats[f].hash == hash && arrivals.size() == publishNs.size();
+        if (! complete) std::printf("fanout: fast endpoint %d got %llu/%llu messages, hash %s\n", f, (unsigned long long) fastStats[f].mediaMessages,
+                                    (unsigned long long) mediaMessages, fastStats[f].hash == hash ? "ok" : "differs");
+        intact = intact && complete;
+        for (size_t i = 0; complete && i < arrivals.size(); ++i) latencyUs.add((double) (arrivals[i].arrivalNs - publishNs[i]) * 1e-3);
+    }
+    for (auto& server : fast) server.stop();
+    slow.stop();
+    if (endpoints.size() != 4 || ! endpoints[2].connected) { std::printf("fanout: the slow endpoint lost its connection\n"); intact = false; }
+
+    m.set("streamSeconds", seconds);
+    m.set("speed", speed);
+    m.latency("publishCallNs", callNs);
+    m.latency("fastLatencyUs", latencyUs);
+    m.set("aggregateMbps", (double) (fastStats[0].bytesReceived + fastStats[1].bytesReceived + slowStats.bytesReceived) * 8.0 / sec / 1e6);
+    m.set("slowReceivedShare", mediaMessages > 0 ? (double) slowStats.mediaMessages / (double) mediaMessages : 0.0);
+    m.set("slowDroppedTags", endpoints.size() == 4 ? (double) endpoints[2].droppedTags : 0.0);
+    m.set("deadReconnects", endpoints.size() == 4 ? (double) endpoints[3].reconnects : 0.0);
+    m.set("deadDroppedTags", endpoints.size() == 4 ? (double) endpoints[3].droppedTags : 0.0);
+    return intact ? 0 : 5;
+#else
+    juce::ignoreUnused(a, m);
+    std::printf("fanout: needs POSIX sockets, skipped\n");
+    return kSkipped;
+#endif
+}
+
+// ---- writers ---------------------------------------------------------------------------------
+
+#if PIPELINE_BENCH_SOCKETS && HAVE_FFMPEG
+// One FfmpegRtmpWriter per loopback server, each fed by its own video and audio thread in real time
+struct WriterLane {
+    LoopbackRtmpServer server;
+    FfmpegRtmpWriter writer;
+    std::vector<juce::int64> videoPushNs, audioPushNs;
+    std::atomic<juce::uint64> refused { 0 };
+    std::thread video, audio;
+};
+#endif
+
+int runWriters(const Args& a, Metrics& m) {
+#if PIPELINE_BENCH_SOCKETS && HAVE_FFMPEG
+    constexpr int kLanes = 4, kFps = 30, kGop = 60, kAudioRate = 48000, kCloseCycles = 20;
+    // The egress paces by PTS against the wall clock, so this case always runs in real time
+    const double seconds = secondsOr(a, 10.0);
+    const int numVideo = (int) (seconds * kFps), numAudio = (int) (seconds * kAudioRate / 1024);
+    StreamingConfig cfg;
+    cfg.fps = kFps;
+    cfg.videoBitrateKbps = 6000;
+    cfg.audioBitrateKbps = 160;
+    const double pBytes = (double) cfg.videoBitrateKbps * 125.0 / kFps * kGop / (kGop - 1 + 8);
+    const double streamBytesPerSec = (double) (cfg.videoBitrateKbps + cfg.audioBitrateKbps) * 125.0;
+    // Video goes by reference out of one pool (AVCC extradata, so flvenc passes payloads through); audio is copied
+    std::vector<uint8_t> pool((size_t) (pBytes * 8.0 * 1.25) + 16, 0x5a), audioFrame((size_t) cfg.audioBitrateKbps * 125 * 1024 / kAudioRate, 0x21);
+    static const uint8_t avcC[] = { 1, 0x64, 0, 0x28, 0xff, 0xe1, 0, 4, 0x67, 0x64, 0, 0x28, 1, 0, 4, 0x68, 0xee, 0x3c, 0x80 };
+    static const uint8_t asc[] = { 0x11, 0x90 };
+    auto frameSize = [&](int i) { return (size_t) (pBytes * (i % kGop == 0 ? 8.0 : 1.0) * (0.75 + 0.5 * (double) ((i * 7919) % 1000) / 1000.0)); };
+
+    // Lane 0 reads at a quarter of the stream rate; its writer backs up and blocks in libavformat while
+    // the others must carry on as if it weren't there
+    WriterLane lanes[kLanes];
+    for (int l = 0; l < kLanes; ++l) {
+        auto& lane = lanes[l];
+        if (! lane.server.start(l == 0 ? streamBytesPerSec * 0.25 : 0.0, (size_t) (numVideo + numAudio + 16))) { std::printf("writers: cannot start the loopback servers\n"); return 5; }
+        if (! lane.writer.open(lane.server.url("lane" + juce::String(l)), cfg)) { std::printf("writers: lane %d open failed\n", l); return 5; }
+        lane.videoPushNs.reserve((size_t) numVideo);
+        lane.audioPushNs.reserve((size_t) numAudio);
+    }
+    const auto startUs = streaming::PrecisionClock::nowMicros() + 50000;
+    for (auto& lane : lanes) {
+        // Both configs race from the two producer threads, as the encoders deliver them
+        lane.video = std::thread([&] {
+            lane.writer.setVideoConfig(avcC, sizeof(avcC));
+            for (int i = 0; i < numVideo; ++i) {
+                const auto ptsMs = (juce::int64) i * 1000 / kFps;
+                streaming::PrecisionClock::sleepUntilMicros(startUs + ptsMs * 1000);
+                lane.videoPushNs.push_back(nowNs());
+                if (! lane.writer.writeVideoFrame(streaming::MediaBuffer::wrap(pool.data(), frameSize(i), nullptr, nullptr), ptsMs, i % kGop == 0)) lane.refused.fetch_add(1);
+            }
+        });
+        lane.audio = std::thread([&] {
+            lane.writer.setAudioConfig(asc, sizeof(asc));
+            for (int i = 0; i < numAudio; ++i) {
+                const auto ptsMs = (juce::int64) i * 1024 * 1000 / kAudioRate;
+                streaming::PrecisionClock::sleepUntilMicros(startUs + ptsMs * 1000);
+                lane.audioPushNs.push_back(nowNs());
+                if (! lane.writer.writeAudioFrame(audioFrame.data(), audioFrame.size(), ptsMs)) lane.refused.fetch_add(1);
+            }
+        });
+    }
+    for (auto& lane : lanes) { lane.video.join(); lane.audio.join(); }
+
+    // Fast lanes: every frame arrives (after one sequence header per stream), with no gap a stalled neighbour would open
+    Samples latencyUs((size_t) (numVideo + numAudio) * (kLanes - 1)), gapMs((size_t) numVideo * (kLanes - 1));
+    bool intact = true;
+    for (int l = 1; l < kLanes; ++l) {
+        auto& lane = lanes[l];
+        awaitServer(lane.server, (juce::uint64) (numVideo + numAudio + 2), 5000);
+        const auto stats = lane.writer.getStats();
+        std::vector<LoopbackRtmpServer::Arrival> video, audio;
+        for (const auto& arrival : lane.server.getArrivals()) (arrival.type == 9 ? video : audio).push_back(arrival);
+        const bool complete = lane.refused.load() == 0 && stats.droppedPackets == 0 && stats.droppedVideoFrames == 0
+                              && video.size() == (size_t) numVideo + 1 && audio.size() == (size_t) numAudio + 1;
+        if (! complete) {
+            std::printf("writers: lane %d got %d/%d video and %d/%d audio messages (%llu refused, %llu ring drops, %llu shed)\n", l, (int) video.size() - 1, numVideo,
+                        (int) audio.size() - 1, numAudio, (unsigned long long) lane.refused.load(), (unsigned long long) stats.droppedPackets, (unsigned long long) stats.droppedVideoFrames);
+            intact = false;
+            continue;
+        }
+        for (int i = 0; i < numVideo; ++i) {
+            latencyUs.add((double) (video[(size_t) i + 1].arrivalNs - lane.videoPushNs[(size_t) i]) * 1e-3);
+            if (i > 0) gapMs.add((double) (video[(size_t) i + 1].arrivalNs - video[(size_t) i].arrivalNs) * 1e-6);
+        }
+        for (int i = 0; i < numAudio; ++i) latencyUs.add((double) (audio[(size_t) i + 1].arrivalNs - lane.audioPushNs[(size_t) i]) * 1e-3);
+    }
+    const auto slowStats = lanes[0].writer.getStats();
+    const auto slowServer = lanes[0].server.getStats();
+    Samples closeMs(kLanes + kCloseCycles);
+    for (auto& lane : lanes) {
+        const auto c0 = nowNs();
+        lane.writer.close();
+        closeMs.add((double) (nowNs() - c0) * 1e-6);
+        lane.server.stop();
+    }
+    const double maxGapMs = gapMs.percentile(100.0);
+    if (intact && maxGapMs > 250.0) { std::printf("writers: a fast lane stalled for %.1f ms\n", maxGapMs); intact = false; }
+
+    // close() while both producers hammer the writer unpaced: producers must be out of the rings before
+    // they are reset, and the two configs race to start the egress thread
+    LoopbackRtmpServer cycleServer;
+    if (! cycleServer.start()) { std::printf("writers: cannot start the loopback server\n"); return 5; }
+    juce::uint64 cycleAccepted = 0;
+    for (int c = 0; c < kCloseCycles; ++c) {
+        FfmpegRtmpWriter writer;
+        if (! writer.open(cycleServer.url("cycle" + juce::String(c)), cfg)) { std::printf("writers: close cycle %d open failed\n", c); intact = false; break; }
+        std::atomic<bool> stop { false };
+        std::atomic<juce::uint64> accepted { 0 };
+        auto hammer = [&](bool video) {
+            if (video) writer.setVideoConfig(avcC, sizeof(avcC)); else writer.setAudioConfig(asc, sizeof(asc));
+            for (int i = 0; ! stop.load(); ++i) {
+                const bool ok = video ? writer.writeVideoFrame(pool.data(), frameSize(i), (juce::int64) i * 1000 / kFps, i % kGop == 0)
+                                      : writer.writeAudioFrame(audioFrame.data(), audioFrame.size(), (juce::int64) i * 1024 * 1000 / kAudioRate);
+                if (ok) accepted.fetch_add(1);
+            }
+        };
+        std::thread videoThread(hammer, true), audioThread(hammer, false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20 + c % 5 * 10));
+        const auto c0 = nowNs();
+        writer.close();
+        closeMs.add((double) (nowNs() - c0) * 1e-6);
+        stop.store(true);
+        videoThread.join();
+        audioThread.join();
+        if (writer.getStats().queuedBytes != 0) { std::printf("writers: close cycle %d left bytes queued\n", c); intact = false; }
+        cycleAccepted += accepted.load();
+    }
+    cycleServer.stop();
+
+    m.set("streamSeconds", seconds);
+    m.set("lanes", kLanes);
+    m.latency("fastLatencyUs", latencyUs);
+    m.latency("fastVideoGapMs", gapMs);
+    m.set("slowReceivedShare", (double) slowServer.mediaMessages / (double) (numVideo + numAudio + 2));
+    m.set("slowDroppedPackets", (double) slowStats.droppedPackets);
+    m.set("slowShedVideoFrames", (double) slowStats.droppedVideoFrames);
+    m.latency("closeMs", closeMs);
+    m.set("closeCycles", kCloseCycles);
+    m.set("closeCycleAcceptedFrames", (double) cycleAccepted);
+    return intact ? 0 : 5;
+#else
+    juce::ignoreUnused(a, m);
+    std::printf("writers: needs FFmpeg and POSIX sockets, skipped\n");
+    return kSkipped;
+#endif
+}
+
+// ---- report ----------------------------------------------------------------------------------
+
+juce::String jsonNumber(double v) {
+    if (! std::isfinite(v)) return "null";
+    if (v == std::floor(v) && std::abs(v) < 1e15) return juce::String((juce::int64) v);
+    return juce::String(v, 3);
+}
+
+void printUsage() {
+    std::printf("Usage: PipelineBench [--cases recorder,interleave,ring,copies,egress,flv,gopdrop,frames,log,tracegate,abr,rtmp,fanout,writers] [--repeat N, default 3]\n"
+                "                     [--seconds N] [--speed X] [--json results.json]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+#if PIPELINE_BENCH_SOCKETS
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    Args a;
+    for (int i = 1; i < argc; ++i) {
+        const bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--cases") == 0 && hasValue) a.cases = argv[++i];
+        else if (std::strcmp(argv[i], "--repeat") == 0 && hasValue) a.repeat = juce::jmax(1, juce::String(argv[++i]).getIntValue());
+        else if (std::strcmp(argv[i], "--seconds") == 0 && hasValue) a.seconds = juce::String(argv[++i]).getDoubleValue();
+        else if (std::strcmp(argv[i], "--speed") == 0 && hasValue) a.speed = juce::String(argv[++i]).getDoubleValue();
+        else if (std::strcmp(argv[i], "--json") == 0 && hasValue) a.json = argv[++i];
+        else { printUsage(); return 1; }
+    }
+
+    using Runner = int (*)(const Args&, Metrics&);
+    const std::pair<const char*, Runner> all[] = { { "recorder", runRecorder }, { "interleave", runInterleave }, { "ring", runRing }, { "copies", runCopies },
+                                                   { "egress", runEgress }, { "flv", runFlv }, { "gopdrop", runGopDrop }, { "frames", runFrames },
+                                                   { "log", runLog }, { "tracegate", runTraceGate }, { "abr", runAbr }, { "rtmp", runRtmp },
+                                                   { "fanout", runFanout }, { "writers", runWriters } };
+    juce::String json;
+    json << "{\"tool\":\"PipelineBench\",\"schema\":1,\"timeMs\":" << juce::Time::currentTimeMillis()
+         << ",\"cpus\":" << juce::SystemStats::getNumCpus() << ",\"isa\":\"" << SampleConvert::getIsaName(SampleConvert::getIsa())
+         << "\",\"repeat\":" << a.repeat << ",\"cases\":{";
+    int result = 0, numCases = 0;
+    for (const auto& name : juce::StringArray::fromTokens(a.cases, ",", "")) {
+        Runner run = nullptr;
+        for (const auto& c : all) if (name.trim() == c.first) run = c.second;
+        if (run == nullptr) { std::printf("unknown case '%s'\n", name.toRawUTF8()); printUsage(); return 1; }
+
+        // Every run sets the same keys in the same order; each reported value is the median over runs
+        juce::StringArray keys;
+        std::vector<std::vector<double>> runs;
+        int status = 0;
+        for (int r = 0; r < a.repeat && status != kSkipped; ++r) {
+            Metrics m;
+            const int runStatus = run(a, m);
+            status = runStatus == kSkipped ? kSkipped : juce::jmax(status, runStatus);
+            if (keys.isEmpty()) { keys = m.keys; runs.resize((size_t) keys.size()); }
+            for (int k = 0; k < keys.size() && k < (int) m.values.size(); ++k) runs[(size_t) k].push_back(m.values[(size_t) k]);
+        }
+        if (status == kSkipped) {
+            std::printf("%s skipped\n", name.trim().toRawUTF8());
+            json << (numCases++ > 0 ? "," : "") << "\"" << name.trim() << "\":{\"status\":\"skipped\"}";
+            continue;
+        }
+        result = juce::jmax(result, status);
+
+        std::printf("%s (median of %d)%s\n", name.trim().toRawUTF8(), a.repeat, status != 0 ? juce::String(", exit " + juce::String(status)).toRawUTF8() : "");
+        json << (numCases++ > 0 ? "," : "") << "\"" << name.trim() << "\":{\"status\":" << status;
+        for (int k = 0; k < keys.size(); ++k) {
+            const double v = median(runs[(size_t) k]);
+            std::printf("  %-28s %14.3f\n", keys[k].toRawUTF8(), v);
+            json << ",\"" << keys[k] << "\":" << jsonNumber(v);
+        }
+        json << "}";
+    }
+    json << "}}";
+
+    if (a.json.isNotEmpty()) {
+        const juce::File file(a.json);
+        file.deleteFile();
+        juce::FileOutputStream out(file);
+        if (! out.openedOk()) { std::printf("cannot write %s\n", a.json.toRawUTF8()); return 1; }
+        out << json << "\n";
+    }
+    return result;
+}
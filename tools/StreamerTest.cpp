@@ -1,42 +1,35 @@
 #include "../src/LiveStreamer.h"
-#include "../src/ScreenRecorder.h"
+#include "../src/LoadGenerator.h"
+#include "../src/PacingScheduler.h"
 #include "../src/StreamingConfig.h"
 #include "../src/Logging.h"
+#include "../src/Trace.h"
+#include "../src/Telemetry.h"
 #include <atomic>
 #include <thread>
 #include <chrono>
 #include <cstring>
-#include <CoreVideo/CoreVideo.h>
+#include <vector>
+#if JUCE_MAC
+ #include "../src/ScreenRecorder.h"
+#endif
 
 using namespace streaming;
 
 static void printUsage() {
-    juce::String msg = "Usage: StreamerTest [--url <rtmp(s)_url>] [--profile <name>] [--preset <name>] [--seconds <N>] [--synthetic]\n"
-                       "Presets: youtube_720p30, youtube_1080p30, facebook_720p30, facebook_1080p30, facebook_1080p60\n";
+    juce::String msg = "Usage: StreamerTest [--url <rtmp(s)_url|file.flv>] [--profile <name>] [--preset <name>] [--seconds <N>] [--synthetic] [--software] [--videoKbps <N>] [--trace <spec>] [--metrics <file.jsonl|file.csv>]\n"
+                       "                   [--scenario <name|file>] [--format bgra|nv12] [--speed 1|2|...|max] [--seed <N>]\n"
+                       "Presets: youtube_720p30, youtube_1080p30, facebook_720p30, facebook_1080p30, facebook_1080p60\n"
+                       "--software encodes with libavcodec instead of VideoToolbox (always the case off macOS, where input is synthetic)\n"
+                       "--trace sets diagnostic levels, e.g. rtmp=debug,tls=trace or all=trace (default warning; also CREATOR_TRACE).\n"
+                       "--metrics samples the pipeline telemetry into the file every second (JSON Lines, or CSV by extension).\n"
+                       "--scenario drives the synthetic input: " + LoadGenerator::Scenario::getBuiltInNames().joinIntoString(", ") + " (default steady), or a script file.\n"
+                       "--speed offers synthetic video at that multiple of the preset's frame rate and bitrate (max: as fast as the pipeline takes\n"
+                       "frames, up to 8x); frames are the same at any speed, audio stays real time.\n"
+                       "The egress thread's CPU use is logged when the stream stops.\n";
     LogMessage(msg);
 }
 
-static CVPixelBufferRef makeBGRAFrame(int width, int height, uint8_t r, uint8_t g, uint8_t b) {
-    CVPixelBufferRef pixel = nullptr;
-    const OSType fmt = kCVPixelFormatType_32BGRA;
-    CVReturn rc = CVPixelBufferCreate(kCFAllocatorDefault, width, height, fmt, nullptr, &pixel);
-    if (rc != kCVReturnSuccess || pixel == nullptr) return nullptr;
-    CVPixelBufferLockBaseAddress(pixel, kCVPixelBufferLock_ReadOnly);
-    uint8_t* base = (uint8_t*) CVPixelBufferGetBaseAddress(pixel);
-    const size_t bytesPerRow = CVPixelBufferGetBytesPerRow(pixel);
-    for (int y = 0; y < height; ++y) {
-        uint8_t* row = base + y * bytesPerRow;
-        for (int x = 0; x < width; ++x) {
-            row[x * 4 + 0] = b;
-            row[x * 4 + 1] = g;
-            row[x * 4 + 2] = r;
-            row[x * 4 + 3] = 0xFF;
-        }
-    }
-    CVPixelBufferUnlockBaseAddress(pixel, kCVPixelBufferLock_ReadOnly);
-    return pixel;
-}
-
 static juce::File keysConfigFile() {
     auto dir = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
                    .getChildFile("Creator Tool");
@@ -91,15 +84,26 @@ static juce::String urlFromProfile(const juce::String& profileName) {
     return {};
 }
 
+// Highest --speed, and the frame grid --speed max runs on
+static constexpr int kMaxSpeed = 8;
+
 int main(int argc, char** argv) {
     juce::ignoreUnused(argc, argv);
 
     juce::String url;
     int runSeconds = 900; // default 15 minutes
     bool useSynthetic = false;
+    bool useSoftware = false;
     juce::String profile;
     juce::String preset;
     int overrideVideoKbps = -1;
+    juce::String traceSpec;
+    juce::String metricsPath;
+    juce::String scenarioName = "steady";
+    auto format = LoadGenerator::Format::bgra;
+    int speed = 1;
+    bool maxSpeed = false;
+    juce::uint32 seed = 1;
 
     for (int i = 1; i < argc; ++i) {
         if (std::strcmp(argv[i], "--url") == 0 && i + 1 < argc) {
@@ -108,17 +112,42 @@ int main(int argc, char** argv) {
             runSeconds = juce::String(argv[++i]).getIntValue();
         } else if (std::strcmp(argv[i], "--synthetic") == 0) {
             useSynthetic = true;
+        } else if (std::strcmp(argv[i], "--software") == 0) {
+            useSoftware = true;
+        } else if (std::strcmp(argv[i], "--help") == 0) {
+            printUsage();
+            return 0;
         } else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
             profile = argv[++i];
         } else if (std::strcmp(argv[i], "--preset") == 0 && i + 1 < argc) {
             preset = argv[++i];
         } else if (std::strcmp(argv[i], "--videoKbps") == 0 && i + 1 < argc) {
             overrideVideoKbps = juce::String(argv[++i]).getIntValue();
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            traceSpec = argv[++i];
+        } else if (std::strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metricsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            scenarioName = argv[++i];
+        } else if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            format = std::strcmp(argv[++i], "nv12") == 0 ? LoadGenerator::Format::nv12 : LoadGenerator::Format::bgra;
+        } else if (std::strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+            maxSpeed = std::strcmp(argv[++i], "max") == 0;
+            speed = maxSpeed ? kMaxSpeed : juce::jlimit(1, kMaxSpeed, juce::String(argv[i]).getIntValue());
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (juce::uint32) juce::String(argv[++i]).getLargeIntValue();
         }
     }
 
+    Trace::configureFromEnvironment();
+    if (traceSpec.isNotEmpty() && !Trace::configure(traceSpec)) LogMessage("CLI: could not fully parse --trace " + traceSpec);
+
     if (url.isEmpty() && profile.isNotEmpty()) url = urlFromProfile(profile);
     if (url.isEmpty()) LogMessage("CLI: no URL provided; use --url or --profile to select a saved key");
+#if !JUCE_MAC
+    // No screen capture here: the pipeline is driven by generated frames
+    useSynthetic = true;
+#endif
 
     LogMessage("CLI: StreamerTest starting");
 
@@ -132,6 +161,7 @@ int main(int argc, char** argv) {
     cfg.audioChannels = 2;
     cfg.audioBitrateKbps = 128;
     cfg.rtmpUrl = url;
+    cfg.useHardwareEncoder = !useSoftware;
 
     if (preset.isNotEmpty()) {
         auto p = preset.toLowerCase();
@@ -157,57 +187,86 @@ int main(int argc, char** argv) {
         cfg.videoBitrateKbps = overrideVideoKbps;
     }
 
+    // Test audio, and with --synthetic the frames, depend only on the scenario, seed and preset
+    LoadGenerator::Scenario scenario;
+    juce::String scenarioError;
+    if (!LoadGenerator::Scenario::load(scenarioName, scenario, scenarioError)) {
+        LogMessage("CLI: scenario " + scenarioName + ": " + scenarioError);
+        return 1;
+    }
+    LoadGenerator load;
+    LoadGenerator::Options loadOptions;
+    loadOptions.width = cfg.videoWidth;
+    loadOptions.height = cfg.videoHeight;
+    loadOptions.fps = cfg.fps;
+    loadOptions.format = format;
+    loadOptions.seed = seed;
+    loadOptions.sampleRate = cfg.audioSampleRate;
+    load.prepare(loadOptions, scenario);
+    const int presetFps = cfg.fps;
+    if (useSynthetic) {
+        // The pipeline carries `speed` times the preset: more frames per second at the same bits per frame
+        cfg.fps *= speed;
+        cfg.videoBitrateKbps *= speed;
+        LogMessage("CLI: synthetic " + juce::String(format == LoadGenerator::Format::nv12 ? "NV12" : "BGRA") + " input, scenario " + scenario.name
+                   + ", seed " + juce::String((juce::int64) seed) + ", " + (maxSpeed ? juce::String("max speed") : juce::String(speed) + "x")
+                   + " (" + juce::String(cfg.fps) + " fps, " + juce::String(cfg.videoBitrateKbps) + " kbps)");
+    }
+
+    // The streamer reads its audio from a tap, as in the plugin; declared first so it outlives the streamer
+    AudioTap tap;
+    tap.prepare(2, 1 << 16);
     LiveStreamer streamer;
+    streamer.setAudioSource(&tap);
     if (!streamer.start(cfg)) {
         LogMessage("CLI: streamer.start failed");
         return 1;
     }
 
+    if (metricsPath.isNotEmpty()) Telemetry::getInstance().startDump(juce::File::getCurrentWorkingDirectory().getChildFile(metricsPath));
+    Telemetry::Sampler summary; // whole-run latencies for the report at the end
+
     std::atomic<bool> running{true};
 
-    // Audio thread: 1 kHz sine into AAC path
-    const double freq = 1000.0;
+    // Audio thread: the scenario's signal in 512-frame blocks at real time, as a host would call processBlock
     const int block = 512;
-    juce::AudioBuffer<float> tone(2, block);
-    double phase = 0.0;
-    const double inc = 2.0 * juce::MathConstants<double>::pi * freq / (double) cfg.audioSampleRate;
-
+    juce::AudioBuffer<float> audio(2, block);
     auto audioThread = std::thread([&]{
-        while (running.load()) {
-            for (int i = 0; i < block; ++i) {
-                float s = (float) std::sin(phase);
-                phase += inc; if (phase > 2.0 * juce::MathConstants<double>::pi) phase -= 2.0 * juce::MathConstants<double>::pi;
-                for (int c = 0; c < tone.getNumChannels(); ++c) tone.setSample(c, i, s * 0.1f);
-            }
-            streamer.pushAudioPCM(tone, block, (double) cfg.audioSampleRate, tone.getNumChannels());
-            std::this_thread::sleep_for(std::chrono::milliseconds((int) llround(1000.0 * (double) block / (double) cfg.audioSampleRate)));
+        const juce::int64 startUs = PrecisionClock::nowMicros();
+        for (juce::int64 n = 0; running.load(); ++n) {
+            load.renderAudio(audio.getArrayOfWritePointers(), audio.getNumChannels(), block);
+            tap.write(audio.getArrayOfReadPointers(), audio.getNumChannels(), block, (double) cfg.audioSampleRate);
+            PrecisionClock::sleepUntilMicros(startUs + (n + 1) * block * 1000000 / cfg.audioSampleRate);
         }
     });
 
+#if JUCE_MAC
     std::unique_ptr<ScreenRecorder> cap;
+#endif
     std::unique_ptr<std::thread> videoThread;
+    std::atomic<juce::int64> framesOffered { 0 };
+    const juce::int64 videoStartUs = PrecisionClock::nowMicros();
 
     if (useSynthetic) {
-        // Generate BGRA frames @ cfg.fps with color cycling
+        // Frames on cfg.fps's grid (absolute deadlines); a push that overruns its slot makes the next frames
+        // go back to back, so at max speed the encoder sets the pace
         videoThread = std::make_unique<std::thread>([&]{
-            const int64_t frameDurationMs = (int64_t) llround(1000.0 / (double) cfg.fps);
-            int64_t ptsMs = 0;
-            int t = 0;
-            while (running.load()) {
-                uint8_t r = (uint8_t) ((std::sin(t * 0.05) * 0.5 + 0.5) * 255.0);
-                uint8_t g = (uint8_t) ((std::sin(t * 0.07 + 2.0) * 0.5 + 0.5) * 255.0);
-                uint8_t b = (uint8_t) ((std::sin(t * 0.09 + 4.0) * 0.5 + 0.5) * 255.0);
-                CVPixelBufferRef pb = makeBGRAFrame(cfg.videoWidth, cfg.videoHeight, r, g, b);
-                if (pb != nullptr) {
-                    streamer.pushPixelBuffer(pb, ptsMs);
-                    CVBufferRelease(pb);
-                }
-                ++t;
-                ptsMs += frameDurationMs;
-                std::this_thread::sleep_for(std::chrono::milliseconds((long) frameDurationMs));
+            auto& renderUs = Telemetry::getInstance().histogram("load.renderUs");
+            auto& pushUs = Telemetry::getInstance().histogram("load.pushUs");
+            for (juce::int64 i = 0; running.load(); ++i) {
+                PrecisionClock::sleepUntilMicros(videoStartUs + i * 1000000 / cfg.fps);
+                const juce::int64 t0 = PrecisionClock::nowMicros();
+                const RawVideoFrame& frame = load.renderVideo(i);
+                const juce::int64 t1 = PrecisionClock::nowMicros();
+                streamer.pushVideoFrame(frame);
+                renderUs.record(t1 - t0);
+                pushUs.record(PrecisionClock::nowMicros() - t1);
+                framesOffered.store(i + 1);
             }
         });
-    } else {
+    }
+#if JUCE_MAC
+    else {
         cap = std::make_unique<ScreenRecorder>();
         cap->setFrameCallback([&](void* pixelBuffer, int64_t ptsMs){
             streamer.pushPixelBuffer(pixelBuffer, ptsMs);
@@ -220,6 +279,7 @@ int main(int argc, char** argv) {
             return 1;
         }
     }
+#endif
 
     if (runSeconds <= 0) {
         LogMessage("CLI: streaming... press Ctrl+C to stop");
@@ -232,8 +292,23 @@ int main(int argc, char** argv) {
     running.store(false);
     audioThread.join();
     if (videoThread) videoThread->join();
+    if (useSynthetic) {
+        const double sec = (double) (PrecisionClock::nowMicros() - videoStartUs) / 1e6, fps = (double) framesOffered.load() / sec;
+        LogMessage("CLI: offered " + juce::String(framesOffered.load()) + " frames in " + juce::String(sec, 1) + " s: " + juce::String(fps, 1)
+                   + " fps, " + juce::String(fps / presetFps, 2) + "x the preset's " + juce::String(presetFps) + " fps");
+    }
+#if JUCE_MAC
     if (cap) cap->stop();
+#endif
     streamer.stop();
+    Telemetry::getInstance().stopDump();
+    for (const auto& v : summary.sample()) {
+        if (v.kind == Telemetry::Kind::histogram)
+            LogMessage("CLI: " + v.name + " count=" + juce::String((juce::int64) v.count) + " mean=" + juce::String(v.mean) + " p50=" + juce::String(v.p50)
+                       + " p99=" + juce::String(v.p99) + " max=" + juce::String(v.max));
+        else
+            LogMessage("CLI: " + v.name + " = " + juce::String(v.value));
+    }
     LogMessage("CLI: done");
     return 0;
 }